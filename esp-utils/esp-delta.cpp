@@ -0,0 +1,339 @@
+/*
+ * esp-delta.cpp
+ *
+ * Copyright 2017 DeviceHive
+ *
+ * Description: Main file of esp-delta, generator of firmware update delta
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// delta format, should be the same as in firmware uploadable_delta.c
+#define DELTA_MAGIC 0x31444844
+#define DELTA_WINDOW_BITS 10
+#define DELTA_LENGTH_BITS 6
+#define DELTA_MIN_MATCH 2
+#define DELTA_WINDOW_SIZE (1 << DELTA_WINDOW_BITS)
+#define DELTA_MAX_MATCH ((1 << DELTA_LENGTH_BITS) - 1 + DELTA_MIN_MATCH)
+// search parameters
+#define MATCH_HASH_BITS 16
+#define MATCH_MAX_CHAIN 256
+#define LZSS_HASH_BITS 12
+#define LZSS_MAX_CHAIN 64
+
+typedef struct {
+	uint8_t *data;
+	unsigned int len;
+	unsigned int size;
+} BUFFER;
+
+void put_byte(BUFFER *buf, uint8_t byte) {
+	if(buf->len == buf->size) {
+		buf->size = buf->size ? buf->size * 2 : 4096;
+		buf->data = (uint8_t *)realloc(buf->data, buf->size);
+		if(buf->data == NULL) {
+			printf("Out of memory.\r\n");
+			exit(1);
+		}
+	}
+	buf->data[buf->len++] = byte;
+}
+
+void put_uint32(BUFFER *buf, uint32_t value) {
+	for(int i = 0; i < 4; i++)
+		put_byte(buf, (value >> (i * 8)) & 0xFF);
+}
+
+void put_varint(BUFFER *buf, uint32_t value) {
+	while(value >= 0x80) {
+		put_byte(buf, (value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	put_byte(buf, value);
+}
+
+uint32_t crc32(const uint8_t *data, unsigned int len) {
+	uint32_t crc = 0xFFFFFFFF;
+	for(unsigned int i = 0; i < len; i++) {
+		crc ^= data[i];
+		for(int j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (0xEDB88320 & (-(crc & 1)));
+	}
+	return ~crc;
+}
+
+bool read_file(const char *name, BUFFER *buf) {
+	FILE *fl = fopen(name, "rb");
+	if(fl == NULL) {
+		printf("%s file not found.\r\n", name);
+		return false;
+	}
+	uint8_t chunk[4096];
+	size_t rb;
+	while((rb = fread(chunk, 1, sizeof(chunk), fl)) > 0) {
+		for(size_t i = 0; i < rb; i++)
+			put_byte(buf, chunk[i]);
+	}
+	fclose(fl);
+	return true;
+}
+
+unsigned int hash(const uint8_t *data, unsigned int bits) {
+	const uint32_t v = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+	return (v * 2654435761U) >> (32 - bits);
+}
+
+/**
+ * Index of old image, chains of positions with the same hash of four bytes.
+ */
+typedef struct {
+	const uint8_t *old;
+	unsigned int oldsize;
+	int *head;
+	int *prev;
+} INDEX;
+
+void index_build(INDEX *index, const uint8_t *old, unsigned int oldsize) {
+	index->old = old;
+	index->oldsize = oldsize;
+	index->head = (int *)malloc(sizeof(int) * (1 << MATCH_HASH_BITS));
+	index->prev = (int *)malloc(sizeof(int) * (oldsize + 1));
+	for(unsigned int i = 0; i < (1 << MATCH_HASH_BITS); i++)
+		index->head[i] = -1;
+	for(unsigned int i = 0; i + 4 <= oldsize; i++) {
+		const unsigned int h = hash(&old[i], MATCH_HASH_BITS);
+		index->prev[i] = index->head[h];
+		index->head[h] = i;
+	}
+}
+
+unsigned int match_len(const uint8_t *a, unsigned int alen, const uint8_t *b, unsigned int blen) {
+	unsigned int i;
+	for(i = 0; i < alen && i < blen && a[i] == b[i]; i++);
+	return i;
+}
+
+/**
+ * Find the longest match of new data in old image, position with the same
+ * offset as previous match is checked first since images are similar.
+ */
+unsigned int search(const INDEX *index, const uint8_t *data, unsigned int len,
+		int hint, int *pos) {
+	unsigned int best = 0;
+	*pos = 0;
+	if(hint >= 0 && (unsigned int)hint < index->oldsize) {
+		best = match_len(&index->old[hint], index->oldsize - hint, data, len);
+		*pos = hint;
+	}
+	if(len < 4)
+		return best;
+	int chain = 0;
+	for(int p = index->head[hash(data, MATCH_HASH_BITS)]; p >= 0 && chain < MATCH_MAX_CHAIN;
+			p = index->prev[p], chain++) {
+		const unsigned int l = match_len(&index->old[p], index->oldsize - p, data, len);
+		if(l > best) {
+			best = l;
+			*pos = p;
+		}
+	}
+	return best;
+}
+
+/**
+ * Make uncompressed delta, algorithm is the same as in bsdiff: approximate
+ * matches are encoded as difference with old image, the rest is inserted.
+ */
+void make_delta(const uint8_t *old, unsigned int oldsize, const uint8_t *nw,
+		unsigned int newsize, BUFFER *out) {
+	INDEX index;
+	index_build(&index, old, oldsize);
+	put_uint32(out, DELTA_MAGIC);
+	put_uint32(out, oldsize);
+	put_uint32(out, crc32(old, oldsize));
+	put_uint32(out, newsize);
+
+	int scan = 0, len = 0, pos = 0;
+	int lastscan = 0, lastpos = 0, lastoffset = 0;
+	while(scan < (int)newsize) {
+		int oldscore = 0;
+		int scsc;
+		for(scsc = scan += len; scan < (int)newsize; scan++) {
+			len = search(&index, &nw[scan], newsize - scan, scan + lastoffset, &pos);
+			for(; scsc < scan + len; scsc++) {
+				if(scsc + lastoffset >= 0 && scsc + lastoffset < (int)oldsize
+						&& old[scsc + lastoffset] == nw[scsc])
+					oldscore++;
+			}
+			if((len == oldscore && len != 0) || len > oldscore + 8)
+				break;
+			if(scan + lastoffset >= 0 && scan + lastoffset < (int)oldsize
+					&& old[scan + lastoffset] == nw[scan])
+				oldscore--;
+		}
+		if(len == oldscore && scan != (int)newsize)
+			continue;
+
+		// extend previous match forward and current match backward
+		int s = 0, sf = 0, lenf = 0;
+		for(int i = 0; lastscan + i < scan && lastpos + i < (int)oldsize;) {
+			if(old[lastpos + i] == nw[lastscan + i])
+				s++;
+			i++;
+			if(s * 2 - i > sf * 2 - lenf) {
+				sf = s;
+				lenf = i;
+			}
+		}
+		int lenb = 0;
+		if(scan < (int)newsize) {
+			int sb = 0;
+			s = 0;
+			for(int i = 1; scan >= lastscan + i && pos >= i; i++) {
+				if(old[pos - i] == nw[scan - i])
+					s++;
+				if(s * 2 - i > sb * 2 - lenb) {
+					sb = s;
+					lenb = i;
+				}
+			}
+		}
+		if(lastscan + lenf > scan - lenb) {
+			const int overlap = (lastscan + lenf) - (scan - lenb);
+			int ss = 0, lens = 0;
+			s = 0;
+			for(int i = 0; i < overlap; i++) {
+				if(nw[lastscan + lenf - overlap + i] == old[lastpos + lenf - overlap + i])
+					s++;
+				if(nw[scan - lenb + i] == old[pos - lenb + i])
+					s--;
+				if(s > ss) {
+					ss = s;
+					lens = i + 1;
+				}
+			}
+			lenf += lens - overlap;
+			lenb -= lens;
+		}
+
+		const int insert = (scan - lenb) - (lastscan + lenf);
+		const int seek = (pos - lenb) - (lastpos + lenf);
+		put_varint(out, lenf);
+		put_varint(out, insert);
+		put_varint(out, ((uint32_t)seek << 1) ^ (uint32_t)(seek >> 31));
+		for(int i = 0; i < lenf; i++)
+			put_byte(out, nw[lastscan + i] - old[lastpos + i]);
+		for(int i = 0; i < insert; i++)
+			put_byte(out, nw[lastscan + lenf + i]);
+
+		lastscan = scan - lenb;
+		lastpos = pos - lenb;
+		lastoffset = pos - scan;
+	}
+	free(index.head);
+	free(index.prev);
+}
+
+typedef struct {
+	BUFFER *out;
+	uint32_t bits;
+	unsigned int count;
+} BITWRITER;
+
+void put_bits(BITWRITER *writer, uint32_t value, unsigned int count) {
+	writer->bits = (writer->bits << count) | value;
+	writer->count += count;
+	while(writer->count >= 8) {
+		writer->count -= 8;
+		put_byte(writer->out, writer->bits >> writer->count);
+		writer->bits &= (1 << writer->count) - 1;
+	}
+}
+
+/**
+ * Compress with LZSS, literal is flag 1 and 8 bits, back reference is
+ * flag 0, distance and length. The last byte is padded with zeros.
+ */
+void compress(const uint8_t *data, unsigned int len, BUFFER *out) {
+	BITWRITER writer = {out, 0, 0};
+	int *head = (int *)malloc(sizeof(int) * (1 << LZSS_HASH_BITS));
+	int *prev = (int *)malloc(sizeof(int) * (len + 1));
+	for(unsigned int i = 0; i < (1 << LZSS_HASH_BITS); i++)
+		head[i] = -1;
+	unsigned int pos = 0;
+	while(pos < len) {
+		unsigned int best = 0, distance = 0;
+		const unsigned int maxlen = (len - pos > DELTA_MAX_MATCH) ? DELTA_MAX_MATCH : (len - pos);
+		// runs are the most common in delta, check them without hash
+		if(pos) {
+			best = match_len(&data[pos - 1], maxlen, &data[pos], maxlen);
+			distance = 1;
+		}
+		if(pos + 4 <= len) {
+			int chain = 0;
+			for(int p = head[hash(&data[pos], LZSS_HASH_BITS)];
+					p >= 0 && pos - p <= DELTA_WINDOW_SIZE && chain < LZSS_MAX_CHAIN;
+					p = prev[p], chain++) {
+				const unsigned int l = match_len(&data[p], maxlen, &data[pos], maxlen);
+				if(l > best) {
+					best = l;
+					distance = pos - p;
+				}
+			}
+		}
+		unsigned int step = 1;
+		if(best >= DELTA_MIN_MATCH) {
+			put_bits(&writer, ((distance - 1) << DELTA_LENGTH_BITS) | (best - DELTA_MIN_MATCH),
+					1 + DELTA_WINDOW_BITS + DELTA_LENGTH_BITS);
+			step = best;
+		} else {
+			put_bits(&writer, 0x100 | data[pos], 9);
+		}
+		for(; step; step--, pos++) {
+			if(pos + 4 <= len) {
+				const unsigned int h = hash(&data[pos], LZSS_HASH_BITS);
+				prev[pos] = head[h];
+				head[h] = pos;
+			}
+		}
+	}
+	if(writer.count)
+		put_bits(&writer, 0, 8 - writer.count);
+	free(head);
+	free(prev);
+}
+
+int main(int argc, char* argv[]) {
+	if(argc != 4) {
+		printf("Usage: esp-delta <running image> <new image> <delta file>\r\n");
+		return 1;
+	}
+	BUFFER old = {NULL, 0, 0}, nw = {NULL, 0, 0}, delta = {NULL, 0, 0}, packed = {NULL, 0, 0};
+	if(!read_file(argv[1], &old) || !read_file(argv[2], &nw))
+		return 1;
+	if(nw.len == 0) {
+		printf("%s is empty.\r\n", argv[2]);
+		return 1;
+	}
+	make_delta(old.data, old.len, nw.data, nw.len, &delta);
+	compress(delta.data, delta.len, &packed);
+
+	FILE *fl = fopen(argv[3], "wb");
+	if(fl == NULL || fwrite(packed.data, 1, packed.len, fl) != packed.len) {
+		printf("Can not write %s.\r\n", argv[3]);
+		return 1;
+	}
+	fclose(fl);
+	printf("Delta %u bytes, image %u bytes (%u%%).\r\n", packed.len, nw.len,
+			(unsigned int)((uint64_t)packed.len * 100 / nw.len));
+	printf("Begin request: {\"size\": %u, \"crc\": %u, \"delta\": true}\r\n",
+			nw.len, crc32(nw.data, nw.len));
+	free(old.data);
+	free(nw.data);
+	free(delta.data);
+	free(packed.data);
+	return 0;
+}
@@ -10,6 +10,7 @@ set -e
 if [ "$#" -lt 1 ]; then
   echo Util for generating binary firmware images for ESP8266
   echo Please specify compliled binary in arg
+  echo Add \"boot\" arg after output file to make user1/user2 image for boot loader
 fi
 
 TARGETELF=$1
@@ -18,6 +19,10 @@ FWFILE="devicehive.bin"
 if [ "$#" -gt 1 ]; then
   FWFILE="$2"
 fi
+BOOTIMAGE=""
+if [ "$#" -gt 2 ] && [ "$3" == "boot" ]; then
+  BOOTIMAGE=1
+fi
 
 if [[ $(uname) == *"MINGW"* ]]; then
   CROSS_COMPILE="c:/Espressif/xtensa-lx106-elf/bin/xtensa-lx106-elf-"
@@ -57,6 +62,17 @@ write_section() {
   write_zeros $PADSIZE
 }
 
+write_crc32() {
+  # boot loader expects CRC32 of the whole image with its own adjustment
+  r=$(gzip -c $FWFILE | tail -c 8 | od -An -t u4 -N 4 | tr -d ' ')
+  if [ $(( $r & 0x80000000 )) -ne 0 ]; then
+    r=$(( $r ^ 0xFFFFFFFF ))
+  else
+    r=$(( $r + 1 ))
+  fi
+  write_hex32 $(printf %08X $r)
+}
+
 write_checksum() {
   PAD=16
   FILESIZE=$(( $(file_size $FWFILE) + 1))
@@ -75,13 +91,29 @@ $OBJCOPY --only-section .data -O binary $TARGETELF $BUILDDIR/data.bin
 $OBJCOPY --only-section .rodata -O binary $TARGETELF $BUILDDIR/rodata.bin
 $OBJCOPY --only-section .irom0.text -O binary $TARGETELF $BUILDDIR/irom0.bin
 
+if [ -n "$BOOTIMAGE" ]; then
+  # boot loader image starts with its own header and irom0 right after it,
+  # so irom0 code is linked with 0x10 offset, the usual image follows
+  echo Writing boot loader header...
+  echo -n -e "\xEA\x04\x00\x20" > $FWFILE
+  write_addr " call_user_start$"
+  echo Writing irom0 section...
+  write_hex32 00000000
+  write_section $BUILDDIR/irom0.bin
+fi
+
 echo Writing header...
 # image header description
 # first byte - magic - 0xE9, second number of segments, we have 3
 # third SPI flash interface - 0x00: QIO, 0x01: QOUT, 0x02: DIO, 0x03: DOUT
 # forth, high word flash size - 0x00: 512KB, 0x10: 256KB, 0x20: 1MB, 0x30: 2MB, 0x40: 4MB
 # forth, low word CPU spped - 0x00: 40MHz, 0x01: 26MHz, 0x02: 20MHz, 0x0f: 80MHz
-echo -n -e "\xE9\x03\x00\x00" >  $FWFILE
+if [ -n "$BOOTIMAGE" ]; then
+  # two images need at least 1MB
+  echo -n -e "\xE9\x03\x00\x20" >> $FWFILE
+else
+  echo -n -e "\xE9\x03\x00\x00" > $FWFILE
+fi
 write_addr " call_user_start$"
 
 echo Writing .text section...
@@ -99,9 +131,14 @@ write_section $BUILDDIR/rodata.bin
 echo Writing checksum...
 write_checksum $BUILDDIR/text.bin $BUILDDIR/data.bin $BUILDDIR/rodata.bin
 
-echo Writing irom0 section...
-write_zeros $(( 65536 - $(file_size $FWFILE)))
-cat $BUILDDIR/irom0.bin >> $FWFILE
+if [ -n "$BOOTIMAGE" ]; then
+  echo Writing CRC32...
+  write_crc32
+else
+  echo Writing irom0 section...
+  write_zeros $(( 65536 - $(file_size $FWFILE)))
+  cat $BUILDDIR/irom0.bin >> $FWFILE
+fi
 
 echo Done
 echo "Firmware file is $FWFILE, size is $(file_size $FWFILE) bytes"
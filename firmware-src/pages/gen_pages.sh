@@ -8,6 +8,24 @@ DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
 
 TARGETFILE="$DIR/pages.h"
 
+# Routes which are handled by firmware code, "path value" per line, in any order.
+# Path which ends with '*' matches itself and all its sub paths.
+ROUTES="/ WEBROUTE_ROOT
+/api* WEBROUTE_API
+/api/ws WEBROUTE_WEBSOCKET
+/flash/page/begin WEBROUTE_FLASH_PAGE_BEGIN
+/flash/page/finish WEBROUTE_FLASH_PAGE_FINISH
+/flash/page/put WEBROUTE_FLASH_PAGE_PUT
+/flash/file/begin WEBROUTE_FLASH_FILE_BEGIN
+/flash/file/finish WEBROUTE_FLASH_FILE_FINISH
+/flash/file/put WEBROUTE_FLASH_FILE_PUT
+/flash/file/delete WEBROUTE_FLASH_FILE_DELETE
+/flash/file/list WEBROUTE_FLASH_FILE_LIST
+/flash/firmware/begin WEBROUTE_FLASH_FIRMWARE_BEGIN
+/flash/firmware/finish WEBROUTE_FLASH_FIRMWARE_FINISH
+/flash/firmware/put WEBROUTE_FLASH_FIRMWARE_PUT
+/flash/firmware/info WEBROUTE_FLASH_FIRMWARE_INFO"
+
 print() {
   echo "$@" >> $TARGETFILE
 }
@@ -16,21 +34,115 @@ echo "/* This is autogenerated file. Do not modify directly. */" > $TARGETFILE
 print "#ifndef _PAGES_H_"
 print "#define _PAGES_H_"
 print '#include "../sources/irom.h"'
-print "typedef struct {const char *path; const char *data; unsigned int data_len;} WEBPAGE;"
+print '#include "../sources/httpd.h"'
+print "typedef struct {const char *data; unsigned int data_len; const char *etag; HTTP_RESPONSE_STATUS type; unsigned gzip : 1;} WEBPAGE;"
+print "#define WEBROUTE_ROOT 0xFF0"
+print "#define WEBROUTE_API 0xFF1"
+print "#define WEBROUTE_FLASH_PAGE_BEGIN 0xFF2"
+print "#define WEBROUTE_FLASH_PAGE_FINISH 0xFF3"
+print "#define WEBROUTE_FLASH_PAGE_PUT 0xFF4"
+print "#define WEBROUTE_WEBSOCKET 0xFF5"
+print "#define WEBROUTE_FLASH_FILE_BEGIN 0xFF6"
+print "#define WEBROUTE_FLASH_FILE_FINISH 0xFF7"
+print "#define WEBROUTE_FLASH_FILE_PUT 0xFF8"
+print "#define WEBROUTE_FLASH_FILE_DELETE 0xFF9"
+print "#define WEBROUTE_FLASH_FILE_LIST 0xFFA"
+print "#define WEBROUTE_FLASH_FIRMWARE_BEGIN 0xFFB"
+print "#define WEBROUTE_FLASH_FIRMWARE_FINISH 0xFFC"
+print "#define WEBROUTE_FLASH_FIRMWARE_PUT 0xFFD"
+print "#define WEBROUTE_FLASH_FIRMWARE_INFO 0xFFE"
+print "#define WEBROUTE_NONE 0xFFF"
 
 index="WEBPAGE web_pages[] = { "
 comma=""
+pos=0
 FILE_LIST=$(find $DIR -name \*.html -o -name \*.css -o -name \*.js)
 FILE_LIST="$FILE_LIST $DIR/favicon.ico"
 for file in $FILE_LIST; do
     filename=$(basename "$file")
     echo "Parsing $filename ..."
     name=${filename/./_}
+    case "$filename" in
+        *.html) type=HRCS_ANSWERED_HTML ;;
+        *.js) type=HRCS_ANSWERED_JS ;;
+        *.css) type=HRCS_ANSWERED_CSS ;;
+        *.ico) type=HRCS_ANSWERED_XICON ;;
+        *) type=HRCS_ANSWERED_PLAIN ;;
+    esac
     data=$(gzip -c $file | od -An -v -t x1 | tr -d '\n' | sed -E "s/( +)([[:xdigit:]]{2})/\\\x\2/g")
+    hash=$(md5sum < $file | cut -c1-16)
     print "RO_DATA char $name[] = \"$data\";"
-    index="$index$comma {\"$filename\", $name, sizeof($name) - 1}"
+    print "RO_DATA char ${name}_etag[] = \"$hash\";"
+    index="$index$comma {$name, sizeof($name) - 1, ${name}_etag, $type, 1}"
     comma=", "
+    ROUTES="$ROUTES
+/$filename $pos"
+    pos=$((pos + 1))
 done
 print "$index };"
+
+# Route trie. Each node is 32 bits word which can be read from ROM directly:
+# char (8 bits), first child index (12 bits), next sibling index (12 bits).
+# Char 0 marks the end of path and char 1 marks the end of path prefix,
+# child index of such nodes is a route value. Such nodes always go before
+# other children of the same node regardless of routes order, so firmware
+# walk meets prefix route before it goes deeper for a longer route.
+print "#define WEBROUTE_CHAR(node) ((node) >> 24)"
+print "#define WEBROUTE_CHILD(node) (((node) >> 12) & 0xFFF)"
+print "#define WEBROUTE_SIBLING(node) ((node) & 0xFFF)"
+echo "$ROUTES" | awk '
+BEGIN {
+    for(i = 32; i < 127; i++)
+        ord[sprintf("%c", i)] = i;
+    count = 1;
+}
+{
+    path = $1; value = $2; marker = 0;
+    if(substr(path, length(path)) == "*") {
+        path = substr(path, 1, length(path) - 1);
+        marker = 1;
+    }
+    cur = 0;
+    for(i = 1; i <= length(path) + 1; i++) {
+        ch = (i <= length(path)) ? ord[substr(path, i, 1)] : marker;
+        if((cur, ch) in child) {
+            cur = child[cur, ch];
+            continue;
+        }
+        node = count++;
+        child[cur, ch] = node;
+        nodech[node] = ch;
+        if(ch < 2)
+            kids[cur] = " " node kids[cur];
+        else
+            kids[cur] = kids[cur] " " node;
+        cur = node;
+    }
+    nodeval[cur] = value;
+}
+END {
+    if(count > 4095) {
+        print "Too many route nodes" > "/dev/stderr";
+        exit 1;
+    }
+    for(p = 0; p < count; p++) {
+        n = split(kids[p], list, " ");
+        for(k = 1; k <= n; k++) {
+            sibling[list[k]] = (k < n) ? list[k + 1] - 1 : "WEBROUTE_NONE";
+            if(k == 1)
+                first[p] = list[k] - 1;
+        }
+    }
+    printf "RO_DATA uint32_t web_routes[] = {";
+    for(node = 1; node < count; node++) {
+        if(nodech[node] < 2)
+            value = nodeval[node];
+        else
+            value = (node in first) ? first[node] : "WEBROUTE_NONE";
+        printf "%s\n\t(%du << 24) | ((%s) << 12) | (%s)", (node > 1) ? "," : "", nodech[node], value, sibling[node];
+    }
+    print "\n};";
+}' >> $TARGETFILE
+
 print "#endif /* _PAGES_H_ */"
 echo "$(basename $TARGETFILE) successfully generated."
@@ -5,6 +5,7 @@
  * @author Nikolay Khabarov
  */
 #include "DH/adc.h"
+#include "dhutils.h"
 
 #include <ets_sys.h>
 #include <os_type.h>
@@ -12,8 +13,19 @@
 #include <user_interface.h>
 #include <ets_forward.h>
 
+/** Minimum interval between blocks, milliseconds. */
+#define BLOCK_MIN_INTERVAL_MS 100
+/** Minimum sampling period, microseconds. */
+#define BLOCK_MIN_PERIOD_US 100
+
 // module variables
 static os_timer_t mTimer;
+static os_timer_t mBlockTimer;
+static unsigned int mBlockPeriodUs = 0;
+static unsigned int mBlockCount = 0;
+static int mBlockRaw = 0;
+static unsigned int mBlockLow = 0;      // ADC units, zero to disable
+static unsigned int mBlockHigh = 0xFFFF; // ADC units
 
 /*
  * dh_adc_get_value() implementation.
@@ -45,3 +57,145 @@ void ICACHE_FLASH_ATTR dh_adc_loop(unsigned int period_ms)
 		os_timer_arm(&mTimer, period_ms, 1);
 	}
 }
+
+
+/**
+ * @brief Check block parameters.
+ * @return Non zero if parameters are valid.
+ */
+static int ICACHE_FLASH_ATTR block_check(unsigned int period_us,
+                                         unsigned int count, int raw)
+{
+	if (count == 0 || count > DH_ADC_BLOCK_MAX_SAMPLES)
+		return 0; // wrong number of samples
+	if (raw && count > DH_ADC_BLOCK_MAX_RAW)
+		return 0; // too many raw samples
+	if (period_us < BLOCK_MIN_PERIOD_US || period_us > DH_ADC_BLOCK_MAX_US
+	 || (count - 1) * period_us > DH_ADC_BLOCK_MAX_US)
+		return 0; // wrong sampling period
+	return 1;
+}
+
+
+/*
+ * dh_adc_block_read() implementation.
+ */
+int ICACHE_FLASH_ATTR dh_adc_block_read(DHAdcBlock *block, unsigned int period_us,
+                                        unsigned int count, int raw)
+{
+	if (!block_check(period_us, count, raw))
+		return -2; // wrong parameters
+
+	// sum of squares fits 32 bits: 1024^2 * 1024
+	uint32_t sum = 0;
+	uint32_t sum_sq = 0;
+	unsigned int min = 0xFFFF;
+	unsigned int max = 0;
+	unsigned int i;
+	const uint32_t start = system_get_time();
+	uint32_t next = start;
+	uint32_t last = start;
+	for (i = 0; i < count; i++) {
+		if (i) {
+			next += period_us;
+			while ((int32_t)(system_get_time() - next) < 0)
+				continue;
+		}
+		last = system_get_time();
+		const unsigned int v = system_adc_read();
+		sum += v;
+		sum_sq += v * v;
+		if (v < min)
+			min = v;
+		if (v > max)
+			max = v;
+		if (raw)
+			block->samples[i] = v;
+	}
+
+	block->timestamp = start;
+	block->duration = last - start;
+	block->count = count;
+	block->min = min;
+	block->max = max;
+	block->mean = (sum << 4) / count;
+	block->rms = isqrt((uint32_t)(((uint64_t)sum_sq << 8) / count));
+	block->tripped = 0;
+	block->raw = !!raw;
+
+	return 0; // OK
+}
+
+
+/*
+ * dh_adc_capture() implementation.
+ */
+int ICACHE_FLASH_ATTR dh_adc_capture(int16_t *samples, unsigned int period_us,
+                                     unsigned int count, uint32_t *duration)
+{
+	if (count == 0 || period_us < BLOCK_MIN_PERIOD_US
+	 || period_us > DH_ADC_CAPTURE_MAX_US
+	 || (count - 1) * period_us > DH_ADC_CAPTURE_MAX_US)
+		return -2; // wrong parameters
+
+	unsigned int i;
+	const uint32_t start = system_get_time();
+	uint32_t next = start;
+	uint32_t last = start;
+	for (i = 0; i < count; i++) {
+		if (i) {
+			next += period_us;
+			while ((int32_t)(system_get_time() - next) < 0)
+				continue;
+		}
+		last = system_get_time();
+		samples[i] = system_adc_read();
+	}
+
+	*duration = last - start;
+	return 0; // OK
+}
+
+
+/**
+ * @brief Block timeout callback.
+ */
+static void ICACHE_FLASH_ATTR block_timeout_cb(void *arg)
+{
+	DHAdcBlock block;
+	if (dh_adc_block_read(&block, mBlockPeriodUs, mBlockCount, mBlockRaw) != 0)
+		return;
+
+	const int trigger = (mBlockLow != 0 || mBlockHigh != 0xFFFF);
+	block.tripped = (block.min < mBlockLow || block.max > mBlockHigh);
+	if (!trigger || block.tripped)
+		dh_adc_block_cb(&block);
+}
+
+
+/*
+ * dh_adc_block_loop() implementation.
+ */
+int ICACHE_FLASH_ATTR dh_adc_block_loop(unsigned int interval_ms, unsigned int period_us,
+                                        unsigned int count, int raw, float low, float high)
+{
+	os_timer_disarm(&mBlockTimer);
+	if (!interval_ms)
+		return 0; // stopped
+
+	if (!block_check(period_us, count, raw))
+		return -2; // wrong parameters
+	if (interval_ms < BLOCK_MIN_INTERVAL_MS
+	 || (count - 1) * period_us / 1000 > interval_ms / 2)
+		return -2; // capture should take less than half of interval
+
+	mBlockPeriodUs = period_us;
+	mBlockCount = count;
+	mBlockRaw = raw;
+	mBlockLow = (low > 0.0f) ? (unsigned int)(low * 1024.0f + 0.5f) : 0;
+	mBlockHigh = (high >= 0.0f) ? (unsigned int)(high * 1024.0f + 0.5f) : 0xFFFF;
+
+	os_timer_setfn(&mBlockTimer, block_timeout_cb, NULL);
+	os_timer_arm(&mBlockTimer, interval_ms, 1);
+	return 0; // OK
+}
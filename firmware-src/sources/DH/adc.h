@@ -7,11 +7,57 @@
 #ifndef _DH_ADC_H_
 #define _DH_ADC_H_
 
+#include <c_types.h>
+
 /**
  * @brief ADC suitable channels.
  */
 #define DH_ADC_SUITABLE_PINS 0x01 // ADC0
 
+/**
+ * @brief Maximum number of samples in block.
+ */
+#define DH_ADC_BLOCK_MAX_SAMPLES 1024
+
+/**
+ * @brief Maximum number of raw samples which can be reported with block.
+ */
+#define DH_ADC_BLOCK_MAX_RAW 120
+
+/**
+ * @brief Maximum block capture time, microseconds.
+ *
+ * Block is captured in one go, so it blocks everything else.
+ */
+#define DH_ADC_BLOCK_MAX_US 100000
+
+/**
+ * @brief Maximum capture time, microseconds.
+ *
+ * Capture is done in one go, so it blocks everything else.
+ * The same limit as for block keeps WiFi alive.
+ */
+#define DH_ADC_CAPTURE_MAX_US DH_ADC_BLOCK_MAX_US
+
+
+/**
+ * @brief ADC block statistics.
+ *
+ * Values are in ADC units, 1024 units is 1.0V.
+ */
+typedef struct {
+	uint32_t timestamp; ///< @brief Block start time, microseconds.
+	uint32_t duration;  ///< @brief Time between the first and the last samples, microseconds.
+	uint16_t count;     ///< @brief Number of samples.
+	uint16_t min;       ///< @brief Minimum value.
+	uint16_t max;       ///< @brief Maximum value.
+	uint16_t mean;      ///< @brief Mean value, 1/16 of unit.
+	uint16_t rms;       ///< @brief Root mean square, 1/16 of unit.
+	uint8_t tripped;    ///< @brief Non zero if threshold was crossed.
+	uint8_t raw;        ///< @brief Non zero if samples are reported.
+	uint16_t samples[DH_ADC_BLOCK_MAX_RAW]; ///< @brief Raw samples.
+} DHAdcBlock;
+
 
 /**
  * @brief Get ADC value.
@@ -34,4 +80,53 @@ void dh_adc_loop(unsigned int period_ms);
 // TODO: consider to use callback function pointer
 extern void dh_adc_loop_value_cb(float value);
 
+
+/**
+ * @brief Capture one block of samples.
+ * @param[out] block Block statistics.
+ * @param[in] period_us Sampling period in microseconds.
+ * @param[in] count Number of samples.
+ * @param[in] raw Non zero to keep raw samples.
+ * @return Zero on success, -2 for wrong parameters.
+ */
+int dh_adc_block_read(DHAdcBlock *block, unsigned int period_us,
+                      unsigned int count, int raw);
+
+
+/**
+ * @brief Capture samples.
+ * @param[out] samples Samples in ADC units, 1024 units is 1.0V.
+ * @param[in] period_us Sampling period in microseconds.
+ * @param[in] count Number of samples.
+ * @param[out] duration Time between the first and the last samples, microseconds.
+ * @return Zero on success, -2 for wrong parameters.
+ */
+int dh_adc_capture(int16_t *samples, unsigned int period_us,
+                   unsigned int count, uint32_t *duration);
+
+
+/**
+ * @brief Start periodic block measurement.
+ *
+ * With thresholds block is reported only if any sample is below
+ * `low` or above `high` threshold.
+ *
+ * @param[in] interval_ms Interval between blocks in milliseconds, zero to stop.
+ * @param[in] period_us Sampling period in microseconds.
+ * @param[in] count Number of samples in block.
+ * @param[in] raw Non zero to report raw samples.
+ * @param[in] low Low threshold in volts, negative to disable.
+ * @param[in] high High threshold in volts, negative to disable.
+ * @return Zero on success, -2 for wrong parameters.
+ */
+int dh_adc_block_loop(unsigned int interval_ms, unsigned int period_us,
+                      unsigned int count, int raw, float low, float high);
+
+
+/**
+ * @brief Callback function for block measurement.
+ * @param[in] block Block statistics.
+ */
+extern void dh_adc_block_cb(const DHAdcBlock *block);
+
 #endif /* _DH_ADC_H_ */
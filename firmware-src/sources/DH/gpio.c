@@ -12,18 +12,162 @@
 #include <osapi.h>
 #include <os_type.h>
 #include <gpio.h>
+#include <user_interface.h>
 #include <ets_forward.h>
 
+/**
+ * @brief Number of edges in capture ring, power of two.
+ */
+#define EDGE_RING_SIZE 64
+
+
+/**
+ * @brief Maximum time before edges are passed, milliseconds.
+ *
+ * Edges are timestamped with CPU cycle counter which overflows
+ * in 26 seconds at 160 MHz.
+ */
+#define EDGE_MAX_AGE_MS 20000
+
+
+/**
+ * @brief Maximum glitch rejection time, microseconds.
+ */
+#define COUNTER_MAX_GLITCH_US 1000000
+
+
+/**
+ * @brief Period of encoder checks, milliseconds.
+ */
+#define ENCODER_CHECK_MS 50
+
+
+/**
+ * @brief Encoder is considered stopped after this time without steps, milliseconds.
+ */
+#define ENCODER_STOP_MS 250
+
+
+/**
+ * @brief Value of transition table for invalid transition.
+ */
+#define ENCODER_ERROR 2
+
+
+/**
+ * @brief Maximum debounce stable time, microseconds.
+ */
+#define DEBOUNCE_MAX_US 1000000
+
+
+/**
+ * @brief Captured edge.
+ */
+typedef struct {
+	uint32_t ccount;   ///< @brief CPU cycle counter at interruption.
+	uint8_t pin_level; ///< @brief Pin number and level in bit 4.
+} EdgeRecord;
+
+
+/**
+ * @brief Pulse counter state.
+ *
+ * The first three fields are written by interruption handler only.
+ */
+typedef struct {
+	volatile uint32_t count;       ///< @brief Counted edges.
+	volatile uint32_t rejected;    ///< @brief Rejected edges.
+	volatile uint32_t last_ccount; ///< @brief CPU cycle counter of the last counted edge.
+	uint32_t min_cycles;  ///< @brief Glitch rejection time, CPU cycles.
+	uint32_t seen_count;  ///< @brief Value of count at the previous check.
+	uint32_t last_us;     ///< @brief Time of the last counted edge, microseconds.
+	uint32_t start_count; ///< @brief Value of count at the start of measurement window.
+	uint32_t start_us;    ///< @brief Time of the edge which started measurement window.
+	uint8_t started;      ///< @brief Measurement window is started.
+	uint8_t cycle_edges;  ///< @brief Edges per signal period.
+} CounterState;
+
+
+/**
+ * @brief Quadrature encoder state.
+ *
+ * Volatile fields are written by interruption handler.
+ */
+typedef struct {
+	volatile int32_t position;     ///< @brief Signed position.
+	volatile uint32_t errors;      ///< @brief Invalid transitions.
+	volatile uint32_t last_ccount; ///< @brief CPU cycle counter of the last step.
+	volatile uint32_t period;      ///< @brief Filtered step period, CPU cycles.
+	volatile int8_t direction;     ///< @brief Direction of the last step.
+	volatile uint8_t stopped;      ///< @brief No steps for ENCODER_STOP_MS, set by timer.
+	uint8_t state;                 ///< @brief Levels of A and B at the last edge.
+	uint8_t pin_a;                 ///< @brief Pin of channel A.
+	uint8_t pin_b;                 ///< @brief Pin of channel B.
+	int32_t reported;              ///< @brief Position at previous report.
+	uint32_t delta;                ///< @brief Position change to report.
+} EncoderState;
+
+
+/**
+ * @brief Quadrature transitions.
+ *
+ * Indexed by previous and current state, state is level of A in bit 1 and
+ * level of B in bit 0. A leads B in positive direction.
+ */
+static const int8_t ENCODER_TABLE[16] = {
+	 0, -1,  1, ENCODER_ERROR,
+	 1,  0, ENCODER_ERROR, -1,
+	-1, ENCODER_ERROR,  0,  1,
+	ENCODER_ERROR,  1, -1,  0
+};
+
 // module variables
 static os_timer_t mTimer;
 static unsigned int mTimeoutMs = 250;
-static unsigned char mTimerArmed = 0;
-static DHGpioPinMask mTriggeredIntrPins = 0;
+static volatile unsigned char mTimerArmed = 0;
+static volatile unsigned char mFlushArmed = 0;
 static DHGpioPinMask mExternalIntPins = 0;
+static EdgeRecord mEdgeRing[EDGE_RING_SIZE];
+static volatile uint32_t mEdgeHead = 0; // written by interruption handler only
+static volatile uint32_t mEdgeTail = 0; // written by timer callback only
+static volatile uint32_t mEdgeOverflow = 0;
+static volatile DHGpioPinMask mOverflowPins = 0;
+static DHGpioEdgesEncoding mEdgesEncoding = DH_GPIO_EDGES_NONE;
+static os_timer_t mCounterTimer;
+static DHGpioPinMask mCounterPins = 0;
+static CounterState mCounters[DH_GPIO_PIN_COUNT];
+static unsigned int mCounterIntervalMs = 0;
+static unsigned int mCounterTicks = 0; // timer ticks per report
+static unsigned int mCounterTick = 0;
+static os_timer_t mEncoderTimer;
+static DHGpioPinMask mEncoderPins = 0;
+static EncoderState mEncoders[DH_GPIO_MAX_ENCODERS];
+static volatile unsigned int mEncoderNum = 0;
+static uint32_t mEncoderStopCycles = 0;
+static os_timer_t mDebounceTimer;
+static DHGpioPinMask mDebouncePins = 0;
+static volatile DHGpioPinMask mDebouncePending = 0;
+static volatile unsigned char mDebounceArmed = 0;
+static volatile uint32_t mDebounceCcount[DH_GPIO_PIN_COUNT];
+static uint32_t mDebounceUs[DH_GPIO_PIN_COUNT];
+static unsigned int mDebounceMinMs = 1;
+static DHGpioPinMask mSettledLevels = 0;
+static DHGpioPinMask mIntRising = 0;
+static DHGpioPinMask mIntFalling = 0;
+
+// pins configuration cache, state of pins out of known masks is unknown
+static DHGpioPinMask mGpioMuxPins = 0;   // pins switched to GPIO function
+static DHGpioPinMask mDriveKnown = 0;
+static DHGpioPinMask mOpenDrainPins = 0;
+static DHGpioPinMask mPullKnown = 0;
+static DHGpioPinMask mPullUpPins = 0;
 
 
 static void timeout_cb(void *arg);
 static void int_cb(void *arg);
+static void counter_timer_cb(void *arg);
+static void debounce_timer_cb(void *arg);
+static void counter_timer_arm(void);
 
 
 /*
@@ -31,6 +175,9 @@ static void int_cb(void *arg);
  */
 void ICACHE_FLASH_ATTR dh_gpio_init(void)
 {
+	// interruption handler only arms timers, it can't call flash code
+	os_timer_setfn(&mTimer, timeout_cb, NULL);
+	os_timer_setfn(&mDebounceTimer, debounce_timer_cb, NULL);
 	ETS_GPIO_INTR_ATTACH(int_cb, NULL);
 	ETS_GPIO_INTR_ENABLE();
 }
@@ -44,6 +191,11 @@ void ICACHE_FLASH_ATTR dh_gpio_prepare_pins(DHGpioPinMask pins, int disable_pwm)
 	if (disable_pwm)
 		dh_pwm_disable(pins);
 
+	pins &= ~mGpioMuxPins;
+	if (!pins)
+		return; // already configured
+	mGpioMuxPins |= pins & DH_GPIO_SUITABLE_PINS;
+
 	// only suitable pins are checked: GPIO0..GPIO5
 	if (pins & DH_GPIO_PIN(0))
 		PIN_FUNC_SELECT(PERIPHS_IO_MUX_GPIO0_U, FUNC_GPIO0);
@@ -75,23 +227,29 @@ void ICACHE_FLASH_ATTR dh_gpio_prepare_pins(DHGpioPinMask pins, int disable_pwm)
  */
 void ICACHE_FLASH_ATTR dh_gpio_open_drain(DHGpioPinMask pins_enable, DHGpioPinMask pins_disable)
 {
+	// skip unsuitable pins and pins which are already in requested mode
+	pins_enable &= DH_GPIO_SUITABLE_PINS & ~(mDriveKnown & mOpenDrainPins);
+	pins_disable &= DH_GPIO_SUITABLE_PINS & ~(mDriveKnown & ~mOpenDrainPins) & ~pins_enable;
+	if (!(pins_enable | pins_disable))
+		return;
+
 	int i;
 	for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
 		const DHGpioPinMask pin = DH_GPIO_PIN(i);
-		if (!(pin & DH_GPIO_SUITABLE_PINS))
-			continue; // skip unsuitable pins
-
-		else if (pin & pins_enable) {
+		if (pin & pins_enable) {
 			const unsigned int reg = GPIO_REG_READ(GPIO_PIN_ADDR(GPIO_ID_PIN(i)))
 			                       | GPIO_PIN_PAD_DRIVER_SET(GPIO_PAD_DRIVER_ENABLE);
 
 			GPIO_REG_WRITE(GPIO_PIN_ADDR(GPIO_ID_PIN(i)), reg);
 		} else if (pin & pins_disable) {
 			const unsigned int reg = GPIO_REG_READ(GPIO_PIN_ADDR(GPIO_ID_PIN(i)))
-			                       | GPIO_PIN_PAD_DRIVER_SET(GPIO_PAD_DRIVER_DISABLE);
+			                       & ~GPIO_PIN_PAD_DRIVER_SET(GPIO_PAD_DRIVER_ENABLE);
 			GPIO_REG_WRITE(GPIO_PIN_ADDR(GPIO_ID_PIN(i)), reg);
 		}
 	}
+
+	mDriveKnown |= pins_enable | pins_disable;
+	mOpenDrainPins = (mOpenDrainPins | pins_enable) & ~pins_disable;
 }
 
 
@@ -100,6 +258,14 @@ void ICACHE_FLASH_ATTR dh_gpio_open_drain(DHGpioPinMask pins_enable, DHGpioPinMa
  */
 void ICACHE_FLASH_ATTR dh_gpio_pull_up(DHGpioPinMask pins_enable, DHGpioPinMask pins_disable)
 {
+	// skip pins which are already in requested mode
+	pins_enable &= DH_GPIO_SUITABLE_PINS & ~(mPullKnown & mPullUpPins);
+	pins_disable &= DH_GPIO_SUITABLE_PINS & ~(mPullKnown & ~mPullUpPins) & ~pins_enable;
+	if (!(pins_enable | pins_disable))
+		return;
+	mPullKnown |= pins_enable | pins_disable;
+	mPullUpPins = (mPullUpPins | pins_enable) & ~pins_disable;
+
 	// enable suitable GPIO pins
 	if (pins_enable & DH_GPIO_PIN(0))
 		PIN_PULLUP_EN(PERIPHS_IO_MUX_GPIO0_U);
@@ -146,6 +312,17 @@ void ICACHE_FLASH_ATTR dh_gpio_pull_up(DHGpioPinMask pins_enable, DHGpioPinMask
 }
 
 
+/*
+ * dh_gpio_reset_config() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_gpio_reset_config(DHGpioPinMask pins)
+{
+	mGpioMuxPins &= ~pins;
+	mDriveKnown &= ~pins;
+	mPullKnown &= ~pins;
+}
+
+
 /*
  * dh_gpio_write() implementation.
  */
@@ -196,24 +373,213 @@ DHGpioPinMask ICACHE_FLASH_ATTR dh_gpio_read(void)
 }
 
 
+/**
+ * @brief Read CPU cycle counter.
+ */
+static inline uint32_t get_ccount(void)
+{
+	uint32_t r;
+	asm volatile("rsr %0, ccount" : "=r"(r));
+	return r;
+}
+
+
 /**
  * @brief Timeout callback.
+ *
+ * Pass captured edges in batches.
  */
 static void ICACHE_FLASH_ATTR timeout_cb(void *arg)
 {
-	// call external handler
-	dh_gpio_int_cb(mTriggeredIntrPins);
-
-	mTriggeredIntrPins = 0;
 	mTimerArmed = 0;
+	mFlushArmed = 0;
+
+	// edges which come after this point have later cycle counter
+	// and are left for the next call
+	const uint32_t head = mEdgeHead;
+	const uint32_t now_us = system_get_time();
+	const uint32_t now_ccount = get_ccount();
+	const uint32_t mhz = system_get_cpu_freq();
+
+	// without edges list all edges are passed in one call
+	const int list = (mEdgesEncoding != DH_GPIO_EDGES_NONE);
+	while (mEdgeTail != head) {
+		DHGpioEdges batch;
+		int first = 1;
+		batch.caused = 0;
+		batch.count = 0;
+		batch.encoding = mEdgesEncoding;
+		while (mEdgeTail != head && (!list || batch.count < DH_GPIO_MAX_EDGES)) {
+			const EdgeRecord *r = &mEdgeRing[mEdgeTail & (EDGE_RING_SIZE - 1)];
+			const uint32_t us = now_us - (now_ccount - r->ccount) / mhz;
+			if (first) {
+				batch.timestamp = us;
+				first = 0;
+			}
+			if (list) {
+				batch.edges[batch.count++] = DH_GPIO_EDGE(r->pin_level & 0xF, r->pin_level >> 4,
+				                                          us - batch.timestamp);
+			}
+			batch.caused |= DH_GPIO_PIN(r->pin_level & 0xF);
+			mEdgeTail++;
+		}
+
+		ETS_GPIO_INTR_DISABLE();
+		const uint32_t overflow = mEdgeOverflow;
+		batch.caused |= mOverflowPins;
+		mEdgeOverflow = 0;
+		mOverflowPins = 0;
+		ETS_GPIO_INTR_ENABLE();
+		batch.overflow = (overflow > 0xFFFF) ? 0xFFFF : overflow;
+
+		// call external handler
+		dh_gpio_int_cb(&batch);
+	}
+}
+
+/**
+ * @brief Count edges on counter pins.
+ *
+ * Called from interruption handler.
+ */
+static inline void counter_int(DHGpioPinMask pins, uint32_t ccount)
+{
+	int i;
+	for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
+		if (!(pins & DH_GPIO_PIN(i)))
+			continue;
+		CounterState *c = &mCounters[i];
+		if (ccount - c->last_ccount < c->min_cycles) {
+			c->rejected++;
+			continue;
+		}
+		c->last_ccount = ccount;
+		c->count++;
+	}
+}
+
+
+/**
+ * @brief Decode quadrature encoders.
+ *
+ * Called from interruption handler. Step period is filtered to estimate
+ * velocity, filter restarts when direction changes or encoder was stopped.
+ */
+static inline void encoder_int(DHGpioPinMask pins, uint32_t levels, uint32_t ccount)
+{
+	unsigned int i;
+	for (i = 0; i < mEncoderNum; ++i) {
+		EncoderState *e = &mEncoders[i];
+		if (!(pins & (DH_GPIO_PIN(e->pin_a) | DH_GPIO_PIN(e->pin_b))))
+			continue;
+		const uint8_t state = (((levels >> e->pin_a) & 1) << 1) | ((levels >> e->pin_b) & 1);
+		const int8_t step = ENCODER_TABLE[(e->state << 2) | state];
+		e->state = state;
+		if (step == ENCODER_ERROR) {
+			e->errors++;
+			continue;
+		} else if (!step) {
+			continue; // level is back already
+		}
+
+		e->position += step;
+		const uint32_t dt = ccount - e->last_ccount;
+		e->last_ccount = ccount;
+		if (e->stopped || dt > mEncoderStopCycles) {
+			// period is unknown until the next step
+			e->period = mEncoderStopCycles;
+			e->direction = 0;
+		} else {
+			e->period = (step != e->direction) ? dt : (e->period * 3 + dt) / 4;
+			e->direction = step;
+		}
+		e->stopped = 0;
+	}
+}
+
+
+/**
+ * @brief Store edge in ring.
+ *
+ * Called from interruption handler or with GPIO interruption disabled.
+ * Edges are kept in order of cycle counter, debounced edges which are
+ * stored later get time of the previous edge if they are older.
+ */
+static inline void edge_push(int pin, int level, uint32_t ccount)
+{
+	if (mEdgeHead - mEdgeTail >= EDGE_RING_SIZE) {
+		mEdgeOverflow++;
+		mOverflowPins |= DH_GPIO_PIN(pin);
+		return;
+	}
+	if (mEdgeHead != mEdgeTail) {
+		const uint32_t prev = mEdgeRing[(mEdgeHead - 1) & (EDGE_RING_SIZE - 1)].ccount;
+		if ((int32_t)(ccount - prev) < 0)
+			ccount = prev;
+	}
+	EdgeRecord *r = &mEdgeRing[mEdgeHead & (EDGE_RING_SIZE - 1)];
+	r->ccount = ccount;
+	r->pin_level = pin | (level << 4);
+	mEdgeHead++;
+}
+
+
+/**
+ * @brief Arm timer which passes edges.
+ *
+ * Called from interruption handler or with GPIO interruption disabled.
+ */
+static inline void edges_arm(void)
+{
+	if (mEdgeHead - mEdgeTail >= DH_GPIO_MAX_EDGES
+	    && mEdgesEncoding != DH_GPIO_EDGES_NONE) {
+		// batch is full, pass it as soon as possible
+		if (mFlushArmed)
+			return;
+		mFlushArmed = 1;
+	} else if (mTimerArmed) {
+		return;
+	}
+
+	os_timer_disarm(&mTimer);
+	mTimerArmed = 1;
+	os_timer_arm(&mTimer, mFlushArmed ? 0 :
+			((mTimeoutMs < EDGE_MAX_AGE_MS) ? mTimeoutMs : EDGE_MAX_AGE_MS), 0);
 }
 
+
+/**
+ * @brief Remember the last edge on debounced pins.
+ *
+ * Called from interruption handler, level is checked by timer
+ * once pin is stable.
+ */
+static inline void debounce_int(DHGpioPinMask pins, uint32_t ccount)
+{
+	int i;
+	for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
+		if (pins & DH_GPIO_PIN(i))
+			mDebounceCcount[i] = ccount;
+	}
+	mDebouncePending |= pins;
+	if (mDebounceArmed)
+		return;
+
+	mDebounceArmed = 1;
+	os_timer_disarm(&mDebounceTimer);
+	os_timer_arm(&mDebounceTimer, mDebounceMinMs, 0);
+}
+
+
 /**
  * @brief Interruption handler.
+ *
+ * Each edge is stored in ring with CPU cycle counter and pin level.
  */
 static void int_cb(void *arg)
 {
 	uint32_t gpio_status = GPIO_REG_READ(GPIO_STATUS_ADDRESS);
+	const uint32_t ccount = get_ccount();
 	GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, gpio_status);
 	if (gpio_status & mExternalIntPins) {
 		dh_gpio_extra_int_cb(gpio_status & mExternalIntPins);
@@ -222,18 +588,34 @@ static void int_cb(void *arg)
 			return;
 	}
 
-	mTriggeredIntrPins |= gpio_status;
-	if (mTimerArmed)
-		return;
+	if (gpio_status & mCounterPins) {
+		counter_int(gpio_status & mCounterPins, ccount);
+		gpio_status &= ~mCounterPins;
+		if (!gpio_status)
+			return;
+	}
 
-	os_timer_disarm(&mTimer);
-	if (mTimeoutMs) {
-		mTimerArmed = 1;
-		os_timer_setfn(&mTimer, timeout_cb, NULL);
-		os_timer_arm(&mTimer, mTimeoutMs, 0);
-	} else {
-		timeout_cb(0);
+	const uint32_t levels = GPIO_REG_READ(GPIO_IN_ADDRESS);
+	if (gpio_status & mEncoderPins) {
+		encoder_int(gpio_status & mEncoderPins, levels, ccount);
+		gpio_status &= ~mEncoderPins;
+		if (!gpio_status)
+			return;
+	}
+
+	if (gpio_status & mDebouncePins) {
+		debounce_int(gpio_status & mDebouncePins, ccount);
+		gpio_status &= ~mDebouncePins;
+		if (!gpio_status)
+			return;
 	}
+
+	int i;
+	for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
+		if (gpio_status & DH_GPIO_PIN(i))
+			edge_push(i, (levels >> i) & 1, ccount);
+	}
+	edges_arm();
 }
 
 
@@ -279,6 +661,25 @@ static int ICACHE_FLASH_ATTR dh_gpio_set_int(DHGpioPinMask pins_disable,
 }
 
 
+/**
+ * @brief Set interruption type of subscribed pins.
+ *
+ * Debounced pins need both edges to track bounce, their
+ * settled levels start from current levels.
+ */
+static void ICACHE_FLASH_ATTR debounce_apply(DHGpioPinMask pins)
+{
+	const DHGpioPinMask subscribed = pins & (mIntRising | mIntFalling);
+	const DHGpioPinMask direct = subscribed & ~mDebouncePins;
+	mDebouncePending &= ~pins;
+	mSettledLevels = (mSettledLevels & ~pins) | (GPIO_REG_READ(GPIO_IN_ADDRESS) & pins);
+	dh_gpio_set_int(0,
+	                direct & mIntRising & ~mIntFalling,
+	                direct & mIntFalling & ~mIntRising,
+	                (direct & mIntRising & mIntFalling) | (subscribed & mDebouncePins));
+}
+
+
 /*
  * dh_gpio_subscribe_int() implementation.
  */
@@ -291,6 +692,7 @@ int ICACHE_FLASH_ATTR dh_gpio_subscribe_int(DHGpioPinMask pins_disable,
 	const DHGpioPinMask pins = pins_disable | pins_rising | pins_falling | pins_both;
 	if (!!dh_gpio_subscribe_extra_int(pins, 0, 0, 0))
 		return -1; // failed to disable all extra interruptions
+	dh_gpio_encoder_disable(pins);
 
 	// subscribe
 	int r = dh_gpio_set_int(pins_disable,
@@ -300,6 +702,13 @@ int ICACHE_FLASH_ATTR dh_gpio_subscribe_int(DHGpioPinMask pins_disable,
 	if (0 == r) {
 		// OK, save timeout...
 		mTimeoutMs = timeout_ms;
+		mIntRising = (mIntRising & ~pins) | pins_rising | pins_both;
+		mIntFalling = (mIntFalling & ~pins) | pins_falling | pins_both;
+		debounce_apply(pins);
+		if (mCounterPins & pins) {
+			mCounterPins &= ~pins;
+			counter_timer_arm();
+		}
 	}
 
 	return r;
@@ -315,6 +724,24 @@ unsigned int ICACHE_FLASH_ATTR dh_gpio_get_timeout(void)
 }
 
 
+/*
+ * dh_gpio_set_edges_encoding() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_gpio_set_edges_encoding(DHGpioEdgesEncoding encoding)
+{
+	mEdgesEncoding = encoding;
+}
+
+
+/*
+ * dh_gpio_get_edges_encoding() implementation.
+ */
+DHGpioEdgesEncoding ICACHE_FLASH_ATTR dh_gpio_get_edges_encoding(void)
+{
+	return mEdgesEncoding;
+}
+
+
 /*
  * dh_gpio_subscribe_extra_int() implementation.
  */
@@ -323,6 +750,7 @@ int ICACHE_FLASH_ATTR dh_gpio_subscribe_extra_int(DHGpioPinMask pins_disable,
                                                   DHGpioPinMask pins_falling,
                                                   DHGpioPinMask pins_both)
 {
+	dh_gpio_encoder_disable(pins_rising | pins_falling | pins_both);
 	pins_disable &= mExternalIntPins;
 	int r = dh_gpio_set_int(pins_disable,
 	                        pins_rising,
@@ -333,7 +761,421 @@ int ICACHE_FLASH_ATTR dh_gpio_subscribe_extra_int(DHGpioPinMask pins_disable,
 		GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, pins_disable);
 		mExternalIntPins |= pins_rising | pins_falling | pins_both;
 		mExternalIntPins &= ~pins_disable;
+		mIntRising &= ~mExternalIntPins;
+		mIntFalling &= ~mExternalIntPins;
+		if (mCounterPins & mExternalIntPins) {
+			mCounterPins &= ~mExternalIntPins;
+			counter_timer_arm();
+		}
 	}
 
 	return r;
 }
+
+
+/**
+ * @brief Check counters.
+ *
+ * Time of the last edge is converted from CPU cycle counter, so
+ * counters should be checked more often than cycle counter overflows.
+ */
+static void ICACHE_FLASH_ATTR counter_check(void)
+{
+	const uint32_t mhz = system_get_cpu_freq();
+	int i;
+	for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
+		if (!(mCounterPins & DH_GPIO_PIN(i)))
+			continue;
+		CounterState *c = &mCounters[i];
+
+		ETS_GPIO_INTR_DISABLE();
+		const uint32_t now_us = system_get_time();
+		const uint32_t now_ccount = get_ccount();
+		const uint32_t count = c->count;
+		const uint32_t last_ccount = c->last_ccount;
+		if (count == c->seen_count) {
+			// keep glitch rejection correct after cycle counter overflow
+			c->last_ccount = now_ccount - c->min_cycles;
+		}
+		ETS_GPIO_INTR_ENABLE();
+
+		if (count != c->seen_count) {
+			c->seen_count = count;
+			c->last_us = now_us - (now_ccount - last_ccount) / mhz;
+		}
+	}
+}
+
+
+/**
+ * @brief Counter timer callback.
+ *
+ * Check counters and report them once per interval.
+ */
+static void ICACHE_FLASH_ATTR counter_timer_cb(void *arg)
+{
+	if (!mCounterTicks || ++mCounterTick < mCounterTicks) {
+		counter_check();
+		return;
+	}
+	mCounterTick = 0;
+
+	DHGpioCounters counters;
+	dh_gpio_read_counters(&counters);
+	dh_gpio_counter_cb(&counters);
+}
+
+
+/**
+ * @brief Arm counter timer.
+ *
+ * Interval is split to equal ticks which are not longer than EDGE_MAX_AGE_MS.
+ */
+static void ICACHE_FLASH_ATTR counter_timer_arm(void)
+{
+	os_timer_disarm(&mCounterTimer);
+	mCounterTick = 0;
+	mCounterTicks = 0;
+	if (!mCounterPins)
+		return;
+
+	unsigned int period_ms = EDGE_MAX_AGE_MS;
+	if (mCounterIntervalMs) {
+		mCounterTicks = (mCounterIntervalMs + EDGE_MAX_AGE_MS - 1) / EDGE_MAX_AGE_MS;
+		period_ms = mCounterIntervalMs / mCounterTicks;
+	}
+	os_timer_setfn(&mCounterTimer, counter_timer_cb, NULL);
+	os_timer_arm(&mCounterTimer, period_ms, 1);
+}
+
+
+/*
+ * dh_gpio_subscribe_counter() implementation.
+ */
+int ICACHE_FLASH_ATTR dh_gpio_subscribe_counter(DHGpioPinMask pins_disable,
+                                                DHGpioPinMask pins_rising,
+                                                DHGpioPinMask pins_falling,
+                                                DHGpioPinMask pins_both,
+                                                unsigned int glitch_us)
+{
+	const DHGpioPinMask pins_enable = pins_rising | pins_falling | pins_both;
+	if (glitch_us > COUNTER_MAX_GLITCH_US)
+		return -2; // bad input parameters
+	if (!!dh_gpio_subscribe_extra_int(pins_disable | pins_enable, 0, 0, 0))
+		return -1; // failed to disable all extra interruptions
+	dh_gpio_encoder_disable(pins_disable | pins_enable);
+	pins_disable &= mCounterPins;
+
+	// edges which come during reset are handled after it
+	ETS_GPIO_INTR_DISABLE();
+	int r = dh_gpio_set_int(pins_disable,
+	                        pins_rising,
+	                        pins_falling,
+	                        pins_both);
+	if (0 == r) {
+		const uint32_t min_cycles = glitch_us * system_get_cpu_freq();
+		const uint32_t now_ccount = get_ccount();
+		int i;
+		for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
+			if (!(pins_enable & DH_GPIO_PIN(i)))
+				continue;
+			CounterState *c = &mCounters[i];
+			os_memset(c, 0, sizeof(*c));
+			c->min_cycles = min_cycles;
+			c->last_ccount = now_ccount - min_cycles;
+			c->cycle_edges = (pins_both & DH_GPIO_PIN(i)) ? 2 : 1;
+		}
+		mCounterPins |= pins_enable;
+		mCounterPins &= ~pins_disable;
+		mIntRising &= ~pins_enable;
+		mIntFalling &= ~pins_enable;
+	}
+	ETS_GPIO_INTR_ENABLE();
+
+	if (0 == r)
+		counter_timer_arm();
+	return r;
+}
+
+
+/*
+ * dh_gpio_set_counter_interval() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_gpio_set_counter_interval(unsigned int interval_ms)
+{
+	mCounterIntervalMs = interval_ms;
+	counter_timer_arm();
+}
+
+
+/*
+ * dh_gpio_get_counter_interval() implementation.
+ */
+unsigned int ICACHE_FLASH_ATTR dh_gpio_get_counter_interval(void)
+{
+	return mCounterIntervalMs;
+}
+
+
+/*
+ * dh_gpio_read_counters() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_gpio_read_counters(DHGpioCounters *counters)
+{
+	counter_check();
+	counters->timestamp = system_get_time();
+	counters->num = 0;
+
+	int i;
+	for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
+		if (!(mCounterPins & DH_GPIO_PIN(i)))
+			continue;
+		CounterState *c = &mCounters[i];
+		DHGpioCounter *r = &counters->counters[counters->num++];
+		r->pin = i;
+		r->cycle_edges = c->cycle_edges;
+		r->count = c->seen_count;
+		r->rejected = c->rejected;
+		r->edges = c->seen_count - c->start_count;
+		r->window = 0;
+		if (r->edges) {
+			// the last edge starts the next window
+			if (c->started)
+				r->window = c->last_us - c->start_us;
+			c->started = 1;
+			c->start_count = c->seen_count;
+			c->start_us = c->last_us;
+		}
+	}
+}
+
+
+/**
+ * @brief Encoder timer callback.
+ *
+ * Mark stopped encoders and report position changes.
+ */
+static void ICACHE_FLASH_ATTR encoder_timer_cb(void *arg)
+{
+	int report = 0;
+	unsigned int i;
+
+	ETS_GPIO_INTR_DISABLE();
+	const uint32_t now_ccount = get_ccount();
+	for (i = 0; i < mEncoderNum; ++i) {
+		EncoderState *e = &mEncoders[i];
+		if (now_ccount - e->last_ccount > mEncoderStopCycles)
+			e->stopped = 1;
+		if (e->delta) {
+			const int32_t change = e->position - e->reported;
+			if (change >= (int32_t)e->delta || -change >= (int32_t)e->delta)
+				report = 1;
+		}
+	}
+	ETS_GPIO_INTR_ENABLE();
+
+	if (report) {
+		DHGpioEncoders encoders;
+		dh_gpio_read_encoders(&encoders);
+		dh_gpio_encoder_cb(&encoders);
+	}
+}
+
+
+/*
+ * dh_gpio_encoder_enable() implementation.
+ */
+int ICACHE_FLASH_ATTR dh_gpio_encoder_enable(unsigned int pin_a,
+                                             unsigned int pin_b,
+                                             unsigned int delta)
+{
+	if (pin_a >= DH_GPIO_PIN_COUNT || pin_b >= DH_GPIO_PIN_COUNT || pin_a == pin_b)
+		return -1; // unsuitable pins
+	const DHGpioPinMask pins = DH_GPIO_PIN(pin_a) | DH_GPIO_PIN(pin_b);
+	if (pins & ~DH_GPIO_SUITABLE_PINS)
+		return -1; // unsuitable pins
+
+	// pins are taken from all other users
+	dh_gpio_encoder_disable(pins);
+	if (mEncoderNum >= DH_GPIO_MAX_ENCODERS)
+		return -2; // too many encoders
+	if (!!dh_gpio_subscribe_extra_int(pins, 0, 0, 0))
+		return -1; // failed to disable extra interruptions
+	if (mCounterPins & pins) {
+		mCounterPins &= ~pins;
+		counter_timer_arm();
+	}
+
+	ETS_GPIO_INTR_DISABLE();
+	const uint32_t levels = GPIO_REG_READ(GPIO_IN_ADDRESS);
+	EncoderState *e = &mEncoders[mEncoderNum];
+	os_memset(e, 0, sizeof(*e));
+	e->pin_a = pin_a;
+	e->pin_b = pin_b;
+	e->state = (((levels >> pin_a) & 1) << 1) | ((levels >> pin_b) & 1);
+	e->stopped = 1;
+	e->delta = delta;
+	mEncoderStopCycles = ENCODER_STOP_MS * 1000 * system_get_cpu_freq();
+	mEncoderNum++;
+	mEncoderPins |= pins;
+	mIntRising &= ~pins;
+	mIntFalling &= ~pins;
+	dh_gpio_set_int(0, 0, 0, pins);
+	ETS_GPIO_INTR_ENABLE();
+
+	os_timer_disarm(&mEncoderTimer);
+	os_timer_setfn(&mEncoderTimer, encoder_timer_cb, NULL);
+	os_timer_arm(&mEncoderTimer, ENCODER_CHECK_MS, 1);
+	return 0; // OK
+}
+
+
+/*
+ * dh_gpio_encoder_disable() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_gpio_encoder_disable(DHGpioPinMask pins)
+{
+	if (!(mEncoderPins & pins))
+		return; // nothing to disable
+
+	ETS_GPIO_INTR_DISABLE();
+	unsigned int i, n = 0;
+	for (i = 0; i < mEncoderNum; ++i) {
+		const DHGpioPinMask encoder_pins = DH_GPIO_PIN(mEncoders[i].pin_a)
+		                                 | DH_GPIO_PIN(mEncoders[i].pin_b);
+		if (encoder_pins & pins) {
+			dh_gpio_set_int(encoder_pins, 0, 0, 0);
+			GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, encoder_pins);
+			mEncoderPins &= ~encoder_pins;
+		} else {
+			if (n != i)
+				os_memcpy(&mEncoders[n], &mEncoders[i], sizeof(EncoderState));
+			n++;
+		}
+	}
+	mEncoderNum = n;
+	ETS_GPIO_INTR_ENABLE();
+
+	if (!mEncoderNum)
+		os_timer_disarm(&mEncoderTimer);
+}
+
+
+/*
+ * dh_gpio_read_encoders() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_gpio_read_encoders(DHGpioEncoders *encoders)
+{
+	const float cycles_per_second = system_get_cpu_freq() * 1000000.0f;
+	encoders->timestamp = system_get_time();
+	encoders->num = mEncoderNum;
+
+	unsigned int i;
+	for (i = 0; i < mEncoderNum; ++i) {
+		EncoderState *e = &mEncoders[i];
+		DHGpioEncoder *r = &encoders->encoders[i];
+
+		ETS_GPIO_INTR_DISABLE();
+		const uint32_t now_ccount = get_ccount();
+		const int32_t position = e->position;
+		const uint32_t since = now_ccount - e->last_ccount;
+		uint32_t period = e->period;
+		const int direction = e->direction;
+		const int stopped = e->stopped;
+		r->errors = e->errors;
+		ETS_GPIO_INTR_ENABLE();
+
+		// velocity decays if the next step is late
+		if (since > period)
+			period = since;
+		r->position = position;
+		r->pin_a = e->pin_a;
+		r->pin_b = e->pin_b;
+		if (stopped || period >= mEncoderStopCycles)
+			r->velocity = 0;
+		else
+			r->velocity = direction * cycles_per_second / period;
+		e->reported = position;
+	}
+}
+
+
+/**
+ * @brief Debounce timer callback.
+ *
+ * Pass settled transitions of pins which had no edges for stable time.
+ */
+static void ICACHE_FLASH_ATTR debounce_timer_cb(void *arg)
+{
+	const uint32_t mhz = system_get_cpu_freq();
+	uint32_t next_us = DEBOUNCE_MAX_US;
+	int pushed = 0;
+	int i;
+
+	ETS_GPIO_INTR_DISABLE();
+	mDebounceArmed = 0;
+	const uint32_t now_ccount = get_ccount();
+	const uint32_t levels = GPIO_REG_READ(GPIO_IN_ADDRESS);
+	for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
+		const DHGpioPinMask pin = DH_GPIO_PIN(i);
+		if (!(mDebouncePending & pin))
+			continue;
+		const uint32_t stable_us = (now_ccount - mDebounceCcount[i]) / mhz;
+		if (stable_us < mDebounceUs[i]) {
+			if (mDebounceUs[i] - stable_us < next_us)
+				next_us = mDebounceUs[i] - stable_us;
+			continue;
+		}
+
+		mDebouncePending &= ~pin;
+		const int level = (levels >> i) & 1;
+		if (!!(mSettledLevels & pin) == level)
+			continue; // bounced back
+		mSettledLevels ^= pin;
+		if ((level ? mIntRising : mIntFalling) & pin) {
+			edge_push(i, level, mDebounceCcount[i]);
+			pushed = 1;
+		}
+	}
+	if (pushed)
+		edges_arm();
+	if (mDebouncePending) {
+		mDebounceArmed = 1;
+		os_timer_disarm(&mDebounceTimer);
+		os_timer_arm(&mDebounceTimer, (next_us + 999) / 1000, 0);
+	}
+	ETS_GPIO_INTR_ENABLE();
+}
+
+
+/*
+ * dh_gpio_debounce() implementation.
+ */
+int ICACHE_FLASH_ATTR dh_gpio_debounce(DHGpioPinMask pins, unsigned int stable_us)
+{
+	if (pins & ~DH_GPIO_SUITABLE_PINS)
+		return -1; // unsuitable pins
+	if (stable_us > DEBOUNCE_MAX_US)
+		return -2; // bad input parameters
+
+	ETS_GPIO_INTR_DISABLE();
+	unsigned int min_us = DEBOUNCE_MAX_US;
+	int i;
+	for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
+		if (pins & DH_GPIO_PIN(i))
+			mDebounceUs[i] = stable_us;
+		if (((mDebouncePins & ~pins) & DH_GPIO_PIN(i)) && mDebounceUs[i] < min_us)
+			min_us = mDebounceUs[i];
+	}
+	if (stable_us) {
+		mDebouncePins |= pins;
+		if (stable_us < min_us)
+			min_us = stable_us;
+	} else {
+		mDebouncePins &= ~pins;
+	}
+	mDebounceMinMs = (min_us + 999) / 1000;
+	debounce_apply(pins);
+	ETS_GPIO_INTR_ENABLE();
+	return 0; // OK
+}
@@ -80,6 +80,18 @@ void dh_gpio_pull_up(DHGpioPinMask pins_enable,
                      DHGpioPinMask pins_disable);
 
 
+/**
+ * @brief Forget cached configuration of pins.
+ *
+ * GPIO module caches pins function, open-drain and pull-up state to
+ * skip registers which are already configured. Modules which configure
+ * pins directly should call this function for such pins.
+ *
+ * @param[in] pins Bitwise pin mask.
+ */
+void dh_gpio_reset_config(DHGpioPinMask pins);
+
+
 /**
  * @brief Set GPIO outputs state.
  * @param[in] pins_set Bitwise pin mask for switching to high level.
@@ -133,12 +145,250 @@ int dh_gpio_subscribe_int(DHGpioPinMask pins_disable,
 unsigned int dh_gpio_get_timeout(void);
 
 
+/**
+ * @brief Set debounce filter for GPIO interruption.
+ *
+ * Edges on debounced pins are reported only when level is stable for
+ * the given time and differs from previous stable level. Both edges are
+ * tracked, subscribed edge types filter settled transitions.
+ *
+ * @param[in] pins Bitwise pin mask.
+ * @param[in] stable_us Stable time in microseconds, zero to disable filter.
+ * @return Zero on success.
+ */
+int dh_gpio_debounce(DHGpioPinMask pins, unsigned int stable_us);
+
+
+/**
+ * @brief Encoding of edges in GPIO interruption notifications.
+ */
+typedef enum {
+	DH_GPIO_EDGES_NONE,   ///< @brief Only pins which caused interruption.
+	DH_GPIO_EDGES_LIST,   ///< @brief List of `[pin, level, time]` per edge.
+	DH_GPIO_EDGES_PACKED  ///< @brief Edges packed to 4 bytes each, encoded as data.
+} DHGpioEdgesEncoding;
+
+
+/**
+ * @brief Edge record.
+ *
+ * Bits 0..3 are pin number, bit 4 is level after edge,
+ * bits 5..31 are microseconds since the first edge of batch.
+ */
+typedef uint32_t DHGpioEdge;
+
+
+/**
+ * @brief Make edge record.
+ */
+#define DH_GPIO_EDGE(pin, level, us) ((DHGpioEdge)(pin) | ((DHGpioEdge)(level) << 4) | ((DHGpioEdge)(us) << 5))
+
+
+/**
+ * @brief Maximum number of edges in one batch.
+ *
+ * Batch is copied to notification data, so it should fit INTERFACES_BUF_SIZE.
+ */
+#define DH_GPIO_MAX_EDGES 56
+
+
+/**
+ * @brief Batch of edges.
+ */
+typedef struct {
+	DHGpioPinMask caused;              ///< @brief Pins with edges.
+	uint32_t timestamp;                ///< @brief Time of the first edge, microseconds.
+	uint16_t count;                    ///< @brief Number of edges.
+	uint16_t overflow;                 ///< @brief Number of edges lost since previous batch.
+	uint8_t encoding;                  ///< @brief Value of DHGpioEdgesEncoding.
+	DHGpioEdge edges[DH_GPIO_MAX_EDGES]; ///< @brief Edges in order of occurrence.
+} DHGpioEdges;
+
+
+/**
+ * @brief Set encoding of edges in interruption notifications.
+ * @param[in] encoding Value of DHGpioEdgesEncoding.
+ */
+void dh_gpio_set_edges_encoding(DHGpioEdgesEncoding encoding);
+
+
+/**
+ * @brief Get encoding of edges in interruption notifications.
+ * @return Value of DHGpioEdgesEncoding.
+ */
+DHGpioEdgesEncoding dh_gpio_get_edges_encoding(void);
+
+
 /**
  * @brief GPIO Interruption callback.
- * @param[in] caused_pins Bitwise pin mask with pins that was trigger interruption.
+ *
+ * Each edge is captured with CPU cycle counter by interruption handler.
+ * Edges are passed in batches after timeout, when batch is full or at least
+ * every 20 seconds.
+ *
+ * @param[in] edges Batch of edges.
+ */
+// TODO: consider to use callback function pointer
+extern void dh_gpio_int_cb(const DHGpioEdges *edges);
+
+
+/**
+ * @brief Counter state of one pin.
+ *
+ * Frequency is measured between the last edges of two reports,
+ * if `edges` is zero there were no edges since previous report,
+ * if `window` is zero there is nothing to measure yet.
+ */
+typedef struct {
+	uint32_t count;      ///< @brief Counted edges since counter was enabled.
+	uint32_t rejected;   ///< @brief Edges rejected as glitches.
+	uint32_t edges;      ///< @brief Edges since previous report.
+	uint32_t window;     ///< @brief Time covered by these edges, microseconds.
+	uint8_t pin;         ///< @brief Pin number.
+	uint8_t cycle_edges; ///< @brief Edges per signal period, two if both edges are counted.
+} DHGpioCounter;
+
+
+/**
+ * @brief Maximum number of counters, one per suitable pin.
+ */
+#define DH_GPIO_MAX_COUNTERS 10
+
+
+/**
+ * @brief Report of all enabled counters.
+ */
+typedef struct {
+	uint32_t timestamp;                        ///< @brief Time of report, microseconds.
+	uint32_t num;                              ///< @brief Number of enabled counters.
+	DHGpioCounter counters[DH_GPIO_MAX_COUNTERS]; ///< @brief Counters in order of pin number.
+} DHGpioCounters;
+
+
+/**
+ * @brief Enable or disable pulse counters.
+ *
+ * Edges on counter pins are counted by interruption handler and are not
+ * passed to dh_gpio_int_cb(). Enabling pin resets its counter.
+ *
+ * @param[in] pins_disable Bitwise pin mask for disabling counter.
+ * @param[in] pins_rising Bitwise pin mask for counting rising edges.
+ * @param[in] pins_falling Bitwise pin mask for counting falling edges.
+ * @param[in] pins_both Bitwise pin mask for counting both edges.
+ * @param[in] glitch_us Edges which come earlier than this time after previous edge
+ *            on the same pin are rejected. Applied to enabled pins only.
+ * @return Zero on success.
+ */
+int dh_gpio_subscribe_counter(DHGpioPinMask pins_disable,
+                              DHGpioPinMask pins_rising,
+                              DHGpioPinMask pins_falling,
+                              DHGpioPinMask pins_both,
+                              unsigned int glitch_us);
+
+
+/**
+ * @brief Set interval of counter reports.
+ * @param[in] interval_ms Interval in milliseconds, zero to report on request only.
+ */
+void dh_gpio_set_counter_interval(unsigned int interval_ms);
+
+
+/**
+ * @brief Get interval of counter reports.
+ * @return Interval in milliseconds.
+ */
+unsigned int dh_gpio_get_counter_interval(void);
+
+
+/**
+ * @brief Read all enabled counters.
+ *
+ * Each read starts the next frequency measurement window.
+ *
+ * @param[out] counters Pointer to report.
+ */
+void dh_gpio_read_counters(DHGpioCounters *counters);
+
+
+/**
+ * @brief GPIO counter report callback.
+ *
+ * Called once per report interval.
+ *
+ * @param[in] counters Report of all enabled counters.
+ */
+// TODO: consider to use callback function pointer
+extern void dh_gpio_counter_cb(const DHGpioCounters *counters);
+
+
+/**
+ * @brief Maximum number of quadrature encoders.
+ */
+#define DH_GPIO_MAX_ENCODERS 4
+
+
+/**
+ * @brief Quadrature encoder state.
+ */
+typedef struct {
+	int32_t position;  ///< @brief Signed position, four steps per encoder period.
+	float velocity;    ///< @brief Steps per second, sign is direction.
+	uint32_t errors;   ///< @brief Transitions with both pins changed, missed steps.
+	uint8_t pin_a;     ///< @brief Pin of channel A.
+	uint8_t pin_b;     ///< @brief Pin of channel B.
+} DHGpioEncoder;
+
+
+/**
+ * @brief Report of all enabled encoders.
+ */
+typedef struct {
+	uint32_t timestamp;                           ///< @brief Time of report, microseconds.
+	uint32_t num;                                 ///< @brief Number of enabled encoders.
+	DHGpioEncoder encoders[DH_GPIO_MAX_ENCODERS]; ///< @brief Encoders in order of enabling.
+} DHGpioEncoders;
+
+
+/**
+ * @brief Enable quadrature encoder on pin pair.
+ *
+ * Both edges of both pins are decoded by interruption handler, encoder
+ * pins are not passed to dh_gpio_int_cb(). Enabling resets position.
+ *
+ * @param[in] pin_a Pin number of channel A.
+ * @param[in] pin_b Pin number of channel B.
+ * @param[in] delta Position change to send report, zero to report on request only.
+ * @return Zero on success.
+ */
+int dh_gpio_encoder_enable(unsigned int pin_a,
+                           unsigned int pin_b,
+                           unsigned int delta);
+
+
+/**
+ * @brief Disable quadrature encoders.
+ * @param[in] pins Bitwise pin mask, encoders which use any of pins are disabled.
+ */
+void dh_gpio_encoder_disable(DHGpioPinMask pins);
+
+
+/**
+ * @brief Read all enabled encoders.
+ * @param[out] encoders Pointer to report.
+ */
+void dh_gpio_read_encoders(DHGpioEncoders *encoders);
+
+
+/**
+ * @brief GPIO encoder report callback.
+ *
+ * Called when position of any encoder changes by its delta since
+ * previous report, no more often than every 50 milliseconds.
+ *
+ * @param[in] encoders Report of all enabled encoders.
  */
 // TODO: consider to use callback function pointer
-extern void dh_gpio_int_cb(DHGpioPinMask caused_pins);
+extern void dh_gpio_encoder_cb(const DHGpioEncoders *encoders);
 
 
 /**
@@ -23,6 +23,7 @@ static DHGpioPinMask mIntPins = 0;
 static unsigned int mIntErrorCount = 0;
 static unsigned int mWaitSearchPins = 0;
 static os_timer_t mIntTimer;
+static int mIntTimerReady = 0;
 
 #define ONEWIRE_MAX_INT_SEARCH_ATTEMPS  5
 #define ONEWIRE_MAX_INT_DELAY_MS        20
@@ -337,7 +338,6 @@ static void ICACHE_FLASH_ATTR onewire_int_search(void *arg)
 			// re-arm timer to avoid long operating in timer interruption.
 			if (mWaitSearchPins) {
 				os_timer_disarm(&mIntTimer);
-				os_timer_setfn(&mIntTimer, onewire_int_search, NULL);
 				os_timer_arm(&mIntTimer, ONEWIRE_MAX_INT_DELAY_MS, 0);
 			}
 			break;
@@ -348,12 +348,12 @@ static void ICACHE_FLASH_ATTR onewire_int_search(void *arg)
 
 /*
  * dh_gpio_extra_int_cb() implementation.
+ * Called from interruption handler, so it's kept in RAM.
  */
-void ICACHE_FLASH_ATTR dh_gpio_extra_int_cb(DHGpioPinMask caused_pins)
+void dh_gpio_extra_int_cb(DHGpioPinMask caused_pins)
 {
 	os_timer_disarm(&mIntTimer);
 	mWaitSearchPins |= caused_pins;
-	os_timer_setfn(&mIntTimer, onewire_int_search, NULL);
 	os_timer_arm(&mIntTimer, ONEWIRE_MAX_INT_DELAY_MS, 0);
 }
 
@@ -363,6 +363,12 @@ void ICACHE_FLASH_ATTR dh_gpio_extra_int_cb(DHGpioPinMask caused_pins)
  */
 int ICACHE_FLASH_ATTR dh_onewire_int(DHGpioPinMask search_pins, DHGpioPinMask disable_pins)
 {
+	if (!mIntTimerReady) {
+		// interruption handler only arms timer
+		os_timer_setfn(&mIntTimer, onewire_int_search, NULL);
+		mIntTimerReady = 1;
+	}
+
 	int res = dh_gpio_subscribe_extra_int(disable_pins, 0, search_pins, 0);
 	if (!!res)
 		return res; // failed to subscribe
@@ -3,6 +3,15 @@
  * @brief Software PWM implementation for ESP8266 firmware.
  * @copyright 2015 [DeviceHive](http://devicehive.com)
  * @author Nikolay Khabarov
+ *
+ * Timer is not ticking with a fixed step. All duty cycles are sorted
+ * into a table of edge events, one event for period start and one event
+ * for each distinct duty cycle. Timer is reloaded in one-shot mode with
+ * the gap to the next event, so number of interruptions per period
+ * depends on number of pins, not on PWM resolution.
+ *
+ * The same timer plays GPIO sequences, so PWM and sequence can not run
+ * simultaneously.
  */
 #include "DH/pwm.h"
 #include "DH/adc.h"
@@ -12,14 +21,21 @@
 #include <osapi.h>
 #include <os_type.h>
 #include <gpio.h>
+#include <user_interface.h>
 #include <ets_forward.h>
 
 #define FRC1_ENABLE_TIMER  BIT7
-#define FRC1_AUTO_LOAD     BIT6
 
-#define MIN_PERIOD_US 500
+#define MIN_PERIOD_US 100
 #define MAX_PERIOD_US 2000004000
 
+/** Minimum interval between two edges, closer edges are merged. */
+#define MIN_GAP_US 2
+/** FRC1 counter is 23 bits wide. */
+#define MAX_LOAD_TICKS 0x7FFFFF
+/** Period start plus one event for each pin. */
+#define MAX_EVENTS (DH_GPIO_PIN_COUNT + 1)
+
 
 typedef enum {
 	DIVDED_BY_1   = 0,
@@ -32,91 +48,360 @@ typedef enum {
 	TM_EDGE_INT  = 0
 } TIMER_INT_MODE;
 
+typedef enum {
+	TIMER_FREE,
+	TIMER_PWM,
+	TIMER_SEQUENCE
+} TIMER_OWNER;
+
+
+/**
+ * @brief Edge event.
+ */
+typedef struct {
+	DHGpioPinMask clear; ///< @brief Pins to switch to low level.
+	uint32_t ticks;      ///< @brief Timer ticks till the next event.
+} PwmEvent;
+
+
+/**
+ * @brief Sequence step.
+ */
+typedef struct {
+	DHGpioPinMask set;   ///< @brief Pins to switch to high level.
+	DHGpioPinMask clear; ///< @brief Pins to switch to low level.
+	uint32_t ticks;      ///< @brief Timer ticks till the next step.
+} SequenceStep;
+
+
 // module variables
-static DHGpioPinMask mDisablePinOn[DH_PWM_DEPTH + 1] = {0};
+static float mDuty[DH_GPIO_PIN_COUNT] = {0};
+static PwmEvent mEvents[MAX_EVENTS];
+static unsigned int mEventsNum = 0;
+static unsigned int mEvent = 0;
+static uint32_t mRemainTicks = 0;
 static unsigned int mPeriodUs = DH_PWM_DEFAULT_PERIOD_US;
-static unsigned char mCounter = 0;
-static unsigned char mPwmInUse = 0;
 static unsigned int mTotalCount = 0;
-static DHGpioPinMask mUsedPins = 0;
+static DHGpioPinMask mPwmPins = 0;  // all pins under PWM, including zero duty
+static DHGpioPinMask mUsedPins = 0; // pins which are set on period start
+static DHGpioPinMask mFullPins = 0; // pins with 100% duty cycle
+static TIMER_DIV_MODE mTimerDiv = DIVDED_BY_1;
+static uint32_t mMinGapTicks = 0;
+static volatile TIMER_OWNER mTimerOwner = TIMER_FREE;
+
+// sequence
+static SequenceStep mSteps[DH_PWM_SEQUENCE_MAX_STEPS];
+static unsigned int mStepsNum = 0;
+static DHGpioPinMask mSequencePins = 0;
+static unsigned int mStep = 0;
+static unsigned int mSequenceCount = 0;
+static unsigned int mSequencePlayed = 0;
+static os_timer_t mSequenceTimer;
+
+// latency correction
+static int mTracked = 0;             // mEventCcount is valid
+static unsigned int mTickShift = 0;  // CPU cycles per timer tick as a shift
+static uint32_t mEventCcount = 0;    // expected CPU cycle counter of the next event
+
+
+/**
+ * @brief Read CPU cycle counter.
+ */
+static inline uint32_t get_ccount(void)
+{
+	uint32_t r;
+	asm volatile("rsr %0, ccount" : "=r"(r));
+	return r;
+}
+
+
+/**
+ * @brief Convert microseconds to timer ticks for current divider.
+ */
+static uint32_t ICACHE_FLASH_ATTR us_to_ticks(uint32_t us)
+{
+	switch (mTimerDiv) {
+	case DIVDED_BY_1:
+		return us * 80;
+	case DIVDED_BY_16:
+		return us * 5;
+	default:
+		return us / 16 * 5 + us % 16 * 5 / 16;
+	}
+}
+
+
+/**
+ * @brief Forget pins in all module structures.
+ */
+static inline void release_pins(DHGpioPinMask pins)
+{
+	unsigned int i;
+	for (i = 0; i < mEventsNum; i++)
+		mEvents[i].clear &= ~pins;
+	mPwmPins &= ~pins;
+	mUsedPins &= ~pins;
+	mFullPins &= ~pins;
+}
 
 
 /**
  * @brief Disable PWM timer.
  */
-static void ICACHE_FLASH_ATTR disarm_timer(void)
+static inline void disarm_timer(void)
 {
+	mTimerOwner = TIMER_FREE;
 	TM1_EDGE_INT_DISABLE();
 	ETS_FRC1_INTR_DISABLE();
 }
 
+
+/**
+ * @brief Load timer with the gap till the next interruption.
+ *
+ * Gaps longer than timer counter are split.
+ */
+static inline void load_timer(uint32_t ticks)
+{
+	if (ticks > MAX_LOAD_TICKS) {
+		// leave at least a half for the next load
+		const uint32_t load = (ticks >= 2 * MAX_LOAD_TICKS) ? MAX_LOAD_TICKS
+		                                                     : ticks / 2;
+		mRemainTicks = ticks - load;
+		ticks = load;
+	} else {
+		mRemainTicks = 0;
+	}
+	RTC_REG_WRITE(FRC1_LOAD_ADDRESS, ticks);
+}
+
+
+/**
+ * @brief Schedule the next event relatively to CPU cycle counter.
+ *
+ * Gaps which do not fit half of the counter range (about 26 seconds
+ * at 80 MHz) are not tracked, latency is negligible for them.
+ *
+ * @param[in] from Cycle counter value of the current event.
+ * @param[in] ticks Gap till the next event.
+ */
+static inline void track_event(uint32_t from, uint32_t ticks)
+{
+	mTracked = (ticks <= (0x7FFFFFFF >> mTickShift));
+	mEventCcount = from + (ticks << mTickShift);
+}
+
+
+/**
+ * @brief Compensate interruption latency.
+ *
+ * Timer is reloaded only from interruption, so latency would accumulate.
+ * Gap is shortened by the delay of the current event, with any divider
+ * the delay is measured in CPU cycles and rounded down to timer ticks.
+ *
+ * @param[in] ticks Nominal gap till the next event.
+ * @return Gap to load.
+ */
+static inline uint32_t correct_ticks(uint32_t ticks)
+{
+	const uint32_t now = get_ccount();
+	const int32_t late = (int32_t)(now - mEventCcount);
+	if (mTracked && late > 0 && (late >> mTickShift) < ticks) {
+		const uint32_t late_ticks = late >> mTickShift;
+		track_event(mEventCcount, ticks);
+		if (ticks - late_ticks >= mMinGapTicks)
+			return ticks - late_ticks;
+		return mMinGapTicks;
+	}
+
+	// too late, early or untracked, start schedule from now
+	track_event(now, ticks);
+	return ticks;
+}
+
+
 /**
  * @brief Timer callback function.
  */
 static void timer_cb(void)
 {
-	if (mCounter == 0) {
+	if (mRemainTicks) {
+		load_timer(mRemainTicks);
+		return;
+	}
+
+	const unsigned int event = mEvent;
+	if (event == 0) {
 		if (mTotalCount) {
 			mTotalCount--;
 			if (mTotalCount == 0) {
 				disarm_timer();
-				gpio_output_set(0, mDisablePinOn[DH_PWM_DEPTH],
-				                mDisablePinOn[DH_PWM_DEPTH], 0);
-				dh_pwm_disable(mUsedPins | mDisablePinOn[0]);
+				gpio_output_set(0, mFullPins, mFullPins, 0);
+				release_pins(mPwmPins);
 				return;
 			}
-		} else {
-			if (mPwmInUse == 0)
-				disarm_timer();
-			}
+		}
+		if (mUsedPins == 0) {
+			disarm_timer();
+			return;
+		}
 		gpio_output_set(mUsedPins, 0, mUsedPins, 0);
-		mPwmInUse = 0;
 	} else {
-		const DHGpioPinMask pins = mDisablePinOn[mCounter];
-		if (pins) {
+		const DHGpioPinMask pins = mEvents[event].clear;
+		if (pins)
 			gpio_output_set(0, pins, pins, 0);
-			mPwmInUse = 1;
+	}
+
+	mEvent = (event + 1 < mEventsNum) ? event + 1 : 0;
+	load_timer(correct_ticks(mEvents[event].ticks));
+}
+
+
+/**
+ * @brief Sequence timer callback function.
+ */
+static void sequence_cb(void)
+{
+	if (mRemainTicks) {
+		load_timer(mRemainTicks);
+		return;
+	}
+
+	unsigned int step = mStep;
+	if (step >= mStepsNum) {
+		mSequencePlayed++;
+		if (mSequenceCount && mSequencePlayed >= mSequenceCount) {
+			disarm_timer();
+			os_timer_disarm(&mSequenceTimer);
+			os_timer_arm(&mSequenceTimer, 0, 0);
+			return;
 		}
+		step = 0;
 	}
-	mCounter++;
-	if (mCounter >= DH_PWM_DEPTH)
-		mCounter = 0;
+
+	const SequenceStep *s = &mSteps[step];
+	gpio_output_set(s->set, s->clear, s->set | s->clear, 0);
+	mStep = step + 1;
+	load_timer(correct_ticks(s->ticks));
 }
 
 
 /**
- * @brief Enable PWM timer.
+ * @brief Report sequence completion out of interruption.
  */
-static void ICACHE_FLASH_ATTR arm_timer(void)
+static void ICACHE_FLASH_ATTR sequence_done_cb(void *arg)
 {
-	// use mFrequency
-	mPwmInUse = 1;
-	mCounter = 1;
-	unsigned int tacts;
-	TIMER_DIV_MODE timer_div;
-	if (mPeriodUs < 10000000) {
-		timer_div = DIVDED_BY_1;
-		tacts = mPeriodUs * (80 >> timer_div) / DH_PWM_DEPTH;
-	} else {
-		timer_div = DIVDED_BY_256;
-		tacts = mPeriodUs / DH_PWM_DEPTH * 80 / (1 << timer_div);
+	dh_pwm_sequence_cb(mSequencePlayed);
+}
+
+
+/**
+ * @brief Build edge events table for pins in use.
+ * @param[in] period_ticks PWM period in timer ticks.
+ */
+static void ICACHE_FLASH_ATTR build_events(uint32_t period_ticks)
+{
+	uint32_t offs[DH_GPIO_PIN_COUNT];
+	DHGpioPinMask masks[DH_GPIO_PIN_COUNT];
+	unsigned int n = 0;
+	int i;
+
+	mUsedPins = 0;
+	mFullPins = 0;
+	for (i = 0; i < DH_GPIO_PIN_COUNT; i++) {
+		const DHGpioPinMask pin = DH_GPIO_PIN(i);
+		if (!(mPwmPins & pin))
+			continue;
+		const uint32_t off = (uint32_t)(mDuty[i] * period_ticks / 100.0f + 0.5f);
+		if (off < mMinGapTicks)
+			continue; // too short pulse, stays low
+		mUsedPins |= pin;
+		if (off > period_ticks - mMinGapTicks) {
+			mFullPins |= pin; // too short pause, stays high
+			continue;
+		}
+
+		// insertion sort by switch off time
+		unsigned int j;
+		for (j = n; j > 0 && offs[j - 1] > off; j--) {
+			offs[j] = offs[j - 1];
+			masks[j] = masks[j - 1];
+		}
+		offs[j] = off;
+		masks[j] = pin;
+		n++;
 	}
 
-	RTC_REG_WRITE(FRC1_CTRL_ADDRESS, FRC1_AUTO_LOAD | timer_div | FRC1_ENABLE_TIMER | TM_EDGE_INT);
-	ETS_FRC_TIMER1_INTR_ATTACH((ets_isr_t)timer_cb, NULL);
+	// period start, then one event per distinct switch off time,
+	// edges closer than minimum gap are merged into the earlier one
+	uint32_t last = 0;
+	unsigned int k;
+	mEvents[0].clear = 0;
+	mEventsNum = 1;
+	for (k = 0; k < n; k++) {
+		if (mEventsNum > 1 && offs[k] - last < mMinGapTicks) {
+			mEvents[mEventsNum - 1].clear |= masks[k];
+			continue;
+		}
+		mEvents[mEventsNum - 1].ticks = offs[k] - last;
+		mEvents[mEventsNum].clear = masks[k];
+		mEventsNum++;
+		last = offs[k];
+	}
+	mEvents[mEventsNum - 1].ticks = period_ticks - last;
+}
+
+
+/**
+ * @brief Choose timer divider.
+ * @param[in] max_us The longest gap between events, microseconds.
+ */
+static void ICACHE_FLASH_ATTR setup_timer(uint32_t max_us)
+{
+	// timer counter fits the whole gap without divider
+	// up to about 100 ms, longer gaps are split while loading
+	if (max_us <= MAX_LOAD_TICKS / 80)
+		mTimerDiv = DIVDED_BY_1;
+	else if (max_us <= 100000000)
+		mTimerDiv = DIVDED_BY_16;
+	else
+		mTimerDiv = DIVDED_BY_256;
+	mMinGapTicks = us_to_ticks(MIN_GAP_US);
+	if (mMinGapTicks == 0)
+		mMinGapTicks = 1;
+	// divider mode value is also log2 of divider
+	mTickShift = mTimerDiv + ((system_get_cpu_freq() > 80) ? 1 : 0);
+}
+
+
+/**
+ * @brief Enable timer.
+ *
+ * The first event happens right now, so pins should be already set.
+ *
+ * @param[in] owner Timer user.
+ * @param[in] ticks Timer ticks till the second event.
+ */
+static void ICACHE_FLASH_ATTR arm_timer(TIMER_OWNER owner, uint32_t ticks)
+{
+	track_event(get_ccount(), ticks);
+	mTimerOwner = owner;
+
+	RTC_REG_WRITE(FRC1_CTRL_ADDRESS, mTimerDiv | FRC1_ENABLE_TIMER | TM_EDGE_INT);
+	if (owner == TIMER_PWM)
+		ETS_FRC_TIMER1_INTR_ATTACH((ets_isr_t)timer_cb, NULL);
+	else
+		ETS_FRC_TIMER1_INTR_ATTACH((ets_isr_t)sequence_cb, NULL);
 	TM1_EDGE_INT_ENABLE();
 	ETS_FRC1_INTR_ENABLE();
-	RTC_REG_WRITE(FRC1_LOAD_ADDRESS, tacts);
-
-	dhdebug("PWM enable with period %u us, timer: %u/%u tacts",
-	        mPeriodUs, tacts, 1 << timer_div);
+	load_timer(ticks);
 }
 
 
 /*
  * dh_pwm_start() implementation.
  */
-int ICACHE_FLASH_ATTR dh_pwm_start(uint32_t duty[DH_GPIO_PIN_COUNT],
+int ICACHE_FLASH_ATTR dh_pwm_start(float duty[DH_GPIO_PIN_COUNT],
                                    DHGpioPinMask pins,
                                    unsigned int period_us,
                                    unsigned int count)
@@ -127,32 +412,35 @@ int ICACHE_FLASH_ATTR dh_pwm_start(uint32_t duty[DH_GPIO_PIN_COUNT],
 		return -2; // period is out of range
 	int i;
 	for (i = 0; i < DH_GPIO_PIN_COUNT; i++) {
-		if (duty[i] > DH_PWM_DEPTH)
+		if ((pins & DH_GPIO_PIN(i)) && (duty[i] < 0.0f || duty[i] > DH_PWM_MAX_DUTY))
 			return -3; // bad duty value
 	}
 
-	disarm_timer();
+	disarm_timer(); // sequence is also stopped
+	mStepsNum = 0;
+	mSequencePins = 0;
 	mPeriodUs = period_us;
 	mTotalCount = count;
-	dh_pwm_disable(pins);
 	for (i = 0; i < DH_GPIO_PIN_COUNT; i++) {
-		const DHGpioPinMask pin = DH_GPIO_PIN(i);
-		if ((pins & pin)) {
-			dhdebug("PWM for %d pin, duty: %d", i, duty[i]);
-			if (duty[i]) {
-				mUsedPins |= pin;
-				mDisablePinOn[duty[i]] |= pin;
-			} else {
-				mDisablePinOn[0] |= pin;
-			}
+		if (pins & DH_GPIO_PIN(i)) {
+			dhdebug("PWM for %d pin, duty: %f", i, duty[i]);
+			mDuty[i] = duty[i];
 		}
 	}
+	mPwmPins |= pins;
 
-	dh_gpio_prepare_pins(mUsedPins | mDisablePinOn[0], 0);
-	gpio_output_set(mUsedPins, mDisablePinOn[0],
-	                mUsedPins | mDisablePinOn[0], 0);
-	if (mUsedPins)
-		arm_timer();
+	setup_timer(period_us);
+	build_events(us_to_ticks(period_us));
+
+	const DHGpioPinMask low = mPwmPins & ~mUsedPins;
+	dh_gpio_prepare_pins(mPwmPins, 0);
+	gpio_output_set(mUsedPins, low, mPwmPins, 0);
+	if (mUsedPins) {
+		mEvent = (mEventsNum > 1) ? 1 : 0;
+		arm_timer(TIMER_PWM, mEvents[0].ticks);
+		dhdebug("PWM enable with period %u us, %u events, timer divider %u",
+		        mPeriodUs, mEventsNum, 1 << mTimerDiv);
+	}
 
 	return 0; // OK
 }
@@ -172,9 +460,86 @@ unsigned int ICACHE_FLASH_ATTR dh_pwm_get_period_us(void)
  */
 void ICACHE_FLASH_ATTR dh_pwm_disable(DHGpioPinMask pins)
 {
-	int i, n = sizeof(mDisablePinOn)/sizeof(mDisablePinOn[0]);
-	for (i = 0; i < n; i++) {
-		mDisablePinOn[i] &= ~pins;
+	if (!(pins & (mPwmPins | mSequencePins)))
+		return; // pins are not used, nothing to do
+
+	unsigned int i;
+	ETS_FRC1_INTR_DISABLE();
+	release_pins(pins);
+	for (i = 0; i < mStepsNum; i++) {
+		mSteps[i].set &= ~pins;
+		mSteps[i].clear &= ~pins;
 	}
-	mUsedPins &= ~pins;
+	mSequencePins &= ~pins;
+	if (mTimerOwner != TIMER_FREE)
+		ETS_FRC1_INTR_ENABLE();
+}
+
+
+/*
+ * dh_pwm_sequence_start() implementation.
+ */
+int ICACHE_FLASH_ATTR dh_pwm_sequence_start(const void *buf,
+                                            unsigned int num,
+                                            unsigned int count)
+{
+	const uint8_t *b = (const uint8_t *)buf;
+	if (num == 0 || num > DH_PWM_SEQUENCE_MAX_STEPS)
+		return -2; // wrong number of steps
+
+	DHGpioPinMask pins = 0;
+	uint32_t max_us = 0;
+	unsigned int i;
+	for (i = 0; i < num; i++, b += DH_PWM_SEQUENCE_STEP_SIZE) {
+		const DHGpioPinMask set = b[0] | (b[1] << 8);
+		const DHGpioPinMask clear = b[2] | (b[3] << 8);
+		const uint32_t us = b[4] | (b[5] << 8) | (b[6] << 16) | ((uint32_t)b[7] << 24);
+		if ((set | clear) & ~DH_GPIO_SUITABLE_PINS)
+			return -1; // unsuitable pins
+		if ((set & clear) || us < MIN_GAP_US)
+			return -2; // wrong step
+		pins |= set | clear;
+		if (us > max_us)
+			max_us = us;
+	}
+
+	// stop PWM and previous sequence
+	disarm_timer();
+	release_pins(mPwmPins);
+
+	setup_timer(max_us);
+	b = (const uint8_t *)buf;
+	for (i = 0; i < num; i++, b += DH_PWM_SEQUENCE_STEP_SIZE) {
+		mSteps[i].set = b[0] | (b[1] << 8);
+		mSteps[i].clear = b[2] | (b[3] << 8);
+		mSteps[i].ticks = us_to_ticks(b[4] | (b[5] << 8) | (b[6] << 16) | ((uint32_t)b[7] << 24));
+	}
+	mStepsNum = num;
+	mSequencePins = pins;
+	mSequenceCount = count;
+	mSequencePlayed = 0;
+	os_timer_disarm(&mSequenceTimer);
+	os_timer_setfn(&mSequenceTimer, sequence_done_cb, NULL);
+
+	dh_gpio_prepare_pins(pins, 0);
+	gpio_output_set(mSteps[0].set, mSteps[0].clear, pins, 0);
+	mStep = 1;
+	arm_timer(TIMER_SEQUENCE, mSteps[0].ticks);
+	dhdebug("Sequence of %u steps started, timer divider %u",
+	        num, 1 << mTimerDiv);
+
+	return 0; // OK
+}
+
+
+/*
+ * dh_pwm_sequence_stop() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_pwm_sequence_stop(void)
+{
+	if (mTimerOwner == TIMER_SEQUENCE)
+		disarm_timer();
+	os_timer_disarm(&mSequenceTimer);
+	mStepsNum = 0;
+	mSequencePins = 0;
 }
@@ -18,21 +18,39 @@
 #define DH_PWM_DEFAULT_PERIOD_US 1000
 
 /**
- * @brief PWM depth, high value may cause very high CPU load.
+ * @brief Maximum duty cycle, percent.
+ *
+ * Duty cycle is not quantized to a fixed number of steps, resolution is
+ * limited by timer tick which is 12.5 ns for periods up to about 100 ms.
  */
-#define DH_PWM_DEPTH 100
+#define DH_PWM_MAX_DUTY 100.0f
+
+
+/**
+ * @brief Size of one sequence step in bytes.
+ *
+ * Step is 16 bit mask of pins to set, 16 bit mask of pins to clear and
+ * 32 bit delay till the next step in microseconds, all little-endian.
+ */
+#define DH_PWM_SEQUENCE_STEP_SIZE 8
+
+/**
+ * @brief Maximum number of sequence steps.
+ */
+#define DH_PWM_SEQUENCE_MAX_STEPS 32
 
 
 /**
  * @brief Start PWM for specified pins.
- * @param[in] duty Array with pins duty cycles for each pin.
+ * @param[in] duty Array with pins duty cycles for each pin, percent.
  * @param[in] pins Bitwise pin mask with pins that should be enabled,
  *                 these pins must have correct values in `duty` array.
  * @param[in] period_us PWM period, microseconds.
  * @param[in] count Number of tacts for PWM. If zero PWM will not stop automatically.
- * @return Zero on success.
+ * @return Zero on success, -1 for unsuitable pins, -2 for wrong period,
+ *         -3 for wrong duty cycle.
  */
-int dh_pwm_start(uint32_t duty[DH_GPIO_PIN_COUNT],
+int dh_pwm_start(float duty[DH_GPIO_PIN_COUNT],
                  DHGpioPinMask pins,
                  unsigned int period_us,
                  unsigned int count);
@@ -54,4 +72,40 @@ unsigned int dh_pwm_get_period_us(void);
  */
 void dh_pwm_disable(DHGpioPinMask pins);
 
+
+/**
+ * @brief Start GPIO sequence playback.
+ *
+ * Sequence uses the same hardware timer, so PWM is stopped.
+ * Each step is applied and then the next step is applied after
+ * step's delay. Pins released with dh_pwm_disable() are excluded.
+ *
+ * @param[in] buf Steps, see DH_PWM_SEQUENCE_STEP_SIZE for format.
+ * @param[in] num Number of steps.
+ * @param[in] count Number of times to play the whole sequence.
+ *                  If zero sequence will not stop automatically.
+ * @return Zero on success, -1 for unsuitable pins, -2 for wrong steps.
+ */
+int dh_pwm_sequence_start(const void *buf,
+                          unsigned int num,
+                          unsigned int count);
+
+
+/**
+ * @brief Stop GPIO sequence playback.
+ *
+ * Pins keep current levels, no notification is reported.
+ */
+void dh_pwm_sequence_stop(void);
+
+
+/**
+ * @brief Sequence completion callback.
+ *
+ * Called after the last step delay of the last repetition.
+ *
+ * @param[in] count Number of played repetitions.
+ */
+extern void dh_pwm_sequence_cb(unsigned int count);
+
 #endif /* _DH_PWM_H_ */
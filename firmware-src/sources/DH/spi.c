@@ -88,6 +88,7 @@ static void ICACHE_FLASH_ATTR spi_reinit(void)
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTDI_U, FUNC_HSPI);
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTCK_U, FUNC_HSPI);
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTMS_U, FUNC_HSPI);
+	dh_gpio_reset_config(pins);
 	WRITE_PERI_REG(SPI_USER, 0);
 	WRITE_PERI_REG(SPI_CLOCK, // 1 MHz
 			((15 & SPI_CLKDIV_PRE) << SPI_CLKDIV_PRE_S)
@@ -6,6 +6,7 @@
  */
 #include "DH/uart.h"
 #include "DH/adc.h"
+#include "DH/gpio.h"
 #include "dhdebug.h"
 #include "user_config.h"
 
@@ -25,85 +26,283 @@
 #define UART_CONFIGURATION_REGISTER0 (UART_BASE + 0x20)
 #define UART_CONFIGURATION_REGISTER1 (UART_BASE + 0x24)
 
-#define BUFFER_OVERFLOW_RESERVE INTERFACES_BUF_SIZE
+#define UART_RXFIFO_FULL_INT BIT(0)
+#define UART_TXFIFO_EMPTY_INT BIT(1)
+#define UART_RXFIFO_OVF_INT BIT(4)
+#define UART_RXFIFO_TOUT_INT BIT(8)
+#define UART_RX_INTS (UART_RXFIFO_FULL_INT | UART_RXFIFO_OVF_INT | UART_RXFIFO_TOUT_INT)
+
+/** RX FIFO level which causes interruption, hardware FIFO is 128 bytes. */
+#define RX_FIFO_FULL_THRESHOLD 64
+/** Idle time in byte periods which causes interruption for the rest of data. */
+#define RX_TIMEOUT_THRESHOLD 2
+/** RX FIFO level for hardware flow control. */
+#define RX_FLOW_THRESHOLD 120
+
+/** RX ring size, should be power of two. */
+#define RX_RING_SIZE 1024
+#define RX_RING_MASK (RX_RING_SIZE - 1)
+
+/** Hardware TX FIFO size. */
+#define TX_FIFO_SIZE 128
+/** TX FIFO level below which interruption happens. */
+#define TX_FIFO_EMPTY_THRESHOLD 16
+
+/** TX ring size, should be power of two. */
+#define TX_RING_SIZE 512
+#define TX_RING_MASK (TX_RING_SIZE - 1)
 
 // module variables
 static DHUartDataMode mDataMode = DH_UART_MODE_IGNORE;
-static uint8_t mUartBuf[INTERFACES_BUF_SIZE + BUFFER_OVERFLOW_RESERVE] = {0};
-static size_t mUartBufPos = 0;
+static uint8_t mRxRing[RX_RING_SIZE] = {0};
+static volatile uint32_t mRxHead = 0; // written by interruption only
+static volatile uint32_t mRxTail = 0;
+static uint8_t mTxRing[TX_RING_SIZE] = {0};
+static volatile uint32_t mTxHead = 0;
+static volatile uint32_t mTxTail = 0; // written with UART interruption disabled only
+static os_timer_t mTxDrainTimer;
+static DHUartDrainCb mDrainCb = NULL;
 static os_timer_t mUartTimer;
 static unsigned int mTimeoutMs = 250;
 static int mBufInterrupt = false;
 static os_timer_t mRecoverLEDTimer;
 static int mKeepLED = false;
+static int mLedActive = false;
+static int mTimersReady = false;
 
 static void arm_buf_timer(void);
+static void arm_drain_timer(void);
+static void led_recover(void *arg);
 
 
 /**
  * @brief Buffer timer callback.
+ *
+ * Ring data is passed to callback directly. Data which wraps
+ * around the end of ring is passed with the next call. In per byte
+ * mode each byte is passed separately.
  */
 static void ICACHE_FLASH_ATTR buf_timeout_cb(void *arg)
 {
-	size_t sz = mUartBufPos;
+	if (mDataMode == DH_UART_MODE_PER_BYTE) {
+		// interruption handler only appends, so tail is safe to move
+		while (mRxTail != mRxHead) {
+			const uint8_t c = mRxRing[mRxTail & RX_RING_MASK];
+			mRxTail++;
+			dh_uart_char_rcv_cb(c);
+		}
+		return;
+	}
+
+	const uint32_t tail = mRxTail;
+	const size_t pos = tail & RX_RING_MASK;
+	size_t sz = mRxHead - tail;
 	if (sz > INTERFACES_BUF_SIZE)
 		sz = INTERFACES_BUF_SIZE;
-	dh_uart_buf_rcv_cb(mUartBuf, sz);
+	if (sz > RX_RING_SIZE - pos)
+		sz = RX_RING_SIZE - pos;
+	if (!sz)
+		return;
+	dh_uart_buf_rcv_cb(&mRxRing[pos], sz);
 
 	ETS_UART_INTR_DISABLE();
-	if (sz != mUartBufPos) {
-		os_memmove(mUartBuf, &mUartBuf[sz],
-		           mUartBufPos - sz);
-		mUartBufPos -= sz;
-	} else {
-		mUartBufPos = 0;
-	}
+	mRxTail = tail + sz;
+	if (mRxTail == mRxHead)
+		mRxHead = mRxTail = 0; // start from the beginning to keep data contiguous
+	const int left = (mRxHead != mRxTail);
 	ETS_UART_INTR_ENABLE();
-	if (mUartBufPos)
+	if (left)
 		arm_buf_timer();
 }
 
 
 /**
- * Start buffer timer.
+ * @brief Start buffer timer.
+ *
+ * Called from interruption handler, so it is kept in RAM and doesn't set
+ * timer function, see timers_setup().
  */
-static void ICACHE_FLASH_ATTR arm_buf_timer(void)
+static void arm_buf_timer(void)
 {
 	os_timer_disarm(&mUartTimer);
+	os_timer_arm(&mUartTimer, (mDataMode == DH_UART_MODE_PER_BYTE
+			|| mTimeoutMs == 0 || mRxHead - mRxTail >= INTERFACES_BUF_SIZE) ? 1 : mTimeoutMs, 0);
+}
+
+
+/**
+ * @brief Number of bytes in hardware TX FIFO.
+ */
+static inline unsigned int tx_fifo_count(void)
+{
+	return (READ_PERI_REG(UART_STATUS_REGISTER) >> 16) & 0xFF;
+}
+
+
+/**
+ * @brief Move data from TX ring to hardware FIFO.
+ *
+ * Should be called with UART interruption disabled.
+ */
+static inline void tx_fill_fifo(void)
+{
+	uint32_t tail = mTxTail;
+	unsigned int room = TX_FIFO_SIZE - tx_fifo_count();
+	while (room && tail != mTxHead) {
+		WRITE_PERI_REG(UART_BASE, mTxRing[tail++ & TX_RING_MASK]);
+		room--;
+	}
+	mTxTail = tail;
+}
+
+
+/**
+ * @brief TX drain timer callback.
+ *
+ * Waits for hardware FIFO to become empty, then recovers LEDs
+ * and calls drain callback.
+ */
+static void ICACHE_FLASH_ATTR tx_drain_cb(void *arg)
+{
+	ETS_UART_INTR_DISABLE();
+	const int ring_busy = (mTxHead != mTxTail);
+	const int fifo_busy = !ring_busy && tx_fifo_count();
+	if (fifo_busy)
+		arm_drain_timer(); // ring is empty, so interruption won't do it
+	ETS_UART_INTR_ENABLE();
+	if (ring_busy || fifo_busy)
+		return;
+
+	if (mKeepLED) {
+		os_timer_setfn(&mRecoverLEDTimer, led_recover, NULL);
+		os_timer_arm(&mRecoverLEDTimer, 20, 0);
+	}
+	if (mDrainCb) {
+		DHUartDrainCb cb = mDrainCb;
+		mDrainCb = NULL;
+		cb();
+	}
+}
+
+
+/**
+ * @brief Start TX drain timer.
+ *
+ * Called from interruption handler, so it is kept in RAM and doesn't set
+ * timer function, see timers_setup().
+ */
+static void arm_drain_timer(void)
+{
+	os_timer_disarm(&mTxDrainTimer);
+	os_timer_arm(&mTxDrainTimer, 1, 0);
+}
+
+
+/**
+ * @brief Set timer functions once.
+ *
+ * Interruption handler only arms timers, os_timer_setfn()
+ * is not called there since it is not in RAM.
+ */
+static void ICACHE_FLASH_ATTR timers_setup(void)
+{
+	if (mTimersReady)
+		return;
 	os_timer_setfn(&mUartTimer, buf_timeout_cb, NULL);
-	os_timer_arm(&mUartTimer, (mTimeoutMs == 0 || mUartBufPos >= INTERFACES_BUF_SIZE) ? 1 : mTimeoutMs, 0);
+	os_timer_setfn(&mTxDrainTimer, tx_drain_cb, NULL);
+	mTimersReady = true;
 }
 
 
 /**
- * @brief UART RX interruption handler.
+ * @brief Queue data for transmission.
+ *
+ * Returns as soon as data is in ring. If ring is full, feeds
+ * hardware FIFO itself until the rest of data fits, so it also
+ * works from RX interruption handler.
+ */
+static void ICACHE_FLASH_ATTR tx_write(const char *data, size_t len)
+{
+	while (len) {
+		ETS_UART_INTR_DISABLE();
+		uint32_t head = mTxHead;
+		while (len && head - mTxTail < TX_RING_SIZE) {
+			mTxRing[head++ & TX_RING_MASK] = *data++;
+			len--;
+		}
+		mTxHead = head;
+		tx_fill_fifo();
+		SET_PERI_REG_MASK(UART_INTERUPTION_ENABLE_REGISTER, UART_TXFIFO_EMPTY_INT);
+		ETS_UART_INTR_ENABLE();
+		if (len)
+			system_soft_wdt_feed(); // backpressure, wait for room
+	}
+}
+
+
+/**
+ * @brief Wait until all queued data is transmitted.
+ */
+static void ICACHE_FLASH_ATTR tx_flush(void)
+{
+	while (mTxHead != mTxTail || tx_fifo_count()) {
+		ETS_UART_INTR_DISABLE();
+		tx_fill_fifo();
+		ETS_UART_INTR_ENABLE();
+		system_soft_wdt_feed();
+	}
+}
+
+
+/**
+ * @brief UART interruption handler.
+ *
+ * RX part is called when FIFO reaches threshold or line is idle,
+ * drains the whole hardware FIFO. TX part refills FIFO from ring.
  */
 static void int_cb(void *arg)
 {
-	if (READ_PERI_REG(UART_INTERUPTION_STATE_REGISTER) & BIT(0)) {
-		const int rcvChar = READ_PERI_REG(UART_BASE) & 0xFF;
-		WRITE_PERI_REG(UART_INTERUPTION_REGISTER, BIT(0));
+	const uint32_t state = READ_PERI_REG(UART_INTERUPTION_STATE_REGISTER);
+	if (state & UART_TXFIFO_EMPTY_INT) {
+		tx_fill_fifo();
+		if (mTxTail == mTxHead) {
+			CLEAR_PERI_REG_MASK(UART_INTERUPTION_ENABLE_REGISTER, UART_TXFIFO_EMPTY_INT);
+			arm_drain_timer();
+		}
+	}
+
+	if (state & UART_RX_INTS) {
+		unsigned int count = READ_PERI_REG(UART_STATUS_REGISTER) & 0xFF;
 
 		switch(mDataMode) {
 		case DH_UART_MODE_PER_BYTE:
-			dh_uart_char_rcv_cb(rcvChar);
-			break;
-
+			// terminal is in flash, bytes are passed to it by timer
 		case DH_UART_MODE_PER_BUF:
-			if (mUartBufPos >= sizeof(mUartBuf)) {
-				return; // buffer overflow
-			}
-			mUartBuf[mUartBufPos++] = rcvChar;
-			if (mBufInterrupt) {
-				if (mUartBufPos <= INTERFACES_BUF_SIZE) {
-					arm_buf_timer();
-				}
+		{
+			const uint32_t tail = mRxTail;
+			const int flush_pending = (mRxHead - tail >= INTERFACES_BUF_SIZE);
+			uint32_t head = mRxHead;
+			while (count--) {
+				const uint8_t rcvChar = READ_PERI_REG(UART_BASE) & 0xFF;
+				if (head - tail < RX_RING_SIZE) // otherwise overflow
+					mRxRing[head++ & RX_RING_MASK] = rcvChar;
 			}
+			mRxHead = head;
+			if (mDataMode == DH_UART_MODE_PER_BYTE
+			    || (mBufInterrupt && !flush_pending && head != tail))
+				arm_buf_timer();
 			break;
+		}
 
 		case DH_UART_MODE_IGNORE:
+			while (count--)
+				READ_PERI_REG(UART_BASE);
 			break;
 		}
+	}
+
+	if (state & (UART_RX_INTS | UART_TXFIFO_EMPTY_INT)) {
+		WRITE_PERI_REG(UART_INTERUPTION_REGISTER, state & (UART_RX_INTS | UART_TXFIFO_EMPTY_INT));
 	} else {
 		WRITE_PERI_REG(UART_INTERUPTION_REGISTER, 0xffff);
 	}
@@ -124,11 +323,14 @@ int ICACHE_FLASH_ATTR dh_uart_init(int speed, int databits, char parity, int sto
 	if (stopbits < 1 || stopbits > 2)
 		return -1; // bad stopbits
 
+	timers_setup();
+	tx_flush(); // FIFO is reset below
 	ETS_UART_INTR_DISABLE();
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_U0TXD_U, FUNC_U0TXD);
 	gpio_output_set(0, 0, 0, BIT(1) | BIT(3));
 	PIN_PULLUP_EN(PERIPHS_IO_MUX_U0RXD_U);
 	PIN_PULLUP_DIS(PERIPHS_IO_MUX_U0TXD_U);
+	dh_gpio_reset_config(DH_GPIO_PIN(1) | DH_GPIO_PIN(3));
 
 	WRITE_PERI_REG(UART_DIV_REGISTER, UART_CLK_FREQ / speed);
 	WRITE_PERI_REG(UART_CONFIGURATION_REGISTER0, 0);
@@ -138,10 +340,14 @@ int ICACHE_FLASH_ATTR dh_uart_init(int speed, int databits, char parity, int sto
 	SET_PERI_REG_MASK(UART_CONFIGURATION_REGISTER0, ((stopbits == 2) ? 3 : 1)  <<  4);
 	SET_PERI_REG_MASK(UART_CONFIGURATION_REGISTER0, BIT(17) | BIT(18));
 	CLEAR_PERI_REG_MASK(UART_CONFIGURATION_REGISTER0, BIT(17) | BIT(18));
-	WRITE_PERI_REG(UART_CONFIGURATION_REGISTER1, BIT(0) | BIT(16) | BIT(23));
+	WRITE_PERI_REG(UART_CONFIGURATION_REGISTER1,
+	               (RX_FIFO_FULL_THRESHOLD << 0)
+	             | (TX_FIFO_EMPTY_THRESHOLD << 8)
+	             | (RX_FLOW_THRESHOLD << 16) | BIT(23)
+	             | (RX_TIMEOUT_THRESHOLD << 24) | BIT(31));
 	ETS_UART_INTR_ATTACH(int_cb, 0);
 	WRITE_PERI_REG(UART_INTERUPTION_REGISTER, 0xffff);
-	SET_PERI_REG_MASK(UART_INTERUPTION_ENABLE_REGISTER, BIT(0));
+	SET_PERI_REG_MASK(UART_INTERUPTION_ENABLE_REGISTER, UART_RX_INTS);
 	ETS_UART_INTR_ENABLE();
 
 	return 0; // OK
@@ -155,7 +361,9 @@ static void ICACHE_FLASH_ATTR led_recover(void *arg)
 {
 	ETS_INTR_LOCK();
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_U0TXD_U, FUNC_GPIO1);
+	dh_gpio_reset_config(DH_GPIO_PIN(1));
 	gpio_output_set(0, 0b0110, 0b0110, 0);
+	mLedActive = true;
 	ETS_INTR_UNLOCK();
 }
 
@@ -167,6 +375,8 @@ static void ICACHE_FLASH_ATTR led_off(void)
 {
 	gpio_output_set(0, 0, 0, 0b0110);
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_U0TXD_U, FUNC_U0TXD);
+	dh_gpio_reset_config(DH_GPIO_PIN(1));
+	mLedActive = false;
 	os_delay_us(10000);
 }
 
@@ -178,7 +388,8 @@ void ICACHE_FLASH_ATTR dh_uart_leds(DHUartLedsMode mode)
 {
 	if (mode == DH_UART_LEDS_ON) {
 		mKeepLED = true;
-		led_recover(0);
+		timers_setup();
+		arm_drain_timer(); // recovers LEDs when TX is idle
 	} else {
 		mKeepLED = false;
 		led_off();
@@ -187,12 +398,15 @@ void ICACHE_FLASH_ATTR dh_uart_leds(DHUartLedsMode mode)
 
 
 /**
- * @brief Send one char to the UART.
+ * @brief Prepare TX pin for sending.
  */
-static void ICACHE_FLASH_ATTR send_char(int ch)
+static void ICACHE_FLASH_ATTR tx_begin(void)
 {
-	while ((READ_PERI_REG(UART_STATUS_REGISTER) >> 16) & 0xFF);
-	WRITE_PERI_REG(UART_BASE, ch);
+	if (mKeepLED) {
+		os_timer_disarm(&mRecoverLEDTimer);
+		if (mLedActive)
+			led_off();
+	}
 }
 
 
@@ -204,18 +418,8 @@ void ICACHE_FLASH_ATTR dh_uart_send_str(const char *str)
 	if (mDataMode != DH_UART_MODE_PER_BYTE)
 		return;
 
-	if (mKeepLED) {
-		os_timer_disarm(&mRecoverLEDTimer);
-		led_off();
-	}
-
-	while (*str)
-		send_char(*str++);
-
-	if (mKeepLED) {
-		os_timer_setfn(&mRecoverLEDTimer, led_recover, NULL);
-		os_timer_arm(&mRecoverLEDTimer, 20, 0);
-	}
+	tx_begin();
+	tx_write(str, os_strlen(str));
 }
 
 
@@ -237,20 +441,23 @@ void ICACHE_FLASH_ATTR dh_uart_send_buf(const void *buf_, size_t len)
 	if (mDataMode != DH_UART_MODE_PER_BUF)
 		return;
 
-	if (mKeepLED) {
-		os_timer_disarm(&mRecoverLEDTimer);
-		led_off();
-	}
+	tx_begin();
+	tx_write((const char*)buf_, len);
+}
 
-	const char *buf = (const char*)buf_;
-	while (len--) {
-		system_soft_wdt_feed();
-		send_char(*buf++);
-	}
 
-	if (mKeepLED) {
-		os_timer_setfn(&mRecoverLEDTimer, led_recover, NULL);
-		os_timer_arm(&mRecoverLEDTimer, 20, 0);
+/*
+ * dh_uart_drain() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_uart_drain(DHUartDrainCb cb)
+{
+	mDrainCb = cb;
+	if (cb) {
+		timers_setup();
+		ETS_UART_INTR_DISABLE();
+		if (mTxHead == mTxTail)
+			arm_drain_timer(); // otherwise interruption arms it
+		ETS_UART_INTR_ENABLE();
 	}
 }
 
@@ -260,11 +467,13 @@ void ICACHE_FLASH_ATTR dh_uart_send_buf(const void *buf_, size_t len)
  */
 void ICACHE_FLASH_ATTR dh_uart_set_mode(DHUartDataMode mode)
 {
+	timers_setup();
 	mDataMode = mode;
 	if (mode == DH_UART_MODE_PER_BUF) {
-		mUartBufPos = 0;
+		dh_uart_reset_buf();
 	} else if(mode == DH_UART_MODE_PER_BYTE) {
 		mBufInterrupt = false;
+		dh_uart_reset_buf();
 	}
 }
 
@@ -292,8 +501,11 @@ unsigned int ICACHE_FLASH_ATTR dh_uart_get_callback_timeout(void)
  */
 size_t ICACHE_FLASH_ATTR dh_uart_get_buf(void **buf)
 {
-	*buf = mUartBuf;
-	return mUartBufPos;
+	const uint32_t tail = mRxTail;
+	const size_t pos = tail & RX_RING_MASK;
+	const size_t sz = mRxHead - tail;
+	*buf = &mRxRing[pos];
+	return (sz > RX_RING_SIZE - pos) ? (RX_RING_SIZE - pos) : sz;
 }
 
 
@@ -302,7 +514,9 @@ size_t ICACHE_FLASH_ATTR dh_uart_get_buf(void **buf)
  */
 void ICACHE_FLASH_ATTR dh_uart_reset_buf(void)
 {
-	mUartBufPos = 0;
+	ETS_UART_INTR_DISABLE();
+	mRxHead = mRxTail = 0;
+	ETS_UART_INTR_ENABLE();
 }
 
 
@@ -10,8 +10,15 @@
  * Each received byte cause dh_uart_char_rcv callback.
  *
  * In DH_UART_MODE_PER_BUF all writing operations with data are allowed, but char operations are disabled.
- * Callback dh_uart_buf_rcv will be called after number of byte in buffer is greater or equal
- * INTERFACES_BUF_SIZE or last byte was received later than specified timeout.
+ * Received data is stored in ring buffer. Callback dh_uart_buf_rcv will be called after number
+ * of byte in buffer is greater or equal INTERFACES_BUF_SIZE or last byte was received later
+ * than specified timeout.
+ *
+ * Hardware FIFO is drained when it's filled to threshold or line is idle, so interruption
+ * happens once per several bytes.
+ *
+ * Sending functions put data into TX ring buffer and return immediately, interruption feeds
+ * hardware FIFO from ring. Only if ring is full, sending function waits for room.
  */
 #ifndef _DH_UART_H_
 #define _DH_UART_H_
@@ -37,8 +44,17 @@ typedef enum {
 } DHUartLedsMode;
 
 
+/**
+ * @brief Callback type for TX drain.
+ */
+typedef void (*DHUartDrainCb)(void);
+
+
 /**
  * @brief Initialize UART module.
+ *
+ * Waits until queued data is transmitted before reconfiguring.
+ *
  * @param[in] speed Bitrate. For example: 115200 or 19200.
  * @param[in] databits Number of bits in byte for UART. From 5 to 8.
  * @param[in] parity Use parity bit or not. Char value: 'N'(not), 'E'(even) or 'O'(odd).
@@ -86,6 +102,16 @@ void dh_uart_send_line(const char *str);
 void dh_uart_send_buf(const void *buf, size_t len);
 
 
+/**
+ * @brief Call function once all queued data is transmitted.
+ *
+ * Callback is called once from timer, even if nothing is queued.
+ *
+ * @param[in] cb Callback, NULL to cancel.
+ */
+void dh_uart_drain(DHUartDrainCb cb);
+
+
 /**
  * @brief Set current operating mode.
  * @details Buffer is cleaned up on setting DH_UART_MODE_PER_BUF mode.
@@ -115,6 +141,10 @@ unsigned int dh_uart_get_callback_timeout(void);
 
 /**
  * @brief Get receiving buffer.
+ *
+ * Buffer is a ring, so only contiguous part of data is returned.
+ * Data is contiguous unless callbacks have consumed part of it.
+ *
  * @param[out] buf Pointer where pointer to buffer is stored.
  * @return Number of bytes in buffer.
  */
@@ -146,8 +176,8 @@ extern void dh_uart_char_rcv_cb(int ch);
 
 /**
  * @brief Callback declaration for DH_UART_MODE_PER_BUF mode.
- * @param[in] buf Data that was received.
- * @param[in] len Size of data in bytes.
+ * @param[in] buf Data that was received. Points to receiving buffer, valid only during the call.
+ * @param[in] len Size of data in bytes, up to INTERFACES_BUF_SIZE.
  */
 extern void dh_uart_buf_rcv_cb(const void *buf, size_t len);
 
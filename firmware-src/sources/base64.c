@@ -7,8 +7,6 @@
 #include "base64.h"
 #include "user_config.h"
 
-#ifdef DATAENCODEBASE64
-
 /**
  * @brief Base64 decoding table.
  * @param[in] ch Input character.
@@ -160,5 +158,3 @@ int ICACHE_FLASH_ATTR esp_base64_decode(const char *text, size_t text_len,
 
 	return data - (uint8_t*)data_base;
 }
-
-#endif // DATAENCODEBASE64
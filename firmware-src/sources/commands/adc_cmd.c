@@ -9,7 +9,11 @@
 
 #ifdef DH_COMMANDS_ADC // ADC command handlers
 #include "dhcommand_parser.h"
+#include "snprintf.h"
+#include "fft.h"
 #include <user_interface.h>
+#include <osapi.h>
+#include <mem.h>
 
 /**
  * Minimum notification timeout, milliseconds.
@@ -23,6 +27,42 @@
 #define MAX_TIMEOUT_MS 0x7fffff
 
 
+/**
+ * Default block sampling period, microseconds.
+ */
+#define DEFAULT_BLOCK_PERIOD_US 1000
+
+
+/**
+ * Default number of samples in block.
+ */
+#define DEFAULT_BLOCK_COUNT 64
+
+
+/**
+ * Default spectrum sampling period, microseconds.
+ */
+#define DEFAULT_SPECTRUM_PERIOD_US 250
+
+
+/**
+ * Default number of samples for spectrum.
+ */
+#define DEFAULT_SPECTRUM_COUNT 256
+
+
+/**
+ * Default number of spectrum peaks.
+ */
+#define DEFAULT_SPECTRUM_PEAKS 5
+
+
+/**
+ * Spectrum response buffer length.
+ */
+#define SPECTRUM_JSON_LENGTH (FFT_JSON_MAX_LENGTH + 64)
+
+
 /*
  * dh_handle_adc_read() implementation.
  */
@@ -81,4 +121,123 @@ void ICACHE_FLASH_ATTR dh_handle_adc_int(COMMAND_RESULT *cmd_res, const char *co
 	}
 }
 
+
+
+/*
+ * dh_handle_adc_block() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_handle_adc_block(COMMAND_RESULT *cmd_res, const char *command,
+                                           const char *params, unsigned int params_len)
+{
+	gpio_command_params info;
+	ALLOWED_FIELDS fields = 0;
+	const char *err_msg = parse_params_pins_set(params, params_len,
+			&info, DH_ADC_SUITABLE_PINS, 0,
+			AF_PERIOD | AF_COUNT | AF_INTERVAL | AF_LOW | AF_HIGH | AF_RAW, &fields);
+
+	if (err_msg != 0) {
+		dh_command_fail(cmd_res, err_msg);
+		return; // FAILED
+	}
+
+	const unsigned int period_us = (fields & AF_PERIOD) ? info.periodus
+	                                                    : DEFAULT_BLOCK_PERIOD_US;
+	const unsigned int count = (fields & AF_COUNT) ? info.count
+	                                               : DEFAULT_BLOCK_COUNT;
+	if (fields & AF_INTERVAL) {
+		// periodic measurement
+		if (!!dh_adc_block_loop(info.interval, period_us, count, info.raw,
+		                        (fields & AF_LOW) ? info.low : -1.0f,
+		                        (fields & AF_HIGH) ? info.high : -1.0f)) {
+			dh_command_fail(cmd_res, "Wrong parameters");
+		} else {
+			dh_command_done(cmd_res, "");
+		}
+		return;
+	} else if (fields & (AF_LOW | AF_HIGH)) {
+		dh_command_fail(cmd_res, "Thresholds require interval");
+		return; // FAILED
+	}
+
+	// single block
+	DHAdcBlock block;
+	if (!!dh_adc_block_read(&block, period_us, count, info.raw)) {
+		dh_command_fail(cmd_res, "Wrong parameters");
+	} else {
+		cmd_res->callback(cmd_res->data, DHSTATUS_OK, RDT_ADC_BLOCK, &block);
+	}
+}
+
+
+
+/*
+ * dh_handle_adc_spectrum() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_handle_adc_spectrum(COMMAND_RESULT *cmd_res, const char *command,
+                                              const char *params, unsigned int params_len)
+{
+	gpio_command_params info;
+	ALLOWED_FIELDS fields = 0;
+	const char *err_msg = parse_params_pins_set(params, params_len,
+			&info, DH_ADC_SUITABLE_PINS, 0,
+			AF_PERIOD | AF_COUNT | AF_PEAKS | AF_BINS, &fields);
+
+	if (err_msg != 0) {
+		dh_command_fail(cmd_res, err_msg);
+		return; // FAILED
+	}
+
+	const unsigned int period_us = (fields & AF_PERIOD) ? info.periodus
+	                                                    : DEFAULT_SPECTRUM_PERIOD_US;
+	const unsigned int count = (fields & AF_COUNT) ? info.count
+	                                               : DEFAULT_SPECTRUM_COUNT;
+	const unsigned int peaks = (fields & AF_PEAKS) ? info.peaks
+	                                               : DEFAULT_SPECTRUM_PEAKS;
+	const unsigned int bins = (fields & AF_BINS) ? info.bins : 0;
+	if ((fields & AF_PEAKS) && (fields & AF_BINS)) {
+		dh_command_fail(cmd_res, "Only one of peaks and bins can be used");
+		return; // FAILED
+	} else if (!fft_check_size(count) || peaks == 0 || peaks > FFT_MAX_PEAKS
+	        || bins > FFT_MAX_BINS || bins > count / 2) {
+		dh_command_fail(cmd_res, "Wrong parameters");
+		return; // FAILED
+	}
+
+	// samples followed by imaginary part
+	int16_t *samples = (int16_t *)os_malloc(2 * count * sizeof(int16_t));
+	if (!samples) {
+		dh_command_fail(cmd_res, "Out of memory");
+		return; // FAILED
+	}
+	char *json = (char *)os_malloc(SPECTRUM_JSON_LENGTH);
+	if (!json) {
+		os_free(samples);
+		dh_command_fail(cmd_res, "Out of memory");
+		return; // FAILED
+	}
+
+	uint32_t duration;
+	if (!!dh_adc_capture(samples, period_us, count, &duration)) {
+		os_free(json);
+		os_free(samples);
+		dh_command_fail(cmd_res, "Wrong parameters");
+		return; // FAILED
+	}
+
+	// real sampling rate is a bit lower because of busy loop
+	const float rate = duration ? (count - 1) * 1000000.0f / duration
+	                            : 1000000.0f / period_us;
+	int len = snprintf(json, SPECTRUM_JSON_LENGTH,
+			"{\"count\":%u, \"frequency\":%f, \"resolution\":%f, ",
+			count, rate, rate / count);
+	len += fft_spectrum_json(&json[len], SPECTRUM_JSON_LENGTH - len,
+			samples, &samples[count], count, rate / count,
+			1.0f / 1024.0f, peaks, bins);
+	len += snprintf(&json[len], SPECTRUM_JSON_LENGTH - len, "}");
+	os_free(samples);
+
+	cmd_res->callback(cmd_res->data, DHSTATUS_OK,
+	                  RDT_JSON_MALLOC_PTR, json, len);
+}
+
 #endif /* DH_COMMANDS_ADC */
@@ -24,5 +24,19 @@ void dh_handle_adc_read(COMMAND_RESULT *cmd_res, const char *command,
 void dh_handle_adc_int(COMMAND_RESULT *cmd_res, const char *command,
                        const char *params, unsigned int params_len);
 
+
+/**
+ * @brief Handle "adc/block" command.
+ */
+void dh_handle_adc_block(COMMAND_RESULT *cmd_res, const char *command,
+                         const char *params, unsigned int params_len);
+
+
+/**
+ * @brief Handle "adc/spectrum" command.
+ */
+void dh_handle_adc_spectrum(COMMAND_RESULT *cmd_res, const char *command,
+                            const char *params, unsigned int params_len);
+
 #endif /* DH_COMMANDS_ADC */
 #endif /* _COMMANDS_ADC_CMD_H_ */
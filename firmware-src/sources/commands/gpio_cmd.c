@@ -6,6 +6,7 @@
  */
 #include "commands/gpio_cmd.h"
 #include "DH/gpio.h"
+#include "DH/pwm.h"
 
 #ifdef DH_COMMANDS_GPIO // GPIO command handlers
 #include "dhcommand_parser.h"
@@ -91,7 +92,7 @@ void ICACHE_FLASH_ATTR dh_handle_gpio_int(COMMAND_RESULT *cmd_res, const char *c
 	ALLOWED_FIELDS fields = 0;
 	const char *err_msg = parse_params_pins_set(params, params_len,
 			&info, DH_GPIO_SUITABLE_PINS, dh_gpio_get_timeout(),
-			AF_DISABLE | AF_RISING | AF_FALLING | AF_BOTH | AF_TIMEOUT, &fields);
+			AF_DISABLE | AF_RISING | AF_FALLING | AF_BOTH | AF_TIMEOUT | AF_EDGES, &fields);
 
 	if (err_msg != 0) {
 		dh_command_fail(cmd_res, err_msg);
@@ -105,6 +106,192 @@ void ICACHE_FLASH_ATTR dh_handle_gpio_int(COMMAND_RESULT *cmd_res, const char *c
 	                                   info.pins_to_both,
 	                                   info.timeout)) {
 		dh_command_fail(cmd_res, "Unsuitable pin");
+	} else {
+		if (fields & AF_EDGES)
+			dh_gpio_set_edges_encoding((DHGpioEdgesEncoding)info.edges);
+		dh_command_done(cmd_res, "");
+	}
+}
+
+
+/*
+ * dh_handle_gpio_debounce() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_handle_gpio_debounce(COMMAND_RESULT *cmd_res, const char *command,
+                                               const char *params, unsigned int params_len)
+{
+	gpio_command_params info;
+	ALLOWED_FIELDS fields = 0;
+	const char *err_msg = parse_params_pins_set(params, params_len,
+			&info, DH_GPIO_SUITABLE_PINS, 0, AF_VALUES, &fields);
+
+	if (err_msg != 0) {
+		dh_command_fail(cmd_res, err_msg);
+		return; // FAILED
+	} else if (fields == 0) {
+		dh_command_fail(cmd_res, "Wrong action");
+		return; // FAILED
+	}
+
+	int i;
+	for (i = 0; i < DH_GPIO_PIN_COUNT; ++i) {
+		const DHGpioPinMask pin = DH_GPIO_PIN(i);
+		if (!(info.pin_value_readed & pin))
+			continue;
+		if (!!dh_gpio_debounce(pin, info.storage.uint_values[i])) {
+			dh_command_fail(cmd_res, "Unsuitable pin or time out of range");
+			return; // FAILED
+		}
+	}
+
+	dh_command_done(cmd_res, "");
+}
+
+
+/*
+ * dh_handle_gpio_counter() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_handle_gpio_counter(COMMAND_RESULT *cmd_res, const char *command,
+                                              const char *params, unsigned int params_len)
+{
+	gpio_command_params info;
+	ALLOWED_FIELDS fields = 0;
+	const char *err_msg = parse_params_pins_set(params, params_len,
+			&info, DH_GPIO_SUITABLE_PINS, 0,
+			AF_DISABLE | AF_RISING | AF_FALLING | AF_BOTH | AF_INTERVAL | AF_GLITCH, &fields);
+	if (!(fields & AF_INTERVAL))
+		info.interval = dh_gpio_get_counter_interval();
+
+	if (err_msg != 0) {
+		dh_command_fail(cmd_res, err_msg);
+	} else if (fields == 0) {
+		dh_command_fail(cmd_res, "Wrong action");
+	} else if (info.interval && (info.interval < MIN_TIMEOUT_MS || info.interval > MAX_TIMEOUT_MS)) {
+		dh_command_fail(cmd_res, "Interval out of range");
+	} else if (!!dh_gpio_subscribe_counter(info.pins_to_disable,
+	                                       info.pins_to_rising,
+	                                       info.pins_to_falling,
+	                                       info.pins_to_both,
+	                                       info.glitch)) {
+		dh_command_fail(cmd_res, "Unsuitable pin or glitch time");
+	} else {
+		if (fields & AF_INTERVAL)
+			dh_gpio_set_counter_interval(info.interval);
+		dh_command_done(cmd_res, "");
+	}
+}
+
+
+/*
+ * dh_handle_gpio_counter_read() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_handle_gpio_counter_read(COMMAND_RESULT *cmd_res, const char *command,
+                                                   const char *params, unsigned int params_len)
+{
+	if (params_len) {
+		dh_command_fail(cmd_res, "Command does not have parameters");
+		return; // FAILED
+	}
+
+	DHGpioCounters counters;
+	dh_gpio_read_counters(&counters);
+	cmd_res->callback(cmd_res->data, DHSTATUS_OK, RDT_GPIO_COUNTERS, &counters);
+}
+
+
+/*
+ * dh_handle_gpio_encoder() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_handle_gpio_encoder(COMMAND_RESULT *cmd_res, const char *command,
+                                              const char *params, unsigned int params_len)
+{
+	gpio_command_params info;
+	ALLOWED_FIELDS fields = 0;
+	const char *err_msg = parse_params_pins_set(params, params_len,
+			&info, DH_GPIO_SUITABLE_PINS, 0,
+			AF_DISABLE | AF_A | AF_B | AF_DELTA, &fields);
+
+	if (err_msg != 0) {
+		dh_command_fail(cmd_res, err_msg);
+		return; // FAILED
+	} else if (fields == 0) {
+		dh_command_fail(cmd_res, "Wrong action");
+		return; // FAILED
+	}
+
+	if (fields & AF_DISABLE)
+		dh_gpio_encoder_disable(info.pins_to_disable);
+
+	if (fields & (AF_A | AF_B | AF_DELTA)) {
+		if ((fields & (AF_A | AF_B)) != (AF_A | AF_B)) {
+			dh_command_fail(cmd_res, "Both a and b pins should be specified");
+			return; // FAILED
+		}
+		const int r = dh_gpio_encoder_enable(info.a, info.b, info.delta);
+		if (r == -1) {
+			dh_command_fail(cmd_res, "Unsuitable pin");
+			return; // FAILED
+		} else if (r != 0) {
+			dh_command_fail(cmd_res, "Too many encoders");
+			return; // FAILED
+		}
+	}
+
+	dh_command_done(cmd_res, "");
+}
+
+
+/*
+ * dh_handle_gpio_encoder_read() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_handle_gpio_encoder_read(COMMAND_RESULT *cmd_res, const char *command,
+                                                   const char *params, unsigned int params_len)
+{
+	if (params_len) {
+		dh_command_fail(cmd_res, "Command does not have parameters");
+		return; // FAILED
+	}
+
+	DHGpioEncoders encoders;
+	dh_gpio_read_encoders(&encoders);
+	cmd_res->callback(cmd_res->data, DHSTATUS_OK, RDT_GPIO_ENCODERS, &encoders);
+}
+
+
+/*
+ * dh_handle_gpio_sequence() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_handle_gpio_sequence(COMMAND_RESULT *cmd_res, const char *command,
+                                               const char *params, unsigned int params_len)
+{
+	gpio_command_params info;
+	ALLOWED_FIELDS fields = 0;
+	const char *err_msg = parse_params_pins_set(params, params_len,
+			&info, DH_GPIO_SUITABLE_PINS, 0,
+			AF_DATA | AF_COUNT, &fields);
+
+	if (err_msg != 0) {
+		dh_command_fail(cmd_res, err_msg);
+		return; // FAILED
+	} else if (!(fields & AF_DATA)) {
+		if (fields & AF_COUNT) {
+			dh_command_fail(cmd_res, "No data");
+			return; // FAILED
+		}
+		dh_pwm_sequence_stop();
+		dh_command_done(cmd_res, "");
+		return;
+	} else if (info.data_len % DH_PWM_SEQUENCE_STEP_SIZE) {
+		dh_command_fail(cmd_res, "Data length should be multiple of step size");
+		return; // FAILED
+	}
+
+	const int r = dh_pwm_sequence_start(info.data,
+			info.data_len / DH_PWM_SEQUENCE_STEP_SIZE, info.count);
+	if (r == -1) {
+		dh_command_fail(cmd_res, "Unsuitable pin");
+	} else if (r != 0) {
+		dh_command_fail(cmd_res, "Wrong steps");
 	} else {
 		dh_command_done(cmd_res, "");
 	}
@@ -31,5 +31,47 @@ void dh_handle_gpio_read(COMMAND_RESULT *cmd_res, const char *command,
 void dh_handle_gpio_int(COMMAND_RESULT *cmd_res, const char *command,
                         const char *params, unsigned int params_len);
 
+
+/**
+ * @brief Handle "gpio/debounce" command.
+ */
+void dh_handle_gpio_debounce(COMMAND_RESULT *cmd_res, const char *command,
+                             const char *params, unsigned int params_len);
+
+
+/**
+ * @brief Handle "gpio/counter" command.
+ */
+void dh_handle_gpio_counter(COMMAND_RESULT *cmd_res, const char *command,
+                            const char *params, unsigned int params_len);
+
+
+/**
+ * @brief Handle "gpio/counter/read" command.
+ */
+void dh_handle_gpio_counter_read(COMMAND_RESULT *cmd_res, const char *command,
+                                 const char *params, unsigned int params_len);
+
+
+/**
+ * @brief Handle "gpio/encoder" command.
+ */
+void dh_handle_gpio_encoder(COMMAND_RESULT *cmd_res, const char *command,
+                            const char *params, unsigned int params_len);
+
+
+/**
+ * @brief Handle "gpio/encoder/read" command.
+ */
+void dh_handle_gpio_encoder_read(COMMAND_RESULT *cmd_res, const char *command,
+                                 const char *params, unsigned int params_len);
+
+
+/**
+ * @brief Handle "gpio/sequence" command.
+ */
+void dh_handle_gpio_sequence(COMMAND_RESULT *cmd_res, const char *command,
+                             const char *params, unsigned int params_len);
+
 #endif /* DH_COMMANDS_GPIO */
 #endif /* _COMMANDS_GPIO_CMD_H_ */
@@ -11,10 +11,44 @@
 #include "DH/adc.h"
 
 #include "dhcommand_parser.h"
+#include "snprintf.h"
+#include "fft.h"
 #include <user_interface.h>
+#include <osapi.h>
+#include <mem.h>
 
 #if defined(DH_COMMANDS_MPU6050) && defined(DH_DEVICE_MPU6050)
 
+/**
+ * Maximum number of samples for spectrum.
+ */
+#define SPECTRUM_MAX_COUNT 64
+
+
+/**
+ * Maximum spectrum capture time, microseconds.
+ */
+#define SPECTRUM_MAX_US DH_ADC_CAPTURE_MAX_US
+
+
+/**
+ * Default number of samples for spectrum.
+ */
+#define DEFAULT_SPECTRUM_COUNT 64
+
+
+/**
+ * Default number of spectrum peaks.
+ */
+#define DEFAULT_SPECTRUM_PEAKS 5
+
+
+/**
+ * Spectrum response buffer length.
+ */
+#define SPECTRUM_JSON_LENGTH (3 * (FFT_JSON_MAX_LENGTH + 8) + 64)
+
+
 /*
  * dh_handle_devices_mpu6050_read() implementation.
  */
@@ -53,4 +87,98 @@ void ICACHE_FLASH_ATTR dh_handle_devices_mpu6050_read(COMMAND_RESULT *cmd_res, c
 	}
 }
 
+
+
+/*
+ * dh_handle_devices_mpu6050_spectrum() implementation.
+ */
+void ICACHE_FLASH_ATTR dh_handle_devices_mpu6050_spectrum(COMMAND_RESULT *cmd_res, const char *command,
+                                                          const char *params, unsigned int params_len)
+{
+	gpio_command_params info;
+	ALLOWED_FIELDS fields = 0;
+	if (params_len) {
+		const char* err_msg = parse_params_pins_set(params, params_len,
+				&info, DH_ADC_SUITABLE_PINS, 0,
+				AF_SDA | AF_SCL | AF_ADDRESS | AF_PERIOD | AF_COUNT
+				| AF_PEAKS | AF_BINS, &fields);
+		if (err_msg != 0) {
+			dh_command_fail(cmd_res, err_msg);
+			return; // FAILED
+		}
+		if (fields & AF_ADDRESS)
+			mpu6050_set_address(info.address);
+	}
+
+	const unsigned int period_us = (fields & AF_PERIOD) ? info.periodus
+	                                                    : MPU6050_CAPTURE_MIN_PERIOD_US;
+	const unsigned int count = (fields & AF_COUNT) ? info.count
+	                                               : DEFAULT_SPECTRUM_COUNT;
+	const unsigned int peaks = (fields & AF_PEAKS) ? info.peaks
+	                                               : DEFAULT_SPECTRUM_PEAKS;
+	const unsigned int bins = (fields & AF_BINS) ? info.bins : 0;
+	if ((fields & AF_PEAKS) && (fields & AF_BINS)) {
+		dh_command_fail(cmd_res, "Only one of peaks and bins can be used");
+		return; // FAILED
+	} else if (!fft_check_size(count) || count > SPECTRUM_MAX_COUNT
+	        || period_us < MPU6050_CAPTURE_MIN_PERIOD_US
+	        || (count - 1) * period_us > SPECTRUM_MAX_US
+	        || peaks == 0 || peaks > FFT_MAX_PEAKS
+	        || bins > FFT_MAX_BINS || bins > count / 2) {
+		dh_command_fail(cmd_res, "Wrong parameters");
+		return; // FAILED
+	}
+
+	fields |= AF_ADDRESS;
+	if (dh_i2c_init_helper(cmd_res, fields, &info))
+		return; // FAILED
+
+	// X, Y, Z samples followed by imaginary part
+	int16_t *samples = (int16_t *)os_malloc(4 * count * sizeof(int16_t));
+	if (!samples) {
+		dh_command_fail(cmd_res, "Out of memory");
+		return; // FAILED
+	}
+	char *json = (char *)os_malloc(SPECTRUM_JSON_LENGTH);
+	if (!json) {
+		os_free(samples);
+		dh_command_fail(cmd_res, "Out of memory");
+		return; // FAILED
+	}
+
+	uint32_t duration;
+	const int status = mpu6050_capture(DH_I2C_NO_PIN, DH_I2C_NO_PIN,
+			samples, &samples[count], &samples[2 * count],
+			count, period_us, &duration);
+	const char *err_msg = dh_i2c_error_string(status);
+	if (err_msg != 0) {
+		os_free(json);
+		os_free(samples);
+		dh_command_fail(cmd_res, err_msg);
+		return; // FAILED
+	}
+
+	// real sampling rate is a bit lower because of busy loop
+	const float rate = duration ? (count - 1) * 1000000.0f / duration
+	                            : 1000000.0f / period_us;
+	int len = snprintf(json, SPECTRUM_JSON_LENGTH,
+			"{\"count\":%u, \"frequency\":%f, \"resolution\":%f",
+			count, rate, rate / count);
+	static const char axes[] = "XYZ";
+	unsigned int i;
+	for (i = 0; i < 3; i++) {
+		len += snprintf(&json[len], SPECTRUM_JSON_LENGTH - len,
+				", \"%c\":{", axes[i]);
+		len += fft_spectrum_json(&json[len], SPECTRUM_JSON_LENGTH - len,
+				&samples[i * count], &samples[3 * count], count,
+				rate / count, MPU6050_ACCELERATION_UNIT, peaks, bins);
+		len += snprintf(&json[len], SPECTRUM_JSON_LENGTH - len, "}");
+	}
+	len += snprintf(&json[len], SPECTRUM_JSON_LENGTH - len, "}");
+	os_free(samples);
+
+	cmd_res->callback(cmd_res->data, DHSTATUS_OK,
+	                  RDT_JSON_MALLOC_PTR, json, len);
+}
+
 #endif /* DH_COMMANDS_MPU6050 && DH_DEVICE_MPU6050 */
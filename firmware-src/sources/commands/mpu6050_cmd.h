@@ -17,5 +17,12 @@
 void dh_handle_devices_mpu6050_read(COMMAND_RESULT *cmd_res, const char *command,
                                     const char *params, unsigned int params_len);
 
+
+/**
+ * @brief Handle "devices/mpu6050/spectrum" command.
+ */
+void dh_handle_devices_mpu6050_spectrum(COMMAND_RESULT *cmd_res, const char *command,
+                                        const char *params, unsigned int params_len);
+
 #endif /* DH_COMMANDS_MPU6050 && DH_DEVICE_MPU6050 */
 #endif /* _COMMANDS_MPU6050_CMD_H_ */
@@ -22,11 +22,11 @@ void ICACHE_FLASH_ATTR dh_handle_pwm_control(COMMAND_RESULT *cmd_res, const char
 	ALLOWED_FIELDS fields = 0;
 	const char *err_msg = parse_params_pins_set(params, params_len,
 			&info, DH_GPIO_SUITABLE_PINS, 0,
-			AF_VALUES | AF_PERIOD | AF_COUNT, &fields);
+			AF_FLOATVALUES | AF_PERIOD | AF_COUNT, &fields);
 
 	if (err_msg != 0) {
 		dh_command_fail(cmd_res, err_msg);
-	} else if (!!dh_pwm_start(info.storage.uint_values,
+	} else if (!!dh_pwm_start(info.storage.float_values,
 	                          info.pin_value_readed,
 	                          (fields & AF_PERIOD) ? info.periodus
 	                                               : dh_pwm_get_period_us(),
@@ -89,12 +89,17 @@ static const uint32_t crc32_tab[] DH_RO_ATTR = {
 	0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
-uint32_t crc32(const void *buf, size_t size)
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t size)
 {
-	uint32_t crc = 0xFFFFFFFF;
 	const uint8_t *p = buf;
+	crc = ~crc;
 	while (size--)
 		crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
 
 	return ~crc;
 }
+
+uint32_t crc32(const void *buf, size_t size)
+{
+	return crc32_update(0, buf, size);
+}
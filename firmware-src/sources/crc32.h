@@ -19,4 +19,13 @@
  */
 uint32_t crc32(const void *buf, size_t size);
 
+/**
+ *	\brief				Continue CRC32 calculation with the next piece of data.
+ *	\param[in]	crc		CRC32 of previous data, zero for the first piece.
+ *	\param[in]	buf		Point to data.
+ *	\param[in]	size	Data size in bytes.
+ *	\return 			CRC32 value of all data.
+ */
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t size);
+
 #endif /* _CRC32_H_ */
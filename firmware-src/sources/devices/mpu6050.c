@@ -10,6 +10,7 @@
 #include "dhutils.h"
 
 #include <osapi.h>
+#include <user_interface.h>
 
 #if defined(DH_DEVICE_MPU6050)
 
@@ -94,6 +95,90 @@ int ICACHE_FLASH_ATTR mpu6050_read(int sda, int scl, MPU6050_XYZ *acceleromter,
 }
 
 
+/*
+ * mpu6050_capture() implementation.
+ */
+int ICACHE_FLASH_ATTR mpu6050_capture(int sda, int scl, int16_t *x, int16_t *y, int16_t *z,
+                                      unsigned int count, unsigned int period_us, uint32_t *duration)
+{
+	// accelerometer bandwidth for DLPF_CFG values, Hz
+	static const uint16_t bandwidth[] = {260, 184, 94, 44, 21, 10, 5};
+	int status;
+	if (sda != DH_I2C_NO_PIN && scl != DH_I2C_NO_PIN) {
+		if ((status = dh_i2c_init(sda, scl)) != DH_I2C_OK) {
+			dhdebug("mpu6050: failed to set up pins");
+			return status;
+		}
+	}
+
+	uint8_t buf[6];
+	buf[0] = 0x6B; // power up
+	buf[1] = 0; // no sleep bit
+	if ((status = dh_i2c_write(mAddress, buf, 2, 1)) != DH_I2C_OK) {
+		dhdebug("mpu6050: failed to power up");
+		return status;
+	}
+
+	buf[0] = 0x1C; // accelerometer configuration
+	buf[1] = BIT(4); // AFS_SEL = 2, range +-8 g
+	if ((status = dh_i2c_write(mAddress, buf, 2, 1)) != DH_I2C_OK) {
+		dhdebug("mpu6050: failed to configure accelerometer");
+		return status;
+	}
+
+	unsigned int dlpf = 0;
+	while (dlpf + 1 < sizeof(bandwidth) / sizeof(bandwidth[0])
+	    && bandwidth[dlpf] * period_us > 500000)
+		dlpf++;
+	buf[0] = 0x1A; // configuration
+	buf[1] = dlpf; // DLPF_CFG
+	if ((status = dh_i2c_write(mAddress, buf, 2, 1)) != DH_I2C_OK) {
+		dhdebug("mpu6050: failed to configure filter");
+		return status;
+	}
+
+	delay_ms(50);
+
+	unsigned int i;
+	const uint32_t start = system_get_time();
+	uint32_t next = start;
+	uint32_t last = start;
+	for (i = 0; i < count; i++) {
+		if (i) {
+			next += period_us;
+			while ((int32_t)(system_get_time() - next) < 0)
+				continue;
+		}
+		last = system_get_time();
+		buf[0] = 0x3B; // get accelerometer data
+		if ((status = dh_i2c_write(mAddress, buf, 1, 0)) != DH_I2C_OK) {
+			dhdebug("mpu6050: failed to set read register");
+			return status;
+		}
+		if ((status = dh_i2c_read(mAddress, buf, 6)) != DH_I2C_OK) {
+			dhdebug("mpu6050: failed to read");
+			return status;
+		}
+		x[i] = signedInt16be((const char*)buf, 0);
+		y[i] = signedInt16be((const char*)buf, 2);
+		z[i] = signedInt16be((const char*)buf, 4);
+	}
+	*duration = last - start;
+
+	buf[0] = 0x1A; // restore default filter
+	buf[1] = 0;
+	buf[2] = 0x6B; // power down
+	buf[3] = 1 << 6; // sleep bit
+	if ((status = dh_i2c_write(mAddress, buf, 2, 1)) != DH_I2C_OK
+	 || (status = dh_i2c_write(mAddress, &buf[2], 2, 1)) != DH_I2C_OK) {
+		dhdebug("mpu6050: failed to power down");
+		return status;
+	}
+
+	return DH_I2C_OK;
+}
+
+
 /*
  * mpu6050_set_address() implementation.
  */
@@ -9,6 +9,13 @@
 
 #include "user_config.h"
 #if defined(DH_DEVICE_MPU6050)
+#include <c_types.h>
+
+/** @brief Value of raw accelerometer unit in metre per second squared. */
+#define MPU6050_ACCELERATION_UNIT (8.0f * 9.80665f / 32768.0f)
+
+/** @brief Minimum capture period in microseconds, sensor output rate is 1kHz. */
+#define MPU6050_CAPTURE_MIN_PERIOD_US 1000
 
 /** @brief Measurements in three dimensions. */
 typedef struct {
@@ -30,6 +37,25 @@ typedef struct {
 int mpu6050_read(int sda, int scl, MPU6050_XYZ *acceleromter, MPU6050_XYZ *gyroscope, float *temparature);
 
 
+/**
+ * @brief Capture accelerometer samples.
+ *
+ * Sensor's low pass filter is set below half of sampling rate while capturing.
+ *
+ * @param[in] sda Pin for I2C's SDA. Can be DH_I2C_NO_PIN.
+ * @param[in] scl Pin for I2C's SCL.  Can be DH_I2C_NO_PIN.
+ * @param[out] x X axis raw samples, see MPU6050_ACCELERATION_UNIT.
+ * @param[out] y Y axis raw samples.
+ * @param[out] z Z axis raw samples.
+ * @param[in] count Number of samples.
+ * @param[in] period_us Sampling period in microseconds.
+ * @param[out] duration Time between the first and the last samples, microseconds.
+ * @return Status value, one of DH_I2C_Status enum.
+ */
+int mpu6050_capture(int sda, int scl, int16_t *x, int16_t *y, int16_t *z,
+                    unsigned int count, unsigned int period_us, uint32_t *duration);
+
+
 /**
  * @brief Set sensor address which should be used while reading.
  * @param[in] address I2C end device address.
@@ -207,6 +207,72 @@ char * ICACHE_FLASH_ATTR parse_params_pins_set(const char *params, unsigned int
 				if(res)
 					return res;
 				continue;
+			} else if(strcmp_value(&jparser, "interval") == 0) {
+				char * res = readUIntField(&jparser, AF_INTERVAL, &out->interval, fields, readedfields, 0);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "glitch") == 0) {
+				char * res = readUIntField(&jparser, AF_GLITCH, &out->glitch, fields, readedfields, 0);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "a") == 0) {
+				char * res = readUIntField(&jparser, AF_A, &out->a, fields, readedfields, 0);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "b") == 0) {
+				char * res = readUIntField(&jparser, AF_B, &out->b, fields, readedfields, 0);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "delta") == 0) {
+				char * res = readUIntField(&jparser, AF_DELTA, &out->delta, fields, readedfields, 0);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "low") == 0) {
+				char * res = readFloatField(&jparser, AF_LOW, &out->low, fields, readedfields);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "high") == 0) {
+				char * res = readFloatField(&jparser, AF_HIGH, &out->high, fields, readedfields);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "raw") == 0) {
+				char * res = readUIntField(&jparser, AF_RAW, &out->raw, fields, readedfields, 0);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "peaks") == 0) {
+				char * res = readUIntField(&jparser, AF_PEAKS, &out->peaks, fields, readedfields, 0);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "bins") == 0) {
+				char * res = readUIntField(&jparser, AF_BINS, &out->bins, fields, readedfields, 0);
+				if(res)
+					return res;
+				continue;
+			} else if(strcmp_value(&jparser, "edges") == 0) {
+				if((fields & AF_EDGES) == 0)
+					return UNEXPECTED;
+				jsonparse_next(&jparser);
+				if(jsonparse_next(&jparser) != JSON_TYPE_ERROR) {
+					if(strcmp_value(&jparser, "none") == 0)
+						out->edges = DH_GPIO_EDGES_NONE;
+					else if(strcmp_value(&jparser, "list") == 0)
+						out->edges = DH_GPIO_EDGES_LIST;
+					else if(strcmp_value(&jparser, "packed") == 0)
+						out->edges = DH_GPIO_EDGES_PACKED;
+					else
+						return "Wrong edges value";
+					*readedfields |= AF_EDGES;
+				}
+				continue;
 			} else if(strcmp_value(&jparser, "data") == 0) {
 				if((fields & AF_DATA) == 0 || out->data_len)
 					return UNEXPECTED;
@@ -52,38 +52,59 @@ typedef struct {
 	uint32_t CS;									///< CS field value.
 	uint32_t pin;									///< pin field value
 	float ref;									///< ref field value
+	uint8_t edges;								///< edges field value, DHGpioEdgesEncoding
+	uint32_t interval;								///< interval field value.
+	uint32_t glitch;								///< glitch field value.
+	uint32_t a;										///< a field value.
+	uint32_t b;										///< b field value.
+	uint32_t delta;									///< delta field value.
+	float low;										///< low field value.
+	float high;										///< high field value.
+	uint32_t raw;									///< raw field value.
+	uint32_t peaks;									///< peaks field value.
+	uint32_t bins;									///< bins field value.
 } gpio_command_params;
 
-/** Flag based enum with available parameters fields. */
-typedef enum {
-	AF_SET = 0x01,			///< Read pins with 1 value.
-	AF_CLEAR = 0x02,		///< Read pins with 0 value.
-	AF_INIT = 0x04,			///< Read pins with init value.
-	AF_PULLUP = 0x08,		///< Read pins with pullup value.
-	AF_NOPULLUP = 0x10,		///< Read pins with nopullup value.
-	AF_DISABLE = 0x20,		///< Read pins with disable value.
-	AF_RISING = 0x40,		///< Read pins with rising value.
-	AF_FALLING = 0x80,		///< Read pins with falling value.
-	AF_BOTH = 0x100,		///< Read pins with both value.
-	AF_READ = 0x200,		///< Read pins with read value.
-	AF_PRESENCE = 0x400,	///< Read pins with presence value.
-	AF_PERIOD = 0x800,		///< Read frequency field.
-	AF_COUNT = 0x1000,		///< Read count field.
-	AF_VALUES = 0x2000,		///< Read pins values.
-	AF_FLOATVALUES = 0x4000,///< Read pins values.
-	AF_UARTMODE = 0x8000,	///< Read mode field for UART.
-	AF_DATA = 0x10000,		///< Read data field.
-	AF_TEXT_DATA = 0x20000,	///< Read text field and store as data.
-	AF_TIMEOUT = 0x40000,	///< Read timeout field.
-	AF_ADDRESS = 0x80000,	///< Read address field.
-	AF_SDA = 0x100000,		///< Read SDA field.
-	AF_SCL = 0x200000,		///< Read SCL field.
-	AF_SPIMODE = 0x400000,	///< Read mode field for SPI.
-	AF_CS = 0x800000,		///< Read CS field.
-	AF_PIN = 0x1000000,		///< Read pin field.
-	AF_REF = 0x2000000,		///< Read ref field.
-	AF_KEY = 0x4000000,		///< Read key field.
-} ALLOWED_FIELDS;
+/** Flag based set of available parameters fields. */
+typedef uint64_t ALLOWED_FIELDS;
+#define AF_SET 0x01ULL				///< Read pins with 1 value.
+#define AF_CLEAR 0x02ULL			///< Read pins with 0 value.
+#define AF_INIT 0x04ULL				///< Read pins with init value.
+#define AF_PULLUP 0x08ULL			///< Read pins with pullup value.
+#define AF_NOPULLUP 0x10ULL			///< Read pins with nopullup value.
+#define AF_DISABLE 0x20ULL			///< Read pins with disable value.
+#define AF_RISING 0x40ULL			///< Read pins with rising value.
+#define AF_FALLING 0x80ULL			///< Read pins with falling value.
+#define AF_BOTH 0x100ULL			///< Read pins with both value.
+#define AF_READ 0x200ULL			///< Read pins with read value.
+#define AF_PRESENCE 0x400ULL		///< Read pins with presence value.
+#define AF_PERIOD 0x800ULL			///< Read frequency field.
+#define AF_COUNT 0x1000ULL			///< Read count field.
+#define AF_VALUES 0x2000ULL			///< Read pins values.
+#define AF_FLOATVALUES 0x4000ULL	///< Read pins values.
+#define AF_UARTMODE 0x8000ULL		///< Read mode field for UART.
+#define AF_DATA 0x10000ULL			///< Read data field.
+#define AF_TEXT_DATA 0x20000ULL		///< Read text field and store as data.
+#define AF_TIMEOUT 0x40000ULL		///< Read timeout field.
+#define AF_ADDRESS 0x80000ULL		///< Read address field.
+#define AF_SDA 0x100000ULL			///< Read SDA field.
+#define AF_SCL 0x200000ULL			///< Read SCL field.
+#define AF_SPIMODE 0x400000ULL		///< Read mode field for SPI.
+#define AF_CS 0x800000ULL			///< Read CS field.
+#define AF_PIN 0x1000000ULL			///< Read pin field.
+#define AF_REF 0x2000000ULL			///< Read ref field.
+#define AF_KEY 0x4000000ULL			///< Read key field.
+#define AF_EDGES 0x8000000ULL		///< Read edges field.
+#define AF_INTERVAL 0x10000000ULL	///< Read interval field.
+#define AF_GLITCH 0x20000000ULL		///< Read glitch field.
+#define AF_A 0x40000000ULL			///< Read a field.
+#define AF_B 0x80000000ULL			///< Read b field.
+#define AF_DELTA 0x100000000ULL		///< Read delta field.
+#define AF_LOW 0x200000000ULL		///< Read low field.
+#define AF_HIGH 0x400000000ULL		///< Read high field.
+#define AF_RAW 0x800000000ULL		///< Read raw field.
+#define AF_PEAKS 0x1000000000ULL	///< Read peaks field.
+#define AF_BINS 0x2000000000ULL		///< Read bins field.
 
 /**
  *	\brief						Handle remote command.
@@ -52,63 +52,32 @@ static void do_handle_command_list(COMMAND_RESULT *cmd_res, const char *command,
                                    const char *params, unsigned int params_len);
 
 
+/**
+ * @brief Table of commands.
+ *
+ * Entries should be sorted by name in strcmp() order, command lookup uses binary search.
+ * Order is checked by firmware-tests/host/t_dhcommands.c.
+ */
 RO_DATA struct {
 	const char *name;
 	void (*func)(COMMAND_RESULT*, const char*, const char*, unsigned int);
 } g_command_table[] =
 {
-#if defined(DH_COMMANDS_GPIO)
-	{"gpio/write", dh_handle_gpio_write},
-	{"gpio/read", dh_handle_gpio_read},
-	{"gpio/int", dh_handle_gpio_int},
-#endif /* DH_COMMANDS_GPIO */
-
 #if defined(DH_COMMANDS_ADC)
-	{"adc/read", dh_handle_adc_read},
+	{"adc/block", dh_handle_adc_block},
 	{"adc/int", dh_handle_adc_int},
+	{"adc/read", dh_handle_adc_read},
+	{"adc/spectrum", dh_handle_adc_spectrum},
 #endif /* DH_COMMANDS_ADC */
 
-#if defined(DH_COMMANDS_PWM)
-	{"pwm/control", dh_handle_pwm_control},
-#endif /* DH_COMMANDS_PWM */
-
-#if defined(DH_COMMANDS_UART)
-	{"uart/write", dh_handle_uart_write},
-	{"uart/read", dh_handle_uart_read},
-	{"uart/int", dh_handle_uart_int},
-	{"uart/terminal", dh_handle_uart_terminal},
-#endif /* DH_COMMANDS_UART */
-
-#if defined(DH_COMMANDS_I2C)
-	{ "i2c/master/read", dh_handle_i2c_master_read},
-	{ "i2c/master/write", dh_handle_i2c_master_write},
-#endif /* DH_COMMANDS_I2C */
-
-#if defined(DH_COMMANDS_SPI)
-	{ "spi/master/read", dh_handle_spi_master_read},
-	{ "spi/master/write", dh_handle_spi_master_write},
-#endif /* DH_COMMANDS_SPI */
-
-#if defined(DH_COMMANDS_ONEWIRE)
-	{ "onewire/master/read", dh_handle_onewire_master_read},
-	{ "onewire/master/write", dh_handle_onewire_master_write},
-	{ "onewire/master/search", dh_handle_onewire_master_search},
-	{ "onewire/master/alarm", dh_handle_onewire_master_search},
-	{ "onewire/master/int", dh_handle_onewire_master_int},
-	{ "onewire/dht/read", dh_handle_onewire_dht_read},
-	{ "onewire/ws2812b/write", dh_handle_onewire_ws2812b_write},
-#endif /* DH_COMMANDS_ONEWIRE */
-
-#if defined(DH_COMMANDS_DS18B20) && defined(DH_DEVICE_DS18B20)
-	{ "devices/ds18b20/read", dh_handle_devices_ds18b20_read},
-#endif
+	{ "command/list", do_handle_command_list },
 
-#if defined(DH_COMMANDS_DHT11) && defined(DH_DEVICE_DHT11)
-	{ "devices/dht11/read", dh_handle_devices_dht11_read},
+#if defined(DH_COMMANDS_ADS1115) && defined(DH_DEVICE_ADS1115)
+	{ "devices/ads1115/read", dh_handle_devices_ads1115_read},
 #endif
 
-#if defined(DH_COMMANDS_DHT22) && defined(DH_DEVICE_DHT22)
-	{ "devices/dht22/read", dh_handle_devices_dht22_read},
+#if defined(DH_COMMANDS_BH1750) && defined(DH_DEVICE_BH1750)
+	{ "devices/bh1750/read", dh_handle_devices_bh1750_read},
 #endif
 
 #if defined(DH_COMMANDS_BMP180) && defined(DH_DEVICE_BMP180)
@@ -119,83 +88,129 @@ RO_DATA struct {
 	{ "devices/bmp280/read", dh_handle_devices_bmp280_read},
 #endif
 
-#if defined(DH_COMMANDS_BH1750) && defined(DH_DEVICE_BH1750)
-	{ "devices/bh1750/read", dh_handle_devices_bh1750_read},
-#endif
-
-#if defined(DH_COMMANDS_MPU6050) && defined(DH_DEVICE_MPU6050)
-	{ "devices/mpu6050/read", dh_handle_devices_mpu6050_read},
+#if defined(DH_COMMANDS_DHT11) && defined(DH_DEVICE_DHT11)
+	{ "devices/dht11/read", dh_handle_devices_dht11_read},
 #endif
 
-#if defined(DH_COMMANDS_HMC5883L) && defined(DH_DEVICE_HMC5883L)
-	{ "devices/hmc5883l/read", dh_handle_devices_hmc5883l_read},
+#if defined(DH_COMMANDS_DHT22) && defined(DH_DEVICE_DHT22)
+	{ "devices/dht22/read", dh_handle_devices_dht22_read},
 #endif
 
-#if defined(DH_COMMANDS_PCF8574) && defined(DH_DEVICE_PCF8574)
-	{ "devices/pcf8574/read", dh_handle_devices_pcf8574_read},
-	{ "devices/pcf8574/write", dh_handle_devices_pcf8574_write},
+#if defined(DH_COMMANDS_DS18B20) && defined(DH_DEVICE_DS18B20)
+	{ "devices/ds18b20/read", dh_handle_devices_ds18b20_read},
 #endif
 
-#if defined(DH_COMMANDS_PCF8574_HD44780) && defined(DH_DEVICE_PCF8574_HD44780)
-	{ "devices/pcf8574/hd44780/write", dh_handle_devices_pcf8574_hd44780_write},
+#if defined(DH_COMMANDS_HMC5883L) && defined(DH_DEVICE_HMC5883L)
+	{ "devices/hmc5883l/read", dh_handle_devices_hmc5883l_read},
 #endif
 
-#if defined(DH_COMMANDS_MHZ19) && defined(DH_DEVICE_MHZ19)
-	{ "devices/mhz19/read", dh_handle_devices_mhz19_read},
+#if defined(DH_COMMANDS_INA219) && defined(DH_DEVICE_INA219)
+	{ "devices/ina219/read", dh_handle_devices_ina219_read},
 #endif
 
 #if defined(DH_COMMANDS_LM75) && defined(DH_DEVICE_LM75)
 	{ "devices/lm75/read", dh_handle_devices_lm75_read},
 #endif
 
-#if defined(DH_COMMANDS_SI7021) && defined(DH_DEVICE_SI7021)
-	{ "devices/si7021/read", dh_handle_devices_si7021_read},
-#endif
-
-#if defined(DH_COMMANDS_ADS1115) && defined(DH_DEVICE_ADS1115)
-	{ "devices/ads1115/read", dh_handle_devices_ads1115_read},
+#if defined(DH_COMMANDS_MAX31855) && defined(DH_DEVICE_MAX31855)
+	{ "devices/max31855/read", dh_handle_devices_max31855_read},
 #endif
 
-#if defined(DH_COMMANDS_PCF8591) && defined(DH_DEVICE_PCF8591)
-	{ "devices/pcf8591/read", dh_handle_devices_pcf8591_read},
-	{ "devices/pcf8591/write", dh_handle_devices_pcf8591_write},
+#if defined(DH_COMMANDS_MAX6675) && defined(DH_DEVICE_MAX6675)
+	{ "devices/max6675/read", dh_handle_devices_max6675_read},
 #endif
 
 #if defined(DH_COMMANDS_MCP4725) && defined(DH_DEVICE_MCP4725)
 	{ "devices/mcp4725/write", dh_handle_devices_mcp4725_write},
 #endif
 
-#if defined(DH_COMMANDS_INA219) && defined(DH_DEVICE_INA219)
-	{ "devices/ina219/read", dh_handle_devices_ina219_read},
-#endif
-
 #if defined(DH_COMMANDS_MFRC522) && defined(DH_DEVICE_MFRC522)
-	{ "devices/mfrc522/read", dh_handle_devices_mfrc522_read},
 	{ "devices/mfrc522/mifare/read", dh_handle_devices_mfrc522_mifare_read_write},
 	{ "devices/mfrc522/mifare/write", dh_handle_devices_mfrc522_mifare_read_write},
+	{ "devices/mfrc522/read", dh_handle_devices_mfrc522_read},
 #endif
 
-#if defined(DH_COMMANDS_PCA9685) && defined(DH_DEVICE_PCA9685)
-	{ "devices/pca9685/control", dh_handle_devices_pca9685_control},
+#if defined(DH_COMMANDS_MHZ19) && defined(DH_DEVICE_MHZ19)
+	{ "devices/mhz19/read", dh_handle_devices_mhz19_read},
 #endif
 
 #if defined(DH_COMMANDS_MLX90614) && defined(DH_DEVICE_MLX90614)
 	{ "devices/mlx90614/read", dh_handle_devices_mlx90614_read},
 #endif
 
-#if defined(DH_COMMANDS_MAX6675) && defined(DH_DEVICE_MAX6675)
-	{ "devices/max6675/read", dh_handle_devices_max6675_read},
+#if defined(DH_COMMANDS_MPU6050) && defined(DH_DEVICE_MPU6050)
+	{ "devices/mpu6050/read", dh_handle_devices_mpu6050_read},
+	{ "devices/mpu6050/spectrum", dh_handle_devices_mpu6050_spectrum},
 #endif
 
-#if defined(DH_COMMANDS_MAX31855) && defined(DH_DEVICE_MAX31855)
-	{ "devices/max31855/read", dh_handle_devices_max31855_read},
+#if defined(DH_COMMANDS_PCA9685) && defined(DH_DEVICE_PCA9685)
+	{ "devices/pca9685/control", dh_handle_devices_pca9685_control},
+#endif
+
+#if defined(DH_COMMANDS_PCF8574_HD44780) && defined(DH_DEVICE_PCF8574_HD44780)
+	{ "devices/pcf8574/hd44780/write", dh_handle_devices_pcf8574_hd44780_write},
+#endif
+
+#if defined(DH_COMMANDS_PCF8574) && defined(DH_DEVICE_PCF8574)
+	{ "devices/pcf8574/read", dh_handle_devices_pcf8574_read},
+	{ "devices/pcf8574/write", dh_handle_devices_pcf8574_write},
+#endif
+
+#if defined(DH_COMMANDS_PCF8591) && defined(DH_DEVICE_PCF8591)
+	{ "devices/pcf8591/read", dh_handle_devices_pcf8591_read},
+	{ "devices/pcf8591/write", dh_handle_devices_pcf8591_write},
+#endif
+
+#if defined(DH_COMMANDS_SI7021) && defined(DH_DEVICE_SI7021)
+	{ "devices/si7021/read", dh_handle_devices_si7021_read},
 #endif
 
 #if defined(DH_COMMANDS_TM1637) && defined(DH_DEVICE_TM1637)
 	{ "devices/tm1637/write", dh_handle_devices_tm1637_write},
 #endif
 
-	{ "command/list", do_handle_command_list } // END
+#if defined(DH_COMMANDS_GPIO)
+	{"gpio/counter", dh_handle_gpio_counter},
+	{"gpio/counter/read", dh_handle_gpio_counter_read},
+	{"gpio/debounce", dh_handle_gpio_debounce},
+	{"gpio/encoder", dh_handle_gpio_encoder},
+	{"gpio/encoder/read", dh_handle_gpio_encoder_read},
+	{"gpio/int", dh_handle_gpio_int},
+	{"gpio/read", dh_handle_gpio_read},
+	{"gpio/sequence", dh_handle_gpio_sequence},
+	{"gpio/write", dh_handle_gpio_write},
+#endif /* DH_COMMANDS_GPIO */
+
+#if defined(DH_COMMANDS_I2C)
+	{ "i2c/master/read", dh_handle_i2c_master_read},
+	{ "i2c/master/write", dh_handle_i2c_master_write},
+#endif /* DH_COMMANDS_I2C */
+
+#if defined(DH_COMMANDS_ONEWIRE)
+	{ "onewire/dht/read", dh_handle_onewire_dht_read},
+	{ "onewire/master/alarm", dh_handle_onewire_master_search},
+	{ "onewire/master/int", dh_handle_onewire_master_int},
+	{ "onewire/master/read", dh_handle_onewire_master_read},
+	{ "onewire/master/search", dh_handle_onewire_master_search},
+	{ "onewire/master/write", dh_handle_onewire_master_write},
+	{ "onewire/ws2812b/write", dh_handle_onewire_ws2812b_write},
+#endif /* DH_COMMANDS_ONEWIRE */
+
+#if defined(DH_COMMANDS_PWM)
+	{"pwm/control", dh_handle_pwm_control},
+#endif /* DH_COMMANDS_PWM */
+
+#if defined(DH_COMMANDS_SPI)
+	{ "spi/master/read", dh_handle_spi_master_read},
+	{ "spi/master/write", dh_handle_spi_master_write},
+#endif /* DH_COMMANDS_SPI */
+
+#if defined(DH_COMMANDS_UART)
+	{"uart/int", dh_handle_uart_int},
+	{"uart/read", dh_handle_uart_read},
+	{"uart/terminal", dh_handle_uart_terminal},
+	{"uart/write", dh_handle_uart_write},
+#endif /* DH_COMMANDS_UART */
 };
 
 
@@ -220,11 +235,18 @@ void ICACHE_FLASH_ATTR dhcommands_do(COMMAND_RESULT *cb, const char *command, co
 	}
 
 	dhdebug("Got command: %s %d", command, cb->data.id);
-	for (i = 0; i < NUM_OF_COMMANDS; ++i) {
-		if (0 == os_strcmp(command, g_command_table[i].name) && g_command_table[i].func) {
+	int lo = 0, hi = NUM_OF_COMMANDS - 1;
+	while (lo <= hi) {
+		i = (lo + hi) / 2;
+		const int cmp = os_strcmp(command, g_command_table[i].name);
+		if (cmp == 0) {
 			g_command_table[i].func(cb, command, params, paramslen);
 			return; // done
 		}
+		if (cmp < 0)
+			hi = i - 1;
+		else
+			lo = i + 1;
 	}
 
 	dh_command_fail(cb, "Unknown command");
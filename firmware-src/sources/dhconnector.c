@@ -18,6 +18,7 @@
 #include "mdnsd.h"
 #include "dhconnector_websocket.h"
 #include "dhesperrors.h"
+#include "uploadable_firmware.h"
 
 #include <ets_sys.h>
 #include <osapi.h>
@@ -28,41 +29,102 @@
 #include <json/jsonparse.h>
 #include <ets_forward.h>
 
-#define HTTP_RESPONSE_TIMEOUT_MS 60000
+#define RESOLVE_TIMEOUT_MS 15000
+#define CONNECT_TIMEOUT_MS 15000
+#define HTTP_RESPONSE_TIMEOUT_MS 30000
+#define AUTH_TIMEOUT_MS 30000
 LOCAL CONNECTION_STATE mConnectionState;
 LOCAL struct espconn mDHConnector;
 LOCAL int mDHSecure = 0;
 LOCAL os_timer_t mRetryTimer;
-LOCAL os_timer_t mResponseTimer;
+LOCAL os_timer_t mPhaseTimer;
 LOCAL char mWSUrl[DHSETTINGS_SERVER_MAX_LENGTH];
+LOCAL int mRetryPending = 0;
+LOCAL unsigned int mRetryAttempts = 0;
+LOCAL unsigned int mFastRetries = 0;
+LOCAL int mAuthorized = 0;
+LOCAL DHSTAT_PHASE mPhase;
+LOCAL uint32 mPhaseStart;
 
 LOCAL void set_state(CONNECTION_STATE state);
 
 LOCAL void retry(void *arg) {
+	mRetryPending = 0;
 	set_state(mConnectionState);
 }
 
 LOCAL void arm_repeat_timer(unsigned int ms) {
+	mRetryPending = 1;
 	os_timer_disarm(&mRetryTimer);
 	os_timer_setfn(&mRetryTimer, (os_timer_func_t *)retry, NULL);
 	os_timer_arm(&mRetryTimer, ms, 0);
 }
 
-LOCAL void response_timeout(void *arg) {
-	dhdebug("HTTP response timeout");
-	mConnectionState = CS_DISCONNECT;
+LOCAL int ICACHE_FLASH_ATTR is_transient(sint8 err) {
+	return err == ESPCONN_MEM || err == ESPCONN_MAXNUM;
+}
+
+LOCAL void ICACHE_FLASH_ATTR schedule_retry(int transient) {
+	unsigned int ms;
+	if(mRetryPending)
+		return;
+	if(transient && mFastRetries < RETRY_CONNECTION_FAST_ATTEMPTS) {
+		mFastRetries++;
+		ms = RETRY_CONNECTION_FAST_INTERVAL_MS;
+	} else {
+		unsigned int i;
+		ms = RETRY_CONNECTION_INTERVAL_MS;
+		for(i = 0; i < mRetryAttempts && ms < RETRY_CONNECTION_MAX_INTERVAL_MS; i++)
+			ms <<= 1;
+		if(ms > RETRY_CONNECTION_MAX_INTERVAL_MS)
+			ms = RETRY_CONNECTION_MAX_INTERVAL_MS;
+		mRetryAttempts++;
+	}
+	// randomize the second half of interval, so devices do not reconnect simultaneously,
+	// hardware random generator differs between devices even after mass reboot
+	ms = ms / 2 + os_random() % (ms / 2 + 1);
+	dhdebug("Reconnect in %u ms", ms);
+	dhstat_got_reconnect();
+	arm_repeat_timer(ms);
+}
+
+LOCAL void ICACHE_FLASH_ATTR disconnect(void) {
 	if (mDHSecure)
 		espconn_secure_disconnect(&mDHConnector);
 	else
 		espconn_disconnect(&mDHConnector);
 }
 
+LOCAL void ICACHE_FLASH_ATTR phase_timeout(void *arg) {
+	dhdebug("Connection phase %d timeout", mPhase);
+	dhstat_got_phase_timeout(mPhase);
+	mConnectionState = CS_DISCONNECT;
+	if(mPhase != DHSTAT_PHASE_RESOLVE)
+		disconnect();
+	schedule_retry(0);
+}
+
+LOCAL void ICACHE_FLASH_ATTR phase_start(DHSTAT_PHASE phase, unsigned int timeout_ms) {
+	mPhase = phase;
+	mPhaseStart = system_get_time();
+	os_timer_disarm(&mPhaseTimer);
+	os_timer_setfn(&mPhaseTimer, (os_timer_func_t *)phase_timeout, NULL);
+	os_timer_arm(&mPhaseTimer, timeout_ms, 0);
+}
+
+LOCAL void ICACHE_FLASH_ATTR phase_done(void) {
+	os_timer_disarm(&mPhaseTimer);
+	dhstat_got_phase(mPhase, (system_get_time() - mPhaseStart) / 1000);
+}
+
 LOCAL void ICACHE_FLASH_ATTR network_error_cb(void *arg, sint8 err) {
+	const int transient = (mConnectionState == CS_OPERATE && mAuthorized) || is_transient(err);
 	dhconnector_websocket_stop();
-	os_timer_disarm(&mResponseTimer);
+	os_timer_disarm(&mPhaseTimer);
 	dhesperrors_espconn_result("Connector error occurred:", err);
+	mAuthorized = 0;
 	mConnectionState = CS_DISCONNECT;
-	arm_repeat_timer(RETRY_CONNECTION_INTERVAL_MS);
+	schedule_retry(transient);
 	dhstat_got_network_error();
 }
 
@@ -95,10 +157,14 @@ LOCAL void ICACHE_FLASH_ATTR parse_json(struct jsonparse_state *jparser) {
 LOCAL void ICACHE_FLASH_ATTR ws_error(void) {
 	dhstat_got_server_error();
 	// close connection and restart everything on error
-	if (mDHSecure)
-		espconn_secure_disconnect(&mDHConnector);
-	else
-		espconn_disconnect(&mDHConnector);
+	disconnect();
+}
+
+LOCAL void ICACHE_FLASH_ATTR ws_connected(void) {
+	phase_done();
+	mAuthorized = 1;
+	mRetryAttempts = 0;
+	mFastRetries = 0;
 }
 
 LOCAL int ICACHE_FLASH_ATTR ws_send(const char *data, unsigned int len) {
@@ -125,16 +191,19 @@ LOCAL void ICACHE_FLASH_ATTR network_recv_cb(void *arg, char *data, unsigned sho
 		dhconnector_websocket_parse(data, len);
 		return;
 	}
-	os_timer_disarm(&mResponseTimer);
+	os_timer_disarm(&mPhaseTimer);
 	const char *rc = find_http_responce_code(data, len);
 	if(rc) { // HTTP
 		if(rc[0] == '1' && rc[1] == '0' && rc[2] == '1' && mConnectionState == CS_WEBSOCKET) { // HTTP responce code 101 - Switching Protocols
+			phase_done();
 			set_state(CS_OPERATE);
 			dhdebug("WebSocket connection is established");
-			dhconnector_websocket_start(ws_send, ws_error);
+			phase_start(DHSTAT_PHASE_AUTH, AUTH_TIMEOUT_MS);
+			dhconnector_websocket_start(ws_send, ws_error, ws_connected);
 			// do not disconnect
 			return;
 		} else if(*rc == '2' && mConnectionState == CS_GETINFO) { // HTTP responce code 2xx - Success
+			phase_done();
 			if(os_strstr(data, (char *) "\r\n\r\n")) {
 				int deep = 0;
 				unsigned int pos = 0;
@@ -168,10 +237,7 @@ LOCAL void ICACHE_FLASH_ATTR network_recv_cb(void *arg, char *data, unsigned sho
 		dhdebug("Connector HTTP magic number is wrong");
 		dhstat_got_server_error();
 	}
-	if (mDHSecure)
-		espconn_secure_disconnect(&mDHConnector);
-	else
-		espconn_disconnect(&mDHConnector);
+	disconnect();
 }
 
 LOCAL void network_connect_cb(void *arg) {
@@ -185,13 +251,16 @@ LOCAL void network_connect_cb(void *arg) {
 	espconn_set_keepalive(&mDHConnector, ESPCONN_KEEPINTVL, &keepalive);
 	keepalive = 3;
 	espconn_set_keepalive(&mDHConnector, ESPCONN_KEEPCNT, &keepalive);
+	DHSTAT_PHASE phase;
 	switch (mConnectionState) {
 	case CS_GETINFO:
 		request = dhrequest_create_info(dhsettings_get_devicehive_server());
+		phase = DHSTAT_PHASE_INFO;
 		dhdebug("Send info request...");
 		break;
 	case CS_WEBSOCKET:
 		request = dhrequest_create_wsrequest(dhsettings_get_devicehive_server(), mWSUrl);
+		phase = DHSTAT_PHASE_UPGRADE;
 		dhdebug("Send web socket upgrade request...");
 		break;
 	/* TODO case CS_POLL:
@@ -206,28 +275,27 @@ LOCAL void network_connect_cb(void *arg) {
 		break;*/
 	default:
 		dhdebug("ASSERT: networkConnectCb wrong state %d", mConnectionState);
+		disconnect();
+		return;
 	}
+	phase_done();
 	int res = mDHSecure
 	        ? espconn_secure_send(&mDHConnector, (uint8_t*)request->data, request->len)
 	        : espconn_send(&mDHConnector, (uint8_t*)request->data, request->len);
 	if( res != ESPCONN_OK) {
 		mConnectionState = CS_DISCONNECT;
 		dhesperrors_espconn_result("network_connect_cb failed:", res);
-		if (mDHSecure)
-			espconn_secure_disconnect(&mDHConnector);
-		else
-			espconn_disconnect(&mDHConnector);
+		schedule_retry(is_transient(res));
+		disconnect();
 	} else {
 		dhstat_add_bytes_sent(request->len);
-		os_timer_disarm(&mResponseTimer);
-		os_timer_setfn(&mResponseTimer, (os_timer_func_t *)response_timeout, 0);
-		os_timer_arm(&mResponseTimer, HTTP_RESPONSE_TIMEOUT_MS, 0);
+		phase_start(phase, HTTP_RESPONSE_TIMEOUT_MS);
 	}
 }
 
 LOCAL void network_disconnect_cb(void *arg) {
 	dhconnector_websocket_stop();
-	os_timer_disarm(&mResponseTimer);
+	os_timer_disarm(&mPhaseTimer);
 	switch(mConnectionState) {
 	case CS_GETINFO:
 		set_state(CS_WEBSOCKET);
@@ -236,8 +304,9 @@ LOCAL void network_disconnect_cb(void *arg) {
 	case CS_WEBSOCKET:
 	case CS_OPERATE:
 		dhdebug("disconnect");
+		schedule_retry(mConnectionState == CS_OPERATE && mAuthorized);
+		mAuthorized = 0;
 		mConnectionState = CS_DISCONNECT;
-		arm_repeat_timer(RETRY_CONNECTION_INTERVAL_MS);
 		break;
 /* TODO case CS_CUSTOM:
 		if(dhterminal_is_in_use()) {
@@ -263,13 +332,19 @@ LOCAL void ICACHE_FLASH_ATTR dhconnector_init_connection(ip_addr_t *ip) {
 }
 
 LOCAL void ICACHE_FLASH_ATTR resolve_cb(const char *name, ip_addr_t *ip, void *arg) {
+	if(mConnectionState != CS_RESOLVEHTTP && mConnectionState != CS_RESOLVEWEBSOCKET) {
+		dhdebug("Resolve %s result is outdated", name);
+		return;
+	}
 	if(ip == NULL) {
 		dhdebug("Resolve %s failed. Trying again...", name);
+		os_timer_disarm(&mPhaseTimer);
 		mConnectionState = CS_DISCONNECT;
-		arm_repeat_timer(RETRY_CONNECTION_INTERVAL_MS);
+		schedule_retry(0);
 		dhstat_got_network_error();
 		return;
 	}
+	phase_done();
 	unsigned char *bip = (unsigned char *) ip;
 	dhdebug("Host %s ip: %d.%d.%d.%d, using port %d", name, bip[0], bip[1], bip[2], bip[3], mDHConnector.proto.tcp->remote_port);
 
@@ -287,12 +362,14 @@ LOCAL void ICACHE_FLASH_ATTR start_resolve_dh_server(const char *server) {
 	char host[DHREQUEST_HOST_MAX_BUF_LEN];
 	if(dhrequest_parse_url(server, host, &mDHConnector.proto.tcp->remote_port)) {
 		dhdebug("Resolving %s", host);
+		phase_start(DHSTAT_PHASE_RESOLVE, RESOLVE_TIMEOUT_MS);
 		err_t r = espconn_gethostbyname(&mDHConnector, host, &ip, resolve_cb);
 		if(r == ESPCONN_OK) {
 			resolve_cb(host, &ip, NULL);
 		} else if(r != ESPCONN_INPROGRESS) {
+			os_timer_disarm(&mPhaseTimer);
 			dhesperrors_espconn_result("Resolving failed:", r);
-			arm_repeat_timer(RETRY_CONNECTION_INTERVAL_MS);
+			schedule_retry(is_transient(r));
 		}
 	} else {
 		dhdebug("Can not find scheme in server url. Server connectivity is disabled.");
@@ -331,18 +408,21 @@ LOCAL void ICACHE_FLASH_ATTR set_state(CONNECTION_STATE state) {
 	case CS_GETINFO:
 	case CS_WEBSOCKET:
 	{
+		phase_start(DHSTAT_PHASE_CONNECT, CONNECT_TIMEOUT_MS);
 		const sint8 cr = mDHSecure
 		               ? espconn_secure_connect(&mDHConnector)
 		               : espconn_connect(&mDHConnector);
 		if(cr == ESPCONN_ISCONN)
 			return;
 		if(cr != ESPCONN_OK) {
+			os_timer_disarm(&mPhaseTimer);
 			dhesperrors_espconn_result("Connector espconn_connect failed:", cr);
-			arm_repeat_timer(RETRY_CONNECTION_INTERVAL_MS);
+			schedule_retry(is_transient(cr));
 		}
 		break;
 	}
 	case CS_OPERATE:
+		uploadable_firmware_confirm();
 		break;
 	default:
 		dhdebug("ASSERT: set_state wrong state %d", mConnectionState);
@@ -365,6 +445,8 @@ LOCAL void ICACHE_FLASH_ATTR wifi_state_cb(System_Event_t *event) {
 		}
 	} else if(event->event == EVENT_STAMODE_DISCONNECTED) {
 		os_timer_disarm(&mRetryTimer);
+		os_timer_disarm(&mPhaseTimer);
+		mRetryPending = 0;
 		dhesperrors_disconnect_reason("WiFi disconnected", event->event_info.disconnected.reason);
 		dhstat_got_wifi_lost();
 		mdnsd_stop();
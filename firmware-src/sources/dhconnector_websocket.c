@@ -37,6 +37,8 @@
 
 LOCAL dhconnector_websocket_send_proto mSendFunc;
 LOCAL dhconnector_websocket_error mErrFunc;
+LOCAL dhconnector_websocket_connected mConnectedFunc;
+LOCAL int mSubscribed = 0;
 LOCAL char mBuf[PAYLOAD_BUF_SIZE + WEBSOCKET_HEADER_MAX_SIZE + WEBSOCKET_MASK_SIZE];
 LOCAL char *mPayLoadBuf = &mBuf[WEBSOCKET_HEADER_MAX_SIZE + WEBSOCKET_MASK_SIZE];
 LOCAL int mPayLoadBufLen = 0;
@@ -112,9 +114,11 @@ LOCAL void ICACHE_FLASH_ATTR check_queue(void) {
 }
 
 void ICACHE_FLASH_ATTR dhconnector_websocket_start(dhconnector_websocket_send_proto send_func,
-		dhconnector_websocket_error err_func) {
+		dhconnector_websocket_error err_func, dhconnector_websocket_connected connected_func) {
 	mSendFunc = send_func;
 	mErrFunc = err_func;
+	mConnectedFunc = connected_func;
+	mSubscribed = 0;
 
 	dhsender_set_cb(check_queue);
 
@@ -184,6 +188,10 @@ void ICACHE_FLASH_ATTR dhconnector_websocket_parse(const char *data, unsigned in
 			error();
 			return;
 		} else { // successfully connected
+			if(!mSubscribed && dhconnector_websocket_api_check()) {
+				mSubscribed = 1;
+				mConnectedFunc();
+			}
 			arm_timeout_timer(WEBSOCKET_PING_TIMEOUT_MS);
 			// if we have data to send, we can do it
 			check_queue();
@@ -196,4 +204,6 @@ void ICACHE_FLASH_ATTR dhconnector_websocket_parse(const char *data, unsigned in
 void ICACHE_FLASH_ATTR dhconnector_websocket_stop() {
 	os_timer_disarm(&mTimeoutTimer);
 	os_timer_disarm(&mRepeatTimer);
+	// queue is kept for the next connection
+	dhsender_set_cb(NULL);
 }
@@ -13,13 +13,17 @@
 typedef int (*dhconnector_websocket_send_proto)(const char *data, unsigned int len);
 /** Function prototype for error callback. */
 typedef void (*dhconnector_websocket_error)(void);
+/** Function prototype for callback on successful authentication and subscription. */
+typedef void (*dhconnector_websocket_connected)(void);
 
 /**
- *	\brief					Initialize devicehive WebSocket protocol exchange
- *	\param[in]	send_func	Pointer to function to call to send data.
- *	\param[in]	err_func	Pointer to function to call on error.
+ *	\brief						Initialize devicehive WebSocket protocol exchange
+ *	\param[in]	send_func		Pointer to function to call to send data.
+ *	\param[in]	err_func		Pointer to function to call on error.
+ *	\param[in]	connected_func	Pointer to function to call once device is authenticated and subscribed for commands.
  */
-void dhconnector_websocket_start(dhconnector_websocket_send_proto send_func, dhconnector_websocket_error err_func);
+void dhconnector_websocket_start(dhconnector_websocket_send_proto send_func, dhconnector_websocket_error err_func,
+		dhconnector_websocket_connected connected_func);
 
 /**
  *	\brief					Stop any protocol activities.
@@ -12,40 +12,43 @@
 #include "dhsender.h"
 #include "DH/gpio.h"
 #include "DH/adc.h"
+#include "DH/pwm.h"
 #include "user_config.h"
 #include "snprintf.h"
 #include "dhdata.h"
 #include "dhdebug.h"
-#include "dhstatistic.h"
-#include "dhmem.h"
 
 #include <ets_sys.h>
 #include <os_type.h>
 #include <osapi.h>
 #include <user_interface.h>
 
-void ICACHE_FLASH_ATTR dh_gpio_int_cb(DHGpioPinMask caused_pins) {
-	if(dhmem_isblock()) {
-		dhstat_got_notification_dropped();
-		return;
-	}
-	dhsender_notification(RNT_NOTIFICATION_GPIO, RDT_GPIO, caused_pins, dh_gpio_read(), system_get_time(), DH_GPIO_SUITABLE_PINS);
+void ICACHE_FLASH_ATTR dh_gpio_int_cb(const DHGpioEdges *edges) {
+	dhsender_notification(RNT_NOTIFICATION_GPIO, RDT_GPIO_EDGES, edges, dh_gpio_read(), system_get_time(), DH_GPIO_SUITABLE_PINS);
+}
+
+void ICACHE_FLASH_ATTR dh_gpio_counter_cb(const DHGpioCounters *counters) {
+	dhsender_notification(RNT_NOTIFICATION_GPIO_COUNTER, RDT_GPIO_COUNTERS, counters);
+}
+
+void ICACHE_FLASH_ATTR dh_gpio_encoder_cb(const DHGpioEncoders *encoders) {
+	dhsender_notification(RNT_NOTIFICATION_GPIO_ENCODER, RDT_GPIO_ENCODERS, encoders);
+}
+
+void ICACHE_FLASH_ATTR dh_pwm_sequence_cb(unsigned int count) {
+	dhsender_notification(RNT_NOTIFICATION_GPIO_SEQUENCE, RDT_FORMAT_JSON,
+			"{\"count\":%u, \"tick\":%u}", count, system_get_time());
 }
 
 void ICACHE_FLASH_ATTR dh_adc_loop_value_cb(float value){
-	if(dhmem_isblock()) {
-		dhstat_got_notification_dropped();
-		return;
-	}
 	dhsender_notification(RNT_NOTIFICATION_ADC, RDT_FLOAT, value);
 }
 
-void ICACHE_FLASH_ATTR dh_uart_buf_rcv_cb(const void *buf, size_t len) {
-	if(dhmem_isblock()) {
-		dhstat_got_notification_dropped();
-		return;
-	}
+void ICACHE_FLASH_ATTR dh_adc_block_cb(const DHAdcBlock *block) {
+	dhsender_notification(RNT_NOTIFICATION_ADC_BLOCK, RDT_ADC_BLOCK, block);
+}
 
+void ICACHE_FLASH_ATTR dh_uart_buf_rcv_cb(const void *buf, size_t len) {
 	dhsender_notification(RNT_NOTIFICATION_UART, RDT_DATA_WITH_LEN, buf, len);
 }
 
@@ -55,9 +58,5 @@ void ICACHE_FLASH_ATTR dh_uart_buf_rcv_cb(const void *buf, size_t len) {
  */
 void ICACHE_FLASH_ATTR dh_onewire_search_result(unsigned int pin, const void *buf, size_t len)
 {
-	if (dhmem_isblock()) {
-		dhstat_got_notification_dropped();
-		return;
-	}
 	dhsender_notification(RNT_NOTIFICATION_ONEWIRE, RDT_SEARCH64, pin, buf, len);
 }
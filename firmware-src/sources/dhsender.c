@@ -17,6 +17,7 @@
 #include "dhesperrors.h"
 #include "dhutils.h"
 #include "dhstatistic.h"
+#include "dhmem.h"
 
 #include <stdarg.h>
 #include <ets_sys.h>
@@ -25,13 +26,52 @@
 #include <gpio.h>
 #include <user_interface.h>
 #include <espconn.h>
+#include <mem.h>
 
 #define DHSENDER_RETRY_COUNT 5
+#define DHSENDER_MAX_LISTENERS 2
 
 LOCAL SENDER_JSON_DATA mDataToSend;
 LOCAL unsigned int isCurrentNotification;
 LOCAL int mSenderTook = 0;
 dhsender_new_item_cb mNewItemCb = NULL;
+LOCAL dhsender_listener_cb mListeners[DHSENDER_MAX_LISTENERS] = {0};
+
+LOCAL int ICACHE_FLASH_ATTR has_listeners(void) {
+	int i;
+	for(i = 0; i < DHSENDER_MAX_LISTENERS; i++) {
+		if(mListeners[i])
+			return 1;
+	}
+	return 0;
+}
+
+LOCAL void ICACHE_FLASH_ATTR notify_listeners(const SENDER_JSON_DATA *data) {
+	int i;
+	for(i = 0; i < DHSENDER_MAX_LISTENERS; i++) {
+		if(mListeners[i])
+			mListeners[i](data->json, data->jsonlen);
+	}
+}
+
+/**
+ * Pass notification to local listeners right away, queue is kept for server.
+ */
+LOCAL void ICACHE_FLASH_ATTR notify_local(REQUEST_NOTIFICATION_TYPE type, REQUEST_DATA_TYPE data_type, va_list ap) {
+	SENDER_JSON_DATA *data = (SENDER_JSON_DATA *)os_malloc(sizeof(SENDER_JSON_DATA));
+	if(data == 0) {
+		dhdebug("ERROR: No memory for local notification");
+		return;
+	}
+	if(dhsender_queue_format(RT_NOTIFICATION, type, data_type, 0, ap, data))
+		notify_listeners(data);
+	os_free(data);
+}
+
+LOCAL void ICACHE_FLASH_ATTR new_item(void) {
+	if(mNewItemCb)
+		mNewItemCb();
+}
 
 SENDER_JSON_DATA * ICACHE_FLASH_ATTR dhsender_next(void) {
 	if(mSenderTook == 0) {
@@ -63,13 +103,35 @@ void dhsender_set_cb(dhsender_new_item_cb new_item) {
 	mNewItemCb = new_item;
 }
 
+int ICACHE_FLASH_ATTR dhsender_add_listener(dhsender_listener_cb listener) {
+	int i;
+	for(i = 0; i < DHSENDER_MAX_LISTENERS; i++) {
+		if(mListeners[i] == listener)
+			return 1;
+	}
+	for(i = 0; i < DHSENDER_MAX_LISTENERS; i++) {
+		if(mListeners[i] == NULL) {
+			mListeners[i] = listener;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void ICACHE_FLASH_ATTR dhsender_remove_listener(dhsender_listener_cb listener) {
+	int i;
+	for(i = 0; i < DHSENDER_MAX_LISTENERS; i++) {
+		if(mListeners[i] == listener)
+			mListeners[i] = NULL;
+	}
+}
+
 void ICACHE_FLASH_ATTR dhsender_response(CommandResultArgument cid, RESPONCE_STATUS status, REQUEST_DATA_TYPE data_type, ...) {
 	va_list ap;
 	va_start(ap, data_type);
 	dhstat_got_responce();
 	if(dhsender_queue_add(status == DHSTATUS_ERROR ? RT_RESPONCE_ERROR : RT_RESPONCE_OK, RNT_NOTIFICATION_NONE, data_type, cid.id, ap)) {
-		if(mNewItemCb)
-			mNewItemCb();
+		new_item();
 	} else {
 		dhstat_got_responce_dropped();
 		dhdebug("ERROR: No memory for response");
@@ -81,9 +143,19 @@ void ICACHE_FLASH_ATTR dhsender_notification(REQUEST_NOTIFICATION_TYPE type, REQ
 	va_list ap;
 	va_start(ap, data_type);
 	dhstat_got_notification();
-	if(dhsender_queue_add(RT_NOTIFICATION, type, data_type, 0, ap)) {
-		if(mNewItemCb)
-			mNewItemCb();
+	// local listeners don't use queue, so full queue doesn't stop them
+	if(has_listeners()) {
+		va_list local;
+		va_copy(local, ap);
+		notify_local(type, data_type, local);
+		va_end(local);
+	}
+	if(dhsender_queue_is_init() == 0) {
+		// no server connector, nothing would take it from queue
+	} else if(dhmem_isblock()) {
+		dhstat_got_notification_dropped();
+	} else if(dhsender_queue_add(RT_NOTIFICATION, type, data_type, 0, ap)) {
+		new_item();
 	} else {
 		dhstat_got_notification_dropped();
 		dhdebug("ERROR: No memory for notification");
@@ -19,6 +19,9 @@
 /** Function prototype for new item in queue callback. */
 typedef void (*dhsender_new_item_cb)(void);
 
+/** Function prototype for local notification listener. */
+typedef void (*dhsender_listener_cb)(const char *json, unsigned int len);
+
 /**
  *	\brief				Notify that current data was failed to send.
  */
@@ -38,9 +41,25 @@ SENDER_JSON_DATA *dhsender_next(void);
 /**
  *	\brief					Set callbacks.
  *	\param[in]	new_item	Pointer to a function which should be called on adding new item to queue.
+ *							NULL when there is no server connection.
  */
 void dhsender_set_cb(dhsender_new_item_cb new_item);
 
+/**
+ *	\brief					Add listener of notifications for local clients.
+ *	\details				Each notification is passed to listeners when it is added, queue
+ *							for server is not affected.
+ *	\param[in]	listener	Pointer to a function which receives notification JSON.
+ *	\return					Non zero value on success, zero if there are too many listeners.
+ */
+int dhsender_add_listener(dhsender_listener_cb listener);
+
+/**
+ *	\brief					Remove listener of notifications.
+ *	\param[in]	listener	Pointer to a function which was added with dhsender_add_listener().
+ */
+void dhsender_remove_listener(dhsender_listener_cb listener);
+
 /**
  *	\brief					Send command response.
  *	\param[in]	cid			Command id that response should be sent.
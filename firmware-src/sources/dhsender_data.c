@@ -33,6 +33,42 @@ void ICACHE_FLASH_ATTR dhsender_data_parse_va(va_list ap,
 			data->gpio.suitable = va_arg(ap, unsigned int);
 			*data_len = sizeof(GPIO_DATA);
 			break;
+		case RDT_GPIO_EDGES:
+		{
+			const DHGpioEdges *edges = va_arg(ap, const DHGpioEdges *);
+			os_memcpy(&data->gpio_edges.edges, edges, sizeof(DHGpioEdges)
+					- sizeof(edges->edges) + edges->count * sizeof(DHGpioEdge));
+			data->gpio_edges.gpio.caused = edges->caused;
+			data->gpio_edges.gpio.state = va_arg(ap, unsigned int);
+			data->gpio_edges.gpio.timestamp = va_arg(ap, unsigned int);
+			data->gpio_edges.gpio.suitable = va_arg(ap, unsigned int);
+			*data_len = sizeof(GPIO_EDGES_DATA);
+		}
+			break;
+		case RDT_GPIO_COUNTERS:
+		{
+			const DHGpioCounters *counters = va_arg(ap, const DHGpioCounters *);
+			os_memcpy(&data->gpio_counters, counters, sizeof(DHGpioCounters)
+					- sizeof(counters->counters) + counters->num * sizeof(DHGpioCounter));
+			*data_len = sizeof(DHGpioCounters);
+		}
+			break;
+		case RDT_GPIO_ENCODERS:
+		{
+			const DHGpioEncoders *encoders = va_arg(ap, const DHGpioEncoders *);
+			os_memcpy(&data->gpio_encoders, encoders, sizeof(DHGpioEncoders)
+					- sizeof(encoders->encoders) + encoders->num * sizeof(DHGpioEncoder));
+			*data_len = sizeof(DHGpioEncoders);
+		}
+			break;
+		case RDT_ADC_BLOCK:
+		{
+			const DHAdcBlock *block = va_arg(ap, const DHAdcBlock *);
+			os_memcpy(&data->adc_block, block, sizeof(DHAdcBlock) - sizeof(block->samples)
+					+ (block->raw ? block->count * sizeof(block->samples[0]) : 0));
+			*data_len = sizeof(DHAdcBlock);
+		}
+			break;
 		case RDT_FLOAT:
 			data->adc = (float)va_arg(ap, double);
 			*data_len = sizeof(float);
@@ -74,8 +110,35 @@ LOCAL unsigned int ICACHE_FLASH_ATTR gpio_state(char *buf,
 	return len + snprintf(&buf[len], buflen - len, "}");
 }
 
+LOCAL unsigned int ICACHE_FLASH_ATTR gpio_edges(char *buf,
+		unsigned int buflen, const DHGpioEdges *edges) {
+	unsigned int len = 0;
+	unsigned int i;
+	if(edges->encoding == DH_GPIO_EDGES_LIST) {
+		len += snprintf(&buf[len], buflen - len, ", \"edges\":[");
+		for(i = 0; i < edges->count; i++) {
+			const DHGpioEdge edge = edges->edges[i];
+			len += snprintf(&buf[len], buflen - len, (i == 0) ? "[%u,%u,%u]" : ", [%u,%u,%u]",
+					edge & 0xF, (edge >> 4) & 1, edge >> 5);
+		}
+		len += snprintf(&buf[len], buflen - len, "]");
+	} else if(edges->encoding == DH_GPIO_EDGES_PACKED) {
+		len += snprintf(&buf[len], buflen - len, ", \"edges\":\"");
+		if(len < buflen)
+			len += dhdata_encode((const char *)edges->edges, edges->count * sizeof(DHGpioEdge),
+					&buf[len], buflen - len);
+		len += snprintf(&buf[len], buflen - len, "\"");
+	}
+	if(edges->encoding != DH_GPIO_EDGES_NONE)
+		len += snprintf(&buf[len], buflen - len, ", \"edgesTick\":%u", edges->timestamp);
+	if(edges->overflow)
+		len += snprintf(&buf[len], buflen - len, ", \"overflow\":%u", edges->overflow);
+	return len;
+}
+
 LOCAL unsigned int ICACHE_FLASH_ATTR gpio_notification(char *buf,
-		unsigned int buflen, const GPIO_DATA *data, unsigned int suitable) {
+		unsigned int buflen, const GPIO_DATA *data, const DHGpioEdges *edges,
+		unsigned int suitable) {
 	unsigned int len = snprintf(buf, buflen, "{\"caused\":[");
 	unsigned int i;
 	int comma = 0;
@@ -91,8 +154,73 @@ LOCAL unsigned int ICACHE_FLASH_ATTR gpio_notification(char *buf,
 	}
 	len += snprintf(&buf[len], buflen - len, "], \"state\":");
 	len += gpio_state(&buf[len], buflen - len, data->state, suitable);
-	return len + snprintf(&buf[len], buflen - len,
-			", \"tick\":%u}", data->timestamp);
+	len += snprintf(&buf[len], buflen - len, ", \"tick\":%u", data->timestamp);
+	if(edges)
+		len += gpio_edges(&buf[len], buflen - len, edges);
+	return len + snprintf(&buf[len], buflen - len, "}");
+}
+
+LOCAL unsigned int ICACHE_FLASH_ATTR gpio_counters(char *buf,
+		unsigned int buflen, const DHGpioCounters *counters) {
+	unsigned int len = snprintf(buf, buflen, "{");
+	unsigned int i;
+	for(i = 0; i < counters->num; i++) {
+		const DHGpioCounter *c = &counters->counters[i];
+		len += snprintf(&buf[len], buflen - len, "\"%u\":{\"count\":%u",
+				c->pin, c->count);
+		if(c->edges == 0) {
+			len += snprintf(&buf[len], buflen - len, ", \"frequency\":0");
+		} else if(c->window) {
+			// signal period is measured between the first and the last edges of window
+			const float period = (float)c->window * c->cycle_edges / c->edges;
+			len += snprintf(&buf[len], buflen - len, ", \"frequency\":%f, \"period\":%u",
+					1000000.0f / period, (unsigned int)(period + 0.5f));
+		}
+		if(c->rejected)
+			len += snprintf(&buf[len], buflen - len, ", \"rejected\":%u", c->rejected);
+		len += snprintf(&buf[len], buflen - len, "}, ");
+	}
+	return len + snprintf(&buf[len], buflen - len, "\"tick\":%u}", counters->timestamp);
+}
+
+LOCAL unsigned int ICACHE_FLASH_ATTR gpio_encoders(char *buf,
+		unsigned int buflen, const DHGpioEncoders *encoders) {
+	unsigned int len = snprintf(buf, buflen, "{\"encoders\":[");
+	unsigned int i;
+	for(i = 0; i < encoders->num; i++) {
+		const DHGpioEncoder *e = &encoders->encoders[i];
+		len += snprintf(&buf[len], buflen - len,
+				(i == 0) ? "{\"a\":%u, \"b\":%u, \"position\":%d, \"velocity\":%f"
+						: ", {\"a\":%u, \"b\":%u, \"position\":%d, \"velocity\":%f",
+				e->pin_a, e->pin_b, e->position, e->velocity);
+		if(e->errors)
+			len += snprintf(&buf[len], buflen - len, ", \"errors\":%u", e->errors);
+		len += snprintf(&buf[len], buflen - len, "}");
+	}
+	return len + snprintf(&buf[len], buflen - len, "], \"tick\":%u}", encoders->timestamp);
+}
+
+LOCAL int ICACHE_FLASH_ATTR adc_block(char *buf,
+		unsigned int buflen, const DHAdcBlock *block) {
+	unsigned int len = snprintf(buf, buflen,
+			"{\"count\":%u, \"min\":%f, \"max\":%f, \"mean\":%f, \"rms\":%f",
+			block->count, block->min / 1024.0f, block->max / 1024.0f,
+			block->mean / 16384.0f, block->rms / 16384.0f);
+	if(block->duration)
+		len += snprintf(&buf[len], buflen - len, ", \"frequency\":%f",
+				(block->count - 1) * 1000000.0f / block->duration);
+	if(block->tripped)
+		len += snprintf(&buf[len], buflen - len, ", \"tripped\":true");
+	if(block->raw) {
+		len += snprintf(&buf[len], buflen - len, ", \"data\":\"");
+		const unsigned int res = dhdata_encode((const char *)block->samples,
+				block->count * sizeof(block->samples[0]), &buf[len], buflen - len);
+		if(res == 0)
+			return -1;
+		len += res;
+		len += snprintf(&buf[len], buflen - len, "\"");
+	}
+	return len + snprintf(&buf[len], buflen - len, ", \"tick\":%u}", block->timestamp);
 }
 
 int ICACHE_FLASH_ATTR dhsender_data_to_json(char *buf, unsigned int buf_len,
@@ -121,10 +249,19 @@ int ICACHE_FLASH_ATTR dhsender_data_to_json(char *buf, unsigned int buf_len,
 			return snprintf(buf, buf_len, "{\"0\":%f}", data->adc);
 		case RDT_GPIO:
 			if(is_notification) {
-				return gpio_notification(buf, buf_len, &data->gpio, data->gpio.suitable);
+				return gpio_notification(buf, buf_len, &data->gpio, NULL, data->gpio.suitable);
 			} else {
 				return gpio_state(buf, buf_len, data->gpio.state, data->gpio.suitable);
 			}
+		case RDT_GPIO_EDGES:
+			return gpio_notification(buf, buf_len, &data->gpio_edges.gpio,
+					&data->gpio_edges.edges, data->gpio_edges.gpio.suitable);
+		case RDT_GPIO_COUNTERS:
+			return gpio_counters(buf, buf_len, &data->gpio_counters);
+		case RDT_GPIO_ENCODERS:
+			return gpio_encoders(buf, buf_len, &data->gpio_encoders);
+		case RDT_ADC_BLOCK:
+			return adc_block(buf, buf_len, &data->adc_block);
 		case RDT_SEARCH64:
 		{
 			unsigned int i;
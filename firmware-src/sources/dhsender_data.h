@@ -13,6 +13,8 @@
 #include "dhsettings.h"
 #include "dhutils.h"
 #include "irom.h"
+#include "DH/gpio.h"
+#include "DH/adc.h"
 
 #include <stdarg.h>
 
@@ -22,6 +24,10 @@ typedef enum {
 	RDT_DATA_WITH_LEN,	///< Pointer to data and integer length of data should be passed. Will be formatted as json with current data encoded method.
 	RDT_FLOAT,			///< Float should be passed. Will be formatted as json with this value.
 	RDT_GPIO,			///< Four 32bit value should be passed(caused, state, tick, suitable). Will be formatted as json.
+	RDT_GPIO_EDGES,		///< Pointer to DHGpioEdges and three 32bit values should be passed(state, tick, suitable). Will be formatted as json.
+	RDT_GPIO_COUNTERS,	///< Pointer to DHGpioCounters should be passed. Will be formatted as json.
+	RDT_GPIO_ENCODERS,	///< Pointer to DHGpioEncoders should be passed. Will be formatted as json.
+	RDT_ADC_BLOCK,		///< Pointer to DHAdcBlock should be passed. Will be formatted as json.
 	RDT_SEARCH64,		///< Data with groups of 64bit addresses. Pin number, pointer to data and integer length of data should be passed.
 	RDT_FORMAT_JSON,	///< Formated JSON, with sprintf syntax. Text should be valid JSON.
 	RDT_JSON_MALLOC_PTR ///< Dynamically allocated data. Will be freed by DH core once data are sent. Pointer and data length should be passed.
@@ -40,7 +46,11 @@ typedef enum {
 	RNT_NOTIFICATION_GPIO,		///< Notification will be marked as GPIO.
 	RNT_NOTIFICATION_ADC,		///< Notification will be marked as ADC.
 	RNT_NOTIFICATION_UART,		///< Notification will be marked as UART.
-	RNT_NOTIFICATION_ONEWIRE	///< Notification will be marked as onewire.
+	RNT_NOTIFICATION_ONEWIRE,	///< Notification will be marked as onewire.
+	RNT_NOTIFICATION_GPIO_COUNTER,	///< Notification will be marked as GPIO counter.
+	RNT_NOTIFICATION_GPIO_ENCODER,	///< Notification will be marked as GPIO encoder.
+	RNT_NOTIFICATION_GPIO_SEQUENCE,	///< Notification will be marked as GPIO sequence.
+	RNT_NOTIFICATION_ADC_BLOCK	///< Notification will be marked as ADC block.
 } REQUEST_NOTIFICATION_TYPE;
 
 /** Response status*/
@@ -73,12 +83,22 @@ typedef struct {
 	unsigned int suitable;	///< Which pins should be included in answer.
 } GPIO_DATA;
 
+/** Special struct for handling gpio notification with edges. */
+typedef struct {
+	GPIO_DATA gpio;		///< GPIO data, caused pins are taken from edges.
+	DHGpioEdges edges;	///< Captured edges, only used part is copied.
+} GPIO_EDGES_DATA;
+
 /** Struct for storing command result. */
 typedef union {
 	char array[INTERFACES_BUF_SIZE];	///< Raw data.
 	const char *string;					///< Static string pointer.
 	float adc;							///< Float value.
 	GPIO_DATA gpio;						///< GPIO data.
+	GPIO_EDGES_DATA gpio_edges;			///< GPIO data with edges.
+	DHGpioCounters gpio_counters;		///< GPIO counters.
+	DHGpioEncoders gpio_encoders;		///< GPIO encoders.
+	DHAdcBlock adc_block;				///< ADC block statistics.
 } SENDERDATA;
 
 
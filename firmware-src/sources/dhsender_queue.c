@@ -73,27 +73,10 @@ int ICACHE_FLASH_ATTR dhsender_queue_add(REQUEST_TYPE type, REQUEST_NOTIFICATION
 	return 1;
 }
 
-int ICACHE_FLASH_ATTR dhsender_queue_take(SENDER_JSON_DATA *out, unsigned int *is_notification) {
-	if(mQueueTakePos < 0)
-		return 0;
-	ETS_INTR_LOCK();
-	DHSENDER_QUEUE item;
-	os_memcpy(&item, &mQueue[mQueueTakePos], sizeof(DHSENDER_QUEUE));
-	if(mQueueTakePos >= mQueueMaxSize - 1)
-		mQueueTakePos = 0;
-	else
-		mQueueTakePos++;
-	if(mQueueAddPos == mQueueTakePos)
-		mQueueTakePos = -1;
-	mQueueSize--;
-	ETS_INTR_UNLOCK();
-
-	if(mQueueSize < MEM_RECOVER_THRESHOLD && dhmem_isblock())
-		dhmem_unblock();
-
+LOCAL int ICACHE_FLASH_ATTR item_to_json(DHSENDER_QUEUE *item, SENDER_JSON_DATA *out, unsigned int *is_notification) {
 	*is_notification = 0;
 	unsigned int pos = 0;
-	switch(item.type) {
+	switch(item->type) {
 		case RT_RESPONCE_OK:
 		case RT_RESPONCE_ERROR:
 			pos = snprintf(out->json, sizeof(out->json),
@@ -104,14 +87,14 @@ int ICACHE_FLASH_ATTR dhsender_queue_take(SENDER_JSON_DATA *out, unsigned int *i
 						"\"command\":{"
 							"\"status\":\"%s\","
 							"\"result\":"
-					, dhsettings_get_devicehive_deviceid(), item.id,
-					(item.type == RT_RESPONCE_OK) ? STATUS_OK : STATUS_ERROR);
+					, dhsettings_get_devicehive_deviceid(), item->id,
+					(item->type == RT_RESPONCE_OK) ? STATUS_OK : STATUS_ERROR);
 			break;
 		case RT_NOTIFICATION:
 		{
 			char *notification_name = NULL;
 			*is_notification = 1;
-			switch(item.notification_type) {
+			switch(item->notification_type) {
 			case RNT_NOTIFICATION_GPIO:
 				notification_name = "gpio/int";
 				break;
@@ -124,8 +107,20 @@ int ICACHE_FLASH_ATTR dhsender_queue_take(SENDER_JSON_DATA *out, unsigned int *i
 			case RNT_NOTIFICATION_ONEWIRE:
 				notification_name = "onewire/master/int";
 				break;
+			case RNT_NOTIFICATION_GPIO_COUNTER:
+				notification_name = "gpio/counter";
+				break;
+			case RNT_NOTIFICATION_GPIO_ENCODER:
+				notification_name = "gpio/encoder";
+				break;
+			case RNT_NOTIFICATION_GPIO_SEQUENCE:
+				notification_name = "gpio/sequence";
+				break;
+			case RNT_NOTIFICATION_ADC_BLOCK:
+				notification_name = "adc/block";
+				break;
 			default:
-				dhdebug("ERROR: Unknown notification type of request %d", item.notification_type);
+				dhdebug("ERROR: Unknown notification type of request %d", item->notification_type);
 				return 0;
 			}
 			pos = snprintf(out->json, sizeof(out->json),
@@ -139,19 +134,15 @@ int ICACHE_FLASH_ATTR dhsender_queue_take(SENDER_JSON_DATA *out, unsigned int *i
 			break;
 		}
 		default:
-			dhdebug("ERROR: Unknown type of request %d", item.type);
+			dhdebug("ERROR: Unknown type of request %d", item->type);
 			return 0;
 	}
 
 	int rl = dhsender_data_to_json(&out->json[pos], sizeof(out->json) - pos,
-			item.notification_type == RNT_NOTIFICATION_GPIO, item.data_type,
-			&item.data, item.data_len, item.pin);
-	if(item.data_type == RDT_JSON_MALLOC_PTR)
-		os_free((void*)item.data.string);
-	if(rl < 0) {
+			item->notification_type == RNT_NOTIFICATION_GPIO, item->data_type,
+			&item->data, item->data_len, item->pin);
+	if(rl < 0)
 		pos += snprintf(&out->json[pos], sizeof(out->json) - pos, "Failed to convert data to json");
-		item.type = RT_RESPONCE_ERROR;
-	}
 	pos += rl;
 
 	pos += snprintf(&out->json[pos], sizeof(out->json) - pos, "}}");
@@ -159,10 +150,49 @@ int ICACHE_FLASH_ATTR dhsender_queue_take(SENDER_JSON_DATA *out, unsigned int *i
 	return 1;
 }
 
+int ICACHE_FLASH_ATTR dhsender_queue_take(SENDER_JSON_DATA *out, unsigned int *is_notification) {
+	if(mQueueTakePos < 0)
+		return 0;
+	ETS_INTR_LOCK();
+	DHSENDER_QUEUE item;
+	os_memcpy(&item, &mQueue[mQueueTakePos], sizeof(DHSENDER_QUEUE));
+	if(mQueueTakePos >= mQueueMaxSize - 1)
+		mQueueTakePos = 0;
+	else
+		mQueueTakePos++;
+	if(mQueueAddPos == mQueueTakePos)
+		mQueueTakePos = -1;
+	mQueueSize--;
+	ETS_INTR_UNLOCK();
+
+	if(mQueueSize < MEM_RECOVER_THRESHOLD && dhmem_isblock())
+		dhmem_unblock();
+
+	const int res = item_to_json(&item, out, is_notification);
+	if(item.data_type == RDT_JSON_MALLOC_PTR)
+		os_free((void*)item.data.string);
+	return res;
+}
+
+int ICACHE_FLASH_ATTR dhsender_queue_format(REQUEST_TYPE type, REQUEST_NOTIFICATION_TYPE notification_type, REQUEST_DATA_TYPE data_type, unsigned int id, va_list ap, SENDER_JSON_DATA *out) {
+	DHSENDER_QUEUE item;
+	unsigned int is_notification;
+	item.id = id;
+	item.type = type;
+	item.data_type = data_type;
+	item.notification_type = notification_type;
+	dhsender_data_parse_va(ap, &data_type, &item.data, &item.data_len, &item.pin);
+	return item_to_json(&item, out, &is_notification);
+}
+
 unsigned int ICACHE_FLASH_ATTR dhsender_queue_length(void) {
 	return mQueueSize;
 }
 
+int ICACHE_FLASH_ATTR dhsender_queue_is_init(void) {
+	return mQueue != 0;
+}
+
 void ICACHE_FLASH_ATTR dhsender_queue_init(void) {
 	mQueueMaxSize = (system_get_free_heap_size() - MEMORY_RESERVER) / sizeof(DHSENDER_QUEUE);
 	if(mQueueMaxSize > MAX_QUEUE_LENGTH)
@@ -33,6 +33,19 @@ int dhsender_queue_add(REQUEST_TYPE type, REQUEST_NOTIFICATION_TYPE notification
  */
 int dhsender_queue_take(SENDER_JSON_DATA *out, unsigned int *is_notification);
 
+/**
+ *	\brief							Format request without adding it to queue.
+ *	\details						Parameters are the same as for dhsender_queue_add(), data is not freed.
+ *	\param[in]	type				Request type, see REQUEST_TYPE enum.
+ *	\param[in]	notification_type	If it is notification, this parameter should contain notification type. Ignore for responses.
+ *	\param[in]	data_type			Type of data that passed to function.
+ *	\param[in]	id					CommandId for response. Ignore for notifications.
+ *	\param[in]	ap					Request data.
+ *	\param[out]	out					Pointer to SENDER_JSON_DATA that should be created.
+ *	\return							Non zero value on success, zero on error.
+ */
+int dhsender_queue_format(REQUEST_TYPE type, REQUEST_NOTIFICATION_TYPE notification_type, REQUEST_DATA_TYPE data_type, unsigned int id, va_list ap, SENDER_JSON_DATA *out);
+
 /**
  *	\brief				Getting current queue size.
  *	\return				Number of item currently in queue.
@@ -44,4 +57,11 @@ unsigned int dhsender_queue_length(void);
  */
 void dhsender_queue_init(void);
 
+/**
+ *	\brief				Check if queue was initialized.
+ *	\details			Queue is initialized only when server connector is used.
+ *	\return				Non zero value if queue exists, zero otherwise.
+ */
+int dhsender_queue_is_init(void);
+
 #endif /* _DHSENDER_QUEUE_H_ */
@@ -23,6 +23,9 @@
 // using main and backup storage to keep old setting in case of power loss during writing
 #define ESP_SETTINGS_MAIN_SEC   0x7A
 #define ESP_SETTINGS_BACKUP_SEC (ESP_SETTINGS_MAIN_SEC + 1)
+#define ESP_SETTINGS_JOURNAL_MAGIC 0x4C4A4844
+// each change in record is offset(2 bytes), length(2 bytes) and data
+#define ESP_SETTINGS_CHANGE_HEADER 4
 
 typedef struct {
 	WIFI_MODE mode;
@@ -33,6 +36,7 @@ typedef struct {
 	char key[DHSETTINGS_KEY_MAX_LENGTH];
 } DH_SETTINGS_DATA;
 
+// legacy format, the whole sector with data and crc
 typedef struct {
 	uint32_t crc;
 	union {
@@ -41,19 +45,232 @@ typedef struct {
 	};
 } DH_SETTINGS;
 
+// Journal sector starts with header and contains records one by one. Each
+// record keeps changes of one commit relatively to the previous state, the
+// first record is changes relatively to zeroed data. Header is written last
+// when sector is filled with the first record, so sector with header is
+// always complete. Both sectors can have header, the newest one is used.
+typedef struct {
+	uint32_t magic;
+	uint32_t seq;
+} JOURNAL_HEADER;
+
+typedef struct {
+	uint32_t length;	// length of changes, record is aligned to 4 bytes
+	uint32_t crc;		// crc of length and changes
+} JOURNAL_RECORD;
+
+typedef struct {
+	union {
+		uint32_t words[SPI_FLASH_SEC_SIZE / sizeof(uint32_t)];
+		uint8_t sector[SPI_FLASH_SEC_SIZE];
+		DH_SETTINGS legacy;
+	};
+	DH_SETTINGS_DATA image;
+} JOURNAL_BUFFER;
+
 static DH_SETTINGS_DATA mSettingsData = {0};
+LOCAL int mJournalSector = -1;	// sector which is used now, -1 if there is no journal
+LOCAL uint32_t mJournalSeq = 0;
+LOCAL unsigned int mJournalPos = SPI_FLASH_SEC_SIZE; // free space offset, sector size if sector can't be appended
 
 LOCAL uint32_t ICACHE_FLASH_ATTR getStorageCrc(DH_SETTINGS *storage) {
 	return crc32(storage->storage, sizeof(storage->storage));
 }
 
+LOCAL uint32_t ICACHE_FLASH_ATTR journal_record_crc(const JOURNAL_RECORD *record) {
+	return crc32_update(crc32(&record->length, sizeof(record->length)),
+			&record[1], record->length);
+}
+
+/**
+ * Apply all records from sector to data. Return non zero if sector is journal.
+ * Offset where the next record can be written is stored in end.
+ */
+LOCAL int ICACHE_FLASH_ATTR journal_replay(const uint8_t *sector,
+		DH_SETTINGS_DATA *data, unsigned int *end) {
+	const JOURNAL_HEADER *header = (const JOURNAL_HEADER *)sector;
+	if(header->magic != ESP_SETTINGS_JOURNAL_MAGIC)
+		return 0;
+	os_memset(data, 0, sizeof(DH_SETTINGS_DATA));
+	unsigned int pos = sizeof(JOURNAL_HEADER);
+	while(pos + sizeof(JOURNAL_RECORD) <= SPI_FLASH_SEC_SIZE) {
+		const JOURNAL_RECORD *record = (const JOURNAL_RECORD *)&sector[pos];
+		// free space has length 0xFFFFFFFF, interrupted write has wrong crc
+		if(record->length > SPI_FLASH_SEC_SIZE - pos - sizeof(JOURNAL_RECORD)
+				|| journal_record_crc(record) != record->crc)
+			break;
+		const uint8_t *changes = (const uint8_t *)&record[1];
+		unsigned int i = 0;
+		while(i + ESP_SETTINGS_CHANGE_HEADER <= record->length) {
+			const unsigned int offset = (changes[i] << 8) | changes[i + 1];
+			const unsigned int len = (changes[i + 2] << 8) | changes[i + 3];
+			i += ESP_SETTINGS_CHANGE_HEADER;
+			if(offset + len > sizeof(DH_SETTINGS_DATA) || i + len > record->length)
+				break;
+			os_memcpy(&((uint8_t *)data)[offset], &changes[i], len);
+			i += len;
+		}
+		pos += sizeof(JOURNAL_RECORD) + ((record->length + 3) & ~3);
+	}
+	// record can be appended only if the rest of sector was never written
+	*end = pos;
+	for(; pos < SPI_FLASH_SEC_SIZE; pos++) {
+		if(sector[pos] != 0xFF) {
+			*end = SPI_FLASH_SEC_SIZE;
+			break;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Build record with changes between from and to in buf. Return record size,
+ * zero if there are no changes or -1 if record doesn't fit space.
+ */
+LOCAL int ICACHE_FLASH_ATTR journal_make_record(uint8_t *buf, unsigned int space,
+		const DH_SETTINGS_DATA *from, const DH_SETTINGS_DATA *to) {
+	const uint8_t *a = (const uint8_t *)from;
+	const uint8_t *b = (const uint8_t *)to;
+	JOURNAL_RECORD *record = (JOURNAL_RECORD *)buf;
+	uint8_t *changes = &buf[sizeof(JOURNAL_RECORD)];
+	unsigned int len = 0;
+	unsigned int i = 0;
+	if(space < sizeof(JOURNAL_RECORD))
+		return -1;
+	space -= sizeof(JOURNAL_RECORD);
+	while(i < sizeof(DH_SETTINGS_DATA)) {
+		if(a[i] == b[i]) {
+			i++;
+			continue;
+		}
+		// join changes if unchanged gap between them is shorter than change header
+		unsigned int last = i;
+		unsigned int j;
+		for(j = i + 1; j < sizeof(DH_SETTINGS_DATA) && j <= last + ESP_SETTINGS_CHANGE_HEADER; j++) {
+			if(a[j] != b[j])
+				last = j;
+		}
+		const unsigned int change_len = last - i + 1;
+		if(len + ESP_SETTINGS_CHANGE_HEADER + change_len > space)
+			return -1;
+		changes[len++] = i >> 8;
+		changes[len++] = i & 0xFF;
+		changes[len++] = change_len >> 8;
+		changes[len++] = change_len & 0xFF;
+		os_memcpy(&changes[len], &b[i], change_len);
+		len += change_len;
+		i = last + 1;
+	}
+	if(len == 0)
+		return 0;
+	const unsigned int aligned = (len + 3) & ~3;
+	if(aligned > space)
+		return -1;
+	os_memset(&changes[len], 0, aligned - len);
+	record->length = len;
+	record->crc = journal_record_crc(record);
+	return sizeof(JOURNAL_RECORD) + aligned;
+}
+
+/**
+ * Write the whole data to the other sector. Current sector stays untouched
+ * until new one is completely written.
+ */
+LOCAL int ICACHE_FLASH_ATTR journal_compact(JOURNAL_BUFFER *buf, const DH_SETTINGS_DATA *data) {
+	const int sector = (mJournalSector == ESP_SETTINGS_MAIN_SEC) ?
+			ESP_SETTINGS_BACKUP_SEC : ESP_SETTINGS_MAIN_SEC;
+	const uint32_t addr = sector * SPI_FLASH_SEC_SIZE;
+	JOURNAL_HEADER header;
+	os_memset(buf->sector, 0xFF, sizeof(buf->sector));
+	os_memset(&buf->image, 0, sizeof(buf->image));
+	const int size = journal_make_record(&buf->sector[sizeof(JOURNAL_HEADER)],
+			SPI_FLASH_SEC_SIZE - sizeof(JOURNAL_HEADER), &buf->image, data);
+	if(size < 0)
+		return 0;
+	header.magic = ESP_SETTINGS_JOURNAL_MAGIC;
+	header.seq = mJournalSeq + 1;
+	if(spi_flash_erase_sector(sector) != SPI_FLASH_RESULT_OK) {
+		dhdebug("Erasing of settings storage failed");
+		return 0;
+	}
+	// magic goes last, it makes sector valid
+	if((size && spi_flash_write(addr + sizeof(JOURNAL_HEADER),
+				&buf->words[sizeof(JOURNAL_HEADER) / sizeof(uint32_t)], size) != SPI_FLASH_RESULT_OK)
+			|| spi_flash_write(addr + sizeof(header.magic), &header.seq, sizeof(header.seq)) != SPI_FLASH_RESULT_OK
+			|| spi_flash_write(addr, &header.magic, sizeof(header.magic)) != SPI_FLASH_RESULT_OK) {
+		dhdebug("Writing to settings storage failed");
+		return 0;
+	}
+	mJournalSector = sector;
+	mJournalSeq = header.seq;
+	mJournalPos = sizeof(JOURNAL_HEADER) + size;
+	return 1;
+}
+
+/**
+ * Append record with changes to the current sector. Return non zero on success.
+ */
+LOCAL int ICACHE_FLASH_ATTR journal_append(JOURNAL_BUFFER *buf, const DH_SETTINGS_DATA *data) {
+	unsigned int end;
+	if(mJournalSector < 0 || mJournalPos >= SPI_FLASH_SEC_SIZE)
+		return 0;
+	if(spi_flash_read(mJournalSector * SPI_FLASH_SEC_SIZE, buf->words,
+			sizeof(buf->sector)) != SPI_FLASH_RESULT_OK)
+		return 0;
+	if(journal_replay(buf->sector, &buf->image, &end) == 0 || end != mJournalPos)
+		return 0;
+	const int size = journal_make_record(&buf->sector[end], SPI_FLASH_SEC_SIZE - end,
+			&buf->image, data);
+	if(size < 0)
+		return 0;
+	if(size == 0)
+		return 1;
+	mJournalPos = SPI_FLASH_SEC_SIZE;
+	if(spi_flash_write(mJournalSector * SPI_FLASH_SEC_SIZE + end,
+			&buf->words[end / sizeof(uint32_t)], size) != SPI_FLASH_RESULT_OK) {
+		dhdebug("Appending to settings storage failed");
+		return 0;
+	}
+	mJournalPos = end + size;
+	return 1;
+}
+
 int ICACHE_FLASH_ATTR dhsettings_init(int *exist) {
+	const int sectors[] = { ESP_SETTINGS_MAIN_SEC, ESP_SETTINGS_BACKUP_SEC };
+	unsigned int end;
+	int i;
 	*exist = 1;
-	DH_SETTINGS *settings = (DH_SETTINGS *)os_malloc(sizeof(DH_SETTINGS));
-	if(settings == NULL) {
+	JOURNAL_BUFFER *buf = (JOURNAL_BUFFER *)os_malloc(sizeof(JOURNAL_BUFFER));
+	if(buf == NULL) {
 		dhdebug("Failed to read settings, no RAM.");
 		return 0;
 	}
+	mJournalSector = -1;
+	mJournalPos = SPI_FLASH_SEC_SIZE;
+	for(i = 0; i < sizeof(sectors) / sizeof(sectors[0]); i++) {
+		if(spi_flash_read(sectors[i] * SPI_FLASH_SEC_SIZE, buf->words,
+				sizeof(buf->sector)) != SPI_FLASH_RESULT_OK)
+			continue;
+		const uint32_t seq = ((JOURNAL_HEADER *)buf->sector)->seq;
+		if(mJournalSector >= 0 && (int32_t)(seq - mJournalSeq) <= 0)
+			continue;
+		if(journal_replay(buf->sector, &buf->image, &end)) {
+			os_memcpy(&mSettingsData, &buf->image, sizeof(DH_SETTINGS_DATA));
+			mJournalSector = sectors[i];
+			mJournalSeq = seq;
+			mJournalPos = end;
+		}
+	}
+	if(mJournalSector >= 0) {
+		dhdebug("Settings successfully loaded from %s storage",
+				(mJournalSector == ESP_SETTINGS_MAIN_SEC) ? "main" : "backup");
+		os_free(buf);
+		return 1;
+	}
+
+	// there is no journal, try settings which were saved by previous firmware versions
+	DH_SETTINGS *settings = &buf->legacy;
 	SpiFlashOpResult res;
 	res = spi_flash_read(ESP_SETTINGS_MAIN_SEC * SPI_FLASH_SEC_SIZE, (uint32 *)settings, sizeof(DH_SETTINGS));
 	int read = 1;
@@ -80,60 +297,53 @@ int ICACHE_FLASH_ATTR dhsettings_init(int *exist) {
 		dhdebug("Settings successfully loaded from main storage");
 	}
 	os_memcpy(&mSettingsData, &settings->data, sizeof(DH_SETTINGS_DATA));
-	os_free(settings);
+	os_free(buf);
 	return read;
 }
 
-LOCAL int ICACHE_FLASH_ATTR dhsettings_write(const DH_SETTINGS_DATA * data) {
+/**
+ * Save data. Changes are appended to the current sector, whole data is written
+ * to the other sector if it's full. With compact, the whole data is always
+ * written and the other sector is erased, so old values don't stay in flash.
+ */
+LOCAL int ICACHE_FLASH_ATTR dhsettings_write(const DH_SETTINGS_DATA *data, int compact) {
 	int res = 1;
-	DH_SETTINGS *settings = (DH_SETTINGS *)os_malloc(sizeof(*settings));
-	if(settings == NULL) {
+	JOURNAL_BUFFER *buf = (JOURNAL_BUFFER *)os_malloc(sizeof(JOURNAL_BUFFER));
+	if(buf == NULL) {
 		dhdebug("Failed to write settings, no RAM.");
 		return 0;
 	}
-	os_memset(settings, 0x0, sizeof(*settings));
-	if(data)
-		os_memcpy(&settings->data, data, sizeof(DH_SETTINGS_DATA));
-	settings->crc = getStorageCrc(settings);
-	if(spi_flash_erase_sector(ESP_SETTINGS_MAIN_SEC) == SPI_FLASH_RESULT_OK) {
-		if(spi_flash_write(ESP_SETTINGS_MAIN_SEC* SPI_FLASH_SEC_SIZE, (uint32 *)settings, sizeof(DH_SETTINGS)) != SPI_FLASH_RESULT_OK) {
-			dhdebug("Writing to main storage failed");
+	if(compact || journal_append(buf, data) == 0) {
+		if(journal_compact(buf, data) == 0) {
 			res = 0;
-		}
-	} else {
-		dhdebug("Erasing of main storage failed");
-		res = 0;
-	}
-	if(spi_flash_erase_sector(ESP_SETTINGS_BACKUP_SEC) == SPI_FLASH_RESULT_OK) {
-		if(spi_flash_write(ESP_SETTINGS_BACKUP_SEC * SPI_FLASH_SEC_SIZE, (uint32 *)settings, sizeof(DH_SETTINGS)) != SPI_FLASH_RESULT_OK) {
-			dhdebug("Writing to backup storage failed");
+		} else if(compact && spi_flash_erase_sector((mJournalSector == ESP_SETTINGS_MAIN_SEC) ?
+				ESP_SETTINGS_BACKUP_SEC : ESP_SETTINGS_MAIN_SEC) != SPI_FLASH_RESULT_OK) {
+			dhdebug("Erasing of old settings storage failed");
 			res = 0;
 		}
-	} else {
-		dhdebug("Erasing of backup storage failed");
-		res = 0;
 	}
 	if(res)
 		dhdebug("Settings successfully wrote");
-	os_free(settings);
+	os_free(buf);
 	return res;
 }
 
-
 int ICACHE_FLASH_ATTR dhsettings_commit(void) {
-	return dhsettings_write(&mSettingsData);
+	return dhsettings_write(&mSettingsData, 0);
 }
 
 int ICACHE_FLASH_ATTR dhsettings_clear(int force) {
 	os_memset(&mSettingsData, 0, sizeof(mSettingsData));
 	if(force) {
+		mJournalSector = -1;
+		mJournalPos = SPI_FLASH_SEC_SIZE;
 		if(spi_flash_erase_sector(ESP_SETTINGS_MAIN_SEC) == SPI_FLASH_RESULT_OK &&
 				spi_flash_erase_sector(ESP_SETTINGS_BACKUP_SEC) == SPI_FLASH_RESULT_OK) {
 			return 1;
 		}
 		return 0;
 	}
-	return dhsettings_write(NULL);
+	return dhsettings_write(&mSettingsData, 1);
 }
 
 WIFI_MODE ICACHE_FLASH_ATTR dhsettings_get_wifi_mode(void) {
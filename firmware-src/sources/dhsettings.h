@@ -1,6 +1,9 @@
 /**
  *	\file		dhsettings.h
  *	\brief		Permanent data storage for firmware.
+ *	\details	Settings are kept as a journal in two flash sectors. Commit appends
+ *				CRC protected record with changed bytes only, sector is erased only
+ *				when it's full and the whole data is moved to the other sector.
  *	\author		Nikolay Khabarov
  *	\date		2015
  *	\copyright	DeviceHive MIT
@@ -36,6 +39,8 @@ int dhsettings_init(int *saved);
 
 /**
  *	\brief			Saves values to permanent storage.
+ *	\details		Only changes since the previous commit are written. Power loss
+ *					during commit keeps either previous or new values.
  *	\return 		Non zero value on success. Zero on error.
  */
 int dhsettings_commit(void);
@@ -151,3 +151,56 @@ void ICACHE_FLASH_ATTR dhstat_got_local_rest_response_error(void)
 {
 	g_stat.localRestResponcesErrors++;
 }
+
+
+/*
+ * @brief Increment number of notifications queued to local clients.
+ */
+void ICACHE_FLASH_ATTR dhstat_got_local_notification(void)
+{
+	g_stat.localNotificationsCount++;
+}
+
+
+/*
+ * @brief Increment number of notifications which local clients didn't get.
+ */
+void ICACHE_FLASH_ATTR dhstat_got_local_notification_dropped(void)
+{
+	g_stat.localNotificationsDropped++;
+}
+
+
+/*
+ * @brief Increment number of reconnections to server.
+ */
+void ICACHE_FLASH_ATTR dhstat_got_reconnect(void)
+{
+	g_stat.reconnectsCount++;
+}
+
+
+/*
+ * @brief Register completed connection phase.
+ * @param[in] phase Connection phase.
+ * @param[in] ms Phase duration in milliseconds.
+ */
+void ICACHE_FLASH_ATTR dhstat_got_phase(DHSTAT_PHASE phase, unsigned int ms)
+{
+	struct DHStatPhase *p = &g_stat.phases[phase];
+	p->lastMs = ms;
+	if (ms > p->maxMs)
+		p->maxMs = ms;
+	p->totalMs += ms;
+	p->count++;
+}
+
+
+/*
+ * @brief Increment number of timeouts of connection phase.
+ * @param[in] phase Connection phase.
+ */
+void ICACHE_FLASH_ATTR dhstat_got_phase_timeout(DHSTAT_PHASE phase)
+{
+	g_stat.phases[phase].timeouts++;
+}
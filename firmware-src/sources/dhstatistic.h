@@ -8,6 +8,31 @@
 #define _DHSTATISTIC_H_
 
 
+/**
+ * @brief Phases of connection to DeviceHive server.
+ */
+typedef enum {
+	DHSTAT_PHASE_RESOLVE,   ///< Resolving server host name.
+	DHSTAT_PHASE_CONNECT,   ///< Establishing TCP connection.
+	DHSTAT_PHASE_INFO,      ///< Getting info from server with WebSocket url.
+	DHSTAT_PHASE_UPGRADE,   ///< Switching protocol to WebSocket.
+	DHSTAT_PHASE_AUTH,      ///< Authentication and command subscription.
+	DHSTAT_PHASE_COUNT      ///< Number of phases.
+} DHSTAT_PHASE;
+
+
+/**
+ * @brief Timing data of single connection phase.
+ */
+struct DHStatPhase {
+	unsigned int lastMs;                    ///< Duration of the last completed phase in milliseconds.
+	unsigned int maxMs;                     ///< Maximum duration of phase in milliseconds.
+	unsigned int totalMs;                   ///< Total duration of all completed phases in milliseconds.
+	unsigned int count;                     ///< Number of completed phases.
+	unsigned int timeouts;                  ///< Number of phase timeouts.
+};
+
+
 /**
  * @brief Various statistic data.
  */
@@ -29,6 +54,11 @@ struct DHStat {
 
 	unsigned int localRestRequestsCount;    ///< Number of requests received via local REST.
 	unsigned int localRestResponcesErrors;  ///< Number of errors in responses to local REST.
+	unsigned int localNotificationsCount;   ///< Number of notifications queued to local clients.
+	unsigned int localNotificationsDropped; ///< Number of notifications not queued to local clients.
+
+	unsigned int reconnectsCount;           ///< Number of scheduled reconnections to server.
+	struct DHStatPhase phases[DHSTAT_PHASE_COUNT]; ///< Connection phases timing.
 };
 
 
@@ -131,4 +161,37 @@ void dhstat_got_local_rest_request(void);
 void dhstat_got_local_rest_response_error(void);
 
 
+/**
+ * @brief Increment number of notifications queued to local clients.
+ */
+void dhstat_got_local_notification(void);
+
+
+/**
+ * @brief Increment number of notifications which local clients didn't get.
+ */
+void dhstat_got_local_notification_dropped(void);
+
+
+/**
+ * @brief Increment number of reconnections to server.
+ */
+void dhstat_got_reconnect(void);
+
+
+/**
+ * @brief Register completed connection phase.
+ * @param[in] phase Connection phase.
+ * @param[in] ms Phase duration in milliseconds.
+ */
+void dhstat_got_phase(DHSTAT_PHASE phase, unsigned int ms);
+
+
+/**
+ * @brief Increment number of timeouts of connection phase.
+ * @param[in] phase Connection phase.
+ */
+void dhstat_got_phase_timeout(DHSTAT_PHASE phase);
+
+
 #endif /* _DHSTATISTIC_H_ */
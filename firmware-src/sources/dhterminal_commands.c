@@ -196,8 +196,25 @@ void ICACHE_FLASH_ATTR dhterminal_commands_status(const char *args) {
 	}
 	dh_uart_send_str(", errors count: ");
 	snprintf(digitBuff, sizeof(digitBuff), "%u", stat->serverErrors);
+	dh_uart_send_str(digitBuff);
+	dh_uart_send_str(", reconnects: ");
+	snprintf(digitBuff, sizeof(digitBuff), "%u", stat->reconnectsCount);
 	dh_uart_send_line(digitBuff);
 
+	static const char *phases[DHSTAT_PHASE_COUNT] = {"resolve", "connect", "info", "upgrade", "auth"};
+	int i;
+	dh_uart_send_str("Connection phases last/avg/max ms (timeouts):");
+	for(i = 0; i < DHSTAT_PHASE_COUNT; i++) {
+		const struct DHStatPhase *phase = &stat->phases[i];
+		dh_uart_send_str(i ? ", " : " ");
+		dh_uart_send_str(phases[i]);
+		snprintf(digitBuff, sizeof(digitBuff), " %u/%u/%u (%u)", phase->lastMs,
+				phase->count ? phase->totalMs / phase->count : 0,
+				phase->maxMs, phase->timeouts);
+		dh_uart_send_str(digitBuff);
+	}
+	dh_uart_send_line("");
+
 	dh_uart_send_str("Responses created/dropped: ");
 	snprintf(digitBuff, sizeof(digitBuff), "%u/%u", stat->responcesTotal, stat->responcesDroppedCount);
 	dh_uart_send_str(digitBuff);
@@ -207,6 +224,9 @@ void ICACHE_FLASH_ATTR dhterminal_commands_status(const char *args) {
 
 	dh_uart_send_str("Local REST requests/errors: ");
 	snprintf(digitBuff, sizeof(digitBuff), "%u/%u", stat->localRestRequestsCount, stat->localRestResponcesErrors);
+	dh_uart_send_str(digitBuff);
+	dh_uart_send_str(", local notifications sent/dropped: ");
+	snprintf(digitBuff, sizeof(digitBuff), "%u/%u", stat->localNotificationsCount, stat->localNotificationsDropped);
 	dh_uart_send_line(digitBuff);
 
 	dh_uart_send_str("Free heap size: ");
@@ -302,7 +322,7 @@ void ICACHE_FLASH_ATTR dhterminal_commands_history(const char *args) {
 
 void ICACHE_FLASH_ATTR dhterminal_commands_reboot(const char *args) {
 	dh_uart_send_line("Rebooting...");
-	system_restart();
+	dh_uart_drain(system_restart); // reboot when output is sent
 }
 
 void ICACHE_FLASH_ATTR dhterminal_commands_config(const char *args) {
@@ -328,7 +348,7 @@ void ICACHE_FLASH_ATTR dhterminal_commands_configure(const char *args) {
 	if(force || os_strcmp(args, "--clear") == 0) {
 		if(dhsettings_clear(force)) {
 			dh_uart_send_line("Settings was cleared, rebooting...");
-			system_restart();
+			dh_uart_drain(system_restart); // reboot when output is sent
 		} else {
 			dh_uart_send_line("Error while cleaning settings.");
 		}
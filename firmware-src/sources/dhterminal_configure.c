@@ -30,7 +30,7 @@ LOCAL void ICACHE_FLASH_ATTR get_key_cb(const char *key) {
 	if(dhsettings_commit()) {
 		dh_uart_send_line("OK");
 		dh_uart_send_line("Rebooting...");
-		system_restart();
+		dh_uart_drain(system_restart); // reboot when output is sent
 	} else {
 		dh_uart_send_line("ERROR. Not saved. Check debug output.");
 	}
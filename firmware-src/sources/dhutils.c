@@ -173,13 +173,30 @@ void ICACHE_FLASH_ATTR delay_ms(unsigned int ms) {
 		os_delay_us(ms * 1000);
 }
 
+uint32_t ICACHE_FLASH_ATTR isqrt(uint32_t x) {
+	uint32_t res = 0;
+	uint32_t bit = 1UL << 30;
+	while(bit > x)
+		bit >>= 2;
+	while(bit) {
+		if(x >= res + bit) {
+			x -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+	return res;
+}
+
 char ICACHE_FLASH_ATTR to_lower(char c) {
 	if(c >= 'A' && c <= 'Z')
 		return 'a' + c - 'A';
 	return c;
 }
 
-int ICACHE_FLASH_ATTR strncasecmp(const char *s1, const char *s2, int n) {
+int ICACHE_FLASH_ATTR strncasecmp(const char *s1, const char *s2, size_t n) {
 	char c1, c2;
 	while((c1 = to_lower(*s1)) == (c2 = to_lower(*s2))) {
 		s1++;
@@ -139,6 +139,13 @@ static inline int signedInt16le(const char *buf, int pos) {
  */
 void delay_ms(unsigned int ms);
 
+/**
+ * @brief Integer square root.
+ * @param[in] x Value.
+ * @return Square root rounded down.
+ */
+uint32_t isqrt(uint32_t x);
+
 /**
  * @brief Reverse bits in byte.
  * @param[in] v Byte.
@@ -163,6 +170,6 @@ char to_lower(char c);
  * @param[in] n Maximum string length to compare.
  * @return Relationship between the strings, zero if equal.
  */
-int strncasecmp(const char *s1, const char *s2, int n);
+int strncasecmp(const char *s1, const char *s2, size_t n);
 
 #endif /* _DHUTILS_H_ */
@@ -44,7 +44,7 @@ LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR check_if_configured(
 	return HRCS_NOT_FINISHED;
 }
 
-LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR get_cb(const char *path,
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR get_cb(const char *path, const char *query,
 		const char *key, HTTP_CONTENT *content_in, HTTP_ANSWER *answer) {
 	HTTP_RESPONSE_STATUS res = check_if_configured(answer);
 	if(res != HRCS_NOT_FINISHED)
@@ -61,7 +61,7 @@ LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR get_cb(const char *path,
 	return HRCS_NOT_FOUND;
 }
 
-LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR post_cb(const char *path,
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR post_cb(const char *path, const char *query,
 		const char *key, HTTP_CONTENT *content_in, HTTP_ANSWER *answer) {
 	HTTP_RESPONSE_STATUS res = check_if_configured(answer);
 	if(res != HRCS_NOT_FINISHED)
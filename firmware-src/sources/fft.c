@@ -0,0 +1,276 @@
+/**
+ * @file
+ * @brief Fixed point FFT for spectrum analysis.
+ * @copyright 2017 [DeviceHive](http://devicehive.com)
+ */
+#include "fft.h"
+#include "dhutils.h"
+#include "snprintf.h"
+
+#include <osapi.h>
+
+/** Maximum amplitude of prepared samples, leaves room for rounding. */
+#define MAX_AMPLITUDE 0x3FFF
+
+/**
+ * Quarter of sine wave for FFT_MAX_SIZE points, Q15.
+ */
+static const int16_t mSin[FFT_MAX_SIZE / 4 + 1] = {
+	0, 402, 804, 1206, 1608, 2009, 2410, 2811,
+	3212, 3612, 4011, 4410, 4808, 5205, 5602, 5998,
+	6393, 6786, 7179, 7571, 7962, 8351, 8739, 9126,
+	9512, 9896, 10278, 10659, 11039, 11417, 11793, 12167,
+	12539, 12910, 13279, 13645, 14010, 14372, 14732, 15090,
+	15446, 15800, 16151, 16499, 16846, 17189, 17530, 17869,
+	18204, 18537, 18868, 19195, 19519, 19841, 20159, 20475,
+	20787, 21096, 21403, 21705, 22005, 22301, 22594, 22884,
+	23170, 23452, 23731, 24007, 24279, 24547, 24811, 25072,
+	25329, 25582, 25832, 26077, 26319, 26556, 26790, 27019,
+	27245, 27466, 27683, 27896, 28105, 28310, 28510, 28706,
+	28898, 29085, 29268, 29447, 29621, 29791, 29956, 30117,
+	30273, 30424, 30571, 30714, 30852, 30985, 31113, 31237,
+	31356, 31470, 31580, 31685, 31785, 31880, 31971, 32057,
+	32137, 32213, 32285, 32351, 32412, 32469, 32521, 32567,
+	32609, 32646, 32678, 32705, 32728, 32745, 32757, 32765,
+	32767
+};
+
+
+/**
+ * @brief Sine of full circle divided in FFT_MAX_SIZE parts.
+ * @param[in] m Angle in 1/FFT_MAX_SIZE of circle.
+ * @return Sine value, Q15.
+ */
+static inline int sin_q15(unsigned int m)
+{
+	m &= FFT_MAX_SIZE - 1;
+	if (m < FFT_MAX_SIZE / 4)
+		return mSin[m];
+	if (m < FFT_MAX_SIZE / 2)
+		return mSin[FFT_MAX_SIZE / 2 - m];
+	if (m < FFT_MAX_SIZE * 3 / 4)
+		return -mSin[m - FFT_MAX_SIZE / 2];
+	return -mSin[FFT_MAX_SIZE - m];
+}
+
+
+/**
+ * @brief Cosine of full circle divided in FFT_MAX_SIZE parts.
+ * @param[in] m Angle in 1/FFT_MAX_SIZE of circle.
+ * @return Cosine value, Q15.
+ */
+static inline int cos_q15(unsigned int m)
+{
+	return sin_q15(m + FFT_MAX_SIZE / 4);
+}
+
+
+/*
+ * fft_check_size() implementation.
+ */
+int ICACHE_FLASH_ATTR fft_check_size(unsigned int n)
+{
+	return n >= FFT_MIN_SIZE && n <= FFT_MAX_SIZE && (n & (n - 1)) == 0;
+}
+
+
+/*
+ * fft_prepare() implementation.
+ */
+int ICACHE_FLASH_ATTR fft_prepare(int16_t *re, int16_t *im, unsigned int n)
+{
+	// work with samples multiplied by n, so DC is removed exactly
+	int32_t sum = 0;
+	unsigned int i;
+	for (i = 0; i < n; i++)
+		sum += re[i];
+
+	int32_t peak = 0;
+	for (i = 0; i < n; i++) {
+		const int32_t v = re[i] * (int32_t)n - sum;
+		if (v > peak)
+			peak = v;
+		else if (-v > peak)
+			peak = -v;
+	}
+
+	int shift = 0;
+	if (peak) {
+		while (peak > MAX_AMPLITUDE) {
+			peak >>= 1;
+			shift--;
+		}
+		while (peak <= MAX_AMPLITUDE / 2) {
+			peak <<= 1;
+			shift++;
+		}
+	}
+
+	// periodic Hann window
+	const unsigned int step = FFT_MAX_SIZE / n;
+	for (i = 0; i < n; i++) {
+		int32_t v = re[i] * (int32_t)n - sum;
+		if (shift >= 0)
+			v *= 1 << shift;
+		else
+			v = (v + (1 << (-shift - 1))) >> -shift;
+		const int32_t w = (0x7FFF - cos_q15(i * step)) >> 1;
+		re[i] = (v * w + 0x4000) >> 15;
+		im[i] = 0;
+	}
+
+	// shift relative to original samples
+	for (i = n; i > 1; i >>= 1)
+		shift++;
+	return shift;
+}
+
+
+/*
+ * fft_transform() implementation.
+ */
+void ICACHE_FLASH_ATTR fft_transform(int16_t *re, int16_t *im, unsigned int n)
+{
+	unsigned int i, j, k;
+
+	// bit reversal permutation
+	for (i = 1, j = 0; i < n; i++) {
+		unsigned int bit = n >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			int16_t t = re[i];
+			re[i] = re[j];
+			re[j] = t;
+			t = im[i];
+			im[i] = im[j];
+			im[j] = t;
+		}
+	}
+
+	// butterflies, every stage is scaled by 1/2
+	unsigned int len;
+	for (len = 2; len <= n; len <<= 1) {
+		const unsigned int half = len >> 1;
+		const unsigned int step = FFT_MAX_SIZE / len;
+		for (k = 0; k < half; k++) {
+			const int32_t wr = cos_q15(k * step);
+			const int32_t wi = -sin_q15(k * step);
+			for (i = k; i < n; i += len) {
+				j = i + half;
+				const int32_t tr = (wr * re[j] - wi * im[j] + 0x4000) >> 15;
+				const int32_t ti = (wr * im[j] + wi * re[j] + 0x4000) >> 15;
+				const int32_t ur = re[i];
+				const int32_t ui = im[i];
+				re[i] = (ur + tr) >> 1;
+				im[i] = (ui + ti) >> 1;
+				re[j] = (ur - tr) >> 1;
+				im[j] = (ui - ti) >> 1;
+			}
+		}
+	}
+}
+
+
+/*
+ * fft_magnitude() implementation.
+ */
+void ICACHE_FLASH_ATTR fft_magnitude(const int16_t *re, const int16_t *im,
+                                     uint16_t *mag, unsigned int bins)
+{
+	unsigned int k;
+	for (k = 0; k < bins; k++) {
+		const int32_t r = re[k];
+		const int32_t i = im[k];
+		mag[k] = isqrt(r * r + i * i);
+	}
+}
+
+
+/*
+ * fft_peaks() implementation.
+ */
+unsigned int ICACHE_FLASH_ATTR fft_peaks(const uint16_t *mag, unsigned int bins,
+                                         FFT_PEAK *peaks, unsigned int num)
+{
+	unsigned int found = 0;
+	unsigned int k;
+	for (k = 1; k + 1 < bins; k++) {
+		const int32_t a = mag[k - 1];
+		const int32_t b = mag[k];
+		const int32_t c = mag[k + 1];
+		if (b <= a || b < c)
+			continue; // not a local maximum
+
+		// insert sorted by magnitude, the lowest one drops out
+		unsigned int pos = found;
+		while (pos > 0 && peaks[pos - 1].magnitude < b) {
+			if (pos < num)
+				peaks[pos] = peaks[pos - 1];
+			pos--;
+		}
+		if (pos >= num)
+			continue;
+
+		// parabolic interpolation, denominator is always negative here
+		peaks[pos].bin = k;
+		peaks[pos].offset = 128 * (a - c) / (a - 2 * b + c);
+		peaks[pos].magnitude = b;
+		if (found < num)
+			found++;
+	}
+	return found;
+}
+
+
+/*
+ * fft_spectrum_json() implementation.
+ */
+int ICACHE_FLASH_ATTR fft_spectrum_json(char *buf, unsigned int buf_len,
+                                        int16_t *re, int16_t *im, unsigned int n,
+                                        float resolution, float scale,
+                                        unsigned int peaks, unsigned int bins)
+{
+	const int shift = fft_prepare(re, im, n);
+	fft_transform(re, im, n);
+
+	const unsigned int half = n / 2;
+	uint16_t *mag = (uint16_t *)re;
+	fft_magnitude(re, im, mag, half);
+
+	// transform is scaled by 1/n, one-sided spectrum doubles
+	// amplitude and Hann window halves it
+	const float unit = 4.0f * ((shift >= 0) ? scale / (1 << shift)
+	                                        : scale * (1 << -shift));
+	unsigned int i;
+	int len;
+	if (bins) {
+		len = snprintf(buf, buf_len, "\"bins\":[");
+		for (i = 0; i < bins; i++) {
+			const unsigned int end = (i + 1) * half / bins;
+			unsigned int k = i * half / bins;
+			unsigned int max = 0;
+			for (; k < end; k++) {
+				if (mag[k] > max)
+					max = mag[k];
+			}
+			len += snprintf(&buf[len], buf_len - len, "%s%f",
+			                i ? ", " : "", max * unit);
+		}
+	} else {
+		FFT_PEAK found[FFT_MAX_PEAKS];
+		const unsigned int num = fft_peaks(mag, half, found,
+		                                   (peaks < FFT_MAX_PEAKS) ? peaks : FFT_MAX_PEAKS);
+		len = snprintf(buf, buf_len, "\"peaks\":[");
+		for (i = 0; i < num; i++) {
+			len += snprintf(&buf[len], buf_len - len,
+			                "%s{\"frequency\":%f, \"amplitude\":%f}", i ? ", " : "",
+			                (found[i].bin + found[i].offset / 256.0f) * resolution,
+			                found[i].magnitude * unit);
+		}
+	}
+	len += snprintf(&buf[len], buf_len - len, "]");
+
+	return len;
+}
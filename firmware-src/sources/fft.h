@@ -0,0 +1,122 @@
+/**
+ * @file
+ * @brief Fixed point FFT for spectrum analysis.
+ * @copyright 2017 [DeviceHive](http://devicehive.com)
+ *
+ * Radix-2 transform of 16 bits samples. Every stage is scaled by 1/2,
+ * so result is the spectrum divided by number of samples and never
+ * overflows.
+ */
+#ifndef _FFT_H_
+#define _FFT_H_
+
+#include <c_types.h>
+
+/** Minimum number of samples. */
+#define FFT_MIN_SIZE 16
+
+/** Maximum number of samples. */
+#define FFT_MAX_SIZE 512
+
+/** Maximum number of reported peaks. */
+#define FFT_MAX_PEAKS 8
+
+/** Maximum number of reported bins. */
+#define FFT_MAX_BINS 32
+
+/** Maximum length of JSON produced by fft_spectrum_json(). */
+#define FFT_JSON_MAX_LENGTH 512
+
+
+/**
+ * @brief Spectrum peak.
+ */
+typedef struct {
+	uint16_t bin;       ///< @brief Bin index.
+	int16_t offset;     ///< @brief Interpolated peak position relative to bin, 1/256 of bin.
+	uint16_t magnitude; ///< @brief Bin magnitude.
+} FFT_PEAK;
+
+
+/**
+ * @brief Check number of samples.
+ * @param[in] n Number of samples.
+ * @return Non zero if number of samples is a supported power of two.
+ */
+int fft_check_size(unsigned int n);
+
+
+/**
+ * @brief Prepare samples for transform.
+ *
+ * Removes DC, scales samples to use half of 16 bits range
+ * and applies Hann window. Imaginary part is zeroed.
+ *
+ * @param[in,out] re Samples.
+ * @param[out] im Imaginary part.
+ * @param[in] n Number of samples.
+ * @return Number of bits samples were shifted left.
+ */
+int fft_prepare(int16_t *re, int16_t *im, unsigned int n);
+
+
+/**
+ * @brief In place forward transform.
+ *
+ * Result is scaled by 1/n.
+ *
+ * @param[in,out] re Real part.
+ * @param[in,out] im Imaginary part.
+ * @param[in] n Number of samples, see fft_check_size().
+ */
+void fft_transform(int16_t *re, int16_t *im, unsigned int n);
+
+
+/**
+ * @brief Calculate magnitudes.
+ * @param[in] re Real part.
+ * @param[in] im Imaginary part.
+ * @param[out] mag Magnitudes. Can be the same buffer as `re`.
+ * @param[in] bins Number of bins to calculate.
+ */
+void fft_magnitude(const int16_t *re, const int16_t *im,
+                   uint16_t *mag, unsigned int bins);
+
+
+/**
+ * @brief Find the highest peaks.
+ * @param[in] mag Magnitudes.
+ * @param[in] bins Number of bins.
+ * @param[out] peaks Peaks sorted by magnitude, the highest first.
+ * @param[in] num Maximum number of peaks.
+ * @return Number of peaks found.
+ */
+unsigned int fft_peaks(const uint16_t *mag, unsigned int bins,
+                       FFT_PEAK *peaks, unsigned int num);
+
+
+/**
+ * @brief Analyse samples and format spectrum as JSON.
+ *
+ * Writes either `"peaks":[{"frequency":f, "amplitude":a}, ...]` or,
+ * if `bins` is not zero, `"bins":[a, ...]` where every bin is the
+ * maximum amplitude in equal part of range from zero to half of
+ * sampling rate. Amplitudes are in the same units as `scale`.
+ *
+ * @param[out] buf Output buffer.
+ * @param[in] buf_len Output buffer length.
+ * @param[in,out] re Samples. Destroyed.
+ * @param[out] im Buffer of `n` elements for imaginary part.
+ * @param[in] n Number of samples, see fft_check_size().
+ * @param[in] resolution Bin width in hertz.
+ * @param[in] scale Value of one sample unit.
+ * @param[in] peaks Number of peaks to report.
+ * @param[in] bins Number of bins to report, zero to report peaks.
+ * @return Number of characters written.
+ */
+int fft_spectrum_json(char *buf, unsigned int buf_len,
+                      int16_t *re, int16_t *im, unsigned int n,
+                      float resolution, float scale,
+                      unsigned int peaks, unsigned int bins);
+
+#endif /* _FFT_H_ */
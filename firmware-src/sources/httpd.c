@@ -8,6 +8,7 @@
  */
 
 #include "httpd.h"
+#include "httpd_parser.h"
 #include "dhdebug.h"
 #include "dhesperrors.h"
 #include "dhsettings.h"
@@ -19,6 +20,8 @@
 #include "irom.h"
 #include "user_config.h"
 #include "dhutils.h"
+#include "sha1.h"
+#include "base64.h"
 
 #include <ets_sys.h>
 #include <osapi.h>
@@ -29,27 +32,76 @@
 
 #define MAX_CONNECTIONS 5
 #define POST_BUF_SIZE 2048
-#define MAX_SINGLE_PACKET 2048
-#define MAX_PATH 64
+#define POST_BUF_COUNT 3
+#define PENDING_BUF_SIZE 2048
+#define HTTPD_TCP_MSS 1460
+// two segments per send, so client acknowledges them without delay
+#define SEND_BUF_SIZE (2 * HTTPD_TCP_MSS)
+// chunk is framed with "XXXX\r\n" and "\r\n"
+#define CHUNK_HEAD_LEN 6
+#define CHUNK_OVERHEAD (CHUNK_HEAD_LEN + 2)
+#define MAX_ETAG 32
+#define KEEP_ALIVE_TIMEOUT_S 10
+#define MAX_STREAMS 3
+// the biggest notification with frame header fits
+#define STREAM_BUF_SIZE 3072
+// dead clients are detected by failed sending of ping
+#define STREAM_PING_INTERVAL_MS 30000
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+#define WS_FINAL_FRAME 0x80
+#define WS_MASKED 0x80
+#define WS_MASK_SIZE 4
+#define WS_CLOSE_NORMAL 1000
+#define WS_CLOSE_PROTOCOL_ERROR 1002
+#define WS_CLOSE_UNSUPPORTED 1003
+#define WS_CLOSE_TOO_BIG 1009
+
+typedef struct {
+	char *data;
+	unsigned used : 1;
+} POST_BUF;
 
 typedef struct {
 	uint8 remote_ip[4];
 	int remote_port;
+	struct espconn *conn;
+	HTTP_PARSER parser;
 	HTTP_CONTENT content;
+	unsigned int content_pos;
+	HttpContentGenerator generator;
+	void *generator_arg;
+	char *pending;
+	unsigned int pending_len;
+	POST_BUF *post;
+	unsigned int post_len;
+	HttpStreamCb stream;
+	void *stream_arg;
+	char *stream_buf;
+	unsigned int stream_len;
 	unsigned free_mem : 1;
-} CONTENT_ITEM;
+	unsigned busy : 1;
+	unsigned keep_alive : 1;
+	unsigned chunked : 1;
+	unsigned websocket : 1;
+} CONNECTION_ITEM;
 
 LOCAL struct espconn mHttpdConn;
 LOCAL const char *mRedirectHost = 0;
-LOCAL unsigned int mConnected = 0;
-LOCAL struct espconn *mCurrentPost = 0;
-LOCAL char *mPostBuf = 0;
-LOCAL unsigned int mPostBufPos = 0;
 LOCAL HttpRequestCb mGetHttpRequestCb = 0;
 LOCAL HttpRequestCb mPostHttpRequestCb = 0;
-LOCAL CONTENT_ITEM mContentQueue[MAX_CONNECTIONS] = {{{0}}};
+LOCAL CONNECTION_ITEM mConnections[MAX_CONNECTIONS] = {{{0}}};
+LOCAL POST_BUF mPostBufs[POST_BUF_COUNT] = {{0}};
+LOCAL char *mSendBuf = 0;
+LOCAL os_timer_t mStreamTimer;
+LOCAL const char mWebSocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
-LOCAL int ICACHE_FLASH_ATTR is_remote_equal(const esp_tcp *tcp, CONTENT_ITEM *item) {
+LOCAL void ICACHE_FLASH_ATTR handle_pending(CONNECTION_ITEM *item, struct espconn *conn);
+
+LOCAL int ICACHE_FLASH_ATTR is_remote_equal(const esp_tcp *tcp, CONNECTION_ITEM *item) {
 	if(os_memcmp(tcp->remote_ip, item->remote_ip, sizeof(tcp->remote_ip)) == 0
 			&& tcp->remote_port == item->remote_port) {
 		return 1;
@@ -57,55 +109,241 @@ LOCAL int ICACHE_FLASH_ATTR is_remote_equal(const esp_tcp *tcp, CONTENT_ITEM *it
 	return 0;
 }
 
-LOCAL void ICACHE_FLASH_ATTR send_res(struct espconn *conn, const char *data, int len) {
-	sint8 res;
-	if (is_irom(data)) {
-		char buf[len];
-		irom_read(buf, len, data);
-		res = espconn_send(conn, (uint8_t*)buf, len);
-	} else {
-		res = espconn_send(conn, (uint8_t*)data, len);
+LOCAL CONNECTION_ITEM *ICACHE_FLASH_ATTR find_item(struct espconn *conn) {
+	CONNECTION_ITEM *item = (CONNECTION_ITEM *)conn->reverse;
+	if(item && item->remote_port && is_remote_equal(conn->proto.tcp, item))
+		return item;
+	// system can pass listening espconn to disconnect callbacks, search by remote address
+	int i;
+	for(i = 0; i < MAX_CONNECTIONS; i++) {
+		if(mConnections[i].remote_port && is_remote_equal(conn->proto.tcp, &mConnections[i]))
+			return &mConnections[i];
 	}
-	if(res) {
-		dhstat_got_network_error();
-		dhesperrors_espconn_result("Httpd espconn_send returned:", res);
-	} else {
-		dhstat_add_bytes_sent(len);
+	return 0;
+}
+
+LOCAL void ICACHE_FLASH_ATTR free_content(CONNECTION_ITEM *item) {
+	if(item->free_mem)
+		os_free((void*)item->content.data);
+	item->content.data = 0;
+	item->content.len = 0;
+	item->content_pos = 0;
+	item->free_mem = 0;
+	if(item->generator)
+		item->generator(0, 0, item->generator_arg);
+	item->generator = 0;
+	item->generator_arg = 0;
+	item->chunked = 0;
+}
+
+LOCAL void ICACHE_FLASH_ATTR free_answer(HTTP_ANSWER *answer) {
+	if(answer->free_content)
+		os_free((void*)answer->content.data);
+	if(answer->generator)
+		answer->generator(0, 0, answer->generator_arg);
+}
+
+LOCAL unsigned int ICACHE_FLASH_ATTR stream_count(void) {
+	unsigned int i, count = 0;
+	for(i = 0; i < MAX_CONNECTIONS; i++) {
+		if(mConnections[i].stream)
+			count++;
 	}
+	return count;
 }
 
-LOCAL int ICACHE_FLASH_ATTR dequeue(struct espconn *conn, int send) {
+LOCAL void ICACHE_FLASH_ATTR close_stream(CONNECTION_ITEM *item) {
+	HttpStreamCb cb = item->stream;
+	if(cb == 0)
+		return;
+	item->stream = 0;
+	item->websocket = 0;
+	if(item->stream_buf)
+		os_free(item->stream_buf);
+	item->stream_buf = 0;
+	item->stream_len = 0;
+	if(stream_count() == 0)
+		os_timer_disarm(&mStreamTimer);
+	cb(item - mConnections, HSE_CLOSE, 0, 0, item->stream_arg);
+}
+
+LOCAL POST_BUF *ICACHE_FLASH_ATTR acquire_post_buf(void) {
 	int i;
-	for(i = 0; i < MAX_CONNECTIONS; i++) {
-		if(is_remote_equal(conn->proto.tcp, &mContentQueue[i])) {
-			if(send) {
-				if(mContentQueue[i].content.len > MAX_SINGLE_PACKET &&
-						mContentQueue[i].free_mem == 0) {
-					send_res(conn, mContentQueue[i].content.data,
-							MAX_SINGLE_PACKET);
-					mContentQueue[i].content.len -= MAX_SINGLE_PACKET;
-					mContentQueue[i].content.data += MAX_SINGLE_PACKET;
-					if(mContentQueue[i].content.len) {
-						return 1;
-					}
-				} else {
-					send_res(conn, mContentQueue[i].content.data,
-							mContentQueue[i].content.len);
-				}
-			}
-			if(mContentQueue[i].free_mem) {
-				os_free((void*)mContentQueue[i].content.data);
+	for(i = 0; i < POST_BUF_COUNT; i++) {
+		if(mPostBufs[i].used == 0) {
+			if(mPostBufs[i].data == 0) {
+				// one more byte to keep data null terminated for parser
+				mPostBufs[i].data = (char*)os_malloc(POST_BUF_SIZE + 1);
+				if(mPostBufs[i].data == 0)
+					return 0;
 			}
-			mContentQueue[i].remote_port = 0;
-			return 1;
+			mPostBufs[i].used = 1;
+			return &mPostBufs[i];
 		}
 	}
 	return 0;
 }
 
+LOCAL void ICACHE_FLASH_ATTR release_post_buf(CONNECTION_ITEM *item) {
+	if(item->post) {
+		item->post->used = 0;
+		item->post = 0;
+	}
+	item->post_len = 0;
+}
+
+LOCAL void ICACHE_FLASH_ATTR free_buffers(void) {
+	int i;
+	for(i = 0; i < MAX_CONNECTIONS; i++) {
+		if(mConnections[i].remote_port)
+			return;
+	}
+	// no more connections, return memory to system
+	for(i = 0; i < POST_BUF_COUNT; i++) {
+		if(mPostBufs[i].data)
+			os_free(mPostBufs[i].data);
+		mPostBufs[i].data = 0;
+		mPostBufs[i].used = 0;
+	}
+	if(mSendBuf)
+		os_free(mSendBuf);
+	mSendBuf = 0;
+}
+
+LOCAL void ICACHE_FLASH_ATTR release_item(CONNECTION_ITEM *item) {
+	close_stream(item);
+	free_content(item);
+	if(item->pending)
+		os_free(item->pending);
+	item->pending = 0;
+	item->pending_len = 0;
+	release_post_buf(item);
+	httpd_parser_reset(&item->parser);
+	item->remote_port = 0;
+	free_buffers();
+}
+
+LOCAL int ICACHE_FLASH_ATTR append_pending(CONNECTION_ITEM *item, const char *data, unsigned int len) {
+	if(item->pending_len + len > PENDING_BUF_SIZE)
+		return 0;
+	char *buf = (char*)os_malloc(item->pending_len + len);
+	if(buf == 0)
+		return 0;
+	if(item->pending) {
+		os_memcpy(buf, item->pending, item->pending_len);
+		os_free(item->pending);
+	}
+	os_memcpy(&buf[item->pending_len], data, len);
+	item->pending = buf;
+	item->pending_len += len;
+	return 1;
+}
+
+LOCAL void ICACHE_FLASH_ATTR copy_data(char *buf, const char *data, unsigned int len) {
+	if(is_irom(data))
+		irom_read(buf, len, data);
+	else
+		os_memcpy(buf, data, len);
+}
+
+LOCAL unsigned int ICACHE_FLASH_ATTR fill_chunk(CONNECTION_ITEM *item, char *buf, unsigned int size) {
+	RO_DATA char last_chunk[] = "0\r\n\r\n";
+	if(size <= CHUNK_OVERHEAD)
+		return 0;
+	unsigned int len = item->generator(&buf[CHUNK_HEAD_LEN], size - CHUNK_OVERHEAD, item->generator_arg);
+	if(len == 0) {
+		item->generator = 0;
+		irom_read(buf, sizeof(last_chunk) - 1, last_chunk);
+		return sizeof(last_chunk) - 1;
+	}
+	byteToHex((len >> 8) & 0xFF, &buf[0]);
+	byteToHex(len & 0xFF, &buf[2]);
+	buf[4] = '\r';
+	buf[5] = '\n';
+	buf[CHUNK_HEAD_LEN + len] = '\r';
+	buf[CHUNK_HEAD_LEN + len + 1] = '\n';
+	return len + CHUNK_OVERHEAD;
+}
+
+LOCAL unsigned int ICACHE_FLASH_ATTR fill_body(CONNECTION_ITEM *item, char *buf, unsigned int size) {
+	if(item->generator) {
+		if(item->chunked)
+			return fill_chunk(item, buf, size);
+		unsigned int len = item->generator(buf, size, item->generator_arg);
+		if(len == 0)
+			item->generator = 0;
+		return len;
+	}
+	unsigned int len = item->content.len - item->content_pos;
+	if(len > size)
+		len = size;
+	copy_data(buf, &item->content.data[item->content_pos], len);
+	item->content_pos += len;
+	if(item->content_pos == item->content.len)
+		free_content(item);
+	return len;
+}
+
+/**
+ * Send head (if any) followed by as much of queued response body as fits
+ * into a single send buffer. The rest is sent from sent callback, so stack
+ * usage doesn't depend on response size and source.
+ * Return positive value if something was sent, zero if there is nothing to send
+ * and negative value if sending failed and connection is being closed.
+ */
+LOCAL int ICACHE_FLASH_ATTR send_next(CONNECTION_ITEM *item, struct espconn *conn,
+		const char *head, unsigned int head_len) {
+	if(mSendBuf == 0) {
+		mSendBuf = (char*)os_malloc(SEND_BUF_SIZE);
+		if(mSendBuf == 0) {
+			dhdebug("Httpd no memory to send");
+			free_content(item);
+			item->keep_alive = 0;
+			espconn_disconnect(conn);
+			return -1;
+		}
+	}
+	unsigned int len = 0;
+	if(head) {
+		len = (head_len > SEND_BUF_SIZE) ? SEND_BUF_SIZE : head_len;
+		copy_data(mSendBuf, head, len);
+	}
+	while(len < SEND_BUF_SIZE && (item->content.len || item->generator)) {
+		unsigned int res = fill_body(item, &mSendBuf[len], SEND_BUF_SIZE - len);
+		if(res == 0)
+			break;
+		len += res;
+	}
+	if(len < SEND_BUF_SIZE && item->stream_len) {
+		unsigned int part = SEND_BUF_SIZE - len;
+		if(part > item->stream_len)
+			part = item->stream_len;
+		os_memcpy(&mSendBuf[len], item->stream_buf, part);
+		item->stream_len -= part;
+		os_memmove(item->stream_buf, &item->stream_buf[part], item->stream_len);
+		len += part;
+	}
+	if(len == 0)
+		return 0;
+	sint8 res = espconn_send(conn, (uint8_t*)mSendBuf, len);
+	if(res) {
+		dhstat_got_network_error();
+		dhesperrors_espconn_result("Httpd espconn_send returned:", res);
+		// sent callback won't be called, don't wait for idle timeout
+		free_content(item);
+		item->keep_alive = 0;
+		espconn_disconnect(conn);
+		return -1;
+	}
+	dhstat_add_bytes_sent(len);
+	return 1;
+}
+
 LOCAL void ICACHE_FLASH_ATTR on_client_disconnect(struct espconn *conn) {
-	dequeue(conn, 0);
-	mConnected--;
+	CONNECTION_ITEM *item = find_item(conn);
+	if(item)
+		release_item(item);
+	conn->reverse = 0;
 }
 
 LOCAL void ICACHE_FLASH_ATTR dhap_httpd_disconnect_cb(void *arg) {
@@ -114,138 +352,354 @@ LOCAL void ICACHE_FLASH_ATTR dhap_httpd_disconnect_cb(void *arg) {
 
 LOCAL void ICACHE_FLASH_ATTR dhap_httpd_sent_cb(void *arg) {
 	struct espconn *conn = arg;
-	if(dequeue((struct espconn *)arg, 1)) {
+	CONNECTION_ITEM *item = find_item(conn);
+	if(item == 0) {
+		espconn_disconnect(conn);
 		return;
 	}
-	espconn_disconnect(conn);
-}
-
-LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR parse_request(
-		const char *data, unsigned short len, HttpRequestCb cb, HTTP_ANSWER *answer) {
-	static const char content_length[] = "Content-Length:";
-	static const char authorization[] = "Authorization:";
-	static const char bearer[] = "Bearer";
-	static const char sp[] = "\r\n\r\n";
-	int i, j;
-	char path[MAX_PATH];
-	char key[DHSETTINGS_KEY_MAX_LENGTH];
-
-	i = 0;
-	while(data[i] != ' ') // rewind method
-		i++;
-	while(data[i] == ' ')
-		i++;
-	j = i;
-	while(data[j] != ' ' && data[j] != '?') // find end of path
-		j++;
-	if(j - i >= MAX_PATH)
-		return HRCS_NOT_FOUND;
-	snprintf(path, j - i + 1, "%s", &data[i]);
-
-	unsigned int cont_len = 0;
-	key[0] = 0;
-	HTTP_RESPONSE_STATUS res = HRCS_INTERNAL_ERROR;
-	for(i = j; i < len; i++) {
-		if(strncasecmp(&data[i], content_length, sizeof(content_length) - 1) == 0) {
-			i += sizeof(content_length) - 1;
-			while(data[i] == ' ')
-				i++;
-			if(strToUInt(&data[i], &cont_len) == 0) {
-				res = HRCS_BAD_REQUEST;
-				break;
-			}
-		} else if(strncasecmp(&data[i], authorization, sizeof(authorization) - 1) == 0) {
-			i += sizeof(authorization) - 1;
-			while(data[i] == ' ')
-				i++;
-			if(strncasecmp(&data[i], bearer, sizeof(bearer) - 1) == 0) {
-				i += sizeof(bearer) - 1;
-				while(data[i] == ' ')
-					i++;
-				j = i;
-				while(data[j] != '\r')
-					j++;
-				snprintf(key, (j - i < DHSETTINGS_KEY_MAX_LENGTH) ?
-						(j - i + 1) : DHSETTINGS_KEY_MAX_LENGTH,
-						"%s", &data[i]);
-				i = j - 1;
-			}
-		} else if(os_strncmp(&data[i], sp, sizeof(sp) - 1) == 0) {
-			i += sizeof(sp) - 1;
-			if(cont_len && cont_len > len - i) {
-				res = HRCS_NOT_FINISHED;
-				break;
-			}
-			HTTP_CONTENT in;
-			in.data = cont_len ? &data[i] : 0;
-			in.len = cont_len;
-			res = cb(path, key, &in, answer);
-			break;
+	if(send_next(item, conn, 0, 0)) {
+		return; // sent or closed
+	}
+	item->busy = 0;
+	if(item->keep_alive == 0) {
+		espconn_disconnect(conn);
+		return;
+	}
+	// handle pipelined requests, stream keeps only not completed frame there
+	if(item->pending && item->stream == 0)
+		handle_pending(item, conn);
+}
+
+/**
+ * Send queued stream data if connection is not busy with sending already.
+ */
+LOCAL void ICACHE_FLASH_ATTR stream_flush(CONNECTION_ITEM *item) {
+	if(item->busy)
+		return;
+	const int sent = send_next(item, item->conn, 0, 0);
+	if(sent > 0) {
+		item->busy = 1;
+	} else if(sent == 0 && item->keep_alive == 0) {
+		// nothing to send before closing
+		espconn_disconnect(item->conn);
+	}
+}
+
+LOCAL int ICACHE_FLASH_ATTR websocket_append(CONNECTION_ITEM *item, uint8 opcode,
+		const char *data, unsigned int len) {
+	const unsigned int head_len = (len < 126) ? 2 : 4;
+	if(item->stream_buf == 0 || len > 0xFFFF
+			|| item->stream_len + head_len + len > STREAM_BUF_SIZE)
+		return 0;
+	char *frame = &item->stream_buf[item->stream_len];
+	// server frames are never masked
+	frame[0] = WS_FINAL_FRAME | opcode;
+	if(len < 126) {
+		frame[1] = len;
+	} else {
+		frame[1] = 126;
+		frame[2] = (len >> 8) & 0xFF;
+		frame[3] = len & 0xFF;
+	}
+	copy_data(&frame[head_len], data, len);
+	item->stream_len += head_len + len;
+	return 1;
+}
+
+LOCAL void ICACHE_FLASH_ATTR websocket_close(CONNECTION_ITEM *item, unsigned int code) {
+	char payload[2];
+	if(item->keep_alive == 0)
+		return;
+	payload[0] = (code >> 8) & 0xFF;
+	payload[1] = code & 0xFF;
+	// connection is closed anyway, even if there is no space for close frame
+	websocket_append(item, WS_OPCODE_CLOSE, payload, sizeof(payload));
+	item->keep_alive = 0;
+	stream_flush(item);
+}
+
+/**
+ * Append message as "data:" field of event, each line of message is a separate field.
+ */
+LOCAL int ICACHE_FLASH_ATTR events_append(CONNECTION_ITEM *item, const char *data, unsigned int len) {
+	RO_DATA char field[] = "data: ";
+	const unsigned int field_len = sizeof(field) - 1;
+	if(item->stream_buf == 0 || item->stream_len + field_len + len + 2 > STREAM_BUF_SIZE)
+		return 0;
+	char *event = &item->stream_buf[item->stream_len];
+	copy_data(&event[field_len], data, len);
+	unsigned int lines = 0;
+	unsigned int i;
+	for(i = 0; i < len; i++) {
+		if(event[field_len + i] == '\n')
+			lines++;
+	}
+	const unsigned int event_len = field_len * (lines + 1) + len + 2;
+	if(item->stream_len + event_len > STREAM_BUF_SIZE)
+		return 0;
+	// spread lines from the end, each line break is followed by field name
+	char *out = &event[event_len - 2];
+	i = len;
+	while(lines) {
+		const char c = event[field_len + --i];
+		if(c == '\n') {
+			out -= field_len;
+			copy_data(out, field, field_len);
+			lines--;
 		}
+		*--out = c;
 	}
-	return res;
+	copy_data(event, field, field_len);
+	event[event_len - 2] = '\n';
+	event[event_len - 1] = '\n';
+	item->stream_len += event_len;
+	return 1;
+}
+
+LOCAL void ICACHE_FLASH_ATTR events_ping(CONNECTION_ITEM *item) {
+	// comment line is ignored by clients
+	if(item->stream_buf == 0 || item->stream_len + 2 > STREAM_BUF_SIZE)
+		return;
+	item->stream_buf[item->stream_len++] = ':';
+	item->stream_buf[item->stream_len++] = '\n';
 }
 
-LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR receive_post(
-		const char *data, unsigned short len, HTTP_ANSWER *answer) {
-	if(mPostBuf == 0) {
-		mPostBuf = (char*)os_malloc(POST_BUF_SIZE);
-		if(mPostBuf == 0) {
-			mCurrentPost = 0;
-			return HRCS_INTERNAL_ERROR;
+/**
+ * Handle single WebSocket frame from client. Return number of bytes used,
+ * zero if frame is not completed or connection is closing.
+ */
+LOCAL unsigned int ICACHE_FLASH_ATTR websocket_frame(CONNECTION_ITEM *item,
+		char *data, unsigned int len) {
+	unsigned int head_len = 2;
+	unsigned int i;
+	if(len < head_len)
+		return 0;
+	const uint8 opcode = data[0] & 0x0F;
+	unsigned int payload_len = data[1] & 0x7F;
+	if((data[1] & WS_MASKED) == 0) {
+		dhdebug("Httpd WebSocket frame is not masked");
+		websocket_close(item, WS_CLOSE_PROTOCOL_ERROR);
+		return 0;
+	}
+	if(payload_len == 127) {
+		websocket_close(item, WS_CLOSE_TOO_BIG);
+		return 0;
+	} else if(payload_len == 126) {
+		head_len = 4;
+		if(len < head_len)
+			return 0;
+		payload_len = ((uint8)data[2] << 8) | (uint8)data[3];
+	}
+	head_len += WS_MASK_SIZE;
+	if(head_len + payload_len > PENDING_BUF_SIZE) {
+		dhdebug("Httpd WebSocket message is too big");
+		websocket_close(item, WS_CLOSE_TOO_BIG);
+		return 0;
+	}
+	if(len < head_len + payload_len)
+		return 0;
+	char *payload = &data[head_len];
+	const char *mask = &data[head_len - WS_MASK_SIZE];
+	for(i = 0; i < payload_len; i++)
+		payload[i] ^= mask[i % WS_MASK_SIZE];
+	if((data[0] & WS_FINAL_FRAME) == 0 || opcode == 0) {
+		// commands are small, fragmented messages are not supported
+		websocket_close(item, WS_CLOSE_UNSUPPORTED);
+		return 0;
+	}
+	switch(opcode) {
+	case WS_OPCODE_TEXT:
+	case WS_OPCODE_BINARY:
+		item->stream(item - mConnections, HSE_MESSAGE, payload, payload_len, item->stream_arg);
+		break;
+	case WS_OPCODE_CLOSE:
+		websocket_close(item, WS_CLOSE_NORMAL);
+		return 0;
+	case WS_OPCODE_PING:
+		websocket_append(item, WS_OPCODE_PONG, payload, payload_len);
+		stream_flush(item);
+		break;
+	case WS_OPCODE_PONG:
+		break;
+	default:
+		websocket_close(item, WS_CLOSE_PROTOCOL_ERROR);
+		return 0;
+	}
+	return head_len + payload_len;
+}
+
+LOCAL void ICACHE_FLASH_ATTR websocket_receive(CONNECTION_ITEM *item,
+		char *data, unsigned int len) {
+	char *buf = 0;
+	if(item->pending) {
+		// continue not completed frame
+		if(append_pending(item, data, len) == 0) {
+			websocket_close(item, WS_CLOSE_TOO_BIG);
+			return;
 		}
+		buf = item->pending;
+		data = buf;
+		len = item->pending_len;
+		item->pending = 0;
+		item->pending_len = 0;
 	}
-	if(len > POST_BUF_SIZE - mPostBufPos) {
-		mCurrentPost = 0;
-		return HRCS_INTERNAL_ERROR;
+	while(len && item->keep_alive) {
+		unsigned int used = websocket_frame(item, data, len);
+		if(used == 0)
+			break;
+		data += used;
+		len -= used;
 	}
-	os_memcpy(&mPostBuf[mPostBufPos], data, len);
-	mPostBufPos += len;
-	HTTP_RESPONSE_STATUS res = parse_request(mPostBuf, mPostBufPos, mPostHttpRequestCb, answer);
-	if(res != HRCS_NOT_FINISHED && mCurrentPost) {
-		mCurrentPost = 0;
-		os_free(mPostBuf);
-		mPostBuf = 0;
+	if(len && item->keep_alive) {
+		if(append_pending(item, data, len) == 0)
+			websocket_close(item, WS_CLOSE_TOO_BIG);
 	}
-	return res;
+	if(buf)
+		os_free(buf);
 }
 
-LOCAL int check_gzip(const char *data, unsigned short len) {
-	static const char accept_encoding[] = "Accept-Encoding:";
-	static const char gzip[] = "gzip";
-	unsigned short i;
-	for(i = 0; i < len; i++) {
-		if(strncasecmp(&data[i], accept_encoding, sizeof(accept_encoding) - 1) == 0) {
-			i += sizeof(accept_encoding);
-			while(strncasecmp(&data[i], gzip, sizeof(gzip) - 1)) {
-				i++;
-				if(data[i] == '\n' || i >= len)
-					return 0;
-			}
+LOCAL void ICACHE_FLASH_ATTR stream_ping(void *arg) {
+	int i;
+	for(i = 0; i < MAX_CONNECTIONS; i++) {
+		CONNECTION_ITEM *item = &mConnections[i];
+		if(item->stream == 0 || item->keep_alive == 0)
+			continue;
+		if(item->websocket)
+			websocket_append(item, WS_OPCODE_PING, 0, 0);
+		else
+			events_ping(item);
+		stream_flush(item);
+	}
+}
+
+/**
+ * Start stream on connection and send response head. Return zero if there are
+ * too many streams or no memory.
+ */
+LOCAL int ICACHE_FLASH_ATTR open_stream(CONNECTION_ITEM *item, struct espconn *conn,
+		HTTP_ANSWER *answer, int websocket, const char *head, unsigned int head_len) {
+	if(stream_count() >= MAX_STREAMS)
+		return 0;
+	item->stream_buf = (char*)os_malloc(STREAM_BUF_SIZE);
+	if(item->stream_buf == 0) {
+		dhdebug("Httpd no memory for stream");
+		return 0;
+	}
+	if(stream_count() == 0) {
+		os_timer_disarm(&mStreamTimer);
+		os_timer_setfn(&mStreamTimer, stream_ping, NULL);
+		os_timer_arm(&mStreamTimer, STREAM_PING_INTERVAL_MS, 1);
+	}
+	item->stream = answer->stream;
+	item->stream_arg = answer->stream_arg;
+	item->stream_len = 0;
+	item->websocket = websocket ? 1 : 0;
+	item->keep_alive = 1;
+	item->busy = 1;
+	// stream lives until client disconnects, server pings it
+	espconn_regist_time(conn, 0, 1);
+	send_next(item, conn, head, head_len);
+	item->stream(item - mConnections, HSE_OPEN, 0, 0, item->stream_arg);
+	return 1;
+}
+
+/**
+ * Switch connection to WebSocket. Return HRCS_WEBSOCKET on success or error status.
+ */
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR websocket_upgrade(CONNECTION_ITEM *item, struct espconn *conn,
+		HTTP_ANSWER *answer) {
+	RO_DATA char switching[] = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n";
+	SHA1_CONTEXT ctx;
+	uint8_t digest[SHA1_DIGEST_SIZE];
+	char accept[32];
+	char response[sizeof(switching) + sizeof(accept)];
+	HTTP_PARSER *parser = &item->parser;
+	if(parser->method != HTTP_METHOD_GET || parser->upgrade == 0
+			|| parser->websocket == 0 || parser->ws_key_len == 0) {
+		dhdebug("Httpd not a WebSocket handshake");
+		return HRCS_BAD_REQUEST;
+	}
+	sha1_init(&ctx);
+	sha1_update(&ctx, parser->ws_key, parser->ws_key_len);
+	sha1_update(&ctx, mWebSocketGuid, sizeof(mWebSocketGuid) - 1);
+	sha1_final(&ctx, digest);
+	const int accept_len = esp_base64_encode(digest, sizeof(digest), accept, sizeof(accept) - 1);
+	accept[accept_len] = 0;
+	const int response_len = snprintf(response, sizeof(response), switching, accept);
+	if(open_stream(item, conn, answer, 1, response, response_len) == 0)
+		return HRCS_TOO_MANY_REQUESTS;
+	return HRCS_WEBSOCKET;
+}
+
+/**
+ * Start Server-Sent Events stream. Return HRCS_EVENTS on success or error status.
+ */
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR events_open(CONNECTION_ITEM *item, struct espconn *conn,
+		HTTP_ANSWER *answer) {
+	// there is no content length, stream ends with connection
+	RO_DATA char events[] = "HTTP/1.1 200 OK\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n\r\n";
+	if(open_stream(item, conn, answer, 0, events, sizeof(events) - 1) == 0)
+		return HRCS_TOO_MANY_REQUESTS;
+	return HRCS_EVENTS;
+}
+
+LOCAL int ICACHE_FLASH_ATTR check_etag(const char *etags, const char *etag) {
+	// list of quoted tags, possibly weak, or asterisk
+	unsigned int i = 0;
+	while(etags[i]) {
+		if(etags[i] == '*')
 			return 1;
-		} else while(data[i] != '\n' && i < len) i++;
+		if(etags[i++] != '"')
+			continue;
+		unsigned int j = 0;
+		char c;
+		while((c = irom_char(&etag[j])) != 0 && etags[i] == c) {
+			i++;
+			j++;
+		}
+		if(c == 0 && etags[i] == '"')
+			return 1;
+		while(etags[i] && etags[i] != '"')
+			i++;
+		if(etags[i] == '"')
+			i++;
 	}
 	return 0;
 }
 
-LOCAL void ICACHE_FLASH_ATTR dhap_httpd_recv_cb(void *arg, char *data, unsigned short len) {
-	struct espconn *conn = arg;
-	static const char get[] = "GET ";
-	static const char post[] = "POST ";
-	static const char options[] = "OPTIONS ";
-	static const char host[] = "Host:";
-	RO_DATA char unsupported[] = "HTTP/1.0 415 Unsupported Media Type\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: text/plain\r\nContent-Length: 22\r\n\r\nUnsupported Media Type";
-	RO_DATA char internal[] = "HTTP/1.0 500 Internal Server Error\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: text/plain\r\nContent-Length: 14\r\n\r\nInternal Error";
-	RO_DATA char notfound[] = "HTTP/1.0 404 Not Found\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: text/plain\r\nContent-Length: 9\r\n\r\nNot Found";
-	RO_DATA char notimplemented[] = "HTTP/1.0 501 Not Implemented\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: text/plain\r\nContent-Length: 15\r\n\r\nNot Implemented";
-	RO_DATA char unauthorized[] = "HTTP/1.0 401 Unauthorized\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: text/plain; charset=UTF-8\r\nContent-Length: 12\r\n\r\nUnauthorized";
-	RO_DATA char badrequest[] = "HTTP/1.0 400 Bad Request\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: text/plain; charset=UTF-8\r\nContent-Length:11\r\n\r\nBad Request";
-	RO_DATA char toomany[] = "HTTP/1.0 429 Too Many Requests\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: text/plain; charset=UTF-8\r\nContent-Length: 17\r\n\r\nToo Many Requests";
-	RO_DATA char redirectresponse[] = "HTTP/1.0 302 Moved\r\nContent-Length: 0\r\nLocation: http://%s\r\n\r\n";
-	RO_DATA char ok[] = "HTTP/1.0 200 OK\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: %s; charset=UTF-8\r\n%sContent-Length: %u\r\n\r\n";
-	RO_DATA char no_content[] = "HTTP/1.0 204 No content\r\nAccess-Control-Allow-Origin: *\r\nContent-Length: 0\r\n\r\n";
-	RO_DATA char forbidden[] = "HTTP/1.0 403 Forbidden\r\nAccess-Control-Allow-Origin: *\r\nContent-Type: %s; charset=UTF-8\r\n%sContent-Length: %u\r\n\r\n";
-	RO_DATA char options_response[] = "HTTP/1.0 204 No Content\r\nAccess-Control-Allow-Origin: *\r\nAccess-Control-Allow-Credentials: true\r\nAccess-Control-Allow-Methods: GET, POST\r\nAccess-Control-Allow-Headers: Authorization, Content-Type\r\nContent-Length: 0\r\n\r\n";
+LOCAL void ICACHE_FLASH_ATTR send_status(CONNECTION_ITEM *item, struct espconn *conn,
+		const char *status, const char *text, unsigned int text_len) {
+	RO_DATA char response[] = "HTTP/1.1 %s\r\nAccess-Control-Allow-Origin: *\r\nConnection: %s\r\nContent-Type: text/plain; charset=UTF-8\r\nContent-Length: %u\r\n\r\n%s";
+	RO_DATA char keep_alive[] = "keep-alive";
+	RO_DATA char close[] = "close";
+	char buf[sizeof(response) + 64];
+	int len = snprintf(buf, sizeof(buf), response, status,
+			item->keep_alive ? keep_alive : close, text_len, text);
+	item->busy = 1;
+	send_next(item, conn, buf, len);
+}
+
+LOCAL void ICACHE_FLASH_ATTR respond(CONNECTION_ITEM *item, struct espconn *conn,
+		HTTP_RESPONSE_STATUS res, HTTP_ANSWER *answer) {
+	RO_DATA char unsupported[] = "415 Unsupported Media Type";
+	RO_DATA char unsupported_text[] = "Unsupported Media Type";
+	RO_DATA char internal[] = "500 Internal Server Error";
+	RO_DATA char internal_text[] = "Internal Error";
+	RO_DATA char notfound[] = "404 Not Found";
+	RO_DATA char notfound_text[] = "Not Found";
+	RO_DATA char notimplemented[] = "501 Not Implemented";
+	RO_DATA char notimplemented_text[] = "Not Implemented";
+	RO_DATA char unauthorized[] = "401 Unauthorized";
+	RO_DATA char unauthorized_text[] = "Unauthorized";
+	RO_DATA char badrequest[] = "400 Bad Request";
+	RO_DATA char badrequest_text[] = "Bad Request";
+	RO_DATA char toomany[] = "429 Too Many Requests";
+	RO_DATA char toomany_text[] = "Too Many Requests";
+	RO_DATA char ok[] = "HTTP/1.1 200 OK\r\nAccess-Control-Allow-Origin: *\r\nConnection: %s\r\nContent-Type: %s; charset=UTF-8\r\n%s%s%s\r\n";
+	RO_DATA char not_modified[] = "HTTP/1.1 304 Not Modified\r\nAccess-Control-Allow-Origin: *\r\nConnection: %s\r\n%s\r\n";
+	RO_DATA char no_content[] = "HTTP/1.1 204 No content\r\nAccess-Control-Allow-Origin: *\r\nConnection: %s\r\nContent-Length: 0\r\n\r\n";
+	RO_DATA char forbidden[] = "HTTP/1.1 403 Forbidden\r\nAccess-Control-Allow-Origin: *\r\nConnection: %s\r\nContent-Type: %s; charset=UTF-8\r\n%s%s%s\r\n";
+	RO_DATA char options_response[] = "HTTP/1.1 204 No Content\r\nAccess-Control-Allow-Origin: *\r\nAccess-Control-Allow-Credentials: true\r\nAccess-Control-Allow-Methods: GET, POST\r\nAccess-Control-Allow-Headers: Authorization, Content-Type\r\nConnection: %s\r\nContent-Length: 0\r\n\r\n";
 	RO_DATA char html[] = "text/html";
 	RO_DATA char json[] = "text/json";
 	RO_DATA char javascript[] = "text/javascript";
@@ -253,63 +707,15 @@ LOCAL void ICACHE_FLASH_ATTR dhap_httpd_recv_cb(void *arg, char *data, unsigned
 	RO_DATA char plain[] = "text/plain";
 	RO_DATA char xicon[] = "image/x-icon";
 	RO_DATA char gzip[] = "Content-Encoding: gzip\r\n";
+	RO_DATA char content_length[] = "Content-Length: %u\r\n";
+	RO_DATA char chunked[] = "Transfer-Encoding: chunked\r\n";
+	RO_DATA char cache[] = "ETag: \"%s\"\r\nCache-Control: no-cache\r\n";
+	RO_DATA char keep_alive[] = "keep-alive";
+	RO_DATA char close[] = "close";
 
-	HTTP_ANSWER answer;
-	answer.content.len = 0;
-	answer.free_content = 0;
-	answer.ok = 1;
-	answer.gzip = 0;
-	dhstat_add_bytes_received(len);
-	HTTP_RESPONSE_STATUS res = HRCS_INTERNAL_ERROR;
-
-	if(conn == mCurrentPost) {
-		res = receive_post(data, len, &answer);
-	} else {
-		if(mRedirectHost) {
-			const int redirect_host_len = os_strlen(mRedirectHost);
-			const int to = (int)len - redirect_host_len - sizeof(host) + 1;
-			int i;
-			for(i = 0; i < to; i++) {
-				if(strncasecmp(&data[i], host, sizeof(host) - 1) == 0) {
-					i += sizeof(host) - 1;
-					while(data[i] == ' ')
-						i++;
-					if(os_strncmp(&data[i], mRedirectHost, redirect_host_len) != 0) {
-						dhdebug("Httpd redirect");
-						char redirect[sizeof(redirectresponse) - 2 + redirect_host_len];
-						snprintf(redirect, sizeof(redirect), redirectresponse, mRedirectHost);
-						send_res(conn, redirect, sizeof(redirect) - 1);
-						dhstat_got_httpd_request();
-						return;
-					}
-					break;
-				}
-			}
-		}
-
-		if(len < sizeof(get) || len < sizeof(post) || len < sizeof(options)) {
-			res = HRCS_BAD_REQUEST;
-		} else if(os_strncmp(data, post, sizeof(post) - 1) == 0) {
-			if(mCurrentPost) {
-				res = HRCS_TOO_MANY_REQUESTS;
-			} else {
-				mCurrentPost = conn;
-				mPostBufPos = 0;
-				res = receive_post(data, len, &answer);
-			}
-		} else if(os_strncmp(data, get, sizeof(get) - 1) == 0) {
-			res = parse_request(data, len, mGetHttpRequestCb, &answer);
-		} else if(os_strncmp(data, options, sizeof(options) - 1) == 0) {
-			res = HRCS_OPTIONS;
-		} else {
-			res = HRCS_NOT_IMPLEMENTED;
-		}
-	}
-
-	if(res != HRCS_NOT_FINISHED) {
+	// failed stream is counted with its error response
+	if(res != HRCS_WEBSOCKET && res != HRCS_EVENTS)
 		dhstat_got_httpd_request();
-	}
-
 	switch (res) {
 	case HRCS_ANSWERED_XICON:
 	case HRCS_ANSWERED_PLAIN:
@@ -318,38 +724,47 @@ LOCAL void ICACHE_FLASH_ATTR dhap_httpd_recv_cb(void *arg, char *data, unsigned
 	case HRCS_ANSWERED_JSON:
 	case HRCS_ANSWERED_HTML:
 	{
-		if(answer.gzip && check_gzip(data, len) == 0) {
+		if(answer->gzip && item->parser.gzip == 0) {
 			dhdebug("gzip is not supported");
-			send_res(conn, unsupported, sizeof(unsupported) - 1);
+			free_answer(answer);
+			send_status(item, conn, unsupported, unsupported_text, sizeof(unsupported_text) - 1);
 			return;
 		}
-		int i;
-		CONTENT_ITEM *item = 0;
 		int response_len;
-		char response[(sizeof(ok) > sizeof(forbidden) ? sizeof(ok) : sizeof(forbidden)) + sizeof(gzip) + 32];
-		for(i = 0; i < MAX_CONNECTIONS; i++) {
-			if(is_remote_equal(conn->proto.tcp, &mContentQueue[i])) {
-				dhdebug("Httpd duplicate responses");
-				send_res(conn, internal, sizeof(internal) - 1);
-				dhstat_got_httpd_error();
+		char response[(sizeof(ok) > sizeof(forbidden) ? sizeof(ok) : sizeof(forbidden)) + sizeof(keep_alive) + sizeof(gzip) + sizeof(chunked) + sizeof(cache) + MAX_ETAG + 32];
+		char length[sizeof(content_length) + 10];
+		char caching[sizeof(cache) + MAX_ETAG];
+		if(item->content.len || item->generator) {
+			dhdebug("Httpd duplicate responses");
+			free_answer(answer);
+			item->keep_alive = 0;
+			send_status(item, conn, internal, internal_text, sizeof(internal_text) - 1);
+			dhstat_got_httpd_error();
+			return;
+		}
+		item->busy = 1;
+		caching[0] = 0;
+		if(answer->etag) {
+			snprintf(caching, sizeof(caching), cache, answer->etag);
+			if(item->parser.method == HTTP_METHOD_GET
+					&& check_etag(item->parser.etags, answer->etag)) {
+				// client has the same content, don't even read it
+				free_answer(answer);
+				response_len = snprintf(response, sizeof(response), not_modified,
+						item->keep_alive ? keep_alive : close, caching);
+				send_next(item, conn, response, response_len);
 				return;
-			} else if(mContentQueue[i].remote_port == 0) {
-				item = &mContentQueue[i];
 			}
 		}
-		if(answer.content.len == 0) {
-			if(answer.ok) {
-				send_res(conn, no_content, sizeof(no_content) - 1);
+		if(answer->content.len == 0 && answer->generator == 0) {
+			const char *connection = item->keep_alive ? keep_alive : close;
+			if(answer->ok) {
+				response_len = snprintf(response, sizeof(response), no_content, connection);
 			} else {
-				response_len = snprintf(response, sizeof(response), forbidden, plain, "", 0);
-				send_res(conn, response, response_len);
+				snprintf(length, sizeof(length), content_length, 0);
+				response_len = snprintf(response, sizeof(response), forbidden, connection, plain, "", length, "");
 			}
-			return;
-		}
-		if(item == 0) {
-			dhdebug("Httpd no place for responses");
-			send_res(conn, internal, sizeof(internal) - 1);
-			dhstat_got_httpd_error();
+			send_next(item, conn, response, response_len);
 			return;
 		}
 		const char *content_type = plain;
@@ -365,51 +780,247 @@ LOCAL void ICACHE_FLASH_ATTR dhap_httpd_recv_cb(void *arg, char *data, unsigned
 			content_type = xicon;
 		}
 
-		response_len = snprintf(response, sizeof(response),
-				answer.ok ? ok : forbidden, content_type,
-				answer.gzip ? gzip : "", answer.content.len);
-		os_memcpy(item->remote_ip, conn->proto.tcp->remote_ip, sizeof(item->remote_ip));
-		item->remote_port = conn->proto.tcp->remote_port;
-		item->content.data = answer.content.data;
-		item->content.len = answer.content.len;
-		item->free_mem = answer.free_content;
-		send_res(conn, response, response_len);
+		item->content.data = answer->content.data;
+		item->content.len = answer->content.len;
+		item->free_mem = answer->free_content;
+		item->generator = answer->generator;
+		item->generator_arg = answer->generator_arg;
+		if(item->generator == 0) {
+			snprintf(length, sizeof(length), content_length, item->content.len);
+		} else if(item->parser.http11) {
+			item->chunked = 1;
+			irom_read(length, sizeof(chunked), chunked);
+		} else {
+			// the end of content is marked with closed connection
+			item->keep_alive = 0;
+			length[0] = 0;
+		}
+		response_len = snprintf(response, sizeof(response), answer->ok ? ok : forbidden,
+				item->keep_alive ? keep_alive : close, content_type,
+				answer->gzip ? gzip : "", length, caching);
+		send_next(item, conn, response, response_len);
 		return;
 	}
-	case HRCS_NOT_FINISHED:
+	case HRCS_WEBSOCKET:
+	case HRCS_EVENTS:
+		if(res == HRCS_WEBSOCKET)
+			res = websocket_upgrade(item, conn, answer);
+		else
+			res = events_open(item, conn, answer);
+		if(res == HRCS_WEBSOCKET || res == HRCS_EVENTS) {
+			dhstat_got_httpd_request();
+			return;
+		}
+		// stream callback learns that connection was not switched
+		answer->stream(item - mConnections, HSE_CLOSE, 0, 0, answer->stream_arg);
+		respond(item, conn, res, 0);
 		return;
 	case HRCS_OPTIONS:
+	{
 		dhdebug("Httpd options request");
-		send_res(conn, options_response, sizeof(options_response) - 1);
-		break;
+		char response[sizeof(options_response) + sizeof(keep_alive)];
+		int response_len = snprintf(response, sizeof(response), options_response,
+				item->keep_alive ? keep_alive : close);
+		item->busy = 1;
+		send_next(item, conn, response, response_len);
+		return;
+	}
 	case HRCS_TOO_MANY_REQUESTS:
 		dhdebug("Httpd too many requests");
-		send_res(conn, toomany, sizeof(toomany) - 1);
+		item->keep_alive = 0;
+		send_status(item, conn, toomany, toomany_text, sizeof(toomany_text) - 1);
 		break;
 	case HRCS_BAD_REQUEST:
 		dhdebug("Httpd bad request");
-		send_res(conn, badrequest, sizeof(badrequest) - 1);
+		item->keep_alive = 0;
+		send_status(item, conn, badrequest, badrequest_text, sizeof(badrequest_text) - 1);
 		break;
 	case HRCS_NOT_FOUND:
 		dhdebug("Httpd not found");
-		send_res(conn, notfound, sizeof(notfound) - 1);
-		break;
+		send_status(item, conn, notfound, notfound_text, sizeof(notfound_text) - 1);
+		dhstat_got_httpd_error();
+		return;
 	case HRCS_NOT_IMPLEMENTED:
 		dhdebug("Httpd not implemented");
-		send_res(conn, notimplemented, sizeof(notimplemented) - 1);
+		item->keep_alive = 0;
+		send_status(item, conn, notimplemented, notimplemented_text, sizeof(notimplemented_text) - 1);
 		break;
 	case HRCS_UNAUTHORIZED:
 		dhdebug("Httpd unauthorized");
-		send_res(conn, unauthorized, sizeof(unauthorized) - 1);
-		break;
+		send_status(item, conn, unauthorized, unauthorized_text, sizeof(unauthorized_text) - 1);
+		dhstat_got_httpd_error();
+		return;
 	case HRCS_INTERNAL_ERROR:
 	default:
 		dhdebug("Httpd internal error");
-		send_res(conn, internal, sizeof(internal) - 1);
+		item->keep_alive = 0;
+		send_status(item, conn, internal, internal_text, sizeof(internal_text) - 1);
 	}
 	dhstat_got_httpd_error();
 }
 
+LOCAL int ICACHE_FLASH_ATTR check_redirect(CONNECTION_ITEM *item, struct espconn *conn) {
+	RO_DATA char redirectresponse[] = "HTTP/1.1 302 Moved\r\nConnection: close\r\nContent-Length: 0\r\nLocation: http://%s\r\n\r\n";
+	if(mRedirectHost == 0 || item->parser.host_len == 0)
+		return 0;
+	const int redirect_host_len = os_strlen(mRedirectHost);
+	if(os_strncmp(item->parser.host, mRedirectHost, redirect_host_len) == 0)
+		return 0;
+	dhdebug("Httpd redirect");
+	char redirect[sizeof(redirectresponse) + redirect_host_len];
+	int redirect_len = snprintf(redirect, sizeof(redirect), redirectresponse, mRedirectHost);
+	item->keep_alive = 0;
+	item->busy = 1;
+	send_next(item, conn, redirect, redirect_len);
+	dhstat_got_httpd_request();
+	return 1;
+}
+
+LOCAL void ICACHE_FLASH_ATTR dispatch(CONNECTION_ITEM *item, struct espconn *conn) {
+	HTTP_PARSER *parser = &item->parser;
+	HTTP_ANSWER answer;
+	os_memset(&answer, 0, sizeof(answer));
+	answer.ok = 1;
+	HTTP_RESPONSE_STATUS res;
+	HttpRequestCb cb = 0;
+	if(parser->method == HTTP_METHOD_GET)
+		cb = mGetHttpRequestCb;
+	else if(parser->method == HTTP_METHOD_POST)
+		cb = mPostHttpRequestCb;
+
+	if(parser->method == HTTP_METHOD_UNKNOWN) {
+		res = HRCS_NOT_IMPLEMENTED;
+	} else if(parser->path_overflow) {
+		res = HRCS_NOT_FOUND;
+	} else if(parser->method == HTTP_METHOD_OPTIONS) {
+		res = HRCS_OPTIONS;
+	} else {
+		HTTP_CONTENT in;
+		in.data = item->post ? item->post->data : 0;
+		in.len = item->post_len;
+		res = cb(parser->path, parser->query ? parser->query : "",
+				parser->key ? parser->key : "", &in, &answer);
+	}
+	respond(item, conn, res, &answer);
+	release_post_buf(item);
+	httpd_parser_reset(parser);
+}
+
+/**
+ * Handle the next piece of request. Request head is parsed once per byte,
+ * body is collected in buffer from pool. Response is sent when request is
+ * completed. Return number of bytes which belong to current request.
+ */
+LOCAL unsigned int ICACHE_FLASH_ATTR handle_request(CONNECTION_ITEM *item, struct espconn *conn,
+		const char *data, unsigned int len) {
+	HTTP_PARSER *parser = &item->parser;
+	unsigned int used = 0;
+	if(item->post == 0) {
+		HTTP_PARSER_RESULT pres = httpd_parser_feed(parser, data, len, &used);
+		if(pres == HPR_NOT_FINISHED)
+			return used;
+		if(pres == HPR_BAD_REQUEST) {
+			httpd_parser_reset(parser);
+			respond(item, conn, HRCS_BAD_REQUEST, 0);
+			return len;
+		}
+		item->keep_alive = parser->keep_alive;
+		if(check_redirect(item, conn)) {
+			httpd_parser_reset(parser);
+			return len;
+		}
+		if(parser->content_length) {
+			if(parser->content_length > POST_BUF_SIZE) {
+				dhdebug("Httpd request body is too big");
+				httpd_parser_reset(parser);
+				respond(item, conn, HRCS_INTERNAL_ERROR, 0);
+				return len;
+			}
+			item->post = acquire_post_buf();
+			if(item->post == 0) {
+				httpd_parser_reset(parser);
+				respond(item, conn, HRCS_TOO_MANY_REQUESTS, 0);
+				return len;
+			}
+			item->post_len = 0;
+		}
+	}
+	if(item->post) {
+		unsigned int rest = parser->content_length - item->post_len;
+		if(rest > len - used)
+			rest = len - used;
+		os_memcpy(&item->post->data[item->post_len], &data[used], rest);
+		item->post_len += rest;
+		item->post->data[item->post_len] = 0;
+		used += rest;
+		if(item->post_len < parser->content_length)
+			return used;
+	}
+	dispatch(item, conn);
+	return used;
+}
+
+LOCAL int ICACHE_FLASH_ATTR keep_pending(CONNECTION_ITEM *item, struct espconn *conn,
+		const char *data, unsigned int len) {
+	if(append_pending(item, data, len) == 0) {
+		dhdebug("Httpd no place for pipelined requests");
+		item->keep_alive = 0;
+		if(item->busy == 0)
+			espconn_disconnect(conn);
+		return 0;
+	}
+	return 1;
+}
+
+LOCAL void ICACHE_FLASH_ATTR handle_data(CONNECTION_ITEM *item, struct espconn *conn,
+		const char *data, unsigned int len) {
+	while(len && item->busy == 0) {
+		unsigned int used = handle_request(item, conn, data, len);
+		if(used == 0)
+			break;
+		data += used;
+		len -= used;
+	}
+	// the rest is pipelined requests, they will be handled once response is sent
+	if(len && item->websocket)
+		websocket_receive(item, (char*)data, len);
+	else if(len && item->keep_alive && item->stream == 0)
+		keep_pending(item, conn, data, len);
+}
+
+LOCAL void ICACHE_FLASH_ATTR handle_pending(CONNECTION_ITEM *item, struct espconn *conn) {
+	char *data = item->pending;
+	unsigned int len = item->pending_len;
+	item->pending = 0;
+	item->pending_len = 0;
+	handle_data(item, conn, data, len);
+	os_free(data);
+}
+
+LOCAL void ICACHE_FLASH_ATTR dhap_httpd_recv_cb(void *arg, char *data, unsigned short len) {
+	struct espconn *conn = arg;
+	dhstat_add_bytes_received(len);
+	CONNECTION_ITEM *item = find_item(conn);
+	if(item == 0) {
+		espconn_disconnect(conn);
+		return;
+	}
+	if(item->websocket) {
+		websocket_receive(item, data, len);
+	} else if(item->stream) {
+		// events stream is one way, there is nothing to handle
+	} else if(item->busy) {
+		// previous response is not sent yet, keep order of responses
+		keep_pending(item, conn, data, len);
+	} else if(item->pending) {
+		// not completed request was received before
+		if(keep_pending(item, conn, data, len))
+			handle_pending(item, conn);
+	} else {
+		handle_data(item, conn, data, len);
+	}
+}
+
 LOCAL void ICACHE_FLASH_ATTR dhap_httpd_reconnect_cb(void *arg, sint8 err) {
 	struct espconn *conn = arg;
 	on_client_disconnect(conn);
@@ -418,17 +1029,72 @@ LOCAL void ICACHE_FLASH_ATTR dhap_httpd_reconnect_cb(void *arg, sint8 err) {
 
 LOCAL void ICACHE_FLASH_ATTR dhap_httpd_connect_cb(void *arg) {
 	struct espconn *conn = arg;
-	mConnected++;
-	if(mConnected > MAX_CONNECTIONS) {
+	int i;
+	CONNECTION_ITEM *item = 0;
+	for(i = 0; i < MAX_CONNECTIONS; i++) {
+		if(mConnections[i].remote_port == 0) {
+			item = &mConnections[i];
+			break;
+		}
+	}
+	if(item == 0) {
 		espconn_disconnect(conn);
-		dhdebug("Httpd refuse connection, already %u connections", mConnected);
+		dhdebug("Httpd refuse connection, already %u connections", MAX_CONNECTIONS);
 		return;
 	}
+	os_memset(item, 0, sizeof(CONNECTION_ITEM));
+	os_memcpy(item->remote_ip, conn->proto.tcp->remote_ip, sizeof(item->remote_ip));
+	item->remote_port = conn->proto.tcp->remote_port;
+	item->conn = conn;
+	conn->reverse = item;
 	espconn_regist_recvcb(conn, dhap_httpd_recv_cb);
 	espconn_regist_disconcb(conn, dhap_httpd_disconnect_cb);
 	espconn_regist_sentcb(conn, dhap_httpd_sent_cb);
 }
 
+LOCAL int ICACHE_FLASH_ATTR hex_digit(char c) {
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	c = to_lower(c);
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+int ICACHE_FLASH_ATTR httpd_query_param_equal(const char *query, const char *name, const char *value) {
+	const unsigned int name_len = os_strlen(name);
+	while(*query) {
+		if(os_strncmp(query, name, name_len) == 0 && query[name_len] == '=') {
+			const char *v = &query[name_len + 1];
+			const char *expected = value;
+			int equal = 1;
+			while(equal && *v && *v != '&') {
+				char c = *v++;
+				if(c == '+') {
+					c = ' ';
+				} else if(c == '%') {
+					const int hi = hex_digit(v[0]);
+					const int lo = (hi < 0) ? -1 : hex_digit(v[1]);
+					if(lo < 0)
+						return 0; // malformed
+					c = (hi << 4) | lo;
+					v += 2;
+				}
+				if(c == 0 || c != *expected++)
+					equal = 0;
+			}
+			if(equal && *expected == 0)
+				return 1;
+		}
+		// the next parameter
+		while(*query && *query != '&')
+			query++;
+		if(*query)
+			query++;
+	}
+	return 0;
+}
+
 void ICACHE_FLASH_ATTR httpd_init(HttpRequestCb get_cb, HttpRequestCb post_cb) {
 	mGetHttpRequestCb = get_cb;
 	mPostHttpRequestCb = post_cb;
@@ -443,12 +1109,50 @@ void ICACHE_FLASH_ATTR httpd_init(HttpRequestCb get_cb, HttpRequestCb post_cb) {
 	espconn_regist_connectcb(&mHttpdConn, dhap_httpd_connect_cb);
 	espconn_regist_reconcb(&mHttpdConn, dhap_httpd_reconnect_cb);
 	sint8 res = espconn_accept(&mHttpdConn);
-	if(res)
+	if(res) {
 		dhdebug("espconn_accept returned: %d", res);
-	else
+	} else {
+		// idle persistent connections are closed by system
+		espconn_regist_time(&mHttpdConn, KEEP_ALIVE_TIMEOUT_S, 0);
 		dhdebug("Httpd started");
+	}
 }
 
 void httpd_redirect(const char *host) {
 	mRedirectHost = host;
 }
+
+LOCAL CONNECTION_ITEM *ICACHE_FLASH_ATTR get_stream(unsigned int stream) {
+	if(stream >= MAX_CONNECTIONS)
+		return 0;
+	CONNECTION_ITEM *item = &mConnections[stream];
+	if(item->remote_port == 0 || item->stream == 0 || item->keep_alive == 0)
+		return 0;
+	return item;
+}
+
+int ICACHE_FLASH_ATTR httpd_stream_send(unsigned int stream, const char *data, unsigned int len) {
+	CONNECTION_ITEM *item = get_stream(stream);
+	if(item == 0)
+		return 0;
+	if(item->websocket) {
+		if(websocket_append(item, WS_OPCODE_TEXT, data, len) == 0)
+			return 0;
+	} else if(events_append(item, data, len) == 0) {
+		return 0;
+	}
+	stream_flush(item);
+	return 1;
+}
+
+void ICACHE_FLASH_ATTR httpd_stream_close(unsigned int stream) {
+	CONNECTION_ITEM *item = get_stream(stream);
+	if(item == 0)
+		return;
+	if(item->websocket) {
+		websocket_close(item, WS_CLOSE_NORMAL);
+	} else {
+		item->keep_alive = 0;
+		stream_flush(item);
+	}
+}
@@ -24,7 +24,9 @@ typedef enum {
 	HRCS_NOT_IMPLEMENTED,	///< Method is not implemented.
 	HRCS_UNAUTHORIZED,		///< Unauthorized.
 	HRCS_TOO_MANY_REQUESTS,	///< Too many requests on server.
-	HRCS_OPTIONS			///< Options.
+	HRCS_OPTIONS,			///< Options.
+	HRCS_WEBSOCKET,			///< Switch connection to WebSocket, stream field is set.
+	HRCS_EVENTS				///< Keep connection open for Server-Sent Events, stream field is set.
 } HTTP_RESPONSE_STATUS;
 
 /** Content descriptor */
@@ -33,17 +35,52 @@ typedef struct {
 	unsigned int len;		///< Data length.
 } HTTP_CONTENT;
 
+/**
+ *	\brief				Callback prototype for content which is generated while it is being sent.
+ *	\details			Content length is unknown beforehand, so HTTP/1.1 clients receive it with
+ *						chunked transfer encoding and HTTP/1.0 connection is closed after it.
+ *	\param[out]	buf		Buffer to write the next piece of content, zero when response is
+ *						dropped and generator should only release its resources.
+ *	\param[in]	size	Buffer size.
+ *	\param[in]	arg		Generator argument from HTTP_ANSWER.
+ *	\return				Number of bytes written, zero on the end of content.
+ */
+typedef unsigned int (*HttpContentGenerator)(char *buf, unsigned int size, void *arg);
+
+/** Events of connection which is switched to stream. */
+typedef enum {
+	HSE_OPEN,		///< Connection is switched, data can be sent.
+	HSE_MESSAGE,	///< Message is received from WebSocket client.
+	HSE_CLOSE		///< Connection is closed or was not switched, stream can't be used anymore.
+} HTTP_STREAM_EVENT;
+
+/**
+ *	\brief				Callback prototype for stream events.
+ *	\param[in]	stream	Stream id for httpd_stream_send() and httpd_stream_close().
+ *	\param[in]	event	Event type.
+ *	\param[in]	data	Message data for HSE_MESSAGE, valid only during the call.
+ *	\param[in]	len		Message length.
+ *	\param[in]	arg		Stream argument from HTTP_ANSWER.
+ */
+typedef void (*HttpStreamCb)(unsigned int stream, HTTP_STREAM_EVENT event,
+		const char *data, unsigned int len, void *arg);
+
 /** Struct for HRCS_ANSWERED data */
 typedef struct {
-	HTTP_CONTENT content;		///< Data to return.
+	HTTP_CONTENT content;		///< Data to return, can be stored in RAM or ROM.
+	HttpContentGenerator generator;	///< Generator for content of unknown length, used instead of content if set.
+	void *generator_arg;		///< Argument for generator.
+	HttpStreamCb stream;		///< Callback for stream, HSE_CLOSE is always called for it once.
+	void *stream_arg;			///< Argument for stream callback.
+	const char *etag;			///< Entity tag of content, can be stored in RAM or ROM. Zero if content can't be cached.
 	unsigned ok : 1;			///< Is response with 2xx code? True by default.
 	unsigned free_content : 1;	///< Is data was malloced, need to be free? False by default.
 	unsigned gzip : 1;		///< Is data gzip compressed.
 } HTTP_ANSWER;
 
-/** Callback prototype for requests. */
-typedef HTTP_RESPONSE_STATUS (*HttpRequestCb)(const char *path, const char *key,
-		HTTP_CONTENT *content_in, HTTP_ANSWER *answer);
+/** Callback prototype for requests, query is an empty string if request has no query. */
+typedef HTTP_RESPONSE_STATUS (*HttpRequestCb)(const char *path, const char *query,
+		const char *key, HTTP_CONTENT *content_in, HTTP_ANSWER *answer);
 
 /**
  *	\brief		Initialize HTTP daemon
@@ -56,4 +93,33 @@ void httpd_init(HttpRequestCb get_cb, HttpRequestCb post_cb);
  */
 void httpd_redirect(const char *host);
 
+/**
+ *	\brief				Check query parameter value.
+ *	\details			Percent-encoded characters and '+' in value are decoded.
+ *	\param[in]	query	Query without '?'.
+ *	\param[in]	name	Parameter name.
+ *	\param[in]	value	Expected value.
+ *	\return				Non zero value if query has parameter with this value.
+ */
+int httpd_query_param_equal(const char *query, const char *name, const char *value);
+
+/**
+ *	\brief				Send message to stream.
+ *	\details			Message is copied to stream buffer and sent when connection is ready.
+ *						For WebSocket message is sent as a text frame, for events
+ *						stream each line of message is sent as "data:" field of event.
+ *	\param[in]	stream	Stream id.
+ *	\param[in]	data	Message data.
+ *	\param[in]	len		Message length.
+ *	\return				Non zero value if message is queued, zero if stream buffer
+ *						is full or stream is closed.
+ */
+int httpd_stream_send(unsigned int stream, const char *data, unsigned int len);
+
+/**
+ *	\brief				Close stream after all queued messages are sent.
+ *	\param[in]	stream	Stream id.
+ */
+void httpd_stream_close(unsigned int stream);
+
 #endif /* _HTTPD_H_ */
@@ -0,0 +1,385 @@
+/*
+ * httpd_parser.c
+ *
+ * Copyright 2017 DeviceHive
+ *
+ * Description: incremental HTTP request head parser
+ *
+ */
+#include "httpd_parser.h"
+#include "dhsettings.h"
+#include "dhutils.h"
+
+#include <osapi.h>
+#include <mem.h>
+#include <ets_forward.h>
+
+typedef enum {
+	HPS_METHOD,
+	HPS_PATH,
+	HPS_QUERY,
+	HPS_VERSION,
+	HPS_HEADER_START,
+	HPS_HEADER_NAME,
+	HPS_HEADER_VALUE,
+	HPS_END
+} HPS_STATE;
+
+typedef enum {
+	HPH_NONE,
+	HPH_CONTENT_LENGTH,
+	HPH_AUTHORIZATION,
+	HPH_HOST,
+	HPH_ACCEPT_ENCODING,
+	HPH_CONNECTION,
+	HPH_IF_NONE_MATCH,
+	HPH_UPGRADE,
+	HPH_SEC_WEBSOCKET_KEY
+} HPH_HEADER;
+
+// names are compared with lowercased header names
+LOCAL const char *const mHeaders[] = {
+	0,
+	"content-length",
+	"authorization",
+	"host",
+	"accept-encoding",
+	"connection",
+	"if-none-match",
+	"upgrade",
+	"sec-websocket-key"
+};
+
+LOCAL int ICACHE_FLASH_ATTR is_token_equal(HTTP_PARSER *parser, const char *str) {
+	const unsigned int len = os_strlen(str);
+	return (parser->token_len == len && os_strncmp(parser->token, str, len) == 0);
+}
+
+LOCAL int ICACHE_FLASH_ATTR is_space(char c) {
+	return (c == ' ' || c == '\t');
+}
+
+LOCAL void ICACHE_FLASH_ATTR token_add(HTTP_PARSER *parser, char c) {
+	// too long tokens are never equal to known words
+	if(parser->token_len < sizeof(parser->token))
+		parser->token[parser->token_len] = to_lower(c);
+	if(parser->token_len < 0xFF)
+		parser->token_len++;
+}
+
+LOCAL HTTP_PARSER_RESULT ICACHE_FLASH_ATTR finish_method(HTTP_PARSER *parser) {
+	if(parser->token_len == 0)
+		return HPR_BAD_REQUEST;
+	if(is_token_equal(parser, "get"))
+		parser->method = HTTP_METHOD_GET;
+	else if(is_token_equal(parser, "post"))
+		parser->method = HTTP_METHOD_POST;
+	else if(is_token_equal(parser, "options"))
+		parser->method = HTTP_METHOD_OPTIONS;
+	else
+		parser->method = HTTP_METHOD_UNKNOWN;
+	return HPR_NOT_FINISHED;
+}
+
+LOCAL HTTP_PARSER_RESULT ICACHE_FLASH_ATTR finish_version(HTTP_PARSER *parser) {
+	if(is_token_equal(parser, "http/1.1")) {
+		parser->http11 = 1;
+	} else if(parser->token_len < 5 || os_strncmp(parser->token, "http/", 5)) {
+		return HPR_BAD_REQUEST;
+	}
+	return HPR_NOT_FINISHED;
+}
+
+LOCAL void ICACHE_FLASH_ATTR finish_header_name(HTTP_PARSER *parser) {
+	unsigned int i;
+	parser->header = HPH_NONE;
+	parser->pos = 0;
+	for(i = 1; i < sizeof(mHeaders) / sizeof(mHeaders[0]); i++) {
+		if(is_token_equal(parser, mHeaders[i])) {
+			parser->header = i;
+			break;
+		}
+	}
+	parser->token_len = 0;
+	if(parser->header == HPH_CONTENT_LENGTH) {
+		parser->has_digits = 0;
+		parser->content_length = 0;
+	} else if(parser->header == HPH_AUTHORIZATION) {
+		parser->key_len = 0;
+	}
+}
+
+LOCAL void ICACHE_FLASH_ATTR finish_connection_token(HTTP_PARSER *parser) {
+	if(is_token_equal(parser, "keep-alive"))
+		parser->conn_keep_alive = 1;
+	else if(is_token_equal(parser, "close"))
+		parser->conn_close = 1;
+	else if(is_token_equal(parser, "upgrade"))
+		parser->upgrade = 1;
+	parser->token_len = 0;
+}
+
+LOCAL void ICACHE_FLASH_ATTR finish_upgrade_token(HTTP_PARSER *parser) {
+	if(is_token_equal(parser, "websocket"))
+		parser->websocket = 1;
+	parser->token_len = 0;
+}
+
+LOCAL HTTP_PARSER_RESULT ICACHE_FLASH_ATTR header_value(HTTP_PARSER *parser, char c) {
+	static const char bearer[] = "bearer";
+	static const char gzip[] = "gzip";
+	switch(parser->header) {
+	case HPH_CONTENT_LENGTH:
+		if(c >= '0' && c <= '9') {
+			const unsigned int d = c - '0';
+			if(parser->pos || parser->content_length > (~0U - d) / 10)
+				return HPR_BAD_REQUEST;
+			parser->content_length = parser->content_length * 10 + d;
+			parser->has_digits = 1;
+		} else if(is_space(c) && parser->has_digits) {
+			// nothing but spaces after number
+			parser->pos = 1;
+		} else if(!is_space(c)) {
+			return HPR_BAD_REQUEST;
+		}
+		break;
+	case HPH_AUTHORIZATION:
+		if(parser->pos < sizeof(bearer) - 1) {
+			if(parser->pos == 0 && is_space(c))
+				break;
+			if(to_lower(c) != bearer[parser->pos]) {
+				// other authorization schemes are not supported
+				parser->header = HPH_NONE;
+				break;
+			}
+			parser->pos++;
+		} else if(parser->pos == sizeof(bearer) - 1) {
+			if(!is_space(c)) {
+				parser->header = HPH_NONE;
+				break;
+			}
+			parser->pos++;
+		} else if(!is_space(c) || parser->key_len) {
+			if(parser->key == 0) {
+				parser->key = (char *)os_malloc(DHSETTINGS_KEY_MAX_LENGTH);
+				if(parser->key == 0)
+					return HPR_BAD_REQUEST;
+				parser->key_len = 0;
+			}
+			if(parser->key_len < DHSETTINGS_KEY_MAX_LENGTH - 1)
+				parser->key[parser->key_len++] = c;
+		}
+		break;
+	case HPH_HOST:
+		if(is_space(c) && parser->host_len == 0)
+			break;
+		if(parser->host_len < sizeof(parser->host) - 1)
+			parser->host[parser->host_len++] = c;
+		else
+			parser->host_overflow = 1;
+		break;
+	case HPH_ACCEPT_ENCODING:
+		// look for substring
+		if(parser->pos < sizeof(gzip) - 1) {
+			if(to_lower(c) == gzip[parser->pos])
+				parser->pos++;
+			else
+				parser->pos = (to_lower(c) == gzip[0]) ? 1 : 0;
+			if(parser->pos == sizeof(gzip) - 1)
+				parser->gzip = 1;
+		}
+		break;
+	case HPH_CONNECTION:
+		if(c == ',')
+			finish_connection_token(parser);
+		else if(!is_space(c))
+			token_add(parser, c);
+		break;
+	case HPH_IF_NONE_MATCH:
+		if(is_space(c) && parser->etags_len == 0)
+			break;
+		// truncated list just doesn't match
+		if(parser->etags_len < sizeof(parser->etags) - 1)
+			parser->etags[parser->etags_len++] = c;
+		break;
+	case HPH_UPGRADE:
+		if(c == ',')
+			finish_upgrade_token(parser);
+		else if(!is_space(c))
+			token_add(parser, c);
+		break;
+	case HPH_SEC_WEBSOCKET_KEY:
+		// too long key is cut and handshake just fails
+		if(!is_space(c) && parser->ws_key_len < sizeof(parser->ws_key) - 1)
+			parser->ws_key[parser->ws_key_len++] = c;
+		break;
+	}
+	return HPR_NOT_FINISHED;
+}
+
+LOCAL HTTP_PARSER_RESULT ICACHE_FLASH_ATTR finish_header_value(HTTP_PARSER *parser) {
+	switch(parser->header) {
+	case HPH_CONTENT_LENGTH:
+		if(parser->has_digits == 0 || parser->has_content_length)
+			return HPR_BAD_REQUEST;
+		parser->has_content_length = 1;
+		break;
+	case HPH_AUTHORIZATION:
+		while(parser->key_len && is_space(parser->key[parser->key_len - 1]))
+			parser->key_len--;
+		if(parser->key)
+			parser->key[parser->key_len] = 0;
+		break;
+	case HPH_HOST:
+		while(parser->host_len && is_space(parser->host[parser->host_len - 1]))
+			parser->host_len--;
+		parser->host[parser->host_len] = 0;
+		break;
+	case HPH_CONNECTION:
+		finish_connection_token(parser);
+		break;
+	case HPH_IF_NONE_MATCH:
+		parser->etags[parser->etags_len] = 0;
+		break;
+	case HPH_UPGRADE:
+		finish_upgrade_token(parser);
+		break;
+	case HPH_SEC_WEBSOCKET_KEY:
+		parser->ws_key[parser->ws_key_len] = 0;
+		break;
+	}
+	parser->header = HPH_NONE;
+	parser->token_len = 0;
+	return HPR_NOT_FINISHED;
+}
+
+LOCAL void ICACHE_FLASH_ATTR finish_head(HTTP_PARSER *parser) {
+	parser->path[parser->path_len] = 0;
+	if(parser->query)
+		parser->query[parser->query_len] = 0;
+	if(parser->conn_close)
+		parser->keep_alive = 0;
+	else if(parser->conn_keep_alive)
+		parser->keep_alive = 1;
+	else
+		parser->keep_alive = parser->http11;
+	parser->state = HPS_END;
+}
+
+void ICACHE_FLASH_ATTR httpd_parser_reset(HTTP_PARSER *parser) {
+	if(parser->key)
+		os_free(parser->key);
+	if(parser->query)
+		os_free(parser->query);
+	os_memset(parser, 0, sizeof(HTTP_PARSER));
+	parser->state = HPS_METHOD;
+}
+
+HTTP_PARSER_RESULT ICACHE_FLASH_ATTR httpd_parser_feed(HTTP_PARSER *parser,
+		const char *data, unsigned int len, unsigned int *used) {
+	HTTP_PARSER_RESULT res = HPR_NOT_FINISHED;
+	unsigned int i;
+	for(i = 0; i < len && res == HPR_NOT_FINISHED; i++) {
+		const char c = data[i];
+		if(parser->state == HPS_END)
+			break;
+		if(++parser->head_len > HTTPD_PARSER_MAX_HEAD) {
+			res = HPR_BAD_REQUEST;
+			break;
+		}
+		if(c == 0) {
+			res = HPR_BAD_REQUEST;
+			break;
+		}
+		switch(parser->state) {
+		case HPS_METHOD:
+			if(c == ' ') {
+				res = finish_method(parser);
+				parser->token_len = 0;
+				parser->state = HPS_PATH;
+			} else if(c == '\r' || c == '\n') {
+				// empty lines before request are allowed
+				if(parser->token_len)
+					res = HPR_BAD_REQUEST;
+			} else {
+				token_add(parser, c);
+			}
+			break;
+		case HPS_PATH:
+			if(c == ' ') {
+				if(parser->path_len)
+					parser->state = HPS_VERSION;
+			} else if(c == '?') {
+				parser->state = HPS_QUERY;
+			} else if(c == '\r' || c == '\n') {
+				res = HPR_BAD_REQUEST;
+			} else if(parser->path_len < sizeof(parser->path) - 1) {
+				parser->path[parser->path_len++] = c;
+			} else {
+				parser->path_overflow = 1;
+			}
+			break;
+		case HPS_QUERY:
+			if(c == ' ') {
+				parser->state = HPS_VERSION;
+			} else if(c == '\r' || c == '\n') {
+				res = HPR_BAD_REQUEST;
+			} else {
+				if(parser->query == 0) {
+					parser->query = (char *)os_malloc(HTTPD_PARSER_MAX_QUERY);
+					if(parser->query == 0) {
+						res = HPR_BAD_REQUEST;
+						break;
+					}
+				}
+				// too long query is cut, parameters in it just don't match
+				if(parser->query_len < HTTPD_PARSER_MAX_QUERY - 1)
+					parser->query[parser->query_len++] = c;
+			}
+			break;
+		case HPS_VERSION:
+			if(c == '\n') {
+				res = finish_version(parser);
+				parser->token_len = 0;
+				parser->state = HPS_HEADER_START;
+			} else if(c != '\r') {
+				token_add(parser, c);
+			}
+			break;
+		case HPS_HEADER_START:
+			if(c == '\n') {
+				finish_head(parser);
+				res = HPR_DONE;
+				break;
+			} else if(c == '\r') {
+				break;
+			} else if(is_space(c)) {
+				// obsolete line folding
+				res = HPR_BAD_REQUEST;
+				break;
+			}
+			parser->state = HPS_HEADER_NAME;
+			// no break
+		case HPS_HEADER_NAME:
+			if(c == ':') {
+				finish_header_name(parser);
+				parser->state = HPS_HEADER_VALUE;
+			} else if(c == '\r' || c == '\n' || is_space(c)) {
+				res = HPR_BAD_REQUEST;
+			} else {
+				token_add(parser, c);
+			}
+			break;
+		case HPS_HEADER_VALUE:
+			if(c == '\n') {
+				res = finish_header_value(parser);
+				parser->state = HPS_HEADER_START;
+			} else if(c != '\r') {
+				res = header_value(parser, c);
+			}
+			break;
+		}
+	}
+	*used = i;
+	return res;
+}
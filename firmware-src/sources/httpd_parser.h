@@ -0,0 +1,101 @@
+/**
+ *	\file		httpd_parser.h
+ *	\brief		Incremental HTTP/1.x request head parser.
+ *	\details	Each byte of request is processed only once, data can be split
+ *				at any position between TCP segments. Only fields which are used
+ *				by HTTP server are extracted.
+ *	\copyright	DeviceHive MIT
+ */
+
+#ifndef _HTTPD_PARSER_H_
+#define _HTTPD_PARSER_H_
+
+#include "dhsettings.h"
+
+#include <c_types.h>
+
+/** Maximum path length including null terminated char. */
+#define HTTPD_PARSER_MAX_PATH 64
+/** Maximum Host header value length including null terminated char. */
+#define HTTPD_PARSER_MAX_HOST 48
+/** Maximum If-None-Match header value length including null terminated char. */
+#define HTTPD_PARSER_MAX_ETAGS 48
+/** Maximum Sec-WebSocket-Key header value length including null terminated char. */
+#define HTTPD_PARSER_MAX_WS_KEY 32
+/** Maximum query length including null terminated char, fits key parameter. */
+#define HTTPD_PARSER_MAX_QUERY (DHSETTINGS_KEY_MAX_LENGTH + 16)
+/** Maximum length of request head, longer requests are considered as bad. */
+#define HTTPD_PARSER_MAX_HEAD 4096
+/** Buffer for tokens which are compared with known words, should fit the longest of them. */
+#define HTTPD_PARSER_TOKEN_SIZE 20
+
+/** Request method. */
+typedef enum {
+	HTTP_METHOD_UNKNOWN,	///< Method is not supported by server.
+	HTTP_METHOD_GET,		///< GET.
+	HTTP_METHOD_POST,		///< POST.
+	HTTP_METHOD_OPTIONS		///< OPTIONS.
+} HTTP_METHOD;
+
+/** Parser result. */
+typedef enum {
+	HPR_NOT_FINISHED,		///< All data is consumed, request head is not finished yet.
+	HPR_DONE,				///< Request head is parsed, content_length bytes of body follow.
+	HPR_BAD_REQUEST			///< Request is malformed.
+} HTTP_PARSER_RESULT;
+
+/** Parser state and parsed fields. */
+typedef struct {
+	char path[HTTPD_PARSER_MAX_PATH];		///< Path without query.
+	char host[HTTPD_PARSER_MAX_HOST];		///< Host header value.
+	char etags[HTTPD_PARSER_MAX_ETAGS];		///< If-None-Match header value.
+	char ws_key[HTTPD_PARSER_MAX_WS_KEY];	///< Sec-WebSocket-Key header value.
+	char *key;								///< Bearer from Authorization header, zero if there is no such header.
+	char *query;							///< Query without '?', zero if there is no query.
+	unsigned int content_length;			///< Body length.
+	unsigned int head_len;					///< Number of parsed bytes of request head.
+	char token[HTTPD_PARSER_TOKEN_SIZE];	///< Internal buffer for method, version, header names.
+	uint8 token_len;						///< Length of data in token.
+	uint8 state;							///< Internal state.
+	uint8 header;							///< Header which value is parsing now.
+	uint8 pos;								///< Position inside currently parsed value.
+	uint8 method;							///< One of HTTP_METHOD values.
+	uint8 path_len;							///< Length of path.
+	uint8 host_len;							///< Length of host.
+	uint8 etags_len;						///< Length of etags.
+	uint8 ws_key_len;						///< Length of ws_key.
+	unsigned short key_len;					///< Length of key.
+	unsigned short query_len;				///< Length of query.
+	unsigned http11 : 1;					///< Is request made with HTTP/1.1.
+	unsigned keep_alive : 1;				///< Should connection be kept open after response.
+	unsigned gzip : 1;						///< Does client accept gzip encoding.
+	unsigned upgrade : 1;					///< Does client ask to upgrade connection.
+	unsigned websocket : 1;					///< Is WebSocket protocol in Upgrade header.
+	unsigned path_overflow : 1;				///< Path is longer than buffer.
+	unsigned host_overflow : 1;				///< Host is longer than buffer.
+	unsigned conn_close : 1;				///< Connection: close was received.
+	unsigned conn_keep_alive : 1;			///< Connection: keep-alive was received.
+	unsigned has_content_length : 1;		///< Content-Length header was received.
+	unsigned has_digits : 1;				///< Digits of current Content-Length were received.
+} HTTP_PARSER;
+
+/**
+ *	\brief					Prepare parser for the new request.
+ *	\details				Should be called for zero initialized or previously used parser.
+ *	\param[in]	parser		Pointer to parser.
+ */
+void httpd_parser_reset(HTTP_PARSER *parser);
+
+/**
+ *	\brief					Parse the next piece of request head.
+ *	\param[in]	parser		Pointer to parser.
+ *	\param[in]	data		Received data.
+ *	\param[in]	len			Data length.
+ *	\param[out]	used		Number of bytes that belong to request head.
+ *	\return					Parse result. On HPR_DONE the rest of data after used bytes
+ *							is request body or next request.
+ */
+HTTP_PARSER_RESULT httpd_parser_feed(HTTP_PARSER *parser, const char *data,
+		unsigned int len, unsigned int *used);
+
+#endif /* _HTTPD_PARSER_H_ */
@@ -51,6 +51,21 @@ void ICACHE_FLASH_ATTR irom_read(void *ram_buf,
 			buf_len -= 1;
 			ram += 1;
 			rom += 1;
+		} else if ((uint32_t)ram & (IROM_FLASH_ALIGNMENT-1)) {
+			// ... RAM address is not aligned, read 4-bytes
+			// at once, but store them byte-by-byte
+			union {
+				uint32_t u;
+				uint8_t b[4];
+			} tmp;
+			tmp.u = *((const uint32_t *)rom);
+			ram[0] = tmp.b[0];
+			ram[1] = tmp.b[1];
+			ram[2] = tmp.b[2];
+			ram[3] = tmp.b[3];
+			buf_len -= sizeof(uint32_t);
+			ram += sizeof(uint32_t);
+			rom += sizeof(uint32_t);
 		} else {
 			// ... otherwise process 4-bytes at once
 			*((uint32_t*)ram) = *((const uint32_t *)rom);
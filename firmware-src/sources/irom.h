@@ -52,7 +52,7 @@
  */
 static inline bool is_irom(const void *ptr)
 {
-	return (uint32_t)ptr >= IROM_FLASH_BASE_ADDRESS;
+	return (size_t)ptr >= IROM_FLASH_BASE_ADDRESS;
 }
 
 
@@ -0,0 +1,240 @@
+/*
+ * local_websocket.c
+ *
+ * Copyright 2017 DeviceHive
+ *
+ * Description: DeviceHive WebSocket API for clients in local network
+ *
+ */
+#include "local_websocket.h"
+#include "dhcommands.h"
+#include "dhsender.h"
+#include "dhsender_data.h"
+#include "dhsettings.h"
+#include "dhstatistic.h"
+#include "dhdebug.h"
+#include "snprintf.h"
+#include "irom.h"
+#include "user_config.h"
+
+#include <stdarg.h>
+#include <c_types.h>
+#include <osapi.h>
+#include <mem.h>
+#include <json/jsonparse.h>
+#include <ets_forward.h>
+
+#define LOCAL_WEBSOCKET_MAX_CLIENTS 2
+
+typedef struct {
+	unsigned int stream;
+	unsigned used : 1;
+	unsigned opened : 1;
+	unsigned authorized : 1;
+} LOCAL_CLIENT;
+
+LOCAL LOCAL_CLIENT mClients[LOCAL_WEBSOCKET_MAX_CLIENTS] = {{0}};
+LOCAL LOCAL_CLIENT *mCommandClient = 0;
+RO_DATA char mUnauthorized[] = "Unauthorized";
+
+LOCAL void ICACHE_FLASH_ATTR notification_listener(const char *json, unsigned int len) {
+	int i;
+	for(i = 0; i < LOCAL_WEBSOCKET_MAX_CLIENTS; i++) {
+		LOCAL_CLIENT *client = &mClients[i];
+		if(client->opened == 0 || client->authorized == 0)
+			continue;
+		if(httpd_stream_send(client->stream, json, len))
+			dhstat_got_local_notification();
+		else
+			dhstat_got_local_notification_dropped();
+	}
+}
+
+LOCAL void ICACHE_FLASH_ATTR update_listener(void) {
+	int i;
+	for(i = 0; i < LOCAL_WEBSOCKET_MAX_CLIENTS; i++) {
+		if(mClients[i].opened && mClients[i].authorized) {
+			if(dhsender_add_listener(notification_listener) == 0)
+				dhdebug("Local WebSocket can't listen notifications");
+			return;
+		}
+	}
+	dhsender_remove_listener(notification_listener);
+}
+
+LOCAL void ICACHE_FLASH_ATTR send_status(LOCAL_CLIENT *client, const char *action,
+		const char *error) {
+	RO_DATA char success[] = "{\"action\":\"%s\",\"status\":\"success\"}";
+	RO_DATA char failure[] = "{\"action\":\"%s\",\"status\":\"error\",\"error\":\"%s\"}";
+	char buf[sizeof(failure) + 128];
+	int len;
+	if(error)
+		len = snprintf(buf, sizeof(buf), failure, action, error);
+	else
+		len = snprintf(buf, sizeof(buf), success, action);
+	httpd_stream_send(client->stream, buf, len);
+}
+
+LOCAL void ICACHE_FLASH_ATTR local_command_callback(CommandResultArgument cid,
+		RESPONCE_STATUS status, REQUEST_DATA_TYPE data_type, ...) {
+	RO_DATA char template[] =
+			"{"
+				"\"action\":\"command/update\","
+				"\"deviceId\":\"%s\","
+				"\"commandId\":%u,"
+				"\"command\":{"
+					"\"status\":\"%s\","
+					"\"result\":";
+	RO_DATA char status_ok[] = "OK";
+	RO_DATA char status_error[] = "Error";
+	SENDERDATA data;
+	unsigned int data_len;
+	unsigned int pin;
+	va_list ap;
+	va_start(ap, data_type);
+	dhsender_data_parse_va(ap, &data_type, &data, &data_len, &pin);
+	va_end(ap);
+
+	char *buf = (char *)os_malloc(SENDER_JSON_MAX_LENGTH);
+	if(buf == 0) {
+		dhdebug("Local WebSocket no memory for response");
+	} else if(mCommandClient) {
+		int len = snprintf(buf, SENDER_JSON_MAX_LENGTH, template,
+				dhsettings_get_devicehive_deviceid(), cid.id,
+				(status == DHSTATUS_OK) ? status_ok : status_error);
+		int res = dhsender_data_to_json(&buf[len], SENDER_JSON_MAX_LENGTH - len, 0,
+				data_type, &data, data_len, pin);
+		if(res < 0)
+			res = snprintf(&buf[len], SENDER_JSON_MAX_LENGTH - len, "\"Failed to convert data to json\"");
+		len += res;
+		len += snprintf(&buf[len], SENDER_JSON_MAX_LENGTH - len, "}}");
+		httpd_stream_send(mCommandClient->stream, buf, len);
+	}
+	if(buf)
+		os_free(buf);
+	if(data_type == RDT_JSON_MALLOC_PTR)
+		os_free((void*)data.string);
+}
+
+LOCAL int ICACHE_FLASH_ATTR is_key_valid(struct jsonparse_state *jparser) {
+	const char *key = dhsettings_get_devicehive_key();
+	// jsonparse_strcmp_value() compares only as many chars as value has
+	return jsonparse_get_len(jparser) == os_strlen(key)
+			&& jsonparse_strcmp_value(jparser, key) == 0;
+}
+
+LOCAL void ICACHE_FLASH_ATTR handle_message(LOCAL_CLIENT *client, const char *data,
+		unsigned int len) {
+	char action[32];
+	char command[128];
+	const char *params = 0;
+	unsigned int paramslen = 0;
+	unsigned int id = 0;
+	int key_valid = 0;
+	int type;
+	action[0] = 0;
+	command[0] = 0;
+	struct jsonparse_state jparser;
+	jsonparse_setup(&jparser, data, len);
+	while (jparser.pos < jparser.len) {
+		type = jsonparse_next(&jparser);
+		if(type == JSON_TYPE_PAIR_NAME) {
+			if(jsonparse_strcmp_value(&jparser, "action") == 0) {
+				jsonparse_next(&jparser);
+				if(jsonparse_next(&jparser) == JSON_TYPE_STRING)
+					jsonparse_copy_value(&jparser, action, sizeof(action));
+			} else if(jsonparse_strcmp_value(&jparser, "command") == 0) {
+				jsonparse_next(&jparser);
+				if(jsonparse_next(&jparser) == JSON_TYPE_STRING)
+					jsonparse_copy_value(&jparser, command, sizeof(command));
+			} else if(jsonparse_strcmp_value(&jparser, "id") == 0) {
+				jsonparse_next(&jparser);
+				if(jsonparse_next(&jparser) == JSON_TYPE_NUMBER)
+					id = jsonparse_get_value_as_ulong(&jparser);
+			} else if(jsonparse_strcmp_value(&jparser, "token") == 0) {
+				jsonparse_next(&jparser);
+				if(jsonparse_next(&jparser) == JSON_TYPE_STRING)
+					key_valid = is_key_valid(&jparser);
+			} else if(jsonparse_strcmp_value(&jparser, "parameters") == 0) {
+				jsonparse_next(&jparser);
+				if(jsonparse_next(&jparser) != JSON_TYPE_ERROR) {
+					// the same extraction of sub json as for DeviceHive server
+					params = &jparser.json[jparser.pos - 1];
+					if(*params == '{') {
+						int end = jparser.pos;
+						while(end < jparser.len && jparser.json[end] != '}') {
+							end++;
+						}
+						paramslen = end - jparser.pos + 2;
+						jparser.pos += paramslen;
+					}
+				}
+			}
+		} else if(type == JSON_TYPE_ERROR) {
+			break;
+		}
+	}
+
+	if(os_strcmp(action, "command/insert") == 0) {
+		if(client->authorized == 0) {
+			send_status(client, action, mUnauthorized);
+			return;
+		}
+		COMMAND_RESULT cb;
+		cb.callback = local_command_callback;
+		cb.data.id = id;
+		// commands are responded synchronously
+		mCommandClient = client;
+		dhcommands_do(&cb, command, params, paramslen);
+		mCommandClient = 0;
+	} else if(os_strcmp(action, "authenticate") == 0) {
+		if(dhsettings_get_devicehive_key()[0] && key_valid == 0) {
+			send_status(client, action, mUnauthorized);
+			return;
+		}
+		client->authorized = 1;
+		update_listener();
+		send_status(client, action, 0);
+	} else {
+		send_status(client, action, "Unknown action");
+	}
+}
+
+LOCAL void ICACHE_FLASH_ATTR stream_cb(unsigned int stream, HTTP_STREAM_EVENT event,
+		const char *data, unsigned int len, void *arg) {
+	LOCAL_CLIENT *client = (LOCAL_CLIENT *)arg;
+	switch(event) {
+	case HSE_OPEN:
+		dhdebug("Local WebSocket client connected");
+		client->stream = stream;
+		client->opened = 1;
+		update_listener();
+		break;
+	case HSE_MESSAGE:
+		handle_message(client, data, len);
+		break;
+	case HSE_CLOSE:
+		os_memset(client, 0, sizeof(LOCAL_CLIENT));
+		update_listener();
+		break;
+	}
+}
+
+HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR local_websocket_handle(const char *key,
+		HTTP_ANSWER *answer) {
+	const char *device_key = dhsettings_get_devicehive_key();
+	int i;
+	for(i = 0; i < LOCAL_WEBSOCKET_MAX_CLIENTS; i++) {
+		LOCAL_CLIENT *client = &mClients[i];
+		if(client->used)
+			continue;
+		os_memset(client, 0, sizeof(LOCAL_CLIENT));
+		client->used = 1;
+		// browsers can't set header, they authenticate with message
+		client->authorized = (device_key[0] == 0 || os_strcmp(key, device_key) == 0);
+		answer->stream = stream_cb;
+		answer->stream_arg = client;
+		return HRCS_WEBSOCKET;
+	}
+	return HRCS_TOO_MANY_REQUESTS;
+}
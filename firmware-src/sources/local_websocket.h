@@ -0,0 +1,23 @@
+/**
+ *	\file		local_websocket.h
+ *	\brief		DeviceHive WebSocket API for clients in local network.
+ *	\details	Clients use the same JSON messages as DeviceHive server: they send
+ *				"command/insert" messages and receive "command/update" responses
+ *				and "notification/insert" notifications.
+ *	\copyright	DeviceHive MIT
+ */
+
+#ifndef _LOCAL_WEBSOCKET_H_
+#define _LOCAL_WEBSOCKET_H_
+
+#include "httpd.h"
+
+/**
+ *	\brief						Handle request for WebSocket connection.
+ *	\param[in]	key				Authorization key from request, empty string if there is no key.
+ *	\param[out]	answer			Answer for httpd.
+ *	\return						Status for httpd.
+ */
+HTTP_RESPONSE_STATUS local_websocket_handle(const char *key, HTTP_ANSWER *answer);
+
+#endif /* _LOCAL_WEBSOCKET_H_ */
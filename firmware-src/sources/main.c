@@ -19,6 +19,7 @@
 #include "webserver.h"
 #include "irom.h"
 #include "uploadable_page.h"
+#include "uploadable_firmware.h"
 #include "dhzc_dnsd.h"
 #include "dhzc_web.h"
 #include "mdnsd.h"
@@ -133,6 +134,9 @@ void ICACHE_FLASH_ATTR system_init_done(void) {
 			mSpecialMode == 0) {
 		mdnsd_start(dhsettings_get_devicehive_deviceid(), dhap_get_ip_info()->ip.addr);
 	}
+	// there is no DeviceHive server connection to wait for
+	if(dhsettings_get_wifi_mode() != WIFI_MODE_CLIENT || mSpecialMode)
+		uploadable_firmware_confirm();
 	dhdebug("Initialization completed");
 }
 
@@ -140,6 +144,7 @@ void user_init(void) {
 	int ever_saved;
 	gpio_output_set(0, 0, 0, DH_GPIO_SUITABLE_PINS);
 	dhsettings_init(&ever_saved);
+	uploadable_firmware_init();
 	if(ever_saved == 0) { // if first run on this chip
 		uploadable_page_delete();
 		mSpecialMode = 1;
@@ -153,10 +158,12 @@ void user_init(void) {
 		dhzc_web_init();
 		dhdebug("Zero configuration server is initialized");
 	} else {
+		// notifications are used by local clients in both modes,
+		// queue is needed for server connector only
+		dh_gpio_init();
 		if(dhsettings_get_wifi_mode() == WIFI_MODE_CLIENT) {
 			dhsender_queue_init();
 			dhconnector_init();
-			dh_gpio_init();
 		} else if(dhsettings_get_wifi_mode() == WIFI_MODE_AP) {
 			dhap_init(dhsettings_get_wifi_ssid(), dhsettings_get_wifi_password());
 		}
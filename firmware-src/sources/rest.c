@@ -9,10 +9,13 @@
 #include "rest.h"
 #include "dhsettings.h"
 #include "dhcommands.h"
+#include "dhsender.h"
 #include "dhsender_data.h"
 #include "user_config.h"
 #include "irom.h"
 #include "dhstatistic.h"
+#include "dhdebug.h"
+#include "snprintf.h"
 
 #include <stdarg.h>
 #include <c_types.h>
@@ -27,6 +30,83 @@ RO_DATA char desription[] = "<html><body>This is firmware RESTfull API endpoint.
 	"<a href='https://github.com/devicehive/esp8266-firmware' target='_blank'>"\
 	"https://github.com/devicehive/esp8266-firmware</a></body></html>";
 
+#define REST_MAX_EVENTS_CLIENTS 2
+
+typedef struct {
+	unsigned int stream;
+	unsigned int dropped;
+	unsigned used : 1;
+	unsigned opened : 1;
+} EVENTS_CLIENT;
+
+LOCAL EVENTS_CLIENT mEventsClients[REST_MAX_EVENTS_CLIENTS] = {{0}};
+
+LOCAL int ICACHE_FLASH_ATTR send_dropped(EVENTS_CLIENT *client) {
+	RO_DATA char template[] = "{\"action\":\"notification/dropped\",\"count\":%u}";
+	char buf[sizeof(template) + 10];
+	const int len = snprintf(buf, sizeof(buf), template, client->dropped);
+	if(httpd_stream_send(client->stream, buf, len) == 0)
+		return 0;
+	client->dropped = 0;
+	return 1;
+}
+
+LOCAL void ICACHE_FLASH_ATTR events_listener(const char *json, unsigned int len) {
+	int i;
+	for(i = 0; i < REST_MAX_EVENTS_CLIENTS; i++) {
+		EVENTS_CLIENT *client = &mEventsClients[i];
+		if(client->opened == 0)
+			continue;
+		// slow client learns how many notifications it missed before the next one
+		if((client->dropped == 0 || send_dropped(client))
+				&& httpd_stream_send(client->stream, json, len)) {
+			dhstat_got_local_notification();
+		} else {
+			client->dropped++;
+			dhstat_got_local_notification_dropped();
+		}
+	}
+}
+
+LOCAL void ICACHE_FLASH_ATTR events_stream_cb(unsigned int stream, HTTP_STREAM_EVENT event,
+		const char *data, unsigned int len, void *arg) {
+	EVENTS_CLIENT *client = (EVENTS_CLIENT *)arg;
+	int i;
+	switch(event) {
+	case HSE_OPEN:
+		client->stream = stream;
+		client->opened = 1;
+		if(dhsender_add_listener(events_listener) == 0)
+			dhdebug("Events stream can't listen notifications");
+		break;
+	case HSE_MESSAGE:
+		break;
+	case HSE_CLOSE:
+		os_memset(client, 0, sizeof(EVENTS_CLIENT));
+		for(i = 0; i < REST_MAX_EVENTS_CLIENTS; i++) {
+			if(mEventsClients[i].opened)
+				return;
+		}
+		dhsender_remove_listener(events_listener);
+		break;
+	}
+}
+
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR events_handle(HTTP_ANSWER *answer) {
+	int i;
+	for(i = 0; i < REST_MAX_EVENTS_CLIENTS; i++) {
+		EVENTS_CLIENT *client = &mEventsClients[i];
+		if(client->used)
+			continue;
+		os_memset(client, 0, sizeof(EVENTS_CLIENT));
+		client->used = 1;
+		answer->stream = events_stream_cb;
+		answer->stream_arg = client;
+		return HRCS_EVENTS;
+	}
+	return HRCS_TOO_MANY_REQUESTS;
+}
+
 LOCAL void ICACHE_FLASH_ATTR rest_command_callback(CommandResultArgument cid,
 		RESPONCE_STATUS status, REQUEST_DATA_TYPE data_type, ...) {
 	va_list ap;
@@ -45,14 +125,14 @@ LOCAL void ICACHE_FLASH_ATTR rest_command_callback(CommandResultArgument cid,
 		unsigned int data_len;
 		unsigned int pin;
 		dhsender_data_parse_va(ap, &data_type, &data, &data_len, &pin);
-		char *buf = (char *)os_malloc(2*INTERFACES_BUF_SIZE); // do we really can have more?
+		char *buf = (char *)os_malloc(SENDER_JSON_MAX_LENGTH);
 		if(buf == 0) {
 			RO_DATA char error[] = "No memory";
 			answer->ok = 0;
 			answer->content.data = error;
 			answer->content.len = sizeof(error) - 1;
 		} else {
-			int res = dhsender_data_to_json(buf, 2*INTERFACES_BUF_SIZE, 0, data_type, &data,
+			int res = dhsender_data_to_json(buf, SENDER_JSON_MAX_LENGTH, 0, data_type, &data,
 					data_len, pin);
 			if(res < 0) {
 				os_free(buf);
@@ -72,9 +152,10 @@ LOCAL void ICACHE_FLASH_ATTR rest_command_callback(CommandResultArgument cid,
 	va_end(ap);
 }
 
-HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR rest_handle(const char *path, const char *key,
+HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR rest_handle(const char *path, const char *query, const char *key,
 		HTTP_CONTENT *content_in, HTTP_ANSWER *answer) {
 	static const char cint[] = "/int";
+	static const char events[] = "events";
 	dhstat_got_local_rest_request();
 	if(path[0] == 0) {
 		answer->content.data = desription;
@@ -82,14 +163,17 @@ HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR rest_handle(const char *path, const char
 		return HRCS_ANSWERED_HTML;
 	}
 	if(dhsettings_get_devicehive_key()[0]) {
-		if(key == 0) {
-			return HRCS_UNAUTHORIZED;
-		}
-		if(os_strcmp(key, dhsettings_get_devicehive_key())) {
-			return HRCS_UNAUTHORIZED;
+		if(key == 0 || os_strcmp(key, dhsettings_get_devicehive_key())) {
+			// browser's EventSource can't set headers, so events stream accepts key in query
+			if(os_strcmp(path, events)
+					|| httpd_query_param_equal(query, "key", dhsettings_get_devicehive_key()) == 0)
+				return HRCS_UNAUTHORIZED;
 		}
 	}
 
+	if(os_strcmp(path, events) == 0)
+		return events_handle(answer);
+
 	// prevent all commands with interruption
 	int pathlen = os_strlen(path);
 	if(pathlen >= sizeof(cint) - 1) {
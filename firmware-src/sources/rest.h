@@ -14,13 +14,14 @@
 /**
  *	\brief						Handle rest request.
  *	\param[in]	path			Url path.
+ *	\param[in]	query			Url query, events stream takes access key from its "key" parameter.
  *	\param[in]	key				Access key for API which was given in request.
  *	\param[in]	content_in		Request body, typically json.
  *	\param[out]	answer			Data for response.
  *	\return						One of httpd statuses.
  */
 
-HTTP_RESPONSE_STATUS rest_handle(const char *path, const char *key,
+HTTP_RESPONSE_STATUS rest_handle(const char *path, const char *query, const char *key,
 		HTTP_CONTENT *content_in, HTTP_ANSWER *answer);
 
 #endif /* _REST_H_ */
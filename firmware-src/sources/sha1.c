@@ -0,0 +1,127 @@
+/**
+ * @file
+ * @brief SHA-1 hash calculation.
+ * @copyright 2017 [DeviceHive](http://devicehive.com)
+ */
+#include "sha1.h"
+
+#include <osapi.h>
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+ * @brief Process one 64 bytes block.
+ * @param[in,out] ctx Pointer to context.
+ */
+static void ICACHE_FLASH_ATTR sha1_block(SHA1_CONTEXT *ctx)
+{
+	uint32_t w[16];
+	uint32_t a = ctx->state[0];
+	uint32_t b = ctx->state[1];
+	uint32_t c = ctx->state[2];
+	uint32_t d = ctx->state[3];
+	uint32_t e = ctx->state[4];
+	int i;
+
+	for (i = 0; i < 16; ++i) {
+		w[i] = ((uint32_t)ctx->block[4*i] << 24)
+		     | ((uint32_t)ctx->block[4*i + 1] << 16)
+		     | ((uint32_t)ctx->block[4*i + 2] << 8)
+		     | ((uint32_t)ctx->block[4*i + 3]);
+	}
+
+	for (i = 0; i < 80; ++i) {
+		uint32_t f, k;
+		if (i >= 16) {
+			// message schedule is kept in circular buffer
+			const uint32_t t = w[(i + 13) & 15] ^ w[(i + 8) & 15]
+			                 ^ w[(i + 2) & 15] ^ w[i & 15];
+			w[i & 15] = ROL(t, 1);
+		}
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+		const uint32_t t = ROL(a, 5) + f + e + k + w[i & 15];
+		e = d;
+		d = c;
+		c = ROL(b, 30);
+		b = a;
+		a = t;
+	}
+
+	ctx->state[0] += a;
+	ctx->state[1] += b;
+	ctx->state[2] += c;
+	ctx->state[3] += d;
+	ctx->state[4] += e;
+}
+
+
+/*
+ * sha1_init() implementation.
+ */
+void ICACHE_FLASH_ATTR sha1_init(SHA1_CONTEXT *ctx)
+{
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xEFCDAB89;
+	ctx->state[2] = 0x98BADCFE;
+	ctx->state[3] = 0x10325476;
+	ctx->state[4] = 0xC3D2E1F0;
+	ctx->length = 0;
+}
+
+
+/*
+ * sha1_update() implementation.
+ */
+void ICACHE_FLASH_ATTR sha1_update(SHA1_CONTEXT *ctx, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t*)data;
+	while (len--) {
+		ctx->block[ctx->length++ & 63] = *p++;
+		if ((ctx->length & 63) == 0)
+			sha1_block(ctx);
+	}
+}
+
+
+/*
+ * sha1_final() implementation.
+ */
+void ICACHE_FLASH_ATTR sha1_final(SHA1_CONTEXT *ctx, uint8_t *digest)
+{
+	const uint32_t bits = ctx->length * 8;
+	unsigned int pos = ctx->length & 63;
+	int i;
+
+	ctx->block[pos++] = 0x80;
+	if (pos > 56) {
+		os_memset(&ctx->block[pos], 0, 64 - pos);
+		sha1_block(ctx);
+		pos = 0;
+	}
+	os_memset(&ctx->block[pos], 0, 56 - pos);
+	// byte counter is 32 bits, so higher bytes of 64 bits length are zero
+	ctx->block[56] = 0;
+	ctx->block[57] = 0;
+	ctx->block[58] = 0;
+	ctx->block[59] = (uint8_t)(ctx->length >> 29);
+	ctx->block[60] = (uint8_t)(bits >> 24);
+	ctx->block[61] = (uint8_t)(bits >> 16);
+	ctx->block[62] = (uint8_t)(bits >> 8);
+	ctx->block[63] = (uint8_t)(bits);
+	sha1_block(ctx);
+
+	for (i = 0; i < SHA1_DIGEST_SIZE; ++i)
+		digest[i] = (uint8_t)(ctx->state[i >> 2] >> (24 - 8 * (i & 3)));
+}
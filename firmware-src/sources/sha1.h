@@ -0,0 +1,47 @@
+/**
+ * @file
+ * @brief SHA-1 hash calculation.
+ * @copyright 2017 [DeviceHive](http://devicehive.com)
+ */
+#ifndef _SHA1_H_
+#define _SHA1_H_
+
+#include <c_types.h>
+
+/** SHA-1 digest size in bytes. */
+#define SHA1_DIGEST_SIZE 20
+
+/**
+ * @brief SHA-1 calculation context.
+ */
+typedef struct {
+	uint32_t state[5];  ///< Intermediate hash value.
+	uint32_t length;    ///< Number of processed bytes.
+	uint8_t block[64];  ///< Not processed data.
+} SHA1_CONTEXT;
+
+
+/**
+ * @brief Start SHA-1 calculation.
+ * @param[out] ctx Pointer to context.
+ */
+void sha1_init(SHA1_CONTEXT *ctx);
+
+
+/**
+ * @brief Process the next piece of data.
+ * @param[in,out] ctx Pointer to context.
+ * @param[in] data Pointer to data.
+ * @param[in] len Data length in bytes.
+ */
+void sha1_update(SHA1_CONTEXT *ctx, const void *data, size_t len);
+
+
+/**
+ * @brief Finish SHA-1 calculation.
+ * @param[in,out] ctx Pointer to context.
+ * @param[out] digest Buffer for SHA1_DIGEST_SIZE bytes of hash.
+ */
+void sha1_final(SHA1_CONTEXT *ctx, uint8_t *digest);
+
+#endif /* _SHA1_H_ */
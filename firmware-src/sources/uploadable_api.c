@@ -10,50 +10,202 @@
 #include "uploadable_api.h"
 #include "dhsettings.h"
 #include "uploadable_page.h"
+#include "uploadable_fs.h"
+#include "uploadable_firmware.h"
+#include "irom.h"
+#include "snprintf.h"
 
 #include <c_types.h>
 #include <osapi.h>
+#include <mem.h>
+#include <json/jsonparse.h>
 #include <ets_forward.h>
 
-HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR uploadable_api_handle(const char *path, const char *key,
+typedef struct {
+	char name[UPLOADABLE_FS_MAX_NAME + 1];
+	unsigned int size;
+	uint32_t crc;
+	int gzip;
+	int delta;
+	int has_crc;
+} FILE_PARAMS;
+
+/**
+ * Parse optional json with file parameters. Return zero on error.
+ */
+LOCAL int ICACHE_FLASH_ATTR parse_params(HTTP_CONTENT *content_in, FILE_PARAMS *params) {
+	struct jsonparse_state jparser;
+	int type;
+	os_memset(params, 0, sizeof(FILE_PARAMS));
+	if(content_in->len == 0)
+		return 1;
+	jsonparse_setup(&jparser, content_in->data, content_in->len);
+	while((type = jsonparse_next(&jparser)) != JSON_TYPE_ERROR) {
+		if(type != JSON_TYPE_PAIR_NAME)
+			continue;
+		if(jsonparse_strcmp_value(&jparser, "name") == 0) {
+			jsonparse_next(&jparser);
+			if(jsonparse_next(&jparser) != JSON_TYPE_STRING
+					|| jsonparse_get_len(&jparser) > UPLOADABLE_FS_MAX_NAME)
+				return 0;
+			jsonparse_copy_value(&jparser, params->name, sizeof(params->name));
+		} else if(jsonparse_strcmp_value(&jparser, "size") == 0) {
+			jsonparse_next(&jparser);
+			if(jsonparse_next(&jparser) != JSON_TYPE_NUMBER)
+				return 0;
+			params->size = jsonparse_get_value_as_ulong(&jparser);
+		} else if(jsonparse_strcmp_value(&jparser, "crc") == 0) {
+			jsonparse_next(&jparser);
+			if(jsonparse_next(&jparser) != JSON_TYPE_NUMBER)
+				return 0;
+			params->crc = jsonparse_get_value_as_ulong(&jparser);
+			params->has_crc = 1;
+		} else if(jsonparse_strcmp_value(&jparser, "gzip") == 0) {
+			jsonparse_next(&jparser);
+			params->gzip = (jsonparse_next(&jparser) == JSON_TYPE_TRUE);
+		} else if(jsonparse_strcmp_value(&jparser, "delta") == 0) {
+			jsonparse_next(&jparser);
+			params->delta = (jsonparse_next(&jparser) == JSON_TYPE_TRUE);
+		} else {
+			return 0;
+		}
+	}
+	return jparser.pos >= jparser.len;
+}
+
+/**
+ * Build json with list of files.
+ */
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR list_files(HTTP_ANSWER *answer) {
+	RO_DATA char head[] = "{\"free\":%u,\"files\":[";
+	RO_DATA char item[] = "%s{\"name\":\"%s\",\"size\":%u,\"crc\":%u,\"gzip\":%s}";
+	RO_DATA char tail[] = "]}";
+	const unsigned int item_size = sizeof(item) + UPLOADABLE_FS_MAX_NAME + 24;
+	char name[UPLOADABLE_FS_MAX_NAME + 1];
+	UPLOADABLE_FILE file;
+	unsigned int count = 0;
+	while(uploadable_fs_get(count, name, &file))
+		count++;
+	const unsigned int size = sizeof(head) + 10 + count * item_size + sizeof(tail);
+	char *buf = (char *)os_malloc(size);
+	if(buf == NULL)
+		return HRCS_INTERNAL_ERROR;
+	unsigned int len = snprintf(buf, size, head, uploadable_fs_free());
+	unsigned int i;
+	for(i = 0; i < count && uploadable_fs_get(i, name, &file); i++) {
+		// names are not escaped, they are checked on writing
+		len += snprintf(&buf[len], size - len, item, i ? "," : "", name,
+				file.length, file.crc, file.gzip ? "true" : "false");
+	}
+	len += snprintf(&buf[len], size - len, tail);
+	answer->content.data = buf;
+	answer->content.len = len;
+	answer->free_content = 1;
+	return HRCS_ANSWERED_JSON;
+}
+
+/**
+ * Build json with firmware images info.
+ */
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR firmware_info(HTTP_ANSWER *answer) {
+	RO_DATA char template[] = "{\"running\":\"%s\",\"target\":\"%s\",\"maxSize\":%u,\"trial\":%s}";
+	RO_DATA char standalone[] = "standalone";
+	RO_DATA char user1[] = "user1";
+	RO_DATA char user2[] = "user2";
+	const char *names[] = { standalone, user1, user2 };
+	const UPLOADABLE_FIRMWARE_IMAGE target = uploadable_firmware_target();
+	const unsigned int size = sizeof(template) + 32;
+	char *buf = (char *)os_malloc(size);
+	if(buf == NULL)
+		return HRCS_INTERNAL_ERROR;
+	answer->content.data = buf;
+	answer->content.len = snprintf(buf, size, template,
+			names[uploadable_firmware_running()], names[target],
+			(target == UPLOADABLE_FIRMWARE_STANDALONE) ? 0 : UPLOADABLE_FIRMWARE_MAX_SIZE,
+			uploadable_firmware_is_trial() ? "true" : "false");
+	answer->free_content = 1;
+	return HRCS_ANSWERED_JSON;
+}
+
+/**
+ * File names are used in urls and json without escaping.
+ */
+LOCAL int ICACHE_FLASH_ATTR is_name_valid(const char *name) {
+	if(name[0] == 0)
+		return 0;
+	for(; *name; name++) {
+		if(*name <= ' ' || *name == '"' || *name == '\\' || *name == '?' || *name == '#' || *name > '~')
+			return 0;
+	}
+	return 1;
+}
+
+HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR uploadable_api_handle(UPLOADABLE_API_ACTION action, const char *key,
 		HTTP_CONTENT *content_in, HTTP_ANSWER *answer) {
-	static const char flash[] = "/flash/page/";
 	answer->content.len = 0;
-	if(os_strncmp(path, flash, sizeof(flash) - 1) == 0) {
-		if(dhsettings_get_devicehive_key()[0]) {
-			if(key == 0) {
-				return HRCS_UNAUTHORIZED;
-			}
-			if(os_strcmp(key, dhsettings_get_devicehive_key())) {
-				return HRCS_UNAUTHORIZED;
-			}
+	if(dhsettings_get_devicehive_key()[0]) {
+		if(key == 0) {
+			return HRCS_UNAUTHORIZED;
 		}
-		const char *p = &path[sizeof(flash) - 1];
-		UP_STATUS res = UP_STATUS_WRONG_CALL;
-		if(os_strcmp(p, "begin") == 0) {
-			if(content_in->len == 0)
-				res = uploadable_page_begin();
-		} else if(os_strcmp(p, "finish") == 0) {
+		if(os_strcmp(key, dhsettings_get_devicehive_key())) {
+			return HRCS_UNAUTHORIZED;
+		}
+	}
+	UP_STATUS res = UP_STATUS_WRONG_CALL;
+	FILE_PARAMS params;
+	switch(action) {
+		case UPLOADABLE_API_BEGIN:
+			// size is optional for page
+			if(parse_params(content_in, &params) && params.name[0] == 0)
+				res = uploadable_page_begin(params.size);
+			break;
+		case UPLOADABLE_API_FINISH:
+		case UPLOADABLE_API_FILE_FINISH:
 			if(content_in->len == 0)
 				res = uploadable_page_finish();
-		} else if(os_strcmp(p, "put") == 0) {
+			break;
+		case UPLOADABLE_API_PUT:
+		case UPLOADABLE_API_FILE_PUT:
 			if(content_in->len)
 				res = uploadable_page_put(content_in->data, content_in->len);
-		} else {
+			break;
+		case UPLOADABLE_API_FILE_BEGIN:
+			if(parse_params(content_in, &params) && is_name_valid(params.name))
+				res = uploadable_fs_begin(params.name, params.size, params.gzip);
+			break;
+		case UPLOADABLE_API_FILE_DELETE:
+			if(parse_params(content_in, &params) && params.name[0])
+				res = uploadable_fs_delete(params.name);
+			break;
+		case UPLOADABLE_API_FILE_LIST:
+			return list_files(answer);
+		case UPLOADABLE_API_FIRMWARE_BEGIN:
+			if(parse_params(content_in, &params) && params.name[0] == 0 && params.has_crc)
+				res = uploadable_firmware_begin(params.size, params.crc, params.delta);
+			break;
+		case UPLOADABLE_API_FIRMWARE_FINISH:
+			if(content_in->len == 0)
+				res = uploadable_firmware_finish();
+			break;
+		case UPLOADABLE_API_FIRMWARE_PUT:
+			if(content_in->len)
+				res = uploadable_firmware_put(content_in->data, content_in->len);
+			break;
+		case UPLOADABLE_API_FIRMWARE_INFO:
+			return firmware_info(answer);
+		default:
 			return HRCS_NOT_FOUND;
-		}
-		switch(res) {
-			case UP_STATUS_OK:
-				return HRCS_ANSWERED_PLAIN;
-			case UP_STATUS_INTERNAL_ERROR:
-				return HRCS_INTERNAL_ERROR;
-			case UP_STATUS_WRONG_CALL:
-				answer->ok = 0;
-				return HRCS_ANSWERED_PLAIN;
-			case UP_STATUS_OVERFLOW:
-				return HRCS_TOO_MANY_REQUESTS;
-		}
-		return HRCS_ANSWERED_PLAIN;
 	}
-	return HRCS_NOT_FOUND;
+	switch(res) {
+		case UP_STATUS_OK:
+			return HRCS_ANSWERED_PLAIN;
+		case UP_STATUS_INTERNAL_ERROR:
+			return HRCS_INTERNAL_ERROR;
+		case UP_STATUS_WRONG_CALL:
+			answer->ok = 0;
+			return HRCS_ANSWERED_PLAIN;
+		case UP_STATUS_OVERFLOW:
+			return HRCS_TOO_MANY_REQUESTS;
+	}
+	return HRCS_ANSWERED_PLAIN;
 }
@@ -10,15 +10,31 @@
 
 #include "httpd.h"
 
+/** Uploadable page, files and firmware API actions. */
+typedef enum {
+	UPLOADABLE_API_BEGIN,		///< Start flashing, /flash/page/begin path.
+	UPLOADABLE_API_FINISH,		///< Finish flashing, /flash/page/finish path.
+	UPLOADABLE_API_PUT,			///< Write data, /flash/page/put path.
+	UPLOADABLE_API_FILE_BEGIN,	///< Start writing file, /flash/file/begin path.
+	UPLOADABLE_API_FILE_FINISH,	///< Finish writing file, /flash/file/finish path.
+	UPLOADABLE_API_FILE_PUT,	///< Write file data, /flash/file/put path.
+	UPLOADABLE_API_FILE_DELETE,	///< Delete file, /flash/file/delete path.
+	UPLOADABLE_API_FILE_LIST,	///< List files, /flash/file/list path.
+	UPLOADABLE_API_FIRMWARE_BEGIN,	///< Start writing firmware, /flash/firmware/begin path.
+	UPLOADABLE_API_FIRMWARE_FINISH,	///< Check firmware and reboot to it, /flash/firmware/finish path.
+	UPLOADABLE_API_FIRMWARE_PUT,	///< Write firmware data, /flash/firmware/put path.
+	UPLOADABLE_API_FIRMWARE_INFO	///< Firmware images info, /flash/firmware/info path.
+} UPLOADABLE_API_ACTION;
+
 /**
  *	\brief						Handle rest request.
- *	\param[in]	path			Url path.
+ *	\param[in]	action			Action which is resolved from url path.
  *	\param[in]	key				Access key for API which was given in request.
  *	\param[in]	content_in		Request body, typically json.
  *	\return						One of httpd statuses.
  */
 
-HTTP_RESPONSE_STATUS uploadable_api_handle(const char *path, const char *key,
+HTTP_RESPONSE_STATUS uploadable_api_handle(UPLOADABLE_API_ACTION action, const char *key,
 		HTTP_CONTENT *content_in, HTTP_ANSWER *answer);
 
 #endif /* _UPLOADABLE_API_H_ */
@@ -0,0 +1,298 @@
+/*
+ * uploadable_delta.c
+ *
+ * Copyright 2017 DeviceHive
+ *
+ * Description: Streaming decoder of binary delta between firmware images
+ *
+ */
+#include "uploadable_delta.h"
+#include "crc32.h"
+#include "dhdebug.h"
+
+#include <c_types.h>
+#include <spi_flash.h>
+#include <osapi.h>
+#include <user_interface.h>
+#include <mem.h>
+#include <ets_forward.h>
+
+/** Delta header signature, "DHD1". */
+#define DELTA_MAGIC 0x31444844
+/** Size of delta header: signature, old size, old CRC, new size. */
+#define DELTA_HEADER_SIZE 16
+/** Number of bits of LZSS back reference distance. */
+#define DELTA_WINDOW_BITS 10
+/** Number of bits of LZSS back reference length. */
+#define DELTA_LENGTH_BITS 6
+/** The shortest LZSS back reference. */
+#define DELTA_MIN_MATCH 2
+/** Size of LZSS window. */
+#define DELTA_WINDOW_SIZE (1 << DELTA_WINDOW_BITS)
+/** Size of old image piece which is read from flash at once. */
+#define DELTA_CACHE_SIZE 64
+/** Size of decoded data which is passed to output at once. */
+#define DELTA_OUTPUT_SIZE 256
+
+/** Fields of decoded delta stream. */
+typedef enum {
+	DELTA_HEADER,		///< Header is collected.
+	DELTA_ADD_LEN,		///< Varint with number of bytes to add to old image.
+	DELTA_INSERT_LEN,	///< Varint with number of new bytes.
+	DELTA_SEEK,			///< Zigzag varint with old image position change.
+	DELTA_ADD,			///< Bytes which are added to old image bytes.
+	DELTA_INSERT,		///< New bytes.
+	DELTA_DONE			///< New image is complete.
+} DELTA_STATE;
+
+typedef struct {
+	uint8_t window[DELTA_WINDOW_SIZE];
+	unsigned int window_pos;
+	uint32_t bits;
+	unsigned int bits_count;
+	DELTA_STATE state;
+	uint32_t header[DELTA_HEADER_SIZE / sizeof(uint32_t)];
+	unsigned int header_len;
+	uint32_t varint;
+	unsigned int varint_shift;
+	unsigned int add_len;
+	unsigned int insert_len;
+	uint32_t seek;
+	uint32_t old_address;
+	unsigned int old_max;
+	unsigned int old_size;
+	unsigned int old_pos;
+	unsigned int new_size;
+	unsigned int new_pos;
+	uint32_t cache[DELTA_CACHE_SIZE / sizeof(uint32_t)];
+	unsigned int cache_pos;
+	char output[DELTA_OUTPUT_SIZE];
+	unsigned int output_len;
+	UploadableDeltaOutput output_cb;
+} DELTA;
+
+LOCAL DELTA *mDelta = NULL;
+
+LOCAL UP_STATUS ICACHE_FLASH_ATTR read_old(unsigned int pos, uint8_t *byte) {
+	if(pos >= mDelta->old_size)
+		return UP_STATUS_OVERFLOW;
+	const unsigned int aligned = pos & ~(DELTA_CACHE_SIZE - 1);
+	if(aligned != mDelta->cache_pos) {
+		if(spi_flash_read(mDelta->old_address + aligned, mDelta->cache,
+				DELTA_CACHE_SIZE) != SPI_FLASH_RESULT_OK)
+			return UP_STATUS_INTERNAL_ERROR;
+		mDelta->cache_pos = aligned;
+	}
+	*byte = ((uint8_t *)mDelta->cache)[pos - aligned];
+	return UP_STATUS_OK;
+}
+
+/**
+ * Check that delta was made for image in flash.
+ */
+LOCAL UP_STATUS ICACHE_FLASH_ATTR check_header(void) {
+	uint32_t crc = 0;
+	unsigned int pos;
+	if(mDelta->header[0] != DELTA_MAGIC) {
+		dhdebug("Delta signature is wrong");
+		return UP_STATUS_WRONG_CALL;
+	}
+	mDelta->old_size = mDelta->header[1];
+	if(mDelta->old_size > mDelta->old_max || mDelta->header[3] != mDelta->new_size) {
+		dhdebug("Delta is made for the other image size");
+		return UP_STATUS_WRONG_CALL;
+	}
+	for(pos = 0; pos < mDelta->old_size; pos += DELTA_CACHE_SIZE) {
+		const unsigned int piece = (mDelta->old_size - pos > DELTA_CACHE_SIZE) ?
+				DELTA_CACHE_SIZE : (mDelta->old_size - pos);
+		if(spi_flash_read(mDelta->old_address + pos, mDelta->cache,
+				DELTA_CACHE_SIZE) != SPI_FLASH_RESULT_OK)
+			return UP_STATUS_INTERNAL_ERROR;
+		crc = crc32_update(crc, mDelta->cache, piece);
+		if((pos & (SPI_FLASH_SEC_SIZE - 1)) == 0)
+			system_soft_wdt_feed();
+	}
+	mDelta->cache_pos = pos - DELTA_CACHE_SIZE;
+	if(crc != mDelta->header[2]) {
+		dhdebug("Delta is made for the other image");
+		return UP_STATUS_WRONG_CALL;
+	}
+	return UP_STATUS_OK;
+}
+
+LOCAL UP_STATUS ICACHE_FLASH_ATTR flush_output(void) {
+	UP_STATUS res = UP_STATUS_OK;
+	if(mDelta->output_len)
+		res = mDelta->output_cb(mDelta->output, mDelta->output_len);
+	mDelta->output_len = 0;
+	return res;
+}
+
+LOCAL UP_STATUS ICACHE_FLASH_ATTR write_new(uint8_t byte) {
+	if(mDelta->new_pos >= mDelta->new_size)
+		return UP_STATUS_OVERFLOW;
+	mDelta->new_pos++;
+	mDelta->output[mDelta->output_len++] = byte;
+	if(mDelta->output_len == DELTA_OUTPUT_SIZE)
+		return flush_output();
+	return UP_STATUS_OK;
+}
+
+/**
+ * Switch to the next block or finish when new image is complete.
+ */
+LOCAL void ICACHE_FLASH_ATTR next_block(void) {
+	mDelta->varint = 0;
+	mDelta->varint_shift = 0;
+	mDelta->state = (mDelta->new_pos == mDelta->new_size) ? DELTA_DONE : DELTA_ADD_LEN;
+}
+
+/**
+ * Continue block when its varints are read or added bytes are over,
+ * seek is applied after added bytes.
+ */
+LOCAL void ICACHE_FLASH_ATTR continue_block(void) {
+	if(mDelta->add_len) {
+		mDelta->state = DELTA_ADD;
+		return;
+	}
+	mDelta->old_pos += mDelta->seek;
+	mDelta->seek = 0;
+	if(mDelta->insert_len)
+		mDelta->state = DELTA_INSERT;
+	else
+		next_block();
+}
+
+/**
+ * Handle one byte of decompressed delta.
+ */
+LOCAL UP_STATUS ICACHE_FLASH_ATTR delta_byte(uint8_t byte) {
+	UP_STATUS res;
+	uint8_t old;
+	switch(mDelta->state) {
+	case DELTA_HEADER:
+		((uint8_t *)mDelta->header)[mDelta->header_len++] = byte;
+		if(mDelta->header_len < DELTA_HEADER_SIZE)
+			return UP_STATUS_OK;
+		res = check_header();
+		if(res == UP_STATUS_OK)
+			next_block();
+		return res;
+	case DELTA_ADD_LEN:
+	case DELTA_INSERT_LEN:
+	case DELTA_SEEK:
+		if(mDelta->varint_shift > 28)
+			return UP_STATUS_WRONG_CALL;
+		mDelta->varint |= (uint32_t)(byte & 0x7F) << mDelta->varint_shift;
+		mDelta->varint_shift += 7;
+		if(byte & 0x80)
+			return UP_STATUS_OK;
+		if(mDelta->state == DELTA_ADD_LEN) {
+			mDelta->add_len = mDelta->varint;
+			mDelta->state = DELTA_INSERT_LEN;
+		} else if(mDelta->state == DELTA_INSERT_LEN) {
+			mDelta->insert_len = mDelta->varint;
+			mDelta->state = DELTA_SEEK;
+		} else {
+			// zigzag encoding
+			mDelta->seek = (mDelta->varint >> 1) ^ (-(mDelta->varint & 1));
+			continue_block();
+		}
+		mDelta->varint = 0;
+		mDelta->varint_shift = 0;
+		return UP_STATUS_OK;
+	case DELTA_ADD:
+		res = read_old(mDelta->old_pos++, &old);
+		if(res != UP_STATUS_OK)
+			return res;
+		res = write_new(old + byte);
+		if(--mDelta->add_len == 0)
+			continue_block();
+		return res;
+	case DELTA_INSERT:
+		res = write_new(byte);
+		if(--mDelta->insert_len == 0)
+			next_block();
+		return res;
+	case DELTA_DONE:
+		break;
+	}
+	return UP_STATUS_OVERFLOW;
+}
+
+/**
+ * Store decompressed byte in window and decode it.
+ */
+LOCAL UP_STATUS ICACHE_FLASH_ATTR window_byte(uint8_t byte) {
+	mDelta->window[mDelta->window_pos] = byte;
+	mDelta->window_pos = (mDelta->window_pos + 1) & (DELTA_WINDOW_SIZE - 1);
+	return delta_byte(byte);
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_delta_begin(uint32_t old_address, unsigned int old_max,
+		unsigned int new_size, UploadableDeltaOutput output) {
+	uploadable_delta_abort();
+	if(new_size == 0 || output == NULL)
+		return UP_STATUS_WRONG_CALL;
+	mDelta = (DELTA *)os_zalloc(sizeof(DELTA));
+	if(mDelta == NULL) {
+		dhdebug("No memory to decode delta");
+		return UP_STATUS_INTERNAL_ERROR;
+	}
+	mDelta->state = DELTA_HEADER;
+	mDelta->old_address = old_address;
+	mDelta->old_max = old_max;
+	mDelta->new_size = new_size;
+	mDelta->output_cb = output;
+	return UP_STATUS_OK;
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_delta_put(const char *data, unsigned int data_len) {
+	if(mDelta == NULL)
+		return UP_STATUS_WRONG_CALL;
+	while(data_len--) {
+		mDelta->bits = (mDelta->bits << 8) | (uint8_t)*data++;
+		mDelta->bits_count += 8;
+		// literal is flag 1 and 8 bits, reference is flag 0, distance and length
+		while(mDelta->bits_count) {
+			UP_STATUS res = UP_STATUS_OK;
+			if((mDelta->bits >> (mDelta->bits_count - 1)) & 1) {
+				if(mDelta->bits_count < 9)
+					break;
+				mDelta->bits_count -= 9;
+				res = window_byte(mDelta->bits >> mDelta->bits_count);
+			} else {
+				if(mDelta->bits_count < 1 + DELTA_WINDOW_BITS + DELTA_LENGTH_BITS)
+					break;
+				mDelta->bits_count -= 1 + DELTA_WINDOW_BITS + DELTA_LENGTH_BITS;
+				const uint32_t ref = mDelta->bits >> mDelta->bits_count;
+				const unsigned int distance =
+						((ref >> DELTA_LENGTH_BITS) & (DELTA_WINDOW_SIZE - 1)) + 1;
+				unsigned int length =
+						(ref & ((1 << DELTA_LENGTH_BITS) - 1)) + DELTA_MIN_MATCH;
+				while(length-- && res == UP_STATUS_OK)
+					res = window_byte(mDelta->window[(mDelta->window_pos - distance)
+							& (DELTA_WINDOW_SIZE - 1)]);
+			}
+			mDelta->bits &= (1 << mDelta->bits_count) - 1;
+			if(res != UP_STATUS_OK)
+				return res;
+		}
+	}
+	return UP_STATUS_OK;
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_delta_finish(void) {
+	if(mDelta == NULL)
+		return UP_STATUS_WRONG_CALL;
+	UP_STATUS res = (mDelta->state == DELTA_DONE) ? flush_output() : UP_STATUS_WRONG_CALL;
+	uploadable_delta_abort();
+	return res;
+}
+
+void ICACHE_FLASH_ATTR uploadable_delta_abort(void) {
+	if(mDelta)
+		os_free(mDelta);
+	mDelta = NULL;
+}
@@ -0,0 +1,56 @@
+/**
+ *	\file		uploadable_delta.h
+ *	\brief		Streaming decoder of binary delta between firmware images.
+ *	\details	Delta is generated by esp-delta util. It is LZSS compressed
+ *				stream (1 KiB window) of header and blocks. Each block adds
+ *				difference bytes to bytes of old image, inserts new bytes and
+ *				moves position in old image. Old image is read from flash,
+ *				decoded data is passed to output callback, so delta is applied
+ *				while it is received with about 1.5 KiB of RAM.
+ *	\copyright	DeviceHive MIT
+ */
+
+#ifndef _UPLOADABLE_DELTA_H_
+#define _UPLOADABLE_DELTA_H_
+
+#include "uploadable_writer.h"
+
+#include <c_types.h>
+
+/** Callback which receives decoded data. */
+typedef UP_STATUS (*UploadableDeltaOutput)(const char *data, unsigned int len);
+
+/**
+ *	\brief					Start decoding.
+ *	\param[in]	old_address	Flash address of old image.
+ *	\param[in]	old_max		Maximum size of old image.
+ *	\param[in]	new_size	Expected size of new image.
+ *	\param[in]	output		Callback for decoded data.
+ *	\return					One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_delta_begin(uint32_t old_address, unsigned int old_max,
+		unsigned int new_size, UploadableDeltaOutput output);
+
+/**
+ *	\brief					Decode piece of delta.
+ *	\details				Header is checked with the first bytes, delta which was
+ *							made for the other old image is not accepted.
+ *	\param[in]	data		Pointer to data.
+ *	\param[in]	data_len	Data length.
+ *	\return					One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_delta_put(const char *data, unsigned int data_len);
+
+/**
+ *	\brief				Pass the rest of decoded data to output and stop decoding.
+ *	\return				One of UP_STATUS statuses, UP_STATUS_WRONG_CALL if delta
+ *						is incomplete.
+ */
+UP_STATUS uploadable_delta_finish(void);
+
+/**
+ *	\brief				Stop decoding and free memory.
+ */
+void uploadable_delta_abort(void);
+
+#endif /* _UPLOADABLE_DELTA_H_ */
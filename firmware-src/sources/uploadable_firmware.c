@@ -0,0 +1,373 @@
+/*
+ * uploadable_firmware.c
+ *
+ * Copyright 2017 DeviceHive
+ *
+ * Description: Firmware update over local network
+ *
+ */
+#include "uploadable_firmware.h"
+#include "uploadable_delta.h"
+#include "dhdebug.h"
+#include "crc32.h"
+#include "user_config.h"
+
+#include <c_types.h>
+#include <spi_flash.h>
+#include <osapi.h>
+#include <os_type.h>
+#include <user_interface.h>
+#include <upgrade.h>
+#include <ets_forward.h>
+
+/** Images for boot loader have header before irom code in the first sector. */
+#define UPLOADABLE_FIRMWARE_IROM_OFFSET 0x10
+#define UPLOADABLE_FIRMWARE_USER1_ADDRESS 0x1000
+#define UPLOADABLE_FIRMWARE_USER2_512_ADDRESS 0x81000
+#define UPLOADABLE_FIRMWARE_USER2_1024_ADDRESS 0x101000
+/** Image header magics, boot loader image starts with irom part. */
+#define UPLOADABLE_FIRMWARE_BOOT_MAGIC 0xEA
+#define UPLOADABLE_FIRMWARE_MAGIC 0xE9
+#define UPLOADABLE_FIRMWARE_MAX_SEGMENTS 16
+#define UPLOADABLE_FIRMWARE_CHECKSUM_SEED 0xEF
+/** Timeout for dropping unfinished writing. */
+#define UPLOADABLE_FIRMWARE_TIMEOUT_MS 60000
+/** Delay before reboot to answer request. */
+#define UPLOADABLE_FIRMWARE_REBOOT_DELAY_MS 1000
+/** Trial state is kept in RTC memory after reset counter. */
+#define UPLOADABLE_FIRMWARE_RTC_ADDRESS 66
+#define UPLOADABLE_FIRMWARE_TRIAL_MAGIC 0x4C415254
+
+typedef struct {
+	uint8_t magic;
+	uint8_t segments;
+	uint8_t flash_mode;
+	uint8_t flash_size_freq;
+	uint32_t entry;
+} IMAGE_HEADER;
+
+typedef struct {
+	uint32_t address;
+	uint32_t length;
+} IMAGE_SEGMENT;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t image;		///< Image which is on trial.
+	uint32_t boots;		///< Number of boots of image on trial.
+} FIRMWARE_TRIAL;
+
+// the first symbol of irom code, its address shows how image was linked
+extern char _irom0_text_start[];
+
+LOCAL os_timer_t mFlashingTimer;
+LOCAL os_timer_t mTrialTimer;
+LOCAL os_timer_t mRebootTimer;
+LOCAL int mFlashing = 0;
+LOCAL int mFlashingDelta = 0;
+LOCAL int mTrial = 0;
+LOCAL int mRebooting = 0;
+LOCAL unsigned int mFlashingSize = 0;
+LOCAL unsigned int mFlashingLength = 0;
+LOCAL uint32_t mFlashingCrc = 0;
+LOCAL uint32_t mExpectedCrc = 0;
+
+UPLOADABLE_FIRMWARE_IMAGE ICACHE_FLASH_ATTR uploadable_firmware_running(void) {
+	if(((size_t)_irom0_text_start & (SPI_FLASH_SEC_SIZE - 1)) != UPLOADABLE_FIRMWARE_IROM_OFFSET)
+		return UPLOADABLE_FIRMWARE_STANDALONE;
+	return (system_upgrade_userbin_check() == UPGRADE_FW_BIN1) ?
+			UPLOADABLE_FIRMWARE_USER1 : UPLOADABLE_FIRMWARE_USER2;
+}
+
+UPLOADABLE_FIRMWARE_IMAGE ICACHE_FLASH_ATTR uploadable_firmware_target(void) {
+	switch(uploadable_firmware_running()) {
+	case UPLOADABLE_FIRMWARE_USER1:
+		return UPLOADABLE_FIRMWARE_USER2;
+	case UPLOADABLE_FIRMWARE_USER2:
+		return UPLOADABLE_FIRMWARE_USER1;
+	default:
+		return UPLOADABLE_FIRMWARE_STANDALONE;
+	}
+}
+
+/**
+ * Return flash address of image, zero if flash map doesn't have such image.
+ */
+LOCAL uint32_t ICACHE_FLASH_ATTR image_address(UPLOADABLE_FIRMWARE_IMAGE image) {
+	if(image == UPLOADABLE_FIRMWARE_USER1)
+		return UPLOADABLE_FIRMWARE_USER1_ADDRESS;
+	if(image != UPLOADABLE_FIRMWARE_USER2)
+		return 0;
+	switch(system_get_flash_size_map()) {
+	case FLASH_SIZE_8M_MAP_512_512:
+	case FLASH_SIZE_16M_MAP_512_512:
+	case FLASH_SIZE_32M_MAP_512_512:
+		return UPLOADABLE_FIRMWARE_USER2_512_ADDRESS;
+	case FLASH_SIZE_16M_MAP_1024_1024:
+	case FLASH_SIZE_32M_MAP_1024_1024:
+	case FLASH_SIZE_64M_MAP_1024_1024:
+	case FLASH_SIZE_128M_MAP_1024_1024:
+		return UPLOADABLE_FIRMWARE_USER2_1024_ADDRESS;
+	default:
+		return 0;
+	}
+}
+
+LOCAL void ICACHE_FLASH_ATTR write_trial(uint32_t image, uint32_t boots) {
+	FIRMWARE_TRIAL trial;
+	trial.magic = image ? UPLOADABLE_FIRMWARE_TRIAL_MAGIC : 0;
+	trial.image = image;
+	trial.boots = boots;
+	system_rtc_mem_write(UPLOADABLE_FIRMWARE_RTC_ADDRESS, &trial, sizeof(trial));
+}
+
+/**
+ * Boot the other image. Boot loader switches image when upgrade is finished.
+ */
+LOCAL void ICACHE_FLASH_ATTR reboot_to_other(void *arg) {
+	system_upgrade_flag_set(UPGRADE_FLAG_FINISH);
+	system_upgrade_reboot();
+}
+
+LOCAL void ICACHE_FLASH_ATTR rollback(void *arg) {
+	dhdebug("Firmware wasn't confirmed, booting previous firmware");
+	write_trial(0, 0);
+	reboot_to_other(NULL);
+}
+
+void ICACHE_FLASH_ATTR uploadable_firmware_init(void) {
+	FIRMWARE_TRIAL trial;
+	const UPLOADABLE_FIRMWARE_IMAGE running = uploadable_firmware_running();
+	if(running == UPLOADABLE_FIRMWARE_STANDALONE)
+		return;
+	system_rtc_mem_read(UPLOADABLE_FIRMWARE_RTC_ADDRESS, &trial, sizeof(trial));
+	if(trial.magic != UPLOADABLE_FIRMWARE_TRIAL_MAGIC)
+		return;
+	if(trial.image != running) {
+		// boot loader didn't start new image
+		dhdebug("Updated firmware wasn't booted");
+		write_trial(0, 0);
+		return;
+	}
+	if(++trial.boots > FIRMWARE_TRIAL_MAX_BOOTS) {
+		rollback(NULL);
+		return;
+	}
+	dhdebug("Firmware is on trial, boot %u", trial.boots);
+	write_trial(trial.image, trial.boots);
+	mTrial = 1;
+	os_timer_disarm(&mTrialTimer);
+	os_timer_setfn(&mTrialTimer, (os_timer_func_t *)rollback, NULL);
+	os_timer_arm(&mTrialTimer, FIRMWARE_TRIAL_TIMEOUT_MS, 0);
+}
+
+void ICACHE_FLASH_ATTR uploadable_firmware_confirm(void) {
+	if(mTrial == 0)
+		return;
+	os_timer_disarm(&mTrialTimer);
+	write_trial(0, 0);
+	mTrial = 0;
+	dhdebug("Updated firmware is confirmed");
+}
+
+int ICACHE_FLASH_ATTR uploadable_firmware_is_trial(void) {
+	return mTrial;
+}
+
+/**
+ * Called when writing is dropped by file writing.
+ */
+LOCAL void ICACHE_FLASH_ATTR writing_dropped(void) {
+	os_timer_disarm(&mFlashingTimer);
+	if(mFlashingDelta)
+		uploadable_delta_abort();
+	mFlashing = 0;
+	mFlashingDelta = 0;
+}
+
+LOCAL void ICACHE_FLASH_ATTR abort_writing(void) {
+	if(mFlashing)
+		uploadable_writer_abort();
+	writing_dropped();
+}
+
+LOCAL void ICACHE_FLASH_ATTR flash_timeout(void *arg) {
+	dhdebug("Firmware writing isn't finished, dropped");
+	abort_writing();
+}
+
+LOCAL void ICACHE_FLASH_ATTR reset_timer(void) {
+	os_timer_disarm(&mFlashingTimer);
+	os_timer_setfn(&mFlashingTimer, (os_timer_func_t *)flash_timeout, NULL);
+	os_timer_arm(&mFlashingTimer, UPLOADABLE_FIRMWARE_TIMEOUT_MS, 0);
+}
+
+/**
+ * XOR bytes of flash region into checksum.
+ */
+LOCAL int ICACHE_FLASH_ATTR checksum(uint32_t address, unsigned int len, uint8_t *sum) {
+	uint32_t buf[16];
+	unsigned int pos;
+	unsigned int i;
+	for(pos = 0; pos < len; pos += sizeof(buf)) {
+		const unsigned int piece = (len - pos > sizeof(buf)) ? sizeof(buf) : (len - pos);
+		if(spi_flash_read(address + pos, buf, sizeof(buf)) != SPI_FLASH_RESULT_OK)
+			return 0;
+		for(i = 0; i < piece; i++)
+			*sum ^= ((const uint8_t *)buf)[i];
+	}
+	return 1;
+}
+
+LOCAL int ICACHE_FLASH_ATTR is_ram_segment(const IMAGE_SEGMENT *segment) {
+	// iram and dram
+	return (segment->address >= 0x40100000 && segment->address + segment->length <= 0x40108000)
+			|| (segment->address >= 0x3FFE8000 && segment->address + segment->length <= 0x40000000);
+}
+
+/**
+ * Check image structure in flash: boot loader header with irom part, usual
+ * header with ram segments and their checksum.
+ */
+LOCAL int ICACHE_FLASH_ATTR is_image_valid(uint32_t address, unsigned int size) {
+	IMAGE_HEADER header;
+	IMAGE_SEGMENT segment;
+	uint32_t word;
+	uint8_t sum = UPLOADABLE_FIRMWARE_CHECKSUM_SEED;
+	unsigned int pos = sizeof(header);
+	unsigned int i;
+	if(size < 2 * sizeof(header) + sizeof(segment)
+			|| spi_flash_read(address, (uint32 *)&header, sizeof(header)) != SPI_FLASH_RESULT_OK
+			|| spi_flash_read(address + pos, (uint32 *)&segment, sizeof(segment)) != SPI_FLASH_RESULT_OK)
+		return 0;
+	if(header.magic != UPLOADABLE_FIRMWARE_BOOT_MAGIC) {
+		dhdebug("Firmware is not an image for boot loader");
+		return 0;
+	}
+	pos += sizeof(segment);
+	if(segment.length > size - pos - sizeof(header) || (segment.length & (sizeof(uint32_t) - 1)))
+		return 0;
+	pos += segment.length;
+	if(spi_flash_read(address + pos, (uint32 *)&header, sizeof(header)) != SPI_FLASH_RESULT_OK)
+		return 0;
+	if(header.magic != UPLOADABLE_FIRMWARE_MAGIC || header.segments == 0
+			|| header.segments > UPLOADABLE_FIRMWARE_MAX_SEGMENTS
+			|| header.entry < 0x40100000 || header.entry >= 0x40108000) {
+		dhdebug("Firmware header is wrong");
+		return 0;
+	}
+	pos += sizeof(header);
+	for(i = 0; i < header.segments; i++) {
+		if(size - pos < sizeof(segment)
+				|| spi_flash_read(address + pos, (uint32 *)&segment, sizeof(segment)) != SPI_FLASH_RESULT_OK)
+			return 0;
+		pos += sizeof(segment);
+		if(segment.length > size - pos || (segment.length & (sizeof(uint32_t) - 1))
+				|| is_ram_segment(&segment) == 0) {
+			dhdebug("Firmware segment %u is wrong", i);
+			return 0;
+		}
+		if(checksum(address + pos, segment.length, &sum) == 0)
+			return 0;
+		pos += segment.length;
+	}
+	// checksum is the last byte of 16 bytes block
+	pos |= 0xF;
+	if(pos >= size || spi_flash_read(address + (pos & ~(sizeof(uint32_t) - 1)),
+			&word, sizeof(word)) != SPI_FLASH_RESULT_OK)
+		return 0;
+	if(((const uint8_t *)&word)[sizeof(uint32_t) - 1] != sum) {
+		dhdebug("Firmware checksum is wrong");
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Write piece of new image, data comes from request or from delta decoder.
+ */
+LOCAL UP_STATUS ICACHE_FLASH_ATTR write_image(const char *data, unsigned int data_len) {
+	if(mFlashingLength + data_len > mFlashingSize)
+		return UP_STATUS_OVERFLOW;
+	mFlashingCrc = crc32_update(mFlashingCrc, data, data_len);
+	mFlashingLength += data_len;
+	return uploadable_writer_put(data, data_len);
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_firmware_begin(unsigned int size, uint32_t crc, int delta) {
+	const uint32_t address = image_address(uploadable_firmware_target());
+	if(address == 0) {
+		dhdebug("Firmware update isn't supported with this firmware layout");
+		return UP_STATUS_WRONG_CALL;
+	}
+	if(mTrial || mRebooting) {
+		// previous firmware is needed for rollback
+		dhdebug("Current firmware is on trial");
+		return UP_STATUS_WRONG_CALL;
+	}
+	if(size == 0)
+		return UP_STATUS_WRONG_CALL;
+	if(size > UPLOADABLE_FIRMWARE_MAX_SIZE)
+		return UP_STATUS_OVERFLOW;
+	abort_writing();
+	const UP_STATUS res = uploadable_writer_begin(address / SPI_FLASH_SEC_SIZE,
+			(size + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE, 0, writing_dropped);
+	if(res != UP_STATUS_OK)
+		return res;
+	if(delta) {
+		// delta is applied to running image
+		const UP_STATUS dres = uploadable_delta_begin(image_address(uploadable_firmware_running()),
+				UPLOADABLE_FIRMWARE_MAX_SIZE, size, write_image);
+		if(dres != UP_STATUS_OK) {
+			uploadable_writer_abort();
+			return dres;
+		}
+	}
+	mFlashing = 1;
+	mFlashingDelta = delta;
+	mFlashingSize = size;
+	mFlashingLength = 0;
+	mFlashingCrc = 0;
+	mExpectedCrc = crc;
+	reset_timer();
+	dhdebug("Firmware writing is initialized at 0x%X", address);
+	return UP_STATUS_OK;
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_firmware_put(const char *data, unsigned int data_len) {
+	if(mFlashing == 0)
+		return UP_STATUS_WRONG_CALL;
+	reset_timer();
+	if(mFlashingDelta)
+		return uploadable_delta_put(data, data_len);
+	return write_image(data, data_len);
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_firmware_finish(void) {
+	if(mFlashing == 0)
+		return UP_STATUS_WRONG_CALL;
+	if(mFlashingDelta && uploadable_delta_finish() != UP_STATUS_OK) {
+		dhdebug("Firmware delta is incomplete");
+		abort_writing();
+		return UP_STATUS_WRONG_CALL;
+	}
+	if(mFlashingLength != mFlashingSize || mFlashingCrc != mExpectedCrc) {
+		dhdebug("Firmware size or CRC doesn't match");
+		abort_writing();
+		return UP_STATUS_WRONG_CALL;
+	}
+	const UP_STATUS res = uploadable_writer_finish();
+	writing_dropped();
+	if(res != UP_STATUS_OK)
+		return res;
+	const UPLOADABLE_FIRMWARE_IMAGE target = uploadable_firmware_target();
+	if(is_image_valid(image_address(target), mFlashingSize) == 0)
+		return UP_STATUS_WRONG_CALL;
+	dhdebug("Firmware is written, %u bytes, rebooting", mFlashingLength);
+	write_trial(target, 0);
+	mRebooting = 1;
+	os_timer_disarm(&mRebootTimer);
+	os_timer_setfn(&mRebootTimer, (os_timer_func_t *)reboot_to_other, NULL);
+	os_timer_arm(&mRebootTimer, UPLOADABLE_FIRMWARE_REBOOT_DELAY_MS, 0);
+	return UP_STATUS_OK;
+}
@@ -0,0 +1,88 @@
+/**
+ *	\file		uploadable_firmware.h
+ *	\brief		Firmware update over local network.
+ *	\details	Update is possible when firmware is built as user1 and user2
+ *				images for Espressif boot loader. New image is written to the
+ *				image slot which is not running now, its CRC and header are
+ *				checked and then boot loader is switched to it. New firmware is
+ *				on trial until it connects to DeviceHive server, previous
+ *				firmware is booted back if it doesn't connect in time or if
+ *				it reboots too many times.
+ *	\copyright	DeviceHive MIT
+ */
+
+#ifndef _UPLOADABLE_FIRMWARE_H_
+#define _UPLOADABLE_FIRMWARE_H_
+
+#include "uploadable_writer.h"
+
+#include <c_types.h>
+
+/** Maximum size of firmware image, image can't overlap data sectors. */
+#define UPLOADABLE_FIRMWARE_MAX_SIZE 0x67000
+
+/** Firmware images. */
+typedef enum {
+	UPLOADABLE_FIRMWARE_STANDALONE,	///< Firmware is not started by boot loader, update is not possible.
+	UPLOADABLE_FIRMWARE_USER1,		///< The first image of boot loader.
+	UPLOADABLE_FIRMWARE_USER2		///< The second image of boot loader.
+} UPLOADABLE_FIRMWARE_IMAGE;
+
+/**
+ *	\brief				Check if firmware was just updated, should be called on boot.
+ *	\details			Previous firmware is booted if new one was rebooted too many times.
+ */
+void uploadable_firmware_init(void);
+
+/**
+ *	\brief				Confirm that firmware works, i.e. connected to DeviceHive server.
+ */
+void uploadable_firmware_confirm(void);
+
+/**
+ *	\brief				Get running image.
+ *	\return				Value of UPLOADABLE_FIRMWARE_IMAGE enum.
+ */
+UPLOADABLE_FIRMWARE_IMAGE uploadable_firmware_running(void);
+
+/**
+ *	\brief				Get image which should be uploaded.
+ *	\return				Value of UPLOADABLE_FIRMWARE_IMAGE enum, UPLOADABLE_FIRMWARE_STANDALONE
+ *						if update is not possible.
+ */
+UPLOADABLE_FIRMWARE_IMAGE uploadable_firmware_target(void);
+
+/**
+ *	\brief				Check if running firmware is on trial.
+ *	\return				Non zero if firmware is on trial.
+ */
+int uploadable_firmware_is_trial(void);
+
+/**
+ *	\brief				Start writing firmware image.
+ *	\details			Previous unfinished writing of file or firmware is dropped.
+ *						Writing is dropped if no writes operation happen in one minute.
+ *	\param[in]	size	Image size.
+ *	\param[in]	crc		CRC32 of the whole image.
+ *	\param[in]	delta	Non zero if delta to running image is uploaded
+ *						instead of image, size and crc are still for image.
+ *	\return				One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_firmware_begin(unsigned int size, uint32_t crc, int delta);
+
+/**
+ *	\brief					Write piece of image or delta. Address increments internally.
+ *	\param[in]	data		Pointer to data.
+ *	\param[in]	data_len	Data length.
+ *	\return					One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_firmware_put(const char *data, unsigned int data_len);
+
+/**
+ *	\brief				Check written image and reboot to it.
+ *	\details			Reboot happens in a second, so there is time to answer.
+ *	\return				One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_firmware_finish(void);
+
+#endif /* _UPLOADABLE_FIRMWARE_H_ */
@@ -0,0 +1,505 @@
+/*
+ * uploadable_fs.c
+ *
+ * Copyright 2017 DeviceHive
+ *
+ * Description: Tiny log-structured file system for uploadable web files
+ *
+ */
+#include "uploadable_fs.h"
+#include "dhdebug.h"
+#include "irom.h"
+#include "crc32.h"
+
+#include <c_types.h>
+#include <spi_flash.h>
+#include <osapi.h>
+#include <os_type.h>
+#include <user_interface.h>
+#include <mem.h>
+#include <ets_forward.h>
+
+/** File system ROM sectors. */
+#define UPLOADABLE_FS_START_SECTOR 0x68
+#define UPLOADABLE_FS_END_SECTOR 0x77
+#define UPLOADABLE_FS_SECTORS (UPLOADABLE_FS_END_SECTOR - UPLOADABLE_FS_START_SECTOR + 1)
+/** Header marker, "DHFS" in ROM. Zero marker means deleted file. */
+#define UPLOADABLE_FS_MAGIC 0x53464844
+#define UPLOADABLE_FS_FLAG_GZIP 0x1
+#define UPLOADABLE_FS_HEADER_SIZE sizeof(FS_HEADER)
+#define UPLOADABLE_FS_MAX_SIZE (UPLOADABLE_FS_SECTORS * SPI_FLASH_SEC_SIZE - UPLOADABLE_FS_HEADER_SIZE)
+/** Timeout for dropping unfinished writing. */
+#define UPLOADABLE_FS_TIMEOUT_MS 60000
+/** File for page of previous firmware versions, the same as in uploadable_page.c. */
+#define UPLOADABLE_FS_LEGACY_NAME "index.html"
+/** Chunk of flash which is read at once while legacy page is imported. */
+#define UPLOADABLE_FS_LEGACY_CHUNK 256
+
+/** File header at the beginning of the first file sector, data follows it. */
+typedef struct {
+	uint32_t magic;
+	uint32_t seq;		///< Number of write, the biggest one is the last written file.
+	uint32_t length;
+	uint32_t crc;
+	uint32_t flags;
+	char name[UPLOADABLE_FS_MAX_NAME + 1];
+} FS_HEADER;
+
+/** Directory index entry, name is read from header in ROM. */
+typedef struct {
+	uint32_t seq;
+	uint32_t length;
+	uint32_t crc;
+	uint8_t sector;
+	uint8_t sectors;
+	uint8_t flags;
+} FS_ENTRY;
+
+LOCAL FS_ENTRY mEntries[UPLOADABLE_FS_SECTORS];
+LOCAL unsigned int mEntriesCount = 0;
+LOCAL int mMounted = 0;
+LOCAL uint32_t mNextSeq = 1;
+// allocation starts here, so sectors are used in turn
+LOCAL unsigned int mHeadSector = UPLOADABLE_FS_START_SECTOR;
+
+LOCAL os_timer_t mFlashingTimer;
+LOCAL int mFlashing = 0;
+LOCAL char mFlashingName[UPLOADABLE_FS_MAX_NAME + 1];
+LOCAL unsigned int mFlashingFirstSector = 0;
+LOCAL unsigned int mFlashingSize = 0;
+LOCAL unsigned int mFlashingLength = 0;
+LOCAL uint32_t mFlashingCrc = 0;
+LOCAL uint32_t mFlashingFlags = 0;
+
+LOCAL void ICACHE_FLASH_ATTR abort_writing(void);
+
+LOCAL const void *ICACHE_FLASH_ATTR sector_ptr(unsigned int sector) {
+	return (const void *)(size_t)(IROM_FLASH_BASE_ADDRESS + sector * SPI_FLASH_SEC_SIZE);
+}
+
+LOCAL unsigned int ICACHE_FLASH_ATTR sectors_for(unsigned int length) {
+	return (UPLOADABLE_FS_HEADER_SIZE + length + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+}
+
+LOCAL void ICACHE_FLASH_ATTR read_name(const FS_ENTRY *entry, char *name) {
+	// ROM can be read only per 4 bytes
+	uint32_t buf[(UPLOADABLE_FS_MAX_NAME + 1 + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
+	irom_read(buf, UPLOADABLE_FS_MAX_NAME + 1,
+			&((const FS_HEADER *)sector_ptr(entry->sector))->name);
+	os_memcpy(name, buf, UPLOADABLE_FS_MAX_NAME + 1);
+}
+
+LOCAL FS_ENTRY *ICACHE_FLASH_ATTR find_entry(const char *name) {
+	char entry_name[UPLOADABLE_FS_MAX_NAME + 1];
+	unsigned int i;
+	for(i = 0; i < mEntriesCount; i++) {
+		read_name(&mEntries[i], entry_name);
+		if(os_strcmp(name, entry_name) == 0)
+			return &mEntries[i];
+	}
+	return NULL;
+}
+
+LOCAL SpiFlashOpResult ICACHE_FLASH_ATTR invalidate_header(unsigned int sector) {
+	// zero can be written without erasing
+	uint32_t magic = 0;
+	return spi_flash_write(sector * SPI_FLASH_SEC_SIZE, &magic, sizeof(magic));
+}
+
+LOCAL void ICACHE_FLASH_ATTR remove_entry(FS_ENTRY *entry) {
+	const unsigned int index = entry - mEntries;
+	mEntriesCount--;
+	os_memmove(entry, &mEntries[index + 1], (mEntriesCount - index) * sizeof(FS_ENTRY));
+}
+
+LOCAL FS_ENTRY *ICACHE_FLASH_ATTR add_entry(const FS_HEADER *header, unsigned int sector) {
+	FS_ENTRY *entry = &mEntries[mEntriesCount++];
+	entry->seq = header->seq;
+	entry->length = header->length;
+	entry->crc = header->crc;
+	entry->flags = header->flags;
+	entry->sector = sector;
+	entry->sectors = sectors_for(header->length);
+	return entry;
+}
+
+/**
+ * Write header of file which data is already in flash, replace old version
+ * of file in index.
+ */
+LOCAL UP_STATUS ICACHE_FLASH_ATTR commit_file(unsigned int sector, const char *name,
+		unsigned int length, uint32_t crc, uint32_t flags) {
+	FS_HEADER header;
+	os_memset(&header, 0, sizeof(header));
+	header.magic = UPLOADABLE_FS_MAGIC;
+	header.seq = mNextSeq;
+	header.length = length;
+	header.crc = crc;
+	header.flags = flags;
+	os_strncpy(header.name, name, sizeof(header.name) - 1);
+	const unsigned int address = sector * SPI_FLASH_SEC_SIZE;
+	if(spi_flash_write(address, (uint32 *)&header, sizeof(header)) != SPI_FLASH_RESULT_OK
+			|| uploadable_writer_verify(address, &header, sizeof(header)) == 0) {
+		dhdebug("Error while writing file header");
+		invalidate_header(sector);
+		return UP_STATUS_INTERNAL_ERROR;
+	}
+	// new version is in flash, old one can be deleted now
+	FS_ENTRY *old = find_entry(name);
+	if(old) {
+		invalidate_header(old->sector);
+		remove_entry(old);
+	}
+	const FS_ENTRY *entry = add_entry(&header, sector);
+	mNextSeq++;
+	mHeadSector = entry->sector + entry->sectors;
+	if(mHeadSector > UPLOADABLE_FS_END_SECTOR)
+		mHeadSector = UPLOADABLE_FS_START_SECTOR;
+	return UP_STATUS_OK;
+}
+
+/**
+ * Return length of page which previous firmware versions kept as one NUL
+ * terminated string from the first sector, zero if there is no such page.
+ */
+LOCAL unsigned int ICACHE_FLASH_ATTR legacy_length(void) {
+	uint32_t buf[UPLOADABLE_FS_LEGACY_CHUNK / sizeof(uint32_t)];
+	unsigned int pos;
+	for(pos = 0; pos < UPLOADABLE_FS_SECTORS * SPI_FLASH_SEC_SIZE; pos += sizeof(buf)) {
+		if(spi_flash_read(UPLOADABLE_FS_START_SECTOR * SPI_FLASH_SEC_SIZE + pos,
+				buf, sizeof(buf)) != SPI_FLASH_RESULT_OK)
+			return 0;
+		// file header or erased header of unfinished file, deleted file starts with zero
+		if(pos == 0 && (buf[0] == UPLOADABLE_FS_MAGIC || buf[0] == 0xFFFFFFFF))
+			return 0;
+		unsigned int i;
+		for(i = 0; i < sizeof(buf); i++) {
+			if(((const char *)buf)[i] == 0)
+				return pos + i;
+		}
+	}
+	return UPLOADABLE_FS_SECTORS * SPI_FLASH_SEC_SIZE;
+}
+
+/**
+ * Copy legacy page to free sectors after it, page stays until file is complete.
+ */
+LOCAL UP_STATUS ICACHE_FLASH_ATTR copy_legacy(unsigned int length) {
+	uint32_t buf[UPLOADABLE_FS_LEGACY_CHUNK / sizeof(uint32_t)];
+	unsigned int pos;
+	mHeadSector = UPLOADABLE_FS_START_SECTOR + (length + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+	UP_STATUS res = uploadable_fs_begin(UPLOADABLE_FS_LEGACY_NAME, length, 0);
+	for(pos = 0; pos < length && res == UP_STATUS_OK; pos += sizeof(buf)) {
+		const unsigned int piece = (length - pos > sizeof(buf)) ? sizeof(buf) : (length - pos);
+		if(spi_flash_read(UPLOADABLE_FS_START_SECTOR * SPI_FLASH_SEC_SIZE + pos,
+				buf, sizeof(buf)) != SPI_FLASH_RESULT_OK)
+			res = UP_STATUS_INTERNAL_ERROR;
+		else
+			res = uploadable_fs_put((const char *)buf, piece);
+	}
+	if(res != UP_STATUS_OK) {
+		abort_writing();
+		return res;
+	}
+	res = uploadable_fs_finish();
+	if(res == UP_STATUS_OK)
+		invalidate_header(UPLOADABLE_FS_START_SECTOR);
+	return res;
+}
+
+/**
+ * Move legacy page which is too big to be copied by header size in place.
+ * Sectors are moved from the last one, so each sector is read before it is
+ * overwritten. Power loss while moving breaks page.
+ */
+LOCAL UP_STATUS ICACHE_FLASH_ATTR move_legacy(unsigned int length) {
+	uint32_t crc = 0;
+	unsigned int pos;
+	char *buf = (char *)os_malloc(SPI_FLASH_SEC_SIZE);
+	if(buf == NULL)
+		return UP_STATUS_INTERNAL_ERROR;
+	SpiFlashOpResult res = SPI_FLASH_RESULT_OK;
+	for(pos = 0; pos < length && res == SPI_FLASH_RESULT_OK; pos += SPI_FLASH_SEC_SIZE) {
+		const unsigned int piece = (length - pos > SPI_FLASH_SEC_SIZE) ? SPI_FLASH_SEC_SIZE : (length - pos);
+		res = spi_flash_read(UPLOADABLE_FS_START_SECTOR * SPI_FLASH_SEC_SIZE + pos,
+				(uint32 *)buf, SPI_FLASH_SEC_SIZE);
+		crc = crc32_update(crc, buf, piece);
+	}
+	unsigned int i = sectors_for(length);
+	while(i-- && res == SPI_FLASH_RESULT_OK) {
+		const unsigned int address = (UPLOADABLE_FS_START_SECTOR + i) * SPI_FLASH_SEC_SIZE;
+		// header is written last, erased space is left for it
+		os_memset(buf, 0xFF, UPLOADABLE_FS_HEADER_SIZE);
+		if(i)
+			res = spi_flash_read(address - UPLOADABLE_FS_HEADER_SIZE, (uint32 *)buf, UPLOADABLE_FS_HEADER_SIZE);
+		if(res == SPI_FLASH_RESULT_OK)
+			res = spi_flash_read(address, (uint32 *)&buf[UPLOADABLE_FS_HEADER_SIZE],
+					SPI_FLASH_SEC_SIZE - UPLOADABLE_FS_HEADER_SIZE);
+		if(res == SPI_FLASH_RESULT_OK)
+			res = spi_flash_erase_sector(UPLOADABLE_FS_START_SECTOR + i);
+		if(res == SPI_FLASH_RESULT_OK)
+			res = spi_flash_write(address, (uint32 *)buf, SPI_FLASH_SEC_SIZE);
+		if(res == SPI_FLASH_RESULT_OK && uploadable_writer_verify(address, buf, SPI_FLASH_SEC_SIZE) == 0)
+			res = SPI_FLASH_RESULT_ERR;
+		system_soft_wdt_feed();
+	}
+	os_free(buf);
+	if(res != SPI_FLASH_RESULT_OK) {
+		dhdebug("Error while moving legacy page");
+		return UP_STATUS_INTERNAL_ERROR;
+	}
+	return commit_file(UPLOADABLE_FS_START_SECTOR, UPLOADABLE_FS_LEGACY_NAME, length, crc, 0);
+}
+
+/**
+ * Import page of previous firmware versions as a file once.
+ */
+LOCAL void ICACHE_FLASH_ATTR import_legacy(void) {
+	const unsigned int length = legacy_length();
+	if(length == 0)
+		return;
+	if(mEntriesCount) {
+		// page was imported, but power was lost before it was invalidated,
+		// or it was overwritten by files
+		invalidate_header(UPLOADABLE_FS_START_SECTOR);
+		return;
+	}
+	if(length > UPLOADABLE_FS_MAX_SIZE) {
+		dhdebug("Legacy page is too big to be imported");
+		return;
+	}
+	const unsigned int legacy_sectors = (length + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE;
+	const UP_STATUS res = (legacy_sectors + sectors_for(length) <= UPLOADABLE_FS_SECTORS) ?
+			copy_legacy(length) : move_legacy(length);
+	dhdebug("Legacy page import %s, %u bytes", (res == UP_STATUS_OK) ? "done" : "failed", length);
+}
+
+/**
+ * Build directory index from file headers.
+ */
+LOCAL void ICACHE_FLASH_ATTR mount(void) {
+	FS_HEADER header;
+	unsigned int sector = UPLOADABLE_FS_START_SECTOR;
+	if(mMounted)
+		return;
+	mMounted = 1;
+	mEntriesCount = 0;
+	while(sector <= UPLOADABLE_FS_END_SECTOR) {
+		irom_read(&header, sizeof(header), sector_ptr(sector));
+		const unsigned int sectors = sectors_for(header.length);
+		if(header.magic != UPLOADABLE_FS_MAGIC || header.length > UPLOADABLE_FS_MAX_SIZE
+				|| sector + sectors > UPLOADABLE_FS_END_SECTOR + 1
+				|| header.name[UPLOADABLE_FS_MAX_NAME] != 0) {
+			// not a file or file was not finished
+			sector++;
+			continue;
+		}
+		FS_ENTRY *old = find_entry(header.name);
+		if(old) {
+			// power was lost before old version was deleted
+			if(old->seq > header.seq) {
+				invalidate_header(sector);
+				sector++;
+				continue;
+			}
+			invalidate_header(old->sector);
+			remove_entry(old);
+		}
+		add_entry(&header, sector);
+		if(header.seq >= mNextSeq) {
+			mNextSeq = header.seq + 1;
+			mHeadSector = sector + sectors;
+		}
+		sector += sectors;
+	}
+	if(mHeadSector > UPLOADABLE_FS_END_SECTOR)
+		mHeadSector = UPLOADABLE_FS_START_SECTOR;
+	import_legacy();
+}
+
+/**
+ * Return number of free sectors starting from sector.
+ */
+LOCAL unsigned int ICACHE_FLASH_ATTR free_run(unsigned int sector) {
+	unsigned int end = UPLOADABLE_FS_END_SECTOR + 1;
+	unsigned int i;
+	for(i = 0; i < mEntriesCount; i++) {
+		const FS_ENTRY *entry = &mEntries[i];
+		if(entry->sector <= sector && sector < entry->sector + entry->sectors)
+			return 0;
+		if(entry->sector > sector && entry->sector < end)
+			end = entry->sector;
+	}
+	return end - sector;
+}
+
+/**
+ * Find free sectors for file. The first suitable space after the last written
+ * file is used if size is known, the biggest space otherwise.
+ * Return number of allocated sectors, zero if there is no space.
+ */
+LOCAL unsigned int ICACHE_FLASH_ATTR allocate(unsigned int sectors, unsigned int *first) {
+	unsigned int best = 0;
+	unsigned int i;
+	for(i = 0; i < UPLOADABLE_FS_SECTORS; i++) {
+		const unsigned int sector = UPLOADABLE_FS_START_SECTOR +
+				(mHeadSector - UPLOADABLE_FS_START_SECTOR + i) % UPLOADABLE_FS_SECTORS;
+		const unsigned int run = free_run(sector);
+		if(sectors && run >= sectors) {
+			*first = sector;
+			return sectors;
+		}
+		if(sectors == 0 && run > best) {
+			*first = sector;
+			best = run;
+		}
+	}
+	return best;
+}
+
+/**
+ * Called when writing is dropped by firmware writing.
+ */
+LOCAL void ICACHE_FLASH_ATTR writing_dropped(void) {
+	os_timer_disarm(&mFlashingTimer);
+	mFlashing = 0;
+}
+
+/**
+ * Drop unfinished writing, sectors without header are free.
+ */
+LOCAL void ICACHE_FLASH_ATTR abort_writing(void) {
+	if(mFlashing)
+		uploadable_writer_abort();
+	writing_dropped();
+}
+
+LOCAL void ICACHE_FLASH_ATTR flash_timeout(void *arg) {
+	dhdebug("File writing isn't finished, dropped");
+	abort_writing();
+}
+
+LOCAL void ICACHE_FLASH_ATTR reset_timer(void) {
+	os_timer_disarm(&mFlashingTimer);
+	os_timer_setfn(&mFlashingTimer, (os_timer_func_t *)flash_timeout, NULL);
+	os_timer_arm(&mFlashingTimer, UPLOADABLE_FS_TIMEOUT_MS, 0);
+}
+
+LOCAL void ICACHE_FLASH_ATTR fill_file(const FS_ENTRY *entry, UPLOADABLE_FILE *file) {
+	file->data = (const char *)sector_ptr(entry->sector) + UPLOADABLE_FS_HEADER_SIZE;
+	file->length = entry->length;
+	file->crc = entry->crc;
+	file->gzip = (entry->flags & UPLOADABLE_FS_FLAG_GZIP) ? 1 : 0;
+}
+
+int ICACHE_FLASH_ATTR uploadable_fs_find(const char *name, UPLOADABLE_FILE *file) {
+	mount();
+	const FS_ENTRY *entry = find_entry(name);
+	if(entry == NULL)
+		return 0;
+	fill_file(entry, file);
+	return 1;
+}
+
+int ICACHE_FLASH_ATTR uploadable_fs_get(unsigned int index, char *name, UPLOADABLE_FILE *file) {
+	mount();
+	if(index >= mEntriesCount)
+		return 0;
+	read_name(&mEntries[index], name);
+	fill_file(&mEntries[index], file);
+	return 1;
+}
+
+unsigned int ICACHE_FLASH_ATTR uploadable_fs_free(void) {
+	unsigned int first;
+	mount();
+	const unsigned int sectors = mFlashing ? 0 : allocate(0, &first);
+	if(sectors == 0)
+		return 0;
+	return sectors * SPI_FLASH_SEC_SIZE - UPLOADABLE_FS_HEADER_SIZE;
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_fs_delete(const char *name) {
+	mount();
+	FS_ENTRY *entry = find_entry(name);
+	if(entry == NULL)
+		return UP_STATUS_WRONG_CALL;
+	// sectors of file which is being written are not in index
+	const SpiFlashOpResult res = invalidate_header(entry->sector);
+	remove_entry(entry);
+	return (res == SPI_FLASH_RESULT_OK) ? UP_STATUS_OK : UP_STATUS_INTERNAL_ERROR;
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_fs_begin(const char *name, unsigned int size, int gzip) {
+	const unsigned int name_len = os_strlen(name);
+	if(name_len == 0 || name_len > UPLOADABLE_FS_MAX_NAME)
+		return UP_STATUS_WRONG_CALL;
+	if(size > UPLOADABLE_FS_MAX_SIZE)
+		return UP_STATUS_OVERFLOW;
+	abort_writing();
+	mount();
+
+	unsigned int first = 0;
+	const unsigned int need = size ? sectors_for(size) : 0;
+	unsigned int sectors = allocate(need, &first);
+	FS_ENTRY *old = find_entry(name);
+	if(old && (sectors == 0 || (need == 0 && sectors < old->sectors))) {
+		// there is no space to keep old version while new one is written
+		dhdebug("No space for file, old version is deleted");
+		invalidate_header(old->sector);
+		remove_entry(old);
+		sectors = allocate(need, &first);
+	}
+	if(sectors == 0)
+		return UP_STATUS_OVERFLOW;
+
+	// header is written last, erased space is left for it
+	const UP_STATUS res = uploadable_writer_begin(first, sectors,
+			UPLOADABLE_FS_HEADER_SIZE, writing_dropped);
+	if(res != UP_STATUS_OK)
+		return res;
+	mFlashing = 1;
+	os_memcpy(mFlashingName, name, name_len + 1);
+	mFlashingFirstSector = first;
+	mFlashingSize = size;
+	mFlashingLength = 0;
+	mFlashingCrc = 0;
+	mFlashingFlags = gzip ? UPLOADABLE_FS_FLAG_GZIP : 0;
+	reset_timer();
+	dhdebug("File writing is initialized at 0x%X", first * SPI_FLASH_SEC_SIZE);
+	return UP_STATUS_OK;
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_fs_put(const char *data, unsigned int data_len) {
+	if(mFlashing == 0)
+		return UP_STATUS_WRONG_CALL;
+	if(mFlashingSize && mFlashingLength + data_len > mFlashingSize)
+		return UP_STATUS_OVERFLOW;
+	reset_timer();
+
+	mFlashingCrc = crc32_update(mFlashingCrc, data, data_len);
+	mFlashingLength += data_len;
+	return uploadable_writer_put(data, data_len);
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_fs_finish(void) {
+	if(mFlashing == 0)
+		return UP_STATUS_WRONG_CALL;
+	if(mFlashingSize && mFlashingLength != mFlashingSize) {
+		dhdebug("File size doesn't match");
+		abort_writing();
+		return UP_STATUS_WRONG_CALL;
+	}
+	// answer is sent only when all data is in flash
+	UP_STATUS res = uploadable_writer_finish();
+	writing_dropped();
+	if(res != UP_STATUS_OK)
+		return res;
+
+	res = commit_file(mFlashingFirstSector, mFlashingName, mFlashingLength,
+			mFlashingCrc, mFlashingFlags);
+	if(res != UP_STATUS_OK)
+		return res;
+	dhdebug("File %s is written, %u bytes", mFlashingName, mFlashingLength);
+	return UP_STATUS_OK;
+}
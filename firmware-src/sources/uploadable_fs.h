@@ -0,0 +1,92 @@
+/**
+ *	\file		uploadable_fs.h
+ *	\brief		Tiny log-structured file system for uploadable web files.
+ *	\details	Each file takes contiguous flash sectors and starts with a header
+ *				which keeps name, length, CRC and flags. Header is written after
+ *				all data, so file appears only when it is completely written. New
+ *				version of file is written to free sectors, old version is
+ *				invalidated after that. Free sectors are allocated starting after
+ *				the last written file, so writes are spread over whole region.
+ *				Directory index is built in RAM from headers once.
+ *	\copyright	DeviceHive MIT
+ */
+
+#ifndef _UPLOADABLE_FS_H_
+#define _UPLOADABLE_FS_H_
+
+#include "uploadable_writer.h"
+
+#include <c_types.h>
+
+/** Maximum length of file name. */
+#define UPLOADABLE_FS_MAX_NAME 43
+
+/** File description. */
+typedef struct {
+	const char *data;		///< Pointer to data in ROM, can be read only per 4 bytes.
+	unsigned int length;	///< Data length in bytes.
+	uint32_t crc;			///< CRC32 of data.
+	unsigned gzip : 1;		///< Is data gzip compressed.
+} UPLOADABLE_FILE;
+
+/**
+ *	\brief				Find file.
+ *	\param[in]	name	File name.
+ *	\param[out]	file	Pointer where to store file description.
+ *	\return				Non zero if file is found.
+ */
+int uploadable_fs_find(const char *name, UPLOADABLE_FILE *file);
+
+/**
+ *	\brief				Get file by index for listing.
+ *	\param[in]	index	Index of file starting from zero.
+ *	\param[out]	name	Buffer for file name, at least UPLOADABLE_FS_MAX_NAME + 1 bytes.
+ *	\param[out]	file	Pointer where to store file description.
+ *	\return				Non zero if file exists, zero if index is out of files.
+ */
+int uploadable_fs_get(unsigned int index, char *name, UPLOADABLE_FILE *file);
+
+/**
+ *	\brief				Get number of bytes which can be used for a new file.
+ *	\return				Size of the biggest free space, zero while file is being written.
+ */
+unsigned int uploadable_fs_free(void);
+
+/**
+ *	\brief				Delete file.
+ *	\param[in]	name	File name.
+ *	\return				One of UP_STATUS statuses, UP_STATUS_WRONG_CALL if there is no such file.
+ */
+UP_STATUS uploadable_fs_delete(const char *name);
+
+/**
+ *	\brief				Start writing file.
+ *	\details			Previous unfinished writing of file or firmware is dropped.
+ *						Writing is dropped if no writes operation happen in one minute.
+ *	\param[in]	name	File name.
+ *	\param[in]	size	File size if it is known, zero otherwise. Known size helps to
+ *						keep old version of file while new one is written.
+ *	\param[in]	gzip	Is data gzip compressed.
+ *	\return				One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_fs_begin(const char *name, unsigned int size, int gzip);
+
+/**
+ *	\brief					Write piece of data. Address increments internally.
+ *	\details				Data is saved with uploadable writer, write error is
+ *							reported by the next call.
+ *	\param[in]	data		Pointer to data.
+ *	\param[in]	data_len	Data length.
+ *	\return					One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_fs_put(const char *data, unsigned int data_len);
+
+/**
+ *	\brief				Write remaining data and file header.
+ *	\details			Waits until background task writes all blocks. Old version of
+ *						file is deleted after that.
+ *	\return				One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_fs_finish(void);
+
+#endif /* _UPLOADABLE_FS_H_ */
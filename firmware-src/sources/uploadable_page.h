@@ -9,42 +9,49 @@
 #ifndef _UPLOADABLE_PAGE_H_
 #define _UPLOADABLE_PAGE_H_
 
-/** Uploadable page functions return status. */
-typedef enum {
-	UP_STATUS_OK, 				///< Successfully done.
-	UP_STATUS_INTERNAL_ERROR,	///< Error while saving in ROM / no memory.
-	UP_STATUS_WRONG_CALL,		///< Method is not allowed to call at this point.
-	UP_STATUS_OVERFLOW			///< ROM storage is overflowed.
-} UP_STATUS;
+#include "uploadable_fs.h"
 
 /**
  *	\brief				Get the content of uploadable page.
- *	\details			Content is stored in ROM, it can be read only per 4 bytes.
+ *	\details			Page is a file of uploadable file system. Content is stored
+ *						in ROM, it can be read only per 4 bytes.
  *	\param[in]	data	Pointer where to store data length in bytes.
  *	\return				Pointer in ROM memory.
  */
 const char *uploadable_page_get(unsigned int *len);
 
 /**
- *	\brief				Destroy page data.
- *	\details			Physically page will be kept without first byte.
+ *	\brief				Get CRC32 of uploadable page content.
+ *	\details			CRC is stored in file header, so it can be used to check if page
+ *						was changed without reading it.
+ *	\param[out]	crc		Pointer where to store CRC.
+ *	\return				Non zero if page exists and CRC is stored, zero if page is empty.
+ */
+int uploadable_page_crc(uint32_t *crc);
+
+/**
+ *	\brief				Delete page file.
  *	\return				One of UP_STATUS statuses.
  */
 UP_STATUS uploadable_page_delete();
 
 /**
  *	\brief				Initialize flashing new web page procedure.
- *	\details			Pointer for writing will be moved to very beginning. This
- *						mode will be exited	if no writes operation happen in last
- *						UPLOADABLE_PAGE_TIMEOUT_MS.
+ *	\details			Page is written as a new file, previous page is available until
+ *						flashing is finished. Flashing is dropped if no writes operation
+ *						happen in one minute.
+ *	\param[in]	size	Page size if it is known, zero otherwise.
  *	\return				One of UP_STATUS statuses.
  */
-UP_STATUS uploadable_page_begin();
+UP_STATUS uploadable_page_begin(unsigned int size);
 
 /**
  *	\brief					Write piece of data. Address increments internally.
  *	\details				Data is saved per 4 KiB blocks. Smaller buffer will be saved
  *							internally and will be written when 4 KiB is collected.
+ *							Collected block is erased, written and verified by background
+ *							task while the next block is collected in the second buffer.
+ *							Write error is reported by the next call.
  *	\param[in]	data		Pointer to data.
  *	\param[in]	data_len	Data length.
  *	\return					One of UP_STATUS statuses.
@@ -53,6 +60,8 @@ UP_STATUS uploadable_page_put(const char *data, unsigned int data_len);
 
 /**
  *	\brief				Flash all remains data and leave out flashing procedure.
+ *	\details			Waits until background task writes all blocks, new page
+ *						replaces previous one after that.
  *	\return				One of UP_STATUS statuses.
  */
 UP_STATUS uploadable_page_finish();
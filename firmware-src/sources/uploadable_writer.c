@@ -0,0 +1,226 @@
+/*
+ * uploadable_writer.c
+ *
+ * Copyright 2017 DeviceHive
+ *
+ * Description: Background writer of uploadable data to flash sectors
+ *
+ */
+#include "uploadable_writer.h"
+#include "dhdebug.h"
+#include "user_config.h"
+
+#include <c_types.h>
+#include <spi_flash.h>
+#include <osapi.h>
+#include <os_type.h>
+#include <user_interface.h>
+#include <mem.h>
+#include <ets_forward.h>
+
+/** Chunk of flash which is read back at once for verification. */
+#define UPLOADABLE_WRITER_VERIFY_CHUNK 64
+
+/** Steps of writing one sector, each step is done in a separate task call. */
+typedef enum {
+	WRITER_IDLE,	///< No sector to write.
+	WRITER_ERASE,	///< Sector should be erased unless it already has the same data.
+	WRITER_WRITE,	///< Sector is erased and should be written.
+	WRITER_VERIFY	///< Sector is written and should be read back.
+} WRITER_STATE;
+
+LOCAL unsigned int mSector = 0;
+LOCAL unsigned int mLastSector = 0;
+LOCAL UploadableWriterDropped mDropped = NULL;
+// one buffer is being filled while the other one is written by task
+LOCAL char *mBuffers[2] = {NULL, NULL};
+LOCAL char *mBuffer = NULL;
+LOCAL unsigned int mBufferPos = 0;
+LOCAL WRITER_STATE mWriterState = WRITER_IDLE;
+LOCAL char *mWriterBuffer = NULL;
+LOCAL unsigned int mWriterSector = 0;
+LOCAL int mWriterError = 0;
+LOCAL int mWriterPosted = 0;
+LOCAL int mWriterTaskInit = 0;
+LOCAL os_event_t mWriterQueue[1];
+
+int ICACHE_FLASH_ATTR uploadable_writer_verify(unsigned int address, const void *data, unsigned int len) {
+	uint32_t buf[UPLOADABLE_WRITER_VERIFY_CHUNK / sizeof(uint32_t)];
+	unsigned int pos;
+	for(pos = 0; pos < len; pos += sizeof(buf)) {
+		const unsigned int piece = (len - pos > sizeof(buf)) ? sizeof(buf) : (len - pos);
+		if(spi_flash_read(address + pos, buf, sizeof(buf)) != SPI_FLASH_RESULT_OK)
+			return 0;
+		if(os_memcmp(buf, &((const char *)data)[pos], piece))
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Do one step of writing sector. Erasing and writing take tens of milliseconds,
+ * so they are done separately to let system handle network between them.
+ */
+LOCAL void ICACHE_FLASH_ATTR writer_step(void) {
+	SpiFlashOpResult res = SPI_FLASH_RESULT_OK;
+	const unsigned int address = mWriterSector * SPI_FLASH_SEC_SIZE;
+	switch(mWriterState) {
+	case WRITER_IDLE:
+		return;
+	case WRITER_ERASE:
+		if(uploadable_writer_verify(address, mWriterBuffer, SPI_FLASH_SEC_SIZE)) {
+			// sector already has the same data
+			mWriterState = WRITER_IDLE;
+			return;
+		}
+		res = spi_flash_erase_sector(mWriterSector);
+		mWriterState = WRITER_WRITE;
+		break;
+	case WRITER_WRITE:
+		dhdebug("Flashing at address 0x%X", address);
+		res = spi_flash_write(address, (uint32 *)mWriterBuffer, SPI_FLASH_SEC_SIZE);
+		mWriterState = WRITER_VERIFY;
+		break;
+	case WRITER_VERIFY:
+		if(uploadable_writer_verify(address, mWriterBuffer, SPI_FLASH_SEC_SIZE) == 0) {
+			dhdebug("Verification failed at 0x%X", address);
+			res = SPI_FLASH_RESULT_ERR;
+		}
+		mWriterState = WRITER_IDLE;
+		break;
+	}
+	system_soft_wdt_feed();
+	if(res != SPI_FLASH_RESULT_OK) {
+		dhdebug("Error while flashing at 0x%X", address);
+		mWriterError = 1;
+		mWriterState = WRITER_IDLE;
+	}
+}
+
+LOCAL void ICACHE_FLASH_ATTR writer_task(os_event_t *event) {
+	mWriterPosted = 0;
+	writer_step();
+	if(mWriterState != WRITER_IDLE)
+		mWriterPosted = system_os_post(UPLOADABLE_PAGE_TASK_PRIO, 0, 0);
+}
+
+/**
+ * Finish writing of previous sector in place, used when its buffer is needed.
+ */
+LOCAL void ICACHE_FLASH_ATTR writer_wait(void) {
+	while(mWriterState != WRITER_IDLE)
+		writer_step();
+}
+
+/**
+ * Pass buffer to task and switch to the other one.
+ */
+LOCAL UP_STATUS ICACHE_FLASH_ATTR flash_data(void) {
+	if(mSector > mLastSector)
+		return UP_STATUS_OVERFLOW;
+	writer_wait();
+	if(mWriterError)
+		return UP_STATUS_INTERNAL_ERROR;
+
+	if(mBufferPos < SPI_FLASH_SEC_SIZE) {
+		// the rest of sector is kept, sector is not erased if nothing changed,
+		// flash is read per 4 bytes, so a few collected bytes are restored
+		const unsigned int aligned = mBufferPos & ~(sizeof(uint32_t) - 1);
+		uint32_t tail;
+		os_memcpy(&tail, &mBuffer[aligned], mBufferPos - aligned);
+		if(spi_flash_read(mSector * SPI_FLASH_SEC_SIZE + aligned, (uint32 *)&mBuffer[aligned],
+				SPI_FLASH_SEC_SIZE - aligned) != SPI_FLASH_RESULT_OK)
+			return UP_STATUS_INTERNAL_ERROR;
+		os_memcpy(&mBuffer[aligned], &tail, mBufferPos - aligned);
+		mBufferPos = SPI_FLASH_SEC_SIZE;
+	}
+
+	mWriterBuffer = mBuffer;
+	mWriterSector = mSector;
+	mWriterState = WRITER_ERASE;
+	if(mWriterPosted == 0)
+		mWriterPosted = system_os_post(UPLOADABLE_PAGE_TASK_PRIO, 0, 0);
+	mBuffer = (mBuffer == mBuffers[0]) ? mBuffers[1] : mBuffers[0];
+	mBufferPos = 0;
+	mSector++;
+	return UP_STATUS_OK;
+}
+
+void ICACHE_FLASH_ATTR uploadable_writer_abort(void) {
+	writer_wait();
+	if(mBuffers[0])
+		os_free(mBuffers[0]);
+	if(mBuffers[1])
+		os_free(mBuffers[1]);
+	mBuffers[0] = NULL;
+	mBuffers[1] = NULL;
+	mBuffer = NULL;
+	mBufferPos = 0;
+	mDropped = NULL;
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_writer_begin(unsigned int sector, unsigned int sectors,
+		unsigned int skip, UploadableWriterDropped dropped) {
+	if(sectors == 0 || skip >= SPI_FLASH_SEC_SIZE)
+		return UP_STATUS_WRONG_CALL;
+	if(mWriterTaskInit == 0) {
+		system_os_task(writer_task, UPLOADABLE_PAGE_TASK_PRIO, mWriterQueue,
+				sizeof(mWriterQueue) / sizeof(mWriterQueue[0]));
+		mWriterTaskInit = 1;
+	}
+	if(mDropped)
+		mDropped();
+	uploadable_writer_abort();
+	mBuffers[0] = (char *)os_malloc(SPI_FLASH_SEC_SIZE);
+	mBuffers[1] = (char *)os_malloc(SPI_FLASH_SEC_SIZE);
+	mBuffer = mBuffers[0];
+	if(mBuffers[0] == NULL || mBuffers[1] == NULL) {
+		uploadable_writer_abort();
+		dhdebug("No memory to initialize flash writing");
+		return UP_STATUS_INTERNAL_ERROR;
+	}
+	mSector = sector;
+	mLastSector = sector + sectors - 1;
+	mDropped = dropped;
+	mWriterError = 0;
+	os_memset(mBuffer, 0xFF, skip);
+	mBufferPos = skip;
+	return UP_STATUS_OK;
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_writer_put(const char *data, unsigned int data_len) {
+	if(mBuffer == NULL)
+		return UP_STATUS_WRONG_CALL;
+	if(mSector > mLastSector)
+		return UP_STATUS_OVERFLOW;
+	if(mWriterError)
+		return UP_STATUS_INTERNAL_ERROR;
+	while(data_len) {
+		uint32_t tocopy = (data_len > (SPI_FLASH_SEC_SIZE - mBufferPos)) ?
+				(SPI_FLASH_SEC_SIZE - mBufferPos): data_len;
+		os_memcpy(&mBuffer[mBufferPos], data, tocopy);
+		mBufferPos += tocopy;
+		data_len -= tocopy;
+		data += tocopy;
+		if(mBufferPos == SPI_FLASH_SEC_SIZE) {
+			UP_STATUS res = flash_data();
+			if(res != UP_STATUS_OK)
+				return res;
+		}
+	}
+	return UP_STATUS_OK;
+}
+
+UP_STATUS ICACHE_FLASH_ATTR uploadable_writer_finish(void) {
+	if(mBuffer == NULL)
+		return UP_STATUS_WRONG_CALL;
+	UP_STATUS res = UP_STATUS_OK;
+	if(mBufferPos)
+		res = flash_data();
+	// answer is sent only when all data is in flash
+	writer_wait();
+	if(mWriterError)
+		res = UP_STATUS_INTERNAL_ERROR;
+	uploadable_writer_abort();
+	return res;
+}
@@ -0,0 +1,73 @@
+/**
+ *	\file		uploadable_writer.h
+ *	\brief		Background writer of uploadable data to flash sectors.
+ *	\details	Data is collected per 4 KiB blocks in two buffers. Collected
+ *				block is erased, written and verified by background task while
+ *				the next block is collected in the second buffer. Sector which
+ *				already has the same data is not erased. Only one writing can
+ *				be in progress, new writing drops the previous one.
+ *	\copyright	DeviceHive MIT
+ */
+
+#ifndef _UPLOADABLE_WRITER_H_
+#define _UPLOADABLE_WRITER_H_
+
+#include <c_types.h>
+
+/** Uploadable functions return status. */
+typedef enum {
+	UP_STATUS_OK, 				///< Successfully done.
+	UP_STATUS_INTERNAL_ERROR,	///< Error while saving in ROM / no memory.
+	UP_STATUS_WRONG_CALL,		///< Method is not allowed to call at this point.
+	UP_STATUS_OVERFLOW			///< ROM storage is overflowed.
+} UP_STATUS;
+
+/** Callback which is called when writing is dropped by the other writing. */
+typedef void (*UploadableWriterDropped)(void);
+
+/**
+ *	\brief				Start writing.
+ *	\param[in]	sector	The first sector to write.
+ *	\param[in]	sectors	Number of sectors which can be written.
+ *	\param[in]	skip	Number of bytes at the beginning of the first sector
+ *						which are left erased, for example for header.
+ *	\param[in]	dropped	Callback for the case when writing is dropped by
+ *						the other begin call, can be NULL.
+ *	\return				One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_writer_begin(unsigned int sector, unsigned int sectors,
+		unsigned int skip, UploadableWriterDropped dropped);
+
+/**
+ *	\brief					Write piece of data. Address increments internally.
+ *	\details				Write error is reported by the next call.
+ *	\param[in]	data		Pointer to data.
+ *	\param[in]	data_len	Data length.
+ *	\return					One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_writer_put(const char *data, unsigned int data_len);
+
+/**
+ *	\brief				Write the rest of data and wait until all blocks are written.
+ *	\details			The rest of the last sector keeps its previous content.
+ *						Writing is stopped in any case.
+ *	\return				One of UP_STATUS statuses.
+ */
+UP_STATUS uploadable_writer_finish(void);
+
+/**
+ *	\brief				Stop writing and free buffers. Data which was not passed
+ *						to background task is not written.
+ */
+void uploadable_writer_abort(void);
+
+/**
+ *	\brief				Check if flash has exactly the same data.
+ *	\param[in]	address	Flash address, aligned to 4 bytes.
+ *	\param[in]	data	Data to compare with.
+ *	\param[in]	len		Data length.
+ *	\return				Non zero if data is the same.
+ */
+int uploadable_writer_verify(unsigned int address, const void *data, unsigned int len);
+
+#endif /* _UPLOADABLE_WRITER_H_ */
@@ -9,8 +9,14 @@
 #ifndef _USER_CONFIG_H_
 #define _USER_CONFIG_H_
 
-/** Interval in milliseconds that system should wait if error occupied. */
+/** Interval in milliseconds that system should wait if error occupied. Doubled after each consecutive error. */
 #define RETRY_CONNECTION_INTERVAL_MS 5000
+/** Maximum interval in milliseconds between connection attempts. */
+#define RETRY_CONNECTION_MAX_INTERVAL_MS 300000
+/** Interval in milliseconds that system should wait after transient error. */
+#define RETRY_CONNECTION_FAST_INTERVAL_MS 500
+/** Number of fast attempts after transient errors before using normal interval. */
+#define RETRY_CONNECTION_FAST_ATTEMPTS 2
 /** Interval in milliseconds that system should after each request. This time needed for system to handle all wireless interruptions. */
 #define DHREQUEST_PAUSE_MS 10
 /** UART speed to terminal. */
@@ -35,6 +41,12 @@
 #define MDNS_SERVICE_NAME "_esp8266-devicehive._tcp"
 /** HTTP webserver and RESTful service port. */
 #define HTTPD_PORT 80
+/** Priority of background task which writes uploadable page to flash. */
+#define UPLOADABLE_PAGE_TASK_PRIO USER_TASK_PRIO_0
+/** Time in milliseconds for updated firmware to connect to DeviceHive server, previous firmware is booted otherwise. */
+#define FIRMWARE_TRIAL_TIMEOUT_MS 600000
+/** Number of boots of updated firmware without connection to DeviceHive server, previous firmware is booted after that. */
+#define FIRMWARE_TRIAL_MAX_BOOTS 3
 
 // customize supported devices (compile time)
 #ifndef DH_NO_IMPLICIT_DEVICES
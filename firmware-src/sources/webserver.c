@@ -11,71 +11,157 @@
 #include "rest.h"
 #include "../pages/pages.h"
 #include "uploadable_page.h"
+#include "uploadable_fs.h"
 #include "uploadable_api.h"
+#include "local_websocket.h"
 #include "irom.h"
+#include "dhutils.h"
 
 #include <c_types.h>
 #include <osapi.h>
 #include <ets_forward.h>
 
-LOCAL int ICACHE_FLASH_ATTR check_rest(HTTP_RESPONSE_STATUS *res, const char *path,
-		const char *key, HTTP_CONTENT *content_in, HTTP_ANSWER *answer) {
-	static const char api[] = "/api";
-	if(os_strncmp(path, api, sizeof(api) - 1) == 0) {
-		const char *p = &path[sizeof(api) - 1];
-		if(p[0] == 0 || p[0] == '/') {
-			*res = rest_handle((p[0] == 0) ? p : &p[1], key, content_in, answer);
-			return 1;
+/** Uploaded file which is served for root path. */
+#define WEBSERVER_INDEX_FILE "index.html"
+
+LOCAL char mFileEtag[2 * sizeof(uint32_t) + 1];
+
+/**
+ * Find route for path with a single walk over the path and generated trie.
+ * For prefix routes rest is set to the rest of path after prefix and slash.
+ * The longest matched route wins. gen_pages.sh puts end of path and prefix
+ * marker nodes before their siblings, so prefix is remembered before walk
+ * goes deeper.
+ */
+LOCAL unsigned int ICACHE_FLASH_ATTR find_route(const char *path, const char **rest) {
+	unsigned int idx = 0;
+	unsigned int prefix_route = WEBROUTE_NONE;
+	const char *p = path;
+	while(idx != WEBROUTE_NONE) {
+		const uint32_t node = web_routes[idx];
+		const char c = WEBROUTE_CHAR(node);
+		if(c > 1 && c == *p) {
+			idx = WEBROUTE_CHILD(node);
+			p++;
+			continue;
 		}
+		if(c == 0 && *p == 0)
+			return WEBROUTE_CHILD(node);
+		if(c == 1 && (*p == 0 || *p == '/')) {
+			// longer route can be among siblings
+			*rest = (*p == 0) ? p : &p[1];
+			prefix_route = WEBROUTE_CHILD(node);
+		}
+		idx = WEBROUTE_SIBLING(node);
+	}
+	return prefix_route;
+}
+
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR file_type(const char *name) {
+	const char *ext = NULL;
+	for(; *name; name++) {
+		if(*name == '.')
+			ext = &name[1];
 	}
-	return 0;
+	if(ext == NULL)
+		return HRCS_ANSWERED_PLAIN;
+	if(os_strcmp(ext, "html") == 0 || os_strcmp(ext, "htm") == 0)
+		return HRCS_ANSWERED_HTML;
+	if(os_strcmp(ext, "js") == 0)
+		return HRCS_ANSWERED_JS;
+	if(os_strcmp(ext, "css") == 0)
+		return HRCS_ANSWERED_CSS;
+	if(os_strcmp(ext, "json") == 0)
+		return HRCS_ANSWERED_JSON;
+	if(os_strcmp(ext, "ico") == 0)
+		return HRCS_ANSWERED_XICON;
+	return HRCS_ANSWERED_PLAIN;
 }
 
-LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR get_cb(const char *path,
+/**
+ * Answer with uploaded file directly from ROM. Return zero if there is no such file.
+ */
+LOCAL int ICACHE_FLASH_ATTR serve_file(const char *name, HTTP_ANSWER *answer) {
+	UPLOADABLE_FILE file;
+	if(uploadable_fs_find(name, &file) == 0 || file.length == 0)
+		return 0;
+	int i;
+	for(i = 0; i < sizeof(file.crc); i++)
+		byteToHex((file.crc >> (8 * (sizeof(file.crc) - 1 - i))) & 0xFF, &mFileEtag[2 * i]);
+	mFileEtag[sizeof(mFileEtag) - 1] = 0;
+	answer->content.data = file.data;
+	answer->content.len = file.length;
+	answer->etag = mFileEtag;
+	answer->gzip = file.gzip;
+	return 1;
+}
+
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR get_cb(const char *path, const char *query,
 		const char *key, HTTP_CONTENT *content_in, HTTP_ANSWER *answer) {
-	HTTP_RESPONSE_STATUS res;
 	RO_DATA char default_page[] = "<html>\n\t<head>\n\t\t<meta http-equiv=\"refresh\" content=\"5; url=./help.html\"/>\n\t</head>\n\t<body>\n\t\tPage is not uploaded. Redirecting to <a href=\"./help.html\">the help page...</a>\n\t</body>\n</html>";
-	if(check_rest(&res, path, key, content_in, answer)) {
-		return res;
+	const char *rest;
+	const unsigned int route = find_route(path, &rest);
+	if(route == WEBROUTE_API)
+		return rest_handle(rest, query, key, content_in, answer);
+	if(route == WEBROUTE_WEBSOCKET)
+		return local_websocket_handle(key, answer);
+	if(route == WEBROUTE_FLASH_FILE_LIST)
+		return uploadable_api_handle(UPLOADABLE_API_FILE_LIST, key, content_in, answer);
+	if(route == WEBROUTE_FLASH_FIRMWARE_INFO)
+		return uploadable_api_handle(UPLOADABLE_API_FIRMWARE_INFO, key, content_in, answer);
+	if(route == WEBROUTE_ROOT) {
+		if(serve_file(WEBSERVER_INDEX_FILE, answer))
+			return file_type(WEBSERVER_INDEX_FILE);
+		// default page
+		answer->content.data = default_page;
+		answer->content.len = sizeof(default_page) - 1;
+		return HRCS_ANSWERED_HTML;
 	}
-	if(path[0]=='/') {
-		if(path[1]==0) {
-			answer->content.data = uploadable_page_get(&answer->content.len);
-			if(answer->content.len == 0) {
-				// default page
-				answer->content.data = default_page;
-				answer->content.len = sizeof(default_page) - 1;
-			}
-			return HRCS_ANSWERED_HTML;
-		}
-
-		int i;
-		for(i = 0; i < sizeof(web_pages) / sizeof(WEBPAGE); i++) {
-			if(os_strcmp(web_pages[i].path, &path[1]) == 0) {
-				answer->content.data = web_pages[i].data;
-				answer->content.len = web_pages[i].data_len;
-				answer->gzip = 1;
-				if(os_strstr(&path[1], ".js"))
-					return HRCS_ANSWERED_JS;
-				if(os_strstr(&path[1], ".css"))
-					return HRCS_ANSWERED_CSS;
-				if(os_strstr(&path[1], ".ico"))
-					return HRCS_ANSWERED_XICON;
-				return HRCS_ANSWERED_HTML;
-			}
-		}
+	if(route < sizeof(web_pages) / sizeof(WEBPAGE)) {
+		const WEBPAGE *page = &web_pages[route];
+		answer->content.data = page->data;
+		answer->content.len = page->data_len;
+		answer->gzip = page->gzip;
+		answer->etag = page->etag;
+		return page->type;
 	}
-
+	if(route == WEBROUTE_NONE && serve_file(&path[1], answer))
+		return file_type(path);
 	return HRCS_NOT_FOUND;
 }
 
-LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR post_cb(const char *path,
+LOCAL HTTP_RESPONSE_STATUS ICACHE_FLASH_ATTR post_cb(const char *path, const char *query,
 		const char *key, HTTP_CONTENT *content_in, HTTP_ANSWER *answer) {
-	HTTP_RESPONSE_STATUS res;
-	if(check_rest(&res, path, key, content_in, answer)) {
-		return res;
+	const char *rest;
+	switch(find_route(path, &rest)) {
+	case WEBROUTE_API:
+		return rest_handle(rest, query, key, content_in, answer);
+	case WEBROUTE_FLASH_PAGE_BEGIN:
+		return uploadable_api_handle(UPLOADABLE_API_BEGIN, key, content_in, answer);
+	case WEBROUTE_FLASH_PAGE_FINISH:
+		return uploadable_api_handle(UPLOADABLE_API_FINISH, key, content_in, answer);
+	case WEBROUTE_FLASH_PAGE_PUT:
+		return uploadable_api_handle(UPLOADABLE_API_PUT, key, content_in, answer);
+	case WEBROUTE_FLASH_FILE_BEGIN:
+		return uploadable_api_handle(UPLOADABLE_API_FILE_BEGIN, key, content_in, answer);
+	case WEBROUTE_FLASH_FILE_FINISH:
+		return uploadable_api_handle(UPLOADABLE_API_FILE_FINISH, key, content_in, answer);
+	case WEBROUTE_FLASH_FILE_PUT:
+		return uploadable_api_handle(UPLOADABLE_API_FILE_PUT, key, content_in, answer);
+	case WEBROUTE_FLASH_FILE_DELETE:
+		return uploadable_api_handle(UPLOADABLE_API_FILE_DELETE, key, content_in, answer);
+	case WEBROUTE_FLASH_FILE_LIST:
+		return uploadable_api_handle(UPLOADABLE_API_FILE_LIST, key, content_in, answer);
+	case WEBROUTE_FLASH_FIRMWARE_BEGIN:
+		return uploadable_api_handle(UPLOADABLE_API_FIRMWARE_BEGIN, key, content_in, answer);
+	case WEBROUTE_FLASH_FIRMWARE_FINISH:
+		return uploadable_api_handle(UPLOADABLE_API_FIRMWARE_FINISH, key, content_in, answer);
+	case WEBROUTE_FLASH_FIRMWARE_PUT:
+		return uploadable_api_handle(UPLOADABLE_API_FIRMWARE_PUT, key, content_in, answer);
+	case WEBROUTE_FLASH_FIRMWARE_INFO:
+		return uploadable_api_handle(UPLOADABLE_API_FIRMWARE_INFO, key, content_in, answer);
 	}
-	return uploadable_api_handle(path, key, content_in, answer);
+	return HRCS_NOT_FOUND;
 }
 
 void ICACHE_FLASH_ATTR webserver_init(void) {
@@ -0,0 +1,44 @@
+/*
+ * Fixed point FFT benchmark.
+ * Spectrum of ADC like samples is calculated many times, time is reported
+ * with host CPU cycles per butterfly where cycle counter is available.
+ */
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "fft.h"
+
+static unsigned long long cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+int main(void)
+{
+	int16_t re[FFT_MAX_SIZE], im[FFT_MAX_SIZE];
+	unsigned n, i, r;
+	for (n = 64; n <= FFT_MAX_SIZE; n <<= 1) {
+		const unsigned reps = 20000;
+		struct timespec a, b;
+		clock_gettime(CLOCK_MONOTONIC, &a);
+		const unsigned long long c = cycles();
+		for (r = 0; r < reps; r++) {
+			for (i = 0; i < n; i++)
+				re[i] = (int16_t)((i * 37 + r) & 1023);
+			fft_prepare(re, im, n);
+			fft_transform(re, im, n);
+			fft_magnitude(re, im, (uint16_t *)re, n / 2);
+		}
+		const double cyc = (double)(cycles() - c) / reps;
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		const double us = ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / 1e3 / reps;
+		const unsigned bf = n / 2 * (unsigned)log2(n);
+		printf("n=%u: %.2f us, %.0f cycles per spectrum, %u butterflies, %.1f cycles per butterfly\n",
+				n, us, cyc, bf, cyc / bf);
+	}
+	return 0;
+}
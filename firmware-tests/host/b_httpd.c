@@ -0,0 +1,105 @@
+/*
+ * HTTP server benchmark over simulated espconn.
+ * The same small GET is served with Connection: close, on one keep-alive
+ * connection and pipelined in batches. Host CPU requests/s shows server
+ * overhead per request, round trips and espconn_send() calls per request
+ * give requests/s over Wi-Fi with the given round trip time.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <c_types.h>
+#include "httpd.h"
+#include "host.h"
+#include "host_net.h"
+
+#define RTT_MS 5
+#define PIPELINE 8
+
+HTTP_RESPONSE_STATUS get_cb(const char *path, const char *query, const char *key, HTTP_CONTENT *in, HTTP_ANSWER *a) {
+	a->content.data = "{\"value\":1}";
+	a->content.len = 11;
+	return HRCS_ANSWERED_JSON;
+}
+HTTP_RESPONSE_STATUS post_cb(const char *path, const char *query, const char *key, HTTP_CONTENT *in, HTTP_ANSWER *a) {
+	return HRCS_NOT_FOUND;
+}
+
+static const char close_req[] = "GET /api/gpio/read HTTP/1.1\r\nHost: esp-device.local\r\nConnection: close\r\n\r\n";
+static const char keep_req[] = "GET /api/gpio/read HTTP/1.1\r\nHost: esp-device.local\r\n\r\n";
+static char pipe_req[PIPELINE * sizeof(keep_req)];
+
+static int count(const char *h, int len, const char *n) {
+	int c = 0;
+	const char *end = h + len;
+	while((h = memmem(h, end - h, n, strlen(n)))) {
+		c++;
+		h++;
+	}
+	return c;
+}
+
+/* serve n requests, return number of responses and round trips */
+static int run(const char *mode, int n, int *round_trips, int *sends) {
+	struct conn_state *c = 0;
+	int i, responses = 0;
+	*round_trips = *sends = 0;
+	for(i = 0; i < n; ) {
+		if(strcmp(mode, "close") == 0) {
+			// TCP handshake and request with response
+			c = client_connect(1000);
+			client_send(c, close_req, sizeof(close_req) - 1);
+			pump(c);
+			*round_trips += 2;
+			i++;
+		} else {
+			if(c == 0) {
+				c = client_connect(1000);
+				*round_trips += 1;
+			}
+			if(strcmp(mode, "keep-alive") == 0) {
+				client_send(c, keep_req, sizeof(keep_req) - 1);
+				i++;
+			} else {
+				client_send(c, pipe_req, strlen(pipe_req));
+				i += PIPELINE;
+			}
+			pump(c);
+			*round_trips += 1;
+		}
+		responses += count(c->out, c->outlen, "HTTP/1.1 200");
+		*sends += c->sends;
+		c->sends = 0;
+		c->outlen = 0;
+		if(c->closed) {
+			client_close(c);
+			c = 0;
+		}
+	}
+	if(c)
+		client_close(c);
+	return responses;
+}
+
+int main(void) {
+	static const char *modes[] = {"close", "keep-alive", "pipelined"};
+	int m, i, n = 200000;
+	for(i = 0; i < PIPELINE; i++)
+		strcat(pipe_req, keep_req);
+	httpd_init(get_cb, post_cb);
+	for(m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+		int round_trips, sends;
+		clock_t c = clock();
+		int responses = run(modes[m], n, &round_trips, &sends);
+		double s = (double)(clock() - c) / CLOCKS_PER_SEC;
+		if(responses != n) {
+			printf("%s: %d responses for %d requests\n", modes[m], responses, n);
+			return 1;
+		}
+		printf("%-10s: %.0f requests/s on host, %.2f sends/request, %.3f round trips/request, "
+				"%.0f requests/s with %d ms round trip\n", modes[m], n / s,
+				(double)sends / n, (double)round_trips / n, n * 1000.0 / round_trips / RTT_MS, RTT_MS);
+	}
+	return 0;
+}
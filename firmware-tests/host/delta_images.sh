@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Builds user1 image of one git revision and user2 image of the other,
+# makes delta between them with esp-delta and applies it with firmware
+# decoder of t_uploadable_delta, like the update of a running device.
+# Needs xtensa toolchain, CROSS_COMPILE is passed to firmware Makefile.
+# Usage: delta_images.sh <running revision> [<new revision>]
+
+set -e
+
+if [ "$#" -lt 1 ]; then
+  echo Usage: $0 \<running revision\> [\<new revision\>]
+  exit 1
+fi
+
+DIR=$(realpath $(dirname $0))
+ROOT=$(git -C $DIR rev-parse --show-toplevel)
+BUILD=$DIR/build/images
+OLD=$1
+NEW=${2:-HEAD}
+
+# firmware of revision $1 is built for slot $2 in $BUILD/$3
+build_image() {
+  rm -rf $BUILD/$3
+  mkdir -p $BUILD/$3
+  git -C $ROOT archive $1 firmware-src sdk | tar -x -C $BUILD/$3
+  make -C $BUILD/$3/firmware-src APP=$2
+  cp $BUILD/$3/firmware-src/firmware/user$2.bin $BUILD/$3.bin
+}
+
+build_image $OLD 1 old
+build_image $NEW 2 new
+(cd $DIR && make build/esp-delta build/t_uploadable_delta)
+$DIR/build/esp-delta $BUILD/old.bin $BUILD/new.bin $BUILD/delta.bin
+(cd $DIR && ./build/t_uploadable_delta $BUILD/old.bin $BUILD/new.bin $BUILD/delta.bin)
@@ -0,0 +1,25 @@
+/**
+ *	\file		host.h
+ *	\brief		Common declarations for host tests.
+ *	\copyright	DeviceHive MIT
+ */
+
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdio.h>
+
+/** Print debug output of firmware if non zero. */
+extern int host_verbose;
+
+/** Number of failed checks. */
+extern int host_fails;
+
+/** Check condition, print location and message on failure. */
+#define CHECK(c, ...) do { if(!(c)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+	printf(__VA_ARGS__); printf("\n"); host_fails++; } } while(0)
+
+/** Print result and return exit code for main(). */
+#define HOST_RESULT() (printf(host_fails ? "FAILED %d\n" : "OK\n", host_fails), host_fails != 0)
+
+#endif /* _HOST_H_ */
@@ -0,0 +1,173 @@
+/**
+ *	\file		host_net.c
+ *	\brief		Simulation of espconn TCP server and SDK timers for host tests.
+ *	\copyright	DeviceHive MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <c_types.h>
+#include <osapi.h>
+#include <user_interface.h>
+#include "host.h"
+#include "host_net.h"
+
+#define MAX_TIMERS 32
+
+uint32 host_time = 0;
+
+static os_timer_t *mTimers[MAX_TIMERS];
+static uint32 mTimerDue[MAX_TIMERS];
+static int mTimerOn[MAX_TIMERS];
+
+static espconn_connect_callback mConnectCb;
+static struct conn_state mConns[HOST_NET_MAX_CONNS];
+
+uint32 system_get_time(void) { return host_time; }
+
+void dhesperrors_espconn_result(const char *descrption, int reason) {
+	if(host_verbose)
+		printf("ERR %s %d\n", descrption, reason);
+}
+
+void ets_timer_setfn(os_timer_t *t, os_timer_func_t *fn, void *arg) {
+	t->timer_func = fn;
+	t->timer_arg = arg;
+}
+
+void ets_timer_disarm(os_timer_t *t) {
+	int i;
+	for(i = 0; i < MAX_TIMERS; i++) {
+		if(mTimers[i] == t)
+			mTimerOn[i] = 0;
+	}
+}
+
+void ets_timer_arm_new(os_timer_t *t, uint32 time, bool repeat, bool is_ms) {
+	int i, f = -1;
+	for(i = 0; i < MAX_TIMERS; i++) {
+		if(mTimers[i] == t) {
+			f = i;
+			break;
+		}
+		if(mTimers[i] == 0 && f < 0)
+			f = i;
+	}
+	mTimers[f] = t;
+	mTimerDue[f] = host_time + (is_ms ? time * 1000 : time);
+	mTimerOn[f] = 1;
+	t->timer_period = repeat ? time : 0;
+}
+
+void run_timers(void) {
+	int i, again = 1;
+	while(again) {
+		again = 0;
+		for(i = 0; i < MAX_TIMERS; i++) {
+			if(mTimers[i] && mTimerOn[i] && (int)(host_time - mTimerDue[i]) >= 0) {
+				os_timer_t *t = mTimers[i];
+				if(t->timer_period)
+					mTimerDue[i] += t->timer_period * 1000;
+				else
+					mTimerOn[i] = 0;
+				t->timer_func(t->timer_arg);
+				again = 1;
+			}
+		}
+	}
+}
+
+sint8 espconn_accept(struct espconn *c) { return 0; }
+sint8 espconn_regist_connectcb(struct espconn *c, espconn_connect_callback cb) { mConnectCb = cb; return 0; }
+sint8 espconn_regist_reconcb(struct espconn *c, espconn_reconnect_callback cb) { return 0; }
+sint8 espconn_regist_recvcb(struct espconn *c, espconn_recv_callback cb) { c->recv_callback = cb; return 0; }
+sint8 espconn_regist_sentcb(struct espconn *c, espconn_sent_callback cb) { c->sent_callback = cb; return 0; }
+sint8 espconn_regist_disconcb(struct espconn *c, espconn_connect_callback cb) { c->proto.tcp->disconnect_callback = cb; return 0; }
+sint8 espconn_regist_time(struct espconn *c, uint32 interval, uint8 type_flag) { return 0; }
+sint8 espconn_set_opt(struct espconn *c, uint8 opt) { return 0; }
+
+static struct conn_state *state_of(struct espconn *c) {
+	int i;
+	for(i = 0; i < HOST_NET_MAX_CONNS; i++) {
+		if(&mConns[i].conn == c)
+			return &mConns[i];
+	}
+	return 0;
+}
+
+sint8 espconn_send(struct espconn *c, uint8 *data, uint16 len) {
+	struct conn_state *s = state_of(c);
+	if(s->fail_after >= 0 && s->sends >= s->fail_after)
+		return ESPCONN_MAXNUM;
+	if(s->inflight) {
+		printf("espconn_send() while previous data is in flight\n");
+		s->violations++;
+		return ESPCONN_ARG;
+	}
+	if(s->outlen + len > sizeof(s->out))
+		s->outlen = 0;
+	memcpy(s->out + s->outlen, data, len);
+	s->outlen += len;
+	s->inflight = 1;
+	s->sends++;
+	return 0;
+}
+
+sint8 espconn_disconnect(struct espconn *c) {
+	struct conn_state *s = state_of(c);
+	if(s)
+		s->closing = 1;
+	return 0;
+}
+
+struct conn_state *client_connect(int port) {
+	int i;
+	for(i = 0; i < HOST_NET_MAX_CONNS - 1; i++) {
+		if(!mConns[i].used)
+			break;
+	}
+	struct conn_state *s = &mConns[i];
+	memset(s, 0, sizeof(*s));
+	s->used = 1;
+	s->fail_after = -1;
+	s->conn.type = ESPCONN_TCP;
+	s->conn.proto.tcp = &s->tcp;
+	s->tcp.remote_ip[0] = 192;
+	s->tcp.remote_ip[3] = i;
+	s->tcp.remote_port = port;
+	s->tcp.local_port = 80;
+	mConnectCb(&s->conn);
+	return s;
+}
+
+void client_send(struct conn_state *s, const char *data, int len) {
+	s->conn.recv_callback(&s->conn, (char *)data, len);
+}
+
+void pump(struct conn_state *s) {
+	int n = 0;
+	while(s->inflight && n++ < 100000) {
+		s->inflight = 0;
+		s->conn.sent_callback(&s->conn);
+	}
+	if(s->closing && !s->closed) {
+		s->closed = 1;
+		s->tcp.disconnect_callback(&s->conn);
+	}
+}
+
+void client_close(struct conn_state *s) {
+	if(!s->closed) {
+		s->closed = 1;
+		s->tcp.disconnect_callback(&s->conn);
+	}
+	s->used = 0;
+}
+
+void client_close_all(void) {
+	int i;
+	for(i = 0; i < HOST_NET_MAX_CONNS; i++) {
+		if(mConns[i].used)
+			client_close(&mConns[i]);
+	}
+}
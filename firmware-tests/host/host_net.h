@@ -0,0 +1,48 @@
+/**
+ *	\file		host_net.h
+ *	\brief		Simulation of espconn TCP server and SDK timers for host tests.
+ *	\copyright	DeviceHive MIT
+ */
+
+#ifndef _HOST_NET_H_
+#define _HOST_NET_H_
+
+#include <c_types.h>
+#include <ip_addr.h>
+#include <espconn.h>
+
+/** Maximum number of simulated connections. */
+#define HOST_NET_MAX_CONNS 32
+
+/** Simulated client connection. */
+struct conn_state {
+	int used;				///< Slot is in use.
+	struct espconn conn;	///< Server side connection.
+	esp_tcp tcp;			///< TCP part of connection.
+	char out[1 << 20];		///< Data sent by server.
+	int outlen;				///< Length of data in out.
+	int inflight;			///< Sent callback is pending.
+	int closing;			///< Server asked to disconnect.
+	int closed;				///< Disconnect callback was called.
+	int sends;				///< Number of espconn_send() calls.
+	int violations;			///< Number of espconn_send() calls while previous is in flight.
+	int fail_after;			///< Reject sends after this number of them, negative to never fail.
+};
+
+/** Simulated time for system_get_time(), microseconds. */
+extern uint32 host_time;
+
+/** Connect new client to server which called espconn_accept(). */
+struct conn_state *client_connect(int port);
+/** Deliver data from client to server. */
+void client_send(struct conn_state *s, const char *data, int len);
+/** Deliver sent callbacks until server is idle, then disconnect if asked. */
+void pump(struct conn_state *s);
+/** Close connection from client side. */
+void client_close(struct conn_state *s);
+/** Close all connections from client side. */
+void client_close_all(void);
+/** Run timers which are due at host_time. */
+void run_timers(void);
+
+#endif /* _HOST_NET_H_ */
@@ -0,0 +1,53 @@
+/**
+ *	\file		host_sdk.c
+ *	\brief		SDK and firmware helpers backed by host libc.
+ *	\details	Peripherals are simulated by tests themselves.
+ *	\copyright	DeviceHive MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <c_types.h>
+#include "host.h"
+
+int host_verbose = 0;
+int host_fails = 0;
+
+void *pvPortMalloc(size_t size, const char *file, unsigned int line) { return malloc(size); }
+void *pvPortZalloc(size_t size, const char *file, unsigned int line) { return calloc(1, size); }
+void *pvPortRealloc(void *p, size_t size, const char *file, unsigned int line) { return realloc(p, size); }
+void vPortFree(void *p, const char *file, unsigned int line) { free(p); }
+
+int ets_memcmp(const void *a, const void *b, size_t n) { return memcmp(a, b, n); }
+// ROM functions accept null pointer with zero length
+void *ets_memcpy(void *a, const void *b, size_t n) { return n ? memcpy(a, b, n) : a; }
+void *ets_memmove(void *a, const void *b, size_t n) { return memmove(a, b, n); }
+void *ets_memset(void *a, int c, size_t n) { return memset(a, c, n); }
+int ets_strcmp(const char *a, const char *b) { return strcmp(a, b); }
+int ets_strncmp(const char *a, const char *b, size_t n) { return strncmp(a, b, n); }
+int ets_strlen(const char *a) { return strlen(a); }
+char *ets_strstr(const char *a, const char *b) { return strstr(a, b); }
+char *ets_strcpy(char *a, const char *b) { return strcpy(a, b); }
+char *ets_strncpy(char *a, const char *b, size_t n) { return strncpy(a, b, n); }
+
+uint8_t irom_byte(const void *p) { return *(const uint8_t *)p; }
+void irom_read(void *ram, size_t len, const void *rom) { memcpy(ram, rom, len); }
+int irom_cmp(const void *ram, size_t len, const void *rom) { return memcmp(ram, rom, len); }
+
+void ets_delay_us(uint32_t us) {}
+void system_soft_wdt_feed(void) {}
+
+void dhdebug_ram(const char *fmt, ...) {
+	if(!host_verbose)
+		return;
+	va_list ap;
+	va_start(ap, fmt);
+	printf("DBG: ");
+	vprintf(fmt, ap);
+	printf("\n");
+	va_end(ap);
+}
+
+void dhdebug_dump(const char *data, unsigned int len) {}
@@ -0,0 +1,92 @@
+/*
+ * Command table tests. Lookup is a binary search, so the table should be
+ * sorted in strcmp() order: every command from command/list output should
+ * reach its handler, names around and between commands should be unknown.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <c_types.h>
+#include "dhcommands.h"
+#include "host.h"
+
+/* handlers are replaced with stubs which remember their name */
+static const char *host_handled;
+#include "dhcommands_stubs.c"
+
+/* commands which share handler with other commands */
+static const char *shared[] = {"command/list", "onewire/master/alarm",
+		"devices/mfrc522/mifare/read", "devices/mfrc522/mifare/write"};
+
+static int is_shared(const char *command) {
+	unsigned int i;
+	for(i = 0; i < sizeof(shared) / sizeof(shared[0]); i++) {
+		if(strcmp(shared[i], command) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static const char *failed;
+void dh_command_fail(COMMAND_RESULT *cmd_res, const char *str) { failed = str; }
+
+static char *list;
+static void list_cb(CommandResultArgument data, RESPONCE_STATUS status, REQUEST_DATA_TYPE data_type, ...) {
+	va_list ap;
+	va_start(ap, data_type);
+	list = va_arg(ap, char *);
+	va_end(ap);
+	host_handled = "command/list";
+}
+
+static const char *run(const char *command) {
+	COMMAND_RESULT res = {list_cb, {0}};
+	host_handled = NULL;
+	failed = NULL;
+	dhcommands_do(&res, command, "", 0);
+	return host_handled;
+}
+
+int main(void) {
+	CHECK(run("command/list") && list && strncmp(list, "{\"commands\":[\"", 14) == 0, "command/list output");
+	char *json = list;
+	char *names[128];
+	int num = 0, i;
+	char *p = json + 14;
+	while(num < 128) {
+		char *end = strchr(p, '"');
+		*end = 0;
+		names[num++] = p;
+		if(end[1] != ',')
+			break;
+		p = end + 3;
+	}
+	printf("%d commands\n", num);
+	CHECK(num > 10, "command/list has %d commands", num);
+	for(i = 1; i < num; i++)
+		CHECK(strcmp(names[i - 1], names[i]) < 0, "table isn't sorted: \"%s\" goes before \"%s\"", names[i - 1], names[i]);
+	for(i = 0; i < num; i++) {
+		char name[64];
+		const char *h = run(names[i]);
+		CHECK(h && failed == NULL, "command \"%s\" isn't found", names[i]);
+		// handler is named after command
+		snprintf(name, sizeof(name), "dh_handle_%s", names[i]);
+		char *s;
+		for(s = name; *s; s++) {
+			if(*s == '/')
+				*s = '_';
+		}
+		if(h && !is_shared(names[i]))
+			CHECK(strcmp(h, name) == 0, "command \"%s\" is handled by %s", names[i], h);
+		// the next name in strcmp() order which isn't a command
+		snprintf(name, sizeof(name), "%s ", names[i]);
+		CHECK(run(name) == NULL && failed && strcmp(failed, "Unknown command") == 0, "\"%s\" is unknown", name);
+		snprintf(name, sizeof(name), "%.*s", (int)strlen(names[i]) - 1, names[i]);
+		CHECK(run(name) == NULL && failed, "\"%s\" is unknown", name);
+	}
+	CHECK(run("") == NULL && failed, "empty command is unknown");
+	CHECK(run("zzz") == NULL && failed, "command after the last one is unknown");
+	free(json);
+	return HOST_RESULT();
+}
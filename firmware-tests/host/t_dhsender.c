@@ -0,0 +1,73 @@
+/*
+ * Notifications from peripherals for local listeners and server queue.
+ * Local listeners get every notification without server connector (queue
+ * isn't initialized) and while server is not reachable and queue is full,
+ * queue keeps the oldest notifications for server and accepts new ones
+ * after it is drained.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <c_types.h>
+#include "dhsender.h"
+#include "dhsender_queue.h"
+#include "dhmem.h"
+#include "dhnotification.h"
+#include "host.h"
+
+const char *dhsettings_get_devicehive_deviceid(void) { return "dev"; }
+uint32 system_get_free_heap_size(void) { return 40000; }
+void ets_intr_lock(void) {}
+void ets_intr_unlock(void) {}
+uint32 system_get_time(void) { return 0; }
+unsigned int dh_gpio_read(void) { return 0; }
+
+static int received, bad;
+static void listener(const char *json, unsigned int len) {
+	received++;
+	if(len != strlen(json) || !strstr(json, "\"notification\":\"adc/int\""))
+		bad++;
+}
+
+static void notify(int n) {
+	int i;
+	for(i = 0; i < n; i++)
+		dh_adc_loop_value_cb(0.5f + i);
+}
+
+static int drain(void) {
+	int n = 0;
+	SENDER_JSON_DATA *data;
+	while((data = dhsender_next())) {
+		dhsender_current_success();
+		if(!strstr(data->json, "adc/int"))
+			bad++;
+		n++;
+	}
+	return n;
+}
+
+int main(void) {
+	CHECK(dhsender_add_listener(listener), "add listener");
+	// access point mode: no server connector and no queue
+	notify(100);
+	CHECK(received == 100 && bad == 0, "local listener without queue got %d", received);
+	CHECK(!dhsender_queue_is_init() && !dhmem_isblock(), "no queue without server connector");
+	// server connector is used, but server isn't reachable
+	dhsender_queue_init();
+	received = 0;
+	notify(100);
+	CHECK(received == 100 && bad == 0, "local listener with full queue got %d", received);
+	CHECK(dhmem_isblock(), "full queue is blocked");
+	const int queued = dhsender_queue_length();
+	CHECK(queued > 0 && queued < 100, "queue length %d", queued);
+	// server is connected again
+	CHECK(drain() == queued && bad == 0, "queued notifications sent to server");
+	CHECK(!dhmem_isblock(), "drained queue is unblocked");
+	notify(1);
+	CHECK(received == 101 && dhsender_queue_length() == 1, "new notification goes to queue and listener");
+	CHECK(drain() == 1, "new notification sent to server");
+	dhsender_remove_listener(listener);
+	notify(1);
+	CHECK(received == 101 && dhsender_queue_length() == 1, "removed listener doesn't get notification");
+	return HOST_RESULT();
+}
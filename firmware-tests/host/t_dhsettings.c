@@ -0,0 +1,126 @@
+/*
+ * Settings journal tests with simulated flash.
+ * Legacy settings conversion, append only small commits, clear, erase count
+ * and power cut at every write or erase of random commits, after which either
+ * old or new settings should be read and the next commit should work.
+ */
+#define _GNU_SOURCE /* memmem */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <c_types.h>
+#include <spi_flash.h>
+#include "host.h"
+
+/* flash model: settings sectors, power is cut when budget of written bytes runs out */
+#define MAIN 0x7A
+uint8_t flash[2 * 4096];
+int erases[2], write_bytes, budget = -1; jmp_buf cut;
+static void tick(void) { if(budget == 0) longjmp(cut, 1); if(budget > 0) budget--; }
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec) {
+	uint8_t *d = flash + (sec - MAIN) * 4096; int i;
+	if(budget == 0) { // torn erase: random part is erased, random bits elsewhere
+		int n = rand() % 4096; memset(d, 0xFF, n); for(i = n; i < 4096; i++) d[i] |= rand(); longjmp(cut, 1); }
+	tick(); erases[sec - MAIN]++; memset(d, 0xFF, 4096); return 0; }
+SpiFlashOpResult spi_flash_write(uint32 addr, uint32 *src, uint32 size) {
+	uint8_t *d = flash + addr - MAIN * 4096; uint8_t *s = (uint8_t*)src; uint32 i;
+	if((addr & 3) || (size & 3) || ((unsigned long)src & 3)) { printf("unaligned write\n"); exit(1); }
+	for(i = 0; i < size; i++) {
+		if(budget == 0) { d[i] &= s[i] | rand(); longjmp(cut, 1); } // torn byte
+		tick(); d[i] &= s[i]; write_bytes++;
+	}
+	return 0;
+}
+SpiFlashOpResult spi_flash_read(uint32 addr, uint32 *dst, uint32 size) { memcpy(dst, flash + addr - MAIN * 4096, size); return 0; }
+#include "dhsettings.c"
+
+/* power cut jumps over buffers freeing, device would be reset anyway */
+const char *__asan_default_options(void) { return "detect_leaks=0"; }
+static DH_SETTINGS_DATA rnd_change(DH_SETTINGS_DATA d) {
+	char buf[1100]; int n, i;
+	switch(rand() % 6) {
+	case 0: d.mode = rand() & 1; break;
+	case 1: n = rand() % 32; for(i = 0; i < n; i++) buf[i] = 'a' + rand() % 26; buf[n] = 0; mSettingsData = d; dhsettings_set_wifi_ssid(buf); d = mSettingsData; break;
+	case 2: n = rand() % 64; for(i = 0; i < n; i++) buf[i] = 'a' + rand() % 26; buf[n] = 0; mSettingsData = d; dhsettings_set_wifi_password(buf); d = mSettingsData; break;
+	case 3: n = rand() % 384; for(i = 0; i < n; i++) buf[i] = 'a' + rand() % 26; buf[n] = 0; mSettingsData = d; dhsettings_set_devicehive_server(buf); d = mSettingsData; break;
+	case 4: n = rand() % 128; for(i = 0; i < n; i++) buf[i] = 'a' + rand() % 26; buf[n] = 0; mSettingsData = d; dhsettings_set_devicehive_deviceid(buf); d = mSettingsData; break;
+	case 5: n = rand() % 1025; for(i = 0; i < n; i++) buf[i] = 'a' + rand() % 26; buf[n] = 0; mSettingsData = d; dhsettings_set_devicehive_key(buf); d = mSettingsData; break;
+	}
+	return d;
+}
+static int reboot(void) { int exist; memset(&mSettingsData, 0x55, sizeof(mSettingsData)); mJournalSector = 7; mJournalSeq = 99; mJournalPos = 3; dhsettings_init(&exist); return exist; }
+int main(void) {
+	int exist, i;
+	srand(1);
+	memset(flash, 0xFF, sizeof(flash));
+	CHECK(dhsettings_init(&exist) == 0 && exist == 0, "init");
+	// legacy settings are read and converted on the first commit, backup keeps them until then
+	DH_SETTINGS *legacy = calloc(1, sizeof(DH_SETTINGS));
+	legacy->data.mode = WIFI_MODE_AP; strcpy(legacy->data.ssid, "legacy");
+	legacy->crc = getStorageCrc(legacy);
+	memcpy(flash, legacy, 4096); memcpy(flash + 4096, legacy, 4096);
+	CHECK(reboot() && strcmp(dhsettings_get_wifi_ssid(), "legacy") == 0 && dhsettings_get_wifi_mode() == WIFI_MODE_AP, "legacy settings read");
+	dhsettings_set_wifi_password("pass");
+	CHECK(dhsettings_commit() && erases[0] == 1 && erases[1] == 0 && mJournalSector == MAIN, "legacy settings converted on the first commit");
+	CHECK(reboot() && strcmp(dhsettings_get_wifi_ssid(), "legacy") == 0 && strcmp(dhsettings_get_wifi_password(), "pass") == 0, "converted legacy settings read after reboot");
+	// small change is a small append without erase
+	write_bytes = 0; dhsettings_set_wifi_password("word");
+	CHECK(dhsettings_commit() && erases[0] == 1 && write_bytes <= 16, "small change is a small append without erase");
+	printf("one field commit wrote %d bytes\n", write_bytes);
+	write_bytes = 0; CHECK(dhsettings_commit() && write_bytes == 0, "commit without changes writes nothing");
+	CHECK(reboot() && strcmp(dhsettings_get_wifi_password(), "word") == 0, "appended change read after reboot");
+	// clear leaves no old data in flash
+	CHECK(dhsettings_clear(0), "clear");
+	CHECK(memmem(flash, sizeof(flash), "legacy", 6) == NULL && memmem(flash, sizeof(flash), "word", 4) == NULL, "clear leaves no old data in flash");
+	CHECK(reboot() == 1 && dhsettings_get_wifi_ssid()[0] == 0, "cleared settings read after reboot");
+	CHECK(dhsettings_clear(1) && reboot() == 0, "clear with erase leaves no settings");
+
+	// many commits: erase count
+	memset(erases, 0, sizeof(erases));
+	DH_SETTINGS_DATA cur = {0};
+	for(i = 0; i < 1000; i++) {
+		cur = rnd_change(cur); mSettingsData = cur;
+		CHECK(dhsettings_commit(), "many commits: commit %d", i);
+	}
+	CHECK(reboot() && memcmp(&mSettingsData, &cur, sizeof(cur)) == 0, "many commits: last settings read after reboot");
+	printf("1000 random commits: %d erases (old format: 2000)\n", erases[0] + erases[1]);
+
+	// power cut at every possible moment of random commits
+	int cuts = 0, old_seen = 0, new_seen = 0, round;
+	for(round = 0; round < 300; round++) {
+		DH_SETTINGS_DATA next = rnd_change(cur);
+		if(rand() % 3 == 0) next = rnd_change(next);
+		int clear = (rand() % 20 == 0);
+		if(clear) memset(&next, 0, sizeof(next));
+		uint8_t saved[sizeof(flash)]; memcpy(saved, flash, sizeof(flash));
+		int k;
+		for(k = 0; ; k++) {
+			memcpy(flash, saved, sizeof(flash));
+			reboot(); CHECK(memcmp(&mSettingsData, &cur, sizeof(cur)) == 0, "round %d cut %d: old settings after failed commit", round, k);
+			mSettingsData = next;
+			budget = k;
+			if(setjmp(cut) == 0) {
+				int r = clear ? dhsettings_clear(0) : dhsettings_commit();
+				budget = -1;
+				CHECK(r, "round %d cut %d: commit result", round, k);
+				reboot(); CHECK(memcmp(&mSettingsData, &next, sizeof(next)) == 0, "round %d cut %d: new settings after commit", round, k);
+				break;
+			}
+			budget = -1; cuts++;
+			CHECK(reboot() == 1, "round %d cut %d: settings exist after power cut", round, k);
+			if(memcmp(&mSettingsData, &cur, sizeof(cur)) == 0) old_seen++;
+			else if(memcmp(&mSettingsData, &next, sizeof(next)) == 0) new_seen++;
+			else { CHECK(0, "round %d cut %d: mixed state", round, k); break; }
+			// the next commit after power loss must work too
+			DH_SETTINGS_DATA after = rnd_change(mSettingsData);
+			mSettingsData = after; CHECK(dhsettings_commit(), "round %d cut %d: commit after power loss", round, k);
+			reboot(); CHECK(memcmp(&mSettingsData, &after, sizeof(after)) == 0, "round %d cut %d: settings of commit after power loss", round, k);
+			if(k > 5000) k += 97; // erase is one step, long writes are sampled
+		}
+		cur = next;
+		if(host_fails) break;
+	}
+	printf("%d power cuts simulated, old state %d, new state %d\n", cuts, old_seen, new_seen);
+	return HOST_RESULT();
+}
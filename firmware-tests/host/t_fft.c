@@ -0,0 +1,118 @@
+/*
+ * Fixed point FFT accuracy against double precision DFT with the same
+ * preparation, peaks interpolation and JSON output built with firmware
+ * snprintf and isqrt.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fft.h"
+#include "host.h"
+
+/* double reference: same preparation (mean, Hann) DFT scaled 1/n */
+static void ref_mag(const double *x, unsigned n, double *mag)
+{
+	double mean = 0; unsigned i, k;
+	for (i = 0; i < n; i++) mean += x[i];
+	mean /= n;
+	for (k = 0; k < n / 2; k++) {
+		double r = 0, im = 0;
+		for (i = 0; i < n; i++) {
+			double w = 0.5 - 0.5 * cos(2 * M_PI * i / n);
+			double v = (x[i] - mean) * w;
+			r += v * cos(2 * M_PI * k * i / n);
+			im -= v * sin(2 * M_PI * k * i / n);
+		}
+		mag[k] = sqrt(r * r + im * im) / n;
+	}
+}
+
+static double rnd(void) { return rand() / (double)RAND_MAX - 0.5; }
+
+static void accuracy(unsigned n, double amp, double offset, double noise, double full)
+{
+	int16_t re[FFT_MAX_SIZE], im[FFT_MAX_SIZE];
+	double x[FFT_MAX_SIZE], mag[FFT_MAX_SIZE / 2];
+	unsigned i;
+	double f1 = n / 8 + 0.3, f2 = n / 3 + 0.0;
+	for (i = 0; i < n; i++) {
+		x[i] = offset + amp * sin(2 * M_PI * f1 * i / n) + amp / 10 * cos(2 * M_PI * f2 * i / n) + noise * rnd();
+		if (x[i] > full) x[i] = full;
+		if (x[i] < -full - 1) x[i] = -full - 1;
+		x[i] = round(x[i]);
+		re[i] = (int16_t)x[i];
+	}
+	ref_mag(x, n, mag);
+	int shift = fft_prepare(re, im, n);
+	fft_transform(re, im, n);
+	uint16_t *m = (uint16_t *)re;
+	fft_magnitude(re, im, m, n / 2);
+	double scale = (shift >= 0) ? 1.0 / (1 << shift) : (1 << -shift);
+	double maxref = 0, maxerr = 0;
+	for (i = 0; i < n / 2; i++) if (mag[i] > maxref) maxref = mag[i];
+	for (i = 0; i < n / 2; i++) {
+		double e = fabs(m[i] * scale - mag[i]);
+		if (e > maxerr) maxerr = e;
+	}
+	double db = 20 * log10(maxerr / maxref);
+	printf("n=%3u amp=%7.0f shift=%3d max err %.5g of peak %.5g (%.1f dB)\n", n, amp, shift, maxerr, maxref, db);
+	CHECK(db < -50, "accuracy n=%u amp=%f", n, amp);
+
+	/* peaks */
+	FFT_PEAK p[4];
+	unsigned num = fft_peaks(m, n / 2, p, 4);
+	CHECK(num >= 2, "num peaks %u", num);
+	double pf = p[0].bin + p[0].offset / 256.0;
+	CHECK(fabs(pf - f1) < 0.15, "peak0 at %f expected %f", pf, f1);
+	double a = 4 * p[0].magnitude * scale;
+	CHECK(fabs(a - amp) / amp < 0.2, "amp %f expected %f", a, amp);
+	pf = p[1].bin + p[1].offset / 256.0;
+	CHECK(fabs(pf - f2) < 0.15, "peak1 at %f expected %f", pf, f2);
+}
+
+static void json(void)
+{
+	int16_t re[256], im[256];
+	char buf[FFT_JSON_MAX_LENGTH];
+	unsigned i;
+	/* ADC like: 1 kHz sampling, 50 Hz 0.25 V + 120 Hz 0.1 V around 0.5 V */
+	for (i = 0; i < 256; i++)
+		re[i] = (int16_t)lround(512 + 256 * sin(2 * M_PI * 50 * i / 1000.0) + 102.4 * sin(2 * M_PI * 120 * i / 1000.0));
+	int len = fft_spectrum_json(buf, sizeof(buf), re, im, 256, 1000.0f / 256, 1.0f / 1024, 3, 0);
+	printf("%s\n", buf);
+	CHECK(len == (int)strlen(buf), "len");
+	CHECK(strstr(buf, "\"peaks\":[{\"frequency\":50.") || strstr(buf, "\"peaks\":[{\"frequency\":49.9"), "50 Hz first");
+	CHECK(strstr(buf, "\"amplitude\":0.2"), "0.25 V");
+	/* worst case lengths */
+	for (i = 0; i < 512; i++) re[i % 256] = (int16_t)(rand() & 0x7FFF) - 0x4000;
+	int16_t big[512], bim[512];
+	for (i = 0; i < 512; i++) big[i] = (int16_t)(rand() & 0xFFFF);
+	len = fft_spectrum_json(buf, sizeof(buf), big, bim, 512, 12345.678f, 1000.0f, FFT_MAX_PEAKS, 0);
+	printf("peaks worst %d\n", len);
+	CHECK(len < FFT_JSON_MAX_LENGTH - 1, "peaks fit");
+	for (i = 0; i < 512; i++) big[i] = (int16_t)(rand() & 0xFFFF);
+	len = fft_spectrum_json(buf, sizeof(buf), big, bim, 512, 12345.678f, 1000.0f, 0, FFT_MAX_BINS);
+	printf("bins worst %d\n", len);
+	CHECK(len < FFT_JSON_MAX_LENGTH - 1, "bins fit");
+	/* constant input */
+	for (i = 0; i < 64; i++) big[i] = 700;
+	len = fft_spectrum_json(buf, sizeof(buf), big, bim, 64, 10.0f, 1.0f, 5, 0);
+	CHECK(!strcmp(buf, "\"peaks\":[]"), "const %s", buf);
+	len = fft_spectrum_json(buf, sizeof(buf), big, bim, 64, 10.0f, 1.0f, 0, 4);
+	printf("%s\n", buf);
+}
+
+int main(void)
+{
+	CHECK(!fft_check_size(8) && fft_check_size(16) && fft_check_size(512) && !fft_check_size(1024) && !fft_check_size(100), "size");
+	unsigned n;
+	for (n = 16; n <= 512; n <<= 1) {
+		accuracy(n, 400, 512, 2, 1023);       /* ADC 10 bits */
+		accuracy(n, 20000, 0, 50, 32767);     /* MPU full range */
+		accuracy(n, 30, 100, 0.5, 1023);      /* small signal */
+	}
+	json();
+
+	return HOST_RESULT();
+}
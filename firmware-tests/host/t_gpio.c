@@ -0,0 +1,346 @@
+/*
+ * GPIO interruption handler over simulated pins, timers and CPU cycle counter.
+ * Edge capture with batches and overflow, pulse counters with glitch rejection
+ * and report intervals, quadrature encoders in both directions with jitter,
+ * missed steps and delta notifications, debounce filter, all across cycle
+ * counter overflow.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <c_types.h>
+#include <ets_sys.h>
+#include <eagle_soc.h>
+#include <osapi.h>
+#include <gpio.h>
+#include <user_interface.h>
+#include "DH/gpio.h"
+#include "host.h"
+
+/* time in CPU cycles, cycle counter starts close to overflow */
+uint64_t now; uint32_t ccount_offset = 0xFFFFFFFF - 80 * 1000000; int mhz = 80;
+uint32_t fake_ccount;
+uint32 system_get_time(void) { return now / mhz; }
+uint8 system_get_cpu_freq(void) { return mhz; }
+/* GPIO registers, status bits are set for edges of enabled pins */
+uint32_t gpio_in, gpio_status, regs[0x400];
+static uint32_t reg_read(uint32_t addr) {
+	if (addr == PERIPHS_GPIO_BASEADDR + GPIO_IN_ADDRESS) return gpio_in;
+	if (addr == PERIPHS_GPIO_BASEADDR + GPIO_STATUS_ADDRESS) return gpio_status;
+	return regs[(addr / 4) & 0x3FF];
+}
+static void reg_write(uint32_t addr, uint32_t v) {
+	if (addr == PERIPHS_GPIO_BASEADDR + GPIO_STATUS_W1TC_ADDRESS) gpio_status &= ~v;
+	else regs[(addr / 4) & 0x3FF] = v;
+}
+#undef READ_PERI_REG
+#undef WRITE_PERI_REG
+#define READ_PERI_REG(addr) reg_read(addr)
+#define WRITE_PERI_REG(addr, val) reg_write(addr, val)
+GPIO_INT_TYPE int_type[16];
+void gpio_pin_intr_state_set(uint32 i, GPIO_INT_TYPE t) { int_type[i] = t; }
+static ets_isr_t isr; int masked;
+void ets_isr_attach(int i, ets_isr_t f, void *a) { isr = f; }
+void ets_isr_mask(uint32 m) { masked = 1; }
+void ets_isr_unmask(uint32 m) { masked = 0; }
+void dh_pwm_disable(DHGpioPinMask pins) {}
+uint32_t out_set, out_clear;
+void gpio_output_set(uint32 set, uint32 clear, uint32 enable, uint32 disable) { out_set |= set; out_clear |= clear; }
+uint32 gpio_input_get(void) { return gpio_in; }
+/* timers fire between interruptions */
+#define TIMERS 8
+os_timer_t *timers[TIMERS]; uint64_t due[TIMERS]; uint32_t period[TIMERS]; int armed[TIMERS], hold_timers;
+static int tidx(os_timer_t *t) { int i; for (i = 0; i < TIMERS; i++) if (timers[i] == t || timers[i] == 0) { timers[i] = t; return i; } abort(); }
+void ets_timer_setfn(os_timer_t *t, os_timer_func_t *f, void *a) { t->timer_func = f; t->timer_arg = a; }
+void ets_timer_disarm(os_timer_t *t) { armed[tidx(t)] = 0; }
+void ets_timer_arm_new(os_timer_t *t, uint32 ms, bool r, bool m) {
+	const int i = tidx(t);
+	if (!t->timer_func) { printf("timer without function\n"); exit(1); }
+	armed[i] = 1; due[i] = now + (uint64_t)ms * 1000 * mhz; period[i] = r ? ms : 0; }
+/* callbacks */
+#define BATCHES 16
+DHGpioEdges batches[BATCHES]; int nbatches;
+void dh_gpio_int_cb(const DHGpioEdges *edges) { if (nbatches < BATCHES) batches[nbatches] = *edges; nbatches++; }
+DHGpioCounters counters; int ncounters;
+void dh_gpio_counter_cb(const DHGpioCounters *c) { counters = *c; ncounters++; }
+DHGpioEncoders encoders; int nencoders;
+void dh_gpio_encoder_cb(const DHGpioEncoders *e) { encoders = *e; nencoders++; }
+int nextra;
+void dh_gpio_extra_int_cb(DHGpioPinMask caused) { nextra++; }
+#include "gpio_host.c"
+
+static void run_us(uint64_t us) {
+	const uint64_t end = now + us * mhz;
+	for (;;) {
+		int i, next = -1;
+		for (i = 0; i < TIMERS && !hold_timers; i++)
+			if (armed[i] && due[i] <= end && (next < 0 || due[i] < due[next])) next = i;
+		if (next < 0) break;
+		if (due[next] > now) now = due[next];
+		fake_ccount = now + ccount_offset;
+		armed[next] = period[next] != 0;
+		due[next] += (uint64_t)period[next] * 1000 * mhz;
+		timers[next]->timer_func(timers[next]->timer_arg);
+	}
+	now = end;
+	fake_ccount = now + ccount_offset;
+}
+
+/* change pin levels after delay, interruption handler is called for enabled edges */
+static void set_pins(DHGpioPinMask pins, DHGpioPinMask levels, uint64_t after_us) {
+	int i;
+	run_us(after_us);
+	for (i = 0; i < 16; i++) {
+		const uint32_t bit = 1u << i;
+		if (!(pins & bit) || (gpio_in & bit) == (levels & bit)) continue;
+		gpio_in ^= bit;
+		// firmware subscribes rising edges with NEGEDGE type and falling with POSEDGE
+		const int rising = !!(levels & bit);
+		if (int_type[i] == GPIO_PIN_INTR_ANYEDGE || (int_type[i] == GPIO_PIN_INTR_NEGEDGE && rising)
+				|| (int_type[i] == GPIO_PIN_INTR_POSEDGE && !rising))
+			gpio_status |= bit;
+	}
+	if (gpio_status && !masked) isr(NULL);
+}
+static void pin(int n, int level, uint64_t after_us) { set_pins(BIT(n), level ? BIT(n) : 0, after_us); }
+
+/* quadrature steps on pins 4 (A) and 5 (B), A leads B in positive direction */
+static const uint8_t QUAD[4] = {0, 2, 3, 1};
+static int quad;
+static void steps(int n, unsigned int period_us, unsigned int jitter_us) {
+	int i;
+	for (i = 0; i < abs(n); i++) {
+		quad = (quad + (n > 0 ? 1 : 3)) & 3;
+		const int s = QUAD[quad];
+		const unsigned int dt = period_us - jitter_us + (jitter_us ? rand() % (2 * jitter_us + 1) : 0);
+		set_pins(BIT(4) | BIT(5), ((s >> 1) ? BIT(4) : 0) | ((s & 1) ? BIT(5) : 0), dt);
+	}
+}
+static DHGpioEncoder *read_encoder(void) {
+	static DHGpioEncoders e;
+	dh_gpio_read_encoders(&e);
+	return e.num ? &e.encoders[0] : NULL;
+}
+static DHGpioCounter *read_counter(void) {
+	static DHGpioCounters c;
+	dh_gpio_read_counters(&c);
+	return c.num ? &c.counters[0] : NULL;
+}
+static int near(double v, double expected, double tolerance) { return fabs(v - expected) <= fabs(expected) * tolerance; }
+
+static void test_edges(void) {
+	int i;
+	// edges across cycle counter overflow are in order with correct time
+	CHECK(dh_gpio_subscribe_int(0, 0, 0, BIT(2), 100) == 0, "gpio/int on pin 2");
+	dh_gpio_set_edges_encoding(DH_GPIO_EDGES_LIST);
+	ccount_offset = 0xFFFFFFFF - (uint32_t)now - 50 * mhz;
+	run_us(0);
+	const uint32_t start_us = system_get_time();
+	for (i = 0; i < 10; i++)
+		pin(2, !(i & 1), 10);
+	run_us(100000);
+	CHECK(nbatches == 1 && batches[0].count == 10 && batches[0].overflow == 0 && batches[0].caused == BIT(2),
+			"one batch of 10 edges: %d", nbatches ? batches[0].count : -1);
+	CHECK(batches[0].timestamp == start_us + 10, "first edge time %u, expected %u", batches[0].timestamp, start_us + 10);
+	for (i = 0; i < 10; i++)
+		CHECK(batches[0].edges[i] == DH_GPIO_EDGE(2, !(i & 1), i * 10), "edge %d is 0x%X", i, batches[0].edges[i]);
+
+	// full batch is passed without waiting for timeout
+	nbatches = 0;
+	for (i = 0; i < DH_GPIO_MAX_EDGES; i++)
+		pin(2, !(i & 1), 5);
+	run_us(1000);
+	CHECK(nbatches == 1 && batches[0].count == DH_GPIO_MAX_EDGES, "full batch passed early: %d", nbatches);
+
+	// edges which don't fit ring are counted, batches are split
+	nbatches = 0;
+	hold_timers = 1;
+	for (i = 0; i < 100; i++)
+		pin(2, !(i & 1), 1);
+	hold_timers = 0;
+	run_us(1000);
+	CHECK(nbatches == 2 && batches[0].count == DH_GPIO_MAX_EDGES && batches[1].count == 64 - DH_GPIO_MAX_EDGES,
+			"ring split to batches: %d", nbatches);
+	CHECK(nbatches == 2 && batches[0].overflow + batches[1].overflow == 36, "overflow counted");
+
+	// without list all edges go in one call
+	nbatches = 0;
+	dh_gpio_set_edges_encoding(DH_GPIO_EDGES_NONE);
+	for (i = 0; i < 100; i++)
+		pin(2, !(i & 1), 1);
+	run_us(100000);
+	CHECK(nbatches == 1 && batches[0].count == 0 && batches[0].caused == BIT(2), "edges without list");
+	dh_gpio_subscribe_int(BIT(2), 0, 0, 0, 100);
+	pin(2, 0, 10);
+	run_us(100000);
+	CHECK(nbatches == 1, "no edges after unsubscribe");
+}
+
+static void test_counter(void) {
+	int i;
+	// counting with glitches, frequency window across cycle counter overflow
+	ccount_offset = 0xFFFFFFFF - (uint32_t)now - 300000 * mhz;
+	CHECK(dh_gpio_subscribe_counter(0, BIT(12), 0, 0, 100) == 0, "counter on pin 12");
+	DHGpioCounter *c = read_counter();
+	CHECK(c && c->count == 0 && c->cycle_edges == 1, "counter enabled");
+	for (i = 0; i < 1000; i++) {
+		pin(12, 1, 500);
+		if (i % 10 == 0) {
+			// bounce after counted edge
+			pin(12, 0, 20);
+			pin(12, 1, 20);
+		}
+		pin(12, 0, 500);
+	}
+	c = read_counter();
+	CHECK(c && c->count == 1000 && c->rejected == 100, "counted %u, rejected %u", c->count, c->rejected);
+	for (i = 0; i < 500; i++) {
+		pin(12, 1, 500);
+		pin(12, 0, 500);
+	}
+	c = read_counter();
+	CHECK(c && c->edges == 500 && near(c->window, 500000, 0.001), "500 edges in %u us", c->window);
+	CHECK(ncounters == 0, "no report without interval");
+
+	// long interval is split to ticks shorter than cycle counter overflow
+	dh_gpio_set_counter_interval(50000);
+	run_us(150000000ull + 1000);
+	CHECK(ncounters == 3 && counters.num == 1, "3 reports in 150 s: %d", ncounters);
+	pin(12, 1, 1000);
+	run_us(50000000);
+	CHECK(ncounters == 4 && counters.counters[0].edges == 1 && counters.counters[0].count == 1501, "edge after 50 s: %d reports, %u edges, %u count", ncounters, counters.counters[0].edges, counters.counters[0].count);
+
+	// gpio/int takes pin from counter
+	CHECK(dh_gpio_subscribe_int(0, BIT(12), 0, 0, 100) == 0 && read_counter() == NULL, "gpio/int takes counter pin");
+	dh_gpio_subscribe_int(BIT(12), 0, 0, 0, 100);
+	dh_gpio_set_counter_interval(0);
+	pin(12, 0, 10);
+	run_us(1000000);
+	nbatches = 0;
+}
+
+static void test_encoder(void) {
+	DHGpioEncoder *e;
+	int i;
+	ccount_offset = 0xFFFFFFFF - (uint32_t)now - 150000 * mhz;
+	set_pins(BIT(4) | BIT(5), 0, 1000);
+	quad = 0;
+	CHECK(dh_gpio_encoder_enable(4, 5, 8) == 0, "encoder on pins 4 and 5");
+	CHECK(dh_gpio_encoder_enable(4, 4, 8) == -1, "encoder on one pin rejected");
+	e = read_encoder();
+	CHECK(e && e->position == 0 && e->velocity == 0 && e->errors == 0, "encoder enabled");
+
+	// positive direction across cycle counter overflow, reported by delta
+	steps(300, 1000, 0);
+	e = read_encoder();
+	CHECK(e && e->position == 300 && e->errors == 0, "position %d", e ? e->position : 0);
+	CHECK(e && near(e->velocity, 1000, 0.01), "velocity %f", e ? e->velocity : 0);
+	CHECK(nencoders >= 5 && encoders.encoders[0].position > 250, "%d delta notifications", nencoders);
+
+	// negative direction, filter restarts
+	steps(-40, 500, 0);
+	e = read_encoder();
+	CHECK(e && e->position == 260 && near(e->velocity, -2000, 0.01), "reverse at %d, velocity %f", e->position, e->velocity);
+
+	// stop
+	nencoders = 0;
+	run_us(300000);
+	e = read_encoder();
+	CHECK(e && e->velocity == 0 && e->position == 260, "stopped");
+	CHECK(nencoders == 0, "no notification without movement");
+
+	// changes smaller than delta are not reported
+	steps(7, 1000, 0);
+	run_us(300000);
+	CHECK(nencoders == 0, "7 steps not reported");
+	steps(1, 1000, 0);
+	run_us(100000);
+	CHECK(nencoders == 1 && encoders.encoders[0].position == 268 && encoders.encoders[0].pin_a == 4,
+			"8 steps reported: %d", nencoders);
+	run_us(300000);
+
+	// jittered steps
+	steps(400, 1000, 300);
+	e = read_encoder();
+	CHECK(e && e->position == 668 && near(e->velocity, 1000, 0.25), "jittered velocity %f", e->velocity);
+	steps(-400, 1000, 300);
+	e = read_encoder();
+	CHECK(e && e->position == 268 && near(e->velocity, -1000, 0.25), "jittered reverse velocity %f", e->velocity);
+
+	// missed step, both pins change at once
+	quad = (quad + 2) & 3;
+	set_pins(BIT(4) | BIT(5), ((QUAD[quad] >> 1) ? BIT(4) : 0) | ((QUAD[quad] & 1) ? BIT(5) : 0), 1000);
+	e = read_encoder();
+	CHECK(e && e->errors == 1 && e->position == 268, "missed step is error");
+	steps(4, 1000, 0);
+	e = read_encoder();
+	CHECK(e && e->errors == 1 && e->position == 272, "steps after error");
+
+	// the same level again is not a step
+	for (i = 0; i < 3; i++)
+		set_pins(BIT(4) | BIT(5), gpio_in, 100);
+	e = read_encoder();
+	CHECK(e && e->errors == 1 && e->position == 272, "no change is not a step");
+
+	// gpio/int takes encoder pin
+	CHECK(dh_gpio_subscribe_int(0, BIT(5), 0, 0, 100) == 0 && read_encoder() == NULL, "gpio/int takes encoder pin");
+	dh_gpio_subscribe_int(BIT(5), 0, 0, 0, 100);
+	run_us(1000000);
+	nbatches = 0;
+}
+
+static void test_debounce(void) {
+	int i;
+	ccount_offset = 0xFFFFFFFF - (uint32_t)now - 10000 * mhz;
+	set_pins(BIT(13) | BIT(14), 0, 1000);
+	dh_gpio_set_edges_encoding(DH_GPIO_EDGES_LIST);
+	CHECK(dh_gpio_subscribe_int(0, 0, 0, BIT(13), 50) == 0 && dh_gpio_subscribe_int(0, BIT(14), 0, BIT(13), 50) == 0,
+			"gpio/int on pins 13 and 14");
+	CHECK(dh_gpio_debounce(BIT(13), 5000) == 0, "debounce on pin 13");
+	CHECK(dh_gpio_debounce(BIT(13), 2000000) == -2, "too long debounce rejected");
+
+	// bounce train settles to one edge with time of the last bounce
+	nbatches = 0;
+	for (i = 0; i < 11; i++)
+		pin(13, !(i & 1), 100);
+	const uint32_t last_us = system_get_time();
+	run_us(100000);
+	CHECK(nbatches == 1 && batches[0].count == 1 && batches[0].edges[0] == DH_GPIO_EDGE(13, 1, 0)
+			&& batches[0].timestamp == last_us, "bounce train is one edge: %d", nbatches);
+
+	// glitch which returns to settled level is dropped
+	nbatches = 0;
+	pin(13, 0, 1000);
+	pin(13, 1, 50);
+	run_us(100000);
+	CHECK(nbatches == 0, "glitch dropped");
+
+	// direct pin isn't delayed, debounced one follows
+	pin(14, 1, 1000);
+	pin(13, 0, 10);
+	pin(14, 0, 10);
+	run_us(100000);
+	CHECK(nbatches == 1 && batches[0].count == 2 && batches[0].edges[0] == DH_GPIO_EDGE(14, 1, 0)
+			&& batches[0].edges[1] == DH_GPIO_EDGE(13, 0, 10), "mixed pins: %d", nbatches ? batches[0].count : -1);
+
+	// counter takes debounced pin, its edges are only counted
+	nbatches = 0;
+	CHECK(dh_gpio_subscribe_counter(0, BIT(13), 0, 0, 0) == 0, "counter takes debounced pin");
+	for (i = 0; i < 10; i++)
+		pin(13, !(i & 1), 100);
+	run_us(100000);
+	DHGpioCounter *c = read_counter();
+	CHECK(nbatches == 0 && c && c->pin == 13 && c->count == 5, "edges are counted: %u", c ? c->count : 0);
+}
+
+int main(void) {
+	srand(5);
+	dh_gpio_init();
+	CHECK(isr != NULL, "handler attached");
+	test_edges();
+	test_counter();
+	test_encoder();
+	test_debounce();
+	return HOST_RESULT();
+}
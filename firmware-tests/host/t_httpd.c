@@ -0,0 +1,219 @@
+/*
+ * HTTP server tests over simulated espconn: persistent connections,
+ * pipelining, streaming with sent callback pacing, conditional GET,
+ * WebSocket and Server-Sent Events streams.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <c_types.h>
+#include "httpd.h"
+#include "host.h"
+#include "host_net.h"
+
+static char big[6000];
+static int gen_released;
+unsigned int gen(char *buf, unsigned int size, void *arg) {
+	int *left = arg;
+	if(buf == 0) { gen_released++; return 0; }
+	unsigned int n = size > 1000 ? 1000 : size;
+	if(n > *left) n = *left;
+	memset(buf, 'g', n); *left -= n; return n;
+}
+static int ws_open, ws_close, ws_msgs; static unsigned int ws_stream; static char ws_last[256];
+void ws_cb(unsigned int stream, HTTP_STREAM_EVENT ev, const char *d, unsigned int len, void *arg) {
+	if(ev == HSE_OPEN) { ws_open++; ws_stream = stream; }
+	else if(ev == HSE_MESSAGE) { ws_msgs++; memcpy(ws_last, d, len); ws_last[len] = 0; }
+	else ws_close++;
+}
+HTTP_RESPONSE_STATUS get_cb(const char *path, const char *query, const char *key, HTTP_CONTENT *in, HTTP_ANSWER *a) {
+	if(strcmp(path, "/ws") == 0) { a->stream = ws_cb; return HRCS_WEBSOCKET; }
+	if(strcmp(path, "/ev") == 0) { a->stream = ws_cb; return HRCS_EVENTS; }
+	if(strcmp(path, "/big") == 0) { a->content.data = big; a->content.len = sizeof(big); return HRCS_ANSWERED_PLAIN; }
+	if(strcmp(path, "/gen") == 0) { static int left; left = 5000; a->generator = gen; a->generator_arg = &left; return HRCS_ANSWERED_PLAIN; }
+	if(strcmp(path, "/cached") == 0) { a->content.data = "cached body"; a->content.len = 11; a->etag = "abc"; return HRCS_ANSWERED_PLAIN; }
+	if(strcmp(path, "/none") == 0) return HRCS_NOT_FOUND;
+	static char buf[128];
+	a->content.data = buf; a->content.len = sprintf(buf, "path=%s query=%s key=%s", path, query, key);
+	return HRCS_ANSWERED_PLAIN;
+}
+HTTP_RESPONSE_STATUS post_cb(const char *path, const char *query, const char *key, HTTP_CONTENT *in, HTTP_ANSWER *a) {
+	char *buf = malloc(in->len + 64);
+	a->content.len = sprintf(buf, "post %s body=%.*s", path, (int)in->len, in->data ? in->data : "");
+	a->content.data = buf; a->free_content = 1;
+	return HRCS_ANSWERED_JSON;
+}
+int count(const char *h, const char *n) { int c = 0; while((h = strstr(h, n))) { c++; h++; } return c; }
+int main(int argc, char **argv) {
+	memset(big, 'x', sizeof(big));
+	host_verbose = argc > 1;
+	httpd_init(get_cb, post_cb);
+	// 1. keep-alive sequential requests
+	struct conn_state *c = client_connect(1000);
+	const char r1[] = "GET /a HTTP/1.1\r\nHost: x\r\n\r\n";
+	client_send(c, r1, sizeof(r1) - 1); pump(c);
+	CHECK(count(c->out, "HTTP/1.1 200") == 1 && !c->closing, "first keep-alive response, connection open");
+	client_send(c, r1, sizeof(r1) - 1); pump(c);
+	CHECK(count(c->out, "HTTP/1.1 200") == 2 && !c->closing, "second keep-alive response on the same connection");
+	// 2. pipelined 3 requests in one segment, second split
+	c->outlen = 0; memset(c->out, 0, 4096);
+	const char r3[] = "GET /p1 HTTP/1.1\r\n\r\nGET /p2 HTTP/1.1\r\nAuthorization: Bearer k\r\n\r\nPOST /p3 HTTP/1.1\r\nContent-Length: 5\r\n\r\nhel";
+	client_send(c, r3, sizeof(r3) - 1);
+	client_send(c, "lo", 2);
+	pump(c);
+	CHECK(strstr(c->out, "path=/p1") && strstr(c->out, "path=/p2 query= key=k") && strstr(c->out, "post /p3 body=hello"), "all pipelined responses");
+	CHECK(strstr(c->out, "path=/p1") < strstr(c->out, "path=/p2"), "pipelined responses order");
+	CHECK(!c->closing, "pipelined requests keep connection open");
+	// 3. connection close
+	c->outlen = 0; memset(c->out, 0, 4096);
+	const char r4[] = "GET /c HTTP/1.1\r\nConnection: close\r\n\r\n";
+	client_send(c, r4, sizeof(r4) - 1); pump(c);
+	CHECK(strstr(c->out, "Connection: close") && c->closed, "Connection: close answered and closed");
+	// 4. HTTP/1.0 closes by default; keep-alive explicit keeps
+	c = client_connect(1001);
+	const char r5[] = "GET /d HTTP/1.0\r\n\r\n";
+	client_send(c, r5, sizeof(r5) - 1); pump(c);
+	CHECK(c->closed, "HTTP/1.0 closed by default");
+	c = client_connect(1002);
+	const char r6[] = "GET /d HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n";
+	client_send(c, r6, sizeof(r6) - 1); pump(c);
+	CHECK(!c->closed, "HTTP/1.0 with Connection: Keep-Alive kept open");
+	// 5. big response + pipelined after it, byte by byte header
+	c->outlen = 0;
+	const char r7[] = "GET /big HTTP/1.1\r\n\r\nGET /after HTTP/1.1\r\n\r\n";
+	int i; for(i = 0; i < sizeof(r7) - 1; i++) client_send(c, &r7[i], 1);
+	pump(c);
+	CHECK(c->outlen > 6000 && strstr(c->out + 6000, "path=/after"), "request pipelined after big response, byte by byte header");
+	// 6. 404 keeps alive
+	c->outlen = 0;
+	const char r8[] = "GET /none HTTP/1.1\r\n\r\nGET /ok HTTP/1.1\r\n\r\n";
+	client_send(c, r8, sizeof(r8) - 1); pump(c);
+	CHECK(strstr(c->out, "404") && strstr(c->out, "path=/ok") && !c->closed, "404 keeps connection alive");
+	// 7. concurrent POSTs on different connections, split body
+	struct conn_state *pc[4]; const char ph[] = "POST /q HTTP/1.1\r\nContent-Length: 4\r\n\r\nab";
+	for(i = 0; i < 4; i++) { pc[i] = client_connect(2000 + i); client_send(pc[i], ph, sizeof(ph) - 1); }
+	for(i = 0; i < 3; i++) { client_send(pc[i], "cd", 2); pump(pc[i]); CHECK(strstr(pc[i]->out, "body=abcd"), "split body of concurrent POST %d", i); }
+	pump(pc[3]); CHECK(strstr(pc[3]->out, "429"), "POST over post buffers count rejected with 429");
+	struct conn_state *p5 = client_connect(2010); client_send(p5, ph, sizeof(ph) - 1); client_send(p5, "ef", 2); pump(p5);
+	CHECK(strstr(p5->out, "body=abef"), "POST after buffers are released");
+	client_close_all();
+	// 8. generated content, chunked for HTTP/1.1, then keep-alive request
+	c = client_connect(3000);
+	const char r9[] = "GET /gen HTTP/1.1\r\n\r\nGET /ok HTTP/1.1\r\n\r\n";
+	client_send(c, r9, sizeof(r9) - 1); pump(c);
+	CHECK(strstr(c->out, "Transfer-Encoding: chunked") && strstr(c->out, "\r\n0\r\n\r\n") && strstr(c->out, "path=/ok") && !c->closed, "chunked response followed by keep-alive response");
+	{ // decode chunks
+		char *p = strstr(c->out, "\r\n\r\n") + 4; int total = 0, ok = 1;
+		while(1) { unsigned int n; sscanf(p, "%x", &n); p = strstr(p, "\r\n") + 2; if(n == 0) break;
+			int k; for(k = 0; k < n; k++) if(p[k] != 'g') ok = 0; p += n; if(p[0] != '\r' || p[1] != '\n') ok = 0; p += 2; total += n; }
+		CHECK(ok && total == 5000, "chunks decoded to generated content");
+	}
+	c = client_connect(3001);
+	const char r10[] = "GET /gen HTTP/1.0\r\n\r\n";
+	client_send(c, r10, sizeof(r10) - 1); pump(c);
+	CHECK(!strstr(c->out, "chunked") && !strstr(c->out, "Content-Length") && c->closed && strlen(strstr(c->out, "\r\n\r\n") + 4) == 5000, "HTTP/1.0 generated content isn't chunked and closes");
+	// 9. big content length body intact and stack buffer independent
+	c = client_connect(3002);
+	const char r11[] = "GET /big HTTP/1.1\r\n\r\n";
+	client_send(c, r11, sizeof(r11) - 1); pump(c);
+	CHECK(strstr(c->out, "Content-Length: 6000") && strlen(strstr(c->out, "\r\n\r\n") + 4) == 6000, "big content length body intact");
+	// 10. etag
+	client_close(c); c = client_connect(3003);
+	const char r12[] = "GET /cached HTTP/1.1\r\n\r\nGET /cached HTTP/1.1\r\nIf-None-Match: W/\"zz\", \"abc\"\r\n\r\nGET /cached HTTP/1.1\r\nIf-None-Match: \"abcd\"\r\n\r\nGET /cached HTTP/1.1\r\nIf-None-Match: \"ab\"\r\n\r\n";
+	client_send(c, r12, sizeof(r12) - 1); pump(c);
+	if(host_verbose) printf("%s\n", c->out);
+	CHECK(count(c->out, "ETag: \"abc\"") == 4 && count(c->out, "304 Not Modified") == 1 && count(c->out, "cached body") == 3 && !c->closed, "ETag and If-None-Match");
+	/* rejected send closes connection instead of waiting for timeout */
+	gen_released = 0;
+	c = client_connect(1100); c->fail_after = 1;
+	client_send(c, "GET /gen HTTP/1.1\r\n\r\n", 22); pump(c);
+	CHECK(c->closed && c->sends == 1, "rejected send of body closes connection");
+	c = client_connect(1101); c->fail_after = 0;
+	client_send(c, "GET /ok HTTP/1.1\r\n\r\n", 21); pump(c);
+	CHECK(c->closed && c->sends == 0, "rejected send of head closes connection");
+	client_close(c);
+	// 11. websocket
+	c = client_connect(4000);
+	const char w1[] = "GET /ws HTTP/1.1\r\nHost: x\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+	client_send(c, w1, sizeof(w1) - 1); pump(c);
+	if(host_verbose) printf("%s\n", c->out);
+	CHECK(strstr(c->out, "101 ") && strstr(c->out, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") && ws_open == 1 && !c->closing, "websocket handshake accepted");
+	{
+		unsigned char f[] = {0x81, 0x85, 1, 2, 3, 4, 'h'^1, 'e'^2, 'l'^3, 'l'^4, 'o'^1};
+		client_send(c, (char *)f, 3); client_send(c, (char *)f + 3, sizeof(f) - 3); pump(c);
+		CHECK(ws_msgs == 1 && strcmp(ws_last, "hello") == 0, "masked websocket text frame split over segments");
+		c->outlen = 0;
+		CHECK(httpd_stream_send(ws_stream, "abc", 3), "websocket send accepted"); pump(c);
+		CHECK(c->outlen == 5 && (unsigned char)c->out[0] == 0x81 && c->out[1] == 3 && memcmp(c->out + 2, "abc", 3) == 0, "websocket server frame unmasked text");
+		c->outlen = 0;
+		unsigned char ping[] = {0x89, 0x81, 0, 0, 0, 0, 'p'};
+		client_send(c, (char *)ping, sizeof(ping)); pump(c);
+		CHECK(c->outlen == 3 && (unsigned char)c->out[0] == 0x8A && c->out[2] == 'p', "websocket pong for ping");
+		unsigned char unmasked[] = {0x81, 0x01, 'x'};
+		client_send(c, (char *)unmasked, sizeof(unmasked)); pump(c);
+		CHECK(c->closed && ws_close == 1 && !httpd_stream_send(ws_stream, "a", 1), "unmasked client frame closes websocket");
+	}
+	c = client_connect(4001);
+	client_send(c, w1, sizeof(w1) - 1); pump(c);
+	{
+		unsigned char cl[] = {0x88, 0x82, 0, 0, 0, 0, 0x03, 0xE8};
+		c->outlen = 0;
+		client_send(c, (char *)cl, sizeof(cl)); pump(c);
+		CHECK((unsigned char)c->out[0] == 0x88 && c->closed && ws_open == 2 && ws_close == 2, "websocket close frame echoed and closed");
+	}
+	c = client_connect(4002);
+	client_send(c, w1, sizeof(w1) - 1); pump(c);
+	client_close(c);
+	CHECK(ws_open == 3 && ws_close == 3, "websocket closed by client disconnect");
+	c = client_connect(4003);
+	const char w2[] = "GET /ws HTTP/1.1\r\nHost: x\r\n\r\n";
+	client_send(c, w2, sizeof(w2) - 1); pump(c);
+	CHECK(strstr(c->out, "400") && ws_open == 3 && ws_close == 4, "websocket upgrade without key rejected with 400");
+	client_close(c);
+	{ // ping timer keeps running only while streams exist
+		c = client_connect(4004); client_send(c, w1, sizeof(w1) - 1); pump(c);
+		c->outlen = 0; host_time += 31000000; run_timers(); pump(c);
+		CHECK(c->outlen == 2 && (unsigned char)c->out[0] == 0x89, "websocket ping sent by timer");
+		client_close(c);
+	}
+	// 12. server-sent events
+	c = client_connect(5000);
+	const char e1[] = "GET /ev HTTP/1.1\r\n\r\n";
+	client_send(c, e1, sizeof(e1) - 1); pump(c);
+	CHECK(strstr(c->out, "text/event-stream") && ws_open == 5 && !c->closing, "events stream opened");
+	c->outlen = 0; memset(c->out, 0, 256);
+	CHECK(httpd_stream_send(ws_stream, "{\"a\":1}", 7), "event send accepted"); pump(c);
+	CHECK(strcmp(c->out, "data: {\"a\":1}\n\n") == 0, "event data field");
+	c->outlen = 0; memset(c->out, 0, 256);
+	CHECK(httpd_stream_send(ws_stream, "x\ny\n\nz", 6), "multiline event send accepted"); pump(c);
+	CHECK(strcmp(c->out, "data: x\ndata: y\ndata: \ndata: z\n\n") == 0, "multiline event split into data fields");
+	c->outlen = 0; memset(c->out, 0, 256);
+	client_send(c, "GET /ok HTTP/1.1\r\n\r\n", 22); pump(c);
+	CHECK(c->outlen == 0, "request on events stream ignored");
+	{ // backpressure: nothing acknowledged, buffer fills and messages are refused
+		static char m[1000]; memset(m, 'm', sizeof(m)); int ok = 0, n;
+		for(n = 0; n < 10; n++) { if(httpd_stream_send(ws_stream, m, sizeof(m))) ok++; }
+		CHECK(ok >= 3 && ok < 10, "events buffer fills and refuses messages");
+		pump(c);
+		CHECK(httpd_stream_send(ws_stream, m, sizeof(m)), "event accepted after buffer drained");
+		pump(c);
+		CHECK(count(c->out, "data: m") == ok + 1, "all accepted events sent");
+	}
+	c->outlen = 0; memset(c->out, 0, 256); host_time += 31000000; run_timers(); pump(c);
+	CHECK(strcmp(c->out, ":\n") == 0, "events keep-alive comment sent by timer");
+	httpd_stream_close(ws_stream); pump(c);
+	CHECK(c->closed && ws_close == 6, "events stream closed by server");
+	// query kept and decoded
+	c = client_connect(1100);
+	const char rq[] = "GET /q?key=a%2Bb+c&x=1 HTTP/1.1\r\n\r\nGET /n HTTP/1.1\r\n\r\n";
+	client_send(c, rq, sizeof(rq) - 1); pump(c);
+	CHECK(strstr(c->out, "path=/q query=key=a%2Bb+c&x=1") && strstr(c->out, "path=/n query= key="), "query passed to handler");
+	CHECK(httpd_query_param_equal("key=a%2Bb+c&x=1", "key", "a+b c") == 1, "query param decoded");
+	CHECK(httpd_query_param_equal("x=1&key=abc", "key", "abc") == 1, "query param not first");
+	CHECK(httpd_query_param_equal("key=abcd", "key", "abc") == 0, "query param value longer");
+	CHECK(httpd_query_param_equal("mykey=abc", "key", "abc") == 0, "query param name suffix");
+	CHECK(httpd_query_param_equal("key=ab%00", "key", "ab") == 0, "query param with NUL");
+	CHECK(httpd_query_param_equal("key=a%zz", "key", "a") == 0, "query param with bad escape");
+	CHECK(httpd_query_param_equal("", "key", "") == 0, "empty query");
+	return HOST_RESULT();
+}
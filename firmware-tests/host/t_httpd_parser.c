@@ -0,0 +1,90 @@
+/*
+ * HTTP request head parser tests.
+ * Known requests, malformed requests, random splitting between segments and
+ * random mutations of a valid request which should never crash and should
+ * give the same result regardless of splitting.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <c_types.h>
+#include "httpd_parser.h"
+#include "host.h"
+
+static int parse(HTTP_PARSER *p, const char *d, unsigned int len, int split_seed, unsigned int *total) {
+	httpd_parser_reset(p);
+	unsigned int pos = 0; int res = HPR_NOT_FINISHED;
+	srand(split_seed);
+	while(pos < len) {
+		unsigned int n = split_seed ? 1 + rand() % 7 : len;
+		if(n > len - pos) n = len - pos;
+		unsigned int used; res = httpd_parser_feed(p, d + pos, n, &used);
+		pos += used;
+		if(res != HPR_NOT_FINISHED) break;
+		if(used != n) { CHECK(0, "used mismatch"); break; }
+	}
+	*total = pos; return res;
+}
+static void same(HTTP_PARSER *a, HTTP_PARSER *b, int ra, int rb, unsigned ta, unsigned tb) {
+	CHECK(ra == rb, "result");
+	if(ra != HPR_DONE) return;
+	CHECK(ta == tb, "used bytes");
+	CHECK(strcmp(a->path, b->path) == 0 && strcmp(a->host, b->host) == 0 && strcmp(a->etags, b->etags) == 0, "path, host or etags");
+	CHECK((!a->key && !b->key) || (a->key && b->key && strcmp(a->key, b->key) == 0), "key");
+	CHECK((!a->query && !b->query) || (a->query && b->query && strcmp(a->query, b->query) == 0), "query");
+	CHECK(a->content_length == b->content_length && a->method == b->method && a->keep_alive == b->keep_alive && a->gzip == b->gzip && a->http11 == b->http11, "flags");
+}
+int main(void) {
+	HTTP_PARSER p, q; memset(&p, 0, sizeof(p)); memset(&q, 0, sizeof(q));
+	unsigned int t;
+	const char r1[] = "\r\nPOST /api/gpio/write?x=1 HTTP/1.1\r\nHost: dev.local \r\nauthorization:  Bearer abc=\r\nAccept-Encoding: deflate, GZip\r\nConnection: Upgrade, close\r\nContent-Length: 12 \r\nIf-None-Match: W/\"a\", \"b\"\r\n\r\nbody";
+	CHECK(parse(&p, r1, sizeof(r1) - 1, 0, &t) == HPR_DONE, "r1 result");
+	CHECK(strcmp(p.path, "/api/gpio/write") == 0 && strcmp(p.host, "dev.local") == 0 && p.key && strcmp(p.key, "abc=") == 0, "r1 fields");
+	CHECK(p.gzip && p.upgrade && !p.keep_alive && p.content_length == 12 && p.method == HTTP_METHOD_POST && p.http11, "r1 flags");
+	CHECK(strcmp(p.etags, "W/\"a\", \"b\"") == 0 && t == sizeof(r1) - 1 - 4, "r1 etags");
+	CHECK(p.query && strcmp(p.query, "x=1") == 0 && p.query_len == 3, "r1 query");
+	const char r2[] = "GET / HTTP/1.0\nConnection: keep-alive\n\n";
+	CHECK(parse(&p, r2, sizeof(r2) - 1, 0, &t) == HPR_DONE && p.keep_alive && !p.http11 && strcmp(p.path, "/") == 0 && !p.query, "r2");
+	const char *bad[] = {"GET /\r\n\r\n", "GET / FOO\r\n\r\n", "GET / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+		"GET / HTTP/1.1\r\nContent-Length: 99999999999\r\n\r\n", "GET / HTTP/1.1\r\nBad header\r\n\r\n",
+		"GET / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 1\r\n\r\n", "GET / HTTP/1.1\r\n folded\r\n\r\n", 0};
+	int i; for(i = 0; bad[i]; i++) { int r = parse(&p, bad[i], strlen(bad[i]), 0, &t); CHECK(r == HPR_BAD_REQUEST, "not bad: %d %s", r, bad[i]); }
+	// long path
+	char lp[300]; sprintf(lp, "GET /%0200d HTTP/1.1\r\n\r\n", 0);
+	CHECK(parse(&p, lp, strlen(lp), 0, &t) == HPR_DONE && p.path_overflow, "long path");
+	// long query is truncated
+	char lq[1200]; sprintf(lq, "GET /api/events?key=%01100d HTTP/1.1\r\n\r\n", 0);
+	CHECK(parse(&p, lq, strlen(lq), 0, &t) == HPR_DONE && strcmp(p.path, "/api/events") == 0
+			&& p.query_len == HTTPD_PARSER_MAX_QUERY - 1 && strlen(p.query) == p.query_len, "long query");
+	// split invariance on valid requests
+	for(i = 1; i < 2000; i++) {
+		int ra = parse(&p, r1, sizeof(r1) - 1, 0, &t); unsigned ta = t;
+		int rb = parse(&q, r1, sizeof(r1) - 1, i, &t);
+		same(&p, &q, ra, rb, ta, t);
+	}
+	// random mutation fuzz: no crash, split invariance
+	char buf[512]; srand(1);
+	for(i = 0; i < 300000; i++) {
+		unsigned int len = sizeof(r1) - 1; memcpy(buf, r1, len);
+		int m, nm = 1 + rand() % 8;
+		for(m = 0; m < nm; m++) {
+			int k = rand() % 4, pos = rand() % len;
+			static const char alpha[] = "\r\n :,\"*0123456789gzipGETPOST/?\tBearer";
+			if(k == 0) buf[pos] = rand() % 256;
+			else if(k == 1) buf[pos] = alpha[rand() % (sizeof(alpha) - 1)];
+			else if(k == 2 && len > 1) { memmove(buf + pos, buf + pos + 1, len - pos - 1); len--; }
+			else if(len < sizeof(buf) - 1) { memmove(buf + pos + 1, buf + pos, len - pos); buf[pos] = alpha[rand() % (sizeof(alpha) - 1)]; len++; }
+		}
+		int seed = rand();
+		int ra = parse(&p, buf, len, 0, &t); unsigned ta = t;
+		int rb = parse(&q, buf, len, seed | 1, &t);
+		same(&p, &q, ra, rb, ta, t);
+		srand(seed);
+	}
+	// huge head
+	static char huge[10000]; memset(huge, 'a', sizeof(huge)); memcpy(huge, "GET / HTTP/1.1\r\nX: ", 19);
+	CHECK(parse(&p, huge, sizeof(huge), 0, &t) == HPR_BAD_REQUEST, "huge head");
+	httpd_parser_reset(&p); httpd_parser_reset(&q);
+	return HOST_RESULT();
+}
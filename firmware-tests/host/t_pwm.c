@@ -0,0 +1,234 @@
+/*
+ * Software PWM waveform simulation.
+ * FRC1 timer, GPIO and CPU cycle counter are modelled with random interruption
+ * latency, edges are logged with CPU cycle precision.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <c_types.h>
+#include <ets_sys.h>
+#include <eagle_soc.h>
+#include <osapi.h>
+#include <gpio.h>
+#include <user_interface.h>
+#include "DH/gpio.h"
+#include "host.h"
+
+uint32_t fake_ccount; uint64_t now; int mhz = 160;
+/* FRC1 model */
+static int armed, masked = 1; static uint64_t fire_at; static unsigned ctrl; static unsigned nloads;
+static void sim_load(uint32_t t) {
+	if (t == 0 || t > 0x7FFFFF) { printf("bad load %u\n", t); exit(1); }
+	unsigned div = 1u << (ctrl & 0xC);
+	fire_at = now + (uint64_t)t * div * (mhz / 80); nloads++;
+}
+#undef RTC_REG_WRITE
+#define RTC_REG_WRITE(a, v) do { if ((a) == FRC1_LOAD_ADDRESS) sim_load(v); else ctrl = (v); } while (0)
+#undef TM1_EDGE_INT_ENABLE
+#undef TM1_EDGE_INT_DISABLE
+#define TM1_EDGE_INT_ENABLE() (armed = 1)
+#define TM1_EDGE_INT_DISABLE() (armed = 0)
+#undef ETS_FRC1_INTR_ENABLE
+#undef ETS_FRC1_INTR_DISABLE
+#define ETS_FRC1_INTR_ENABLE() (masked = 0)
+#define ETS_FRC1_INTR_DISABLE() (masked = 1)
+static ets_isr_t isr;
+void ets_isr_attach(int i, ets_isr_t f, void *a) { isr = f; }
+/* pin log */
+#define MAXE 200000
+static int level[16]; static uint64_t rise[16][MAXE]; static uint64_t fall[16][MAXE]; static int nr[16], nf[16];
+void gpio_output_set(uint32 s, uint32 c, uint32 e, uint32 d) {
+	int i;
+	for (i = 0; i < 16; i++) {
+		if ((s >> i) & 1) { if (!level[i] && nr[i] < MAXE) rise[i][nr[i]++] = now; level[i] = 1; }
+		if ((c >> i) & 1) { if (level[i] && nf[i] < MAXE) fall[i][nf[i]++] = now; level[i] = 0; }
+	}
+	now += 40; fake_ccount = now;
+}
+void dh_gpio_prepare_pins(DHGpioPinMask p, int d) {}
+uint8 system_get_cpu_freq(void) { return mhz; }
+static os_timer_func_t *seq_fn; static int seq_armed; static unsigned seq_done, seq_count;
+void ets_timer_setfn(os_timer_t *t, os_timer_func_t *f, void *a) { seq_fn = f; }
+void ets_timer_disarm(os_timer_t *t) { seq_armed = 0; }
+void ets_timer_arm_new(os_timer_t *t, uint32 ms, bool r, bool m) { seq_armed = 1; }
+void dh_pwm_sequence_cb(unsigned int count) { seq_done++; seq_count = count; }
+#include "pwm_host.c"
+
+static unsigned nint;
+static void run_us(uint64_t us) {
+	uint64_t end = now + us * mhz;
+	while (armed && !masked && fire_at <= end) {
+		now = fire_at + 150 + rand() % 400; fake_ccount = now; /* latency */
+		nint++;
+		isr(NULL);
+		if (now >= fire_at && armed && fire_at <= now) { printf("load in the past\n"); exit(1); }
+	}
+	now = end; fake_ccount = now;
+	if (seq_armed) { seq_armed = 0; seq_fn(NULL); }
+}
+static void reset_log(void) { memset(nr, 0, sizeof(nr)); memset(nf, 0, sizeof(nf)); nint = 0; nloads = 0; }
+
+/* average period and high time in us over full pulses */
+static void measure(int pin, double *period, double *high) {
+	int n = nr[pin] < nf[pin] ? nr[pin] : nf[pin];
+	double h = 0; int i, o = (nf[pin] && nr[pin] && fall[pin][0] < rise[pin][0]);
+	if (nf[pin] - o < n) n = nf[pin] - o;
+	for (i = 0; i < n; i++) h += (double)(fall[pin][i + o] - rise[pin][i]);
+	*high = n ? h / n / mhz : 0;
+	*period = nr[pin] > 1 ? (double)(rise[pin][nr[pin] - 1] - rise[pin][0]) / (nr[pin] - 1) / mhz : 0;
+}
+
+int main(void) {
+	float duty[16] = {0};
+	double p, h;
+	srand(1);
+	/* 1 kHz, four pins, three distinct duties */
+	reset_log();
+	duty[0] = 25; duty[2] = 50; duty[4] = 50; duty[5] = 12.3456f;
+	CHECK(dh_pwm_start(duty, 0x35, 1000, 0) == 0, "start");
+	CHECK(mEventsNum == 4, "events %u", mEventsNum);
+	run_us(1000000);
+	measure(0, &p, &h); CHECK(fabs(p - 1000) < 0.01 && fabs(h - 250) < 0.05, "pin0 %f %f", p, h);
+	measure(2, &p, &h); CHECK(fabs(p - 1000) < 0.01 && fabs(h - 500) < 0.05, "pin2 %f %f", p, h);
+	measure(4, &p, &h); CHECK(fabs(h - 500) < 0.05, "pin4 %f", h);
+	measure(5, &p, &h); CHECK(fabs(h - 123.456) < 0.05, "pin5 %f", h);
+	CHECK(nint >= 3999 && nint <= 4001, "interrupts %u", nint);
+	printf("1kHz: %u interrupts/s, pin5 high %.4f us\n", nint, h);
+
+	/* 10 kHz, 0.1%% steps */
+	reset_log();
+	duty[0] = 33.3f;
+	CHECK(dh_pwm_start(duty, 0x1, 100, 0) == 0, "start 10k");
+	run_us(100000);
+	measure(0, &p, &h); CHECK(fabs(p - 100) < 0.01 && fabs(h - 33.3) < 0.05, "10k %f %f", p, h);
+	measure(5, &p, &h); CHECK(fabs(p - 100) < 0.01 && fabs(h - 12.3456) < 0.05, "10k pin5 %f %f", p, h);
+	CHECK(dh_pwm_start(duty, 0x1, 99, 0) == -2, "min period");
+	CHECK(dh_pwm_start(duty, 0x40, 1000, 0) == -1, "pin");
+	duty[0] = 100.5f; CHECK(dh_pwm_start(duty, 0x1, 1000, 0) == -3, "duty");
+
+	/* close edges merge */
+	dh_pwm_disable(0xFFFF); reset_log();
+	duty[0] = 50; duty[2] = 50.1f; duty[4] = 0; duty[5] = 100;
+	CHECK(dh_pwm_start(duty, 0x35, 1000, 0) == 0, "merge");
+	CHECK(mEventsNum == 2 && mEvents[1].clear == 0x5, "merged %u %x", mEventsNum, mEvents[1].clear);
+	run_us(10000);
+	CHECK(level[5] == 1 && nf[5] == 0 && nr[4] == 0, "full/zero");
+
+	/* count stops, 100% pin goes low */
+	reset_log();
+	CHECK(dh_pwm_start(duty, 0x35, 1000, 3) == 0, "count");
+	run_us(10000);
+	CHECK(nr[0] == 3 && nf[0] == 3 && !armed && level[5] == 0, "count %d %d %d", nr[0], nf[0], level[5]);
+	CHECK(mPwmPins == 0, "released");
+
+	/* disable one pin while running */
+	reset_log();
+	duty[0] = 20; duty[2] = 60;
+	CHECK(dh_pwm_start(duty, 0x5, 1000, 0) == 0, "d");
+	run_us(5500);
+	dh_pwm_disable(0x4);
+	int r2 = nr[2];
+	run_us(5000);
+	CHECK(nr[2] - r2 <= 1 && nr[0] >= 10, "disable %d %d", nr[2] - r2, nr[0]);
+	/* update one pin, another keeps going */
+	duty[2] = 70; reset_log();
+	CHECK(dh_pwm_start(duty, 0x4, 2000, 0) == 0, "upd");
+	run_us(2000000);
+	measure(0, &p, &h); CHECK(fabs(p - 2000) < 0.01 && fabs(h - 400) < 0.1, "upd0 %f %f", p, h);
+	measure(2, &p, &h); CHECK(fabs(h - 1400) < 0.1, "upd2 %f", h);
+	dh_pwm_disable(0xFFFF);
+	run_us(3000);
+	CHECK(!armed, "stopped when no pins");
+
+	/* 10 s period, split loads */
+	gpio_output_set(0, 1, 1, 0); reset_log(); memset(duty, 0, sizeof(duty));
+	duty[0] = 30;
+	CHECK(dh_pwm_start(duty, 0x1, 10000000, 2) == 0, "10s");
+	run_us(30000000ULL);
+	measure(0, &p, &h);
+	CHECK(nr[0] == 2 && nf[0] == 2 && fabs(p - 1e7) < 50 && fabs(h - 3e6) < 50, "10s %d %f %f", nr[0], p, h);
+	/* divided timer keeps compensating latency */
+	reset_log();
+	duty[0] = 25;
+	CHECK(dh_pwm_start(duty, 0x1, 200000, 0) == 0 && mTimerDiv == DIVDED_BY_16, "div16");
+	run_us(4000000);
+	measure(0, &p, &h);
+	CHECK(nr[0] >= 19 && fabs(p - 200000) < 0.5 && fabs(h - 50000) < 0.5, "div16 %d %f %f", nr[0], p, h);
+	dh_pwm_disable(0xFFFF); run_us(300000);
+	/* 1000 s period */
+	reset_log();
+	duty[0] = 50;
+	CHECK(dh_pwm_start(duty, 0x1, 1000000000, 2) == 0, "1000s");
+	run_us(3000000000ULL);
+	measure(0, &p, &h);
+	CHECK(nr[0] == 2 && fabs(p - 1e9) < 100 && fabs(h - 5e8) < 100, "1000s %d %f %f", nr[0], p, h);
+
+	/* 80 MHz CPU */
+	mhz = 80; reset_log(); memset(duty, 0, sizeof(duty));
+	duty[0] = 10; duty[2] = 90;
+	CHECK(dh_pwm_start(duty, 0x5, 500, 0) == 0, "80");
+	run_us(500000);
+	measure(0, &p, &h); CHECK(fabs(p - 500) < 0.02 && fabs(h - 50) < 0.1, "80mhz %f %f", p, h);
+	measure(2, &p, &h); CHECK(fabs(h - 450) < 0.1, "80mhz2 %f", h);
+
+	/* sequence: 4 step pattern on pins 4 and 5, 3 repetitions */
+	mhz = 160; reset_log();
+	uint8_t buf[8 * 4];
+	const uint16_t sets[4] = {0x10, 0x20, 0x00, 0x00}, clrs[4] = {0x20, 0x00, 0x10, 0x20};
+	const uint32_t dl[4] = {10, 25, 40, 1000};
+	int i;
+	for (i = 0; i < 4; i++) {
+		uint8_t *b = &buf[i * 8];
+		b[0] = sets[i]; b[1] = sets[i] >> 8; b[2] = clrs[i]; b[3] = clrs[i] >> 8;
+		b[4] = dl[i]; b[5] = dl[i] >> 8; b[6] = dl[i] >> 16; b[7] = dl[i] >> 24;
+	}
+	gpio_output_set(0, 0x30, 0x30, 0); reset_log();
+	uint64_t t0 = now;
+	CHECK(dh_pwm_sequence_start(buf, 4, 3) == 0, "seq");
+	run_us(10000);
+	CHECK(nr[4] == 3 && nf[4] == 3 && nr[5] == 3 && nf[5] == 3, "seq edges %d %d %d %d", nr[4], nf[4], nr[5], nf[5]);
+	for (i = 0; i < 3; i++) {
+		double base = (double)(rise[4][i] - t0) / mhz;
+		CHECK(fabs(base - i * 1075.0) < 4, "seq start %d %f", i, base);
+		CHECK(fabs((double)(rise[5][i] - rise[4][i]) / mhz - 10) < 4, "seq rise5 %d", i);
+		CHECK(fabs((double)(fall[4][i] - rise[4][i]) / mhz - 35) < 4, "seq fall4 %d", i);
+		CHECK(fabs((double)(fall[5][i] - rise[4][i]) / mhz - 75) < 4, "seq fall5 %d", i);
+	}
+	CHECK(seq_done == 1 && seq_count == 3 && !armed, "seq done %u %u", seq_done, seq_count);
+	/* endless sequence, long run keeps exact timing */
+	reset_log(); seq_done = 0; t0 = now;
+	CHECK(dh_pwm_sequence_start(buf, 4, 0) == 0, "seq0");
+	run_us(1075000);
+	CHECK(nr[4] >= 999 && nr[4] <= 1001, "seq endless %d", nr[4]);
+	CHECK(fabs((double)(rise[4][999] - rise[4][0]) / mhz - 999 * 1075.0) < 4, "seq drift %f", (double)(rise[4][999] - rise[4][0]) / mhz);
+	/* disabled pin is excluded */
+	dh_pwm_disable(0x20); reset_log();
+	run_us(10000);
+	CHECK(nr[5] == 0 && nf[5] == 0 && nr[4] > 5, "seq disable");
+	/* PWM start stops sequence and vice versa */
+	memset(duty, 0, sizeof(duty)); duty[0] = 50;
+	CHECK(dh_pwm_start(duty, 0x1, 1000, 0) == 0 && mTimerOwner == TIMER_PWM, "pwm after seq");
+	reset_log(); run_us(5000);
+	CHECK(nr[4] == 0 && nr[0] >= 4 && seq_done == 0, "seq stopped");
+	CHECK(dh_pwm_sequence_start(buf, 4, 1) == 0 && mPwmPins == 0, "seq after pwm");
+	reset_log(); run_us(5000);
+	CHECK(nr[0] == 0 && seq_done == 1, "pwm stopped");
+	/* stop */
+	CHECK(dh_pwm_sequence_start(buf, 4, 0) == 0, "seq endless restart");
+	dh_pwm_sequence_stop(); reset_log(); run_us(5000);
+	CHECK(!armed && nr[4] == 0 && seq_done == 1, "seq stop");
+	/* errors and long delays */
+	buf[0] = 0x40; CHECK(dh_pwm_sequence_start(buf, 4, 1) == -1, "seq pin");
+	buf[0] = 0x20; CHECK(dh_pwm_sequence_start(buf, 4, 1) == -2, "seq overlap");
+	buf[0] = 0x10; buf[4] = 1; CHECK(dh_pwm_sequence_start(buf, 4, 1) == -2, "seq short");
+	CHECK(dh_pwm_sequence_start(buf, 0, 1) == -2 && dh_pwm_sequence_start(buf, 33, 1) == -2, "seq num");
+	buf[4] = 0; buf[5] = 0x5e; buf[6] = 0xd0; buf[7] = 0xb2; /* 3000000000 us */
+	reset_log(); seq_done = 0; t0 = now;
+	CHECK(dh_pwm_sequence_start(buf, 4, 1) == 0, "seq long");
+	run_us(3100000000ULL);
+	CHECK(seq_done == 1 && nf[5] == 1 && fabs((double)(fall[5][0] - t0) / mhz - 3000000075.0) < 1000, "seq long %f", (double)(fall[5][0] - t0) / mhz);
+
+	return HOST_RESULT();
+}
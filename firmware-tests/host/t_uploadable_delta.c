@@ -0,0 +1,195 @@
+/*
+ * Round trip of esp-utils/esp-delta encoder and firmware delta decoder.
+ * Built-in images are synthetic substitutes for real firmware, they are random
+ * code edited like rebuilt firmware: code is inserted and removed, addresses
+ * in literal pools are shifted. Delta is made by esp-delta binary and applied
+ * by firmware from simulated flash in random pieces. Real images are checked
+ * by delta_images.sh which passes "old new delta" file triples as arguments.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <c_types.h>
+#include <spi_flash.h>
+#include <user_interface.h>
+#include "host.h"
+
+#define OLD_ADDRESS 0x1000
+#define OLD_MAX 0x67000
+
+static uint8_t flash[0x100000];
+
+SpiFlashOpResult spi_flash_read(uint32 addr, uint32 *dst, uint32 size) {
+	if((addr & 3) || ((unsigned long)dst & 3)) {
+		printf("unaligned read 0x%x\n", addr);
+		exit(1);
+	}
+	if(addr + size > sizeof(flash))
+		return SPI_FLASH_RESULT_ERR;
+	memcpy(dst, flash + addr, size);
+	return SPI_FLASH_RESULT_OK;
+}
+
+#include "uploadable_delta.c"
+
+static uint8_t out[0x80000];
+static unsigned int out_len;
+
+static UP_STATUS output(const char *data, unsigned int len) {
+	if(out_len + len > sizeof(out))
+		return UP_STATUS_OVERFLOW;
+	memcpy(out + out_len, data, len);
+	out_len += len;
+	return UP_STATUS_OK;
+}
+
+static uint8_t *load(const char *name, unsigned int *len) {
+	FILE *f = fopen(name, "rb");
+	if(!f) {
+		printf("can not read %s\n", name);
+		exit(1);
+	}
+	uint8_t *b = malloc(0x100000);
+	*len = fread(b, 1, 0x100000, f);
+	fclose(f);
+	return b;
+}
+
+static void save(const char *name, const uint8_t *data, unsigned int len) {
+	FILE *f = fopen(name, "wb");
+	if(!f || fwrite(data, 1, len, f) != len) {
+		printf("can not write %s\n", name);
+		exit(1);
+	}
+	fclose(f);
+}
+
+static int apply(const uint8_t *d, unsigned int dlen, unsigned int new_size, int maxchunk) {
+	unsigned int pos = 0;
+	int r;
+	out_len = 0;
+	if((r = uploadable_delta_begin(OLD_ADDRESS, OLD_MAX, new_size, output)))
+		return 100 + r;
+	while(pos < dlen) {
+		unsigned int n = 1 + rand() % maxchunk;
+		if(n > dlen - pos)
+			n = dlen - pos;
+		if((r = uploadable_delta_put((const char *)d + pos, n))) {
+			uploadable_delta_abort();
+			return 200 + r;
+		}
+		pos += n;
+	}
+	return uploadable_delta_finish();
+}
+
+static void check_triple(const char *old_name, const char *new_name, const char *delta_name) {
+	unsigned int olen, nlen, dlen;
+	uint8_t *o = load(old_name, &olen), *n = load(new_name, &nlen), *d = load(delta_name, &dlen);
+	int k, c;
+	memset(flash, 0xFF, sizeof(flash));
+	memcpy(flash + OLD_ADDRESS, o, olen);
+	for(k = 0; k < 20; k++) {
+		int r = apply(d, dlen, nlen, k == 0 ? 1 : 2048);
+		CHECK(r == 0 && out_len == nlen && memcmp(out, n, nlen) == 0, "%s result %d", new_name, r);
+	}
+	printf("%s -> %s: image %u, delta %u (%u%%)\n", old_name, new_name, nlen, dlen, dlen * 100 / nlen);
+	CHECK(apply(d, dlen, nlen + 1, 512) == 200 + UP_STATUS_WRONG_CALL, "wrong new size");
+	CHECK(apply(d, dlen - 1, nlen, 512) != 0, "truncated delta");
+	CHECK(apply(d, dlen / 2, nlen, 512) == UP_STATUS_WRONG_CALL, "half of delta");
+	uint8_t *d2 = malloc(dlen + 4);
+	memcpy(d2, d, dlen);
+	memset(d2 + dlen, 0xFF, 4);
+	CHECK(apply(d2, dlen + 4, nlen, 512) == 200 + UP_STATUS_OVERFLOW, "trailing data");
+	// running image differs from delta base
+	flash[OLD_ADDRESS + olen / 2] ^= 1;
+	CHECK(apply(d, dlen, nlen, 512) == 200 + UP_STATUS_WRONG_CALL, "wrong base");
+	flash[OLD_ADDRESS + olen / 2] ^= 1;
+	// corrupted delta never writes too much
+	for(c = 0; c < 300; c++) {
+		memcpy(d2, d, dlen);
+		d2[DELTA_HEADER_SIZE + rand() % (dlen - DELTA_HEADER_SIZE)] ^= 1 << (rand() % 8);
+		apply(d2, dlen, nlen, 512);
+		CHECK(out_len <= nlen, "corrupted delta output %u", out_len);
+	}
+	free(d2);
+	free(o);
+	free(n);
+	free(d);
+}
+
+/* code like data: instructions from small set and literal pools with addresses */
+static unsigned int make_image(uint8_t *img, unsigned int len) {
+	unsigned int i = 0;
+	while(i + 4 <= len) {
+		if(rand() % 16 == 0) {
+			const uint32_t addr = 0x40200000 + (rand() % 0x60000 & ~3);
+			memcpy(&img[i], &addr, 4);
+			i += 4;
+		} else {
+			img[i++] = "\x12\x22\x32\xc1\x0d\xf0\x06\x81"[rand() % 8];
+		}
+	}
+	return i;
+}
+
+/* rebuilt firmware: pieces are inserted and removed, following addresses move */
+static unsigned int edit_image(const uint8_t *old, unsigned int olen, uint8_t *img, int edits) {
+	unsigned int o = 0, n = 0, e;
+	int shift = 0;
+	for(e = 0; e < edits; e++) {
+		unsigned int next = olen / edits * (e + 1);
+		for(; o + 4 <= next; o++) {
+			uint32_t v;
+			memcpy(&v, &old[o], 4);
+			if(v >= 0x40200000 && v < 0x40260000) {
+				v += shift;
+				memcpy(&img[n], &v, 4);
+				n += 4;
+				o += 3;
+			} else {
+				img[n++] = old[o];
+			}
+		}
+		if(rand() & 1) {
+			const unsigned int ins = 4 * (1 + rand() % 64);
+			n += make_image(&img[n], ins);
+			shift += ins;
+		} else {
+			const unsigned int del = 4 * (1 + rand() % 64);
+			o += del;
+			shift -= del;
+		}
+	}
+	for(; o < olen; o++)
+		img[n++] = old[o];
+	return n;
+}
+
+static void roundtrip(const char *esp_delta, const char *name, unsigned int len, int edits) {
+	static uint8_t old[0x60000], nw[0x70000];
+	char o[64], n[64], d[64], cmd[256];
+	const unsigned int olen = make_image(old, len);
+	const unsigned int nlen = edits ? edit_image(old, olen, nw, edits) : make_image(nw, len);
+	snprintf(o, sizeof(o), "%s/%s.old", OBJDIR, name);
+	snprintf(n, sizeof(n), "%s/%s.new", OBJDIR, name);
+	snprintf(d, sizeof(d), "%s/%s.delta", OBJDIR, name);
+	save(o, old, olen);
+	save(n, nw, nlen);
+	snprintf(cmd, sizeof(cmd), "%s %s %s %s > /dev/null", esp_delta, o, n, d);
+	CHECK(system(cmd) == 0, "%s", cmd);
+	check_triple(o, n, d);
+}
+
+int main(int argc, char **argv) {
+	int i;
+	srand(1);
+	printf("decoder state %u bytes\n", (unsigned int)sizeof(DELTA));
+	roundtrip(ESP_DELTA, "unrelated", 0x40000, 0);
+	roundtrip(ESP_DELTA, "small", 0x40000, 3);
+	roundtrip(ESP_DELTA, "large", 0x5C000, 40);
+	roundtrip(ESP_DELTA, "tiny", 64, 1);
+	for(i = 1; i + 2 < argc; i += 3)
+		check_triple(argv[i], argv[i + 1], argv[i + 2]);
+	return HOST_RESULT();
+}
@@ -0,0 +1,177 @@
+/*
+ * Firmware update with flash backed by file and simulated boot loader.
+ * Wrong images, interrupted uploads, power loss while writing, trial boot
+ * with confirmation and rollback, both flash maps and delta upload.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <c_types.h>
+#include <spi_flash.h>
+#include <user_interface.h>
+#include <ets_sys.h>
+#include "host.h"
+
+#define FLASH_SIZE (2 * 1024 * 1024)
+
+/* flash is a file, so image can be inspected after test */
+uint8_t *flash;
+int erases, writes, cut_after = -1;
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec) { if(cut_after == 0) return 1; if(cut_after > 0) cut_after--; erases++; memset(flash + sec * 4096, 0xFF, 4096); return 0; }
+SpiFlashOpResult spi_flash_write(uint32 addr, uint32 *src, uint32 size) {
+	if(cut_after == 0) return 1;
+	if(cut_after > 0) cut_after--;
+	if((addr & 3) || (size & 3)) { printf("unaligned write\n"); exit(1); }
+	writes++; uint32 i; for(i = 0; i < size; i++) flash[addr + i] &= ((uint8_t*)src)[i]; return 0; }
+SpiFlashOpResult spi_flash_read(uint32 addr, uint32 *dst, uint32 size) {
+	if((addr & 3) || ((unsigned long)dst & 3)) { printf("unaligned read 0x%x\n", addr); exit(1); }
+	memcpy(dst, flash + addr, size); return 0; }
+os_task_t g_task; int g_posted;
+bool system_os_task(os_task_t t, uint8 p, os_event_t *q, uint8 l) { g_task = t; return 1; }
+bool system_os_post(uint8 p, os_signal_t s, os_param_t a) { if(g_posted) return 0; g_posted = 1; return 1; }
+void run_tasks(int max) { while(g_posted && max--) { g_posted = 0; g_task(0); } }
+#define TIMERS 8
+os_timer_t *timers[TIMERS]; int armed[TIMERS];
+static int tidx(os_timer_t *t) { int i; for(i = 0; i < TIMERS; i++) if(timers[i] == t || timers[i] == 0) { timers[i] = t; return i; } abort(); }
+void ets_timer_setfn(os_timer_t *t, os_timer_func_t *f, void *a) { t->timer_func = f; t->timer_arg = a; }
+void ets_timer_disarm(os_timer_t *t) { armed[tidx(t)] = 0; }
+void ets_timer_arm_new(os_timer_t *t, uint32 ms, bool r, bool m) { armed[tidx(t)] = ms; }
+int fire(uint32 ms) { int i, n = 0; for(i = 0; i < TIMERS; i++) if(timers[i] && armed[i] == ms) { armed[i] = 0; timers[i]->timer_func(timers[i]->timer_arg); n++; } return n; }
+int userbin = 0, flag = 0, reboots = 0, size_map = FLASH_SIZE_16M_MAP_1024_1024;
+uint8 system_upgrade_userbin_check(void) { return userbin; }
+void system_upgrade_flag_set(uint8 f) { flag = f; }
+void system_upgrade_reboot(void) { if(flag == 2) { userbin ^= 1; reboots++; } flag = 0; }
+enum flash_size_map system_get_flash_size_map(void) { return size_map; }
+uint8_t rtc[768];
+bool system_rtc_mem_write(uint8 a, const void *s, uint16 n) { memcpy(rtc + a * 4, s, n); return 1; }
+bool system_rtc_mem_read(uint8 a, void *d, uint16 n) { memcpy(d, rtc + a * 4, n); return 1; }
+#include "uploadable_writer.c"
+#include "uploadable_firmware.c"
+#include "uploadable_delta.c"
+#include "crc32.h"
+uint8_t img[200000]; unsigned int img_len;
+static void put32(unsigned int p, uint32_t v) { memcpy(img + p, &v, 4); }
+void make_image(int irom_len, int bad_sum) {
+	unsigned int p = 0, i; uint8_t sum = 0xEF;
+	img[0] = 0xEA; img[1] = 4; img[2] = 0; img[3] = 0x40; put32(4, 0x40100004);
+	put32(8, 0); put32(12, irom_len); p = 16;
+	for(i = 0; i < irom_len; i++) img[p++] = rand();
+	img[p] = 0xE9; img[p + 1] = 2; img[p + 2] = 0; img[p + 3] = 0x40; put32(p + 4, 0x40100004); p += 8;
+	put32(p, 0x40100000); put32(p + 4, 0x300); p += 8;
+	for(i = 0; i < 0x300; i++) { img[p] = rand(); sum ^= img[p++]; }
+	put32(p, 0x3FFE8000); put32(p + 4, 0x44); p += 8;
+	for(i = 0; i < 0x44; i++) { img[p] = rand(); sum ^= img[p++]; }
+	while((p & 15) != 15) img[p++] = 0;
+	img[p++] = sum ^ (bad_sum ? 1 : 0);
+	img_len = p;
+}
+int upload(unsigned int len, uint32_t crc, int chunk, int stop_at) {
+	unsigned int pos; int r;
+	if((r = uploadable_firmware_begin(img_len, crc, 0))) return 100 + r;
+	for(pos = 0; pos < len; pos += chunk) {
+		if(stop_at >= 0 && pos >= stop_at) return -1;
+		int n = len - pos < chunk ? len - pos : chunk;
+		if((r = uploadable_firmware_put((char *)img + pos, n))) return 200 + r;
+		run_tasks(3);
+	}
+	return uploadable_firmware_finish();
+}
+/* power cycle: RAM state is lost */
+void power_cycle(int keep_rtc) {
+	uploadable_delta_abort(); mFlashingDelta = 0;
+	mFlashing = mTrial = mRebooting = 0; free(mBuffers[0]); free(mBuffers[1]);
+	mBuffers[0] = mBuffers[1] = mBuffer = NULL; mWriterState = WRITER_IDLE; mWriterPosted = 0; mDropped = NULL; g_posted = 0;
+	memset(armed, 0, sizeof(armed)); if(!keep_rtc) memset(rtc, 0, sizeof(rtc));
+	uploadable_firmware_init();
+}
+int main(void) {
+	int fd = open(OBJDIR "/flash.bin", O_RDWR | O_CREAT | O_TRUNC, 0644);
+	ftruncate(fd, FLASH_SIZE);
+	flash = mmap(NULL, FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	memset(flash, 0xFF, FLASH_SIZE);
+	srand(3);
+	make_image(50001 & ~3, 0);
+	uint32_t crc = crc32(img, img_len);
+	uint8_t *user2 = flash + 0x101000;
+	CHECK(uploadable_firmware_running() == UPLOADABLE_FIRMWARE_USER1 && uploadable_firmware_target() == UPLOADABLE_FIRMWARE_USER2, "running image");
+	// wrong crc, wrong size, too big
+	CHECK(upload(img_len, crc ^ 1, 1400, -1) == UP_STATUS_WRONG_CALL && reboots == 0 && flag == 0, "wrong crc rejected, nothing switched");
+	CHECK(uploadable_firmware_begin(UPLOADABLE_FIRMWARE_MAX_SIZE + 1, 0, 0) == UP_STATUS_OVERFLOW, "too big image rejected");
+	CHECK(uploadable_firmware_begin(0, 0, 0) == UP_STATUS_WRONG_CALL, "empty image rejected");
+	CHECK(uploadable_firmware_put("x", 1) == UP_STATUS_WRONG_CALL && uploadable_firmware_finish() == UP_STATUS_WRONG_CALL, "put and finish without begin rejected");
+	CHECK(uploadable_firmware_begin(10, 0, 0) == 0 && uploadable_firmware_put("0123456789a", 11) == UP_STATUS_OVERFLOW, "data over declared size rejected");
+	// bad image checksum and bad header are rejected after crc
+	make_image(4000, 1); CHECK(upload(img_len, crc32(img, img_len), 1400, -1) == UP_STATUS_WRONG_CALL && flag == 0, "bad image checksum rejected after crc");
+	make_image(4000, 0); img[0] = 0xE9; CHECK(upload(img_len, crc32(img, img_len), 1400, -1) == UP_STATUS_WRONG_CALL, "bad image header rejected after crc");
+	make_image(4000, 0); put32(16 + 4000 + 8, 0x40000000); CHECK(upload(img_len, crc32(img, img_len), 1400, -1) == UP_STATUS_WRONG_CALL, "bad irom address rejected after crc");
+	// interrupted upload: client disappears, timeout drops writing, boot is not switched
+	srand(3); make_image(50001 & ~3, 0);
+	CHECK(upload(img_len, crc, 1400, 30000) == -1, "client disappears in the middle of upload");
+	CHECK(fire(UPLOADABLE_FIRMWARE_TIMEOUT_MS) == 1 && mFlashing == 0 && mBuffers[0] == NULL, "timeout drops writing and frees buffers");
+	CHECK(uploadable_firmware_put((char *)img, 4) == UP_STATUS_WRONG_CALL && userbin == 0 && flag == 0, "put after timeout rejected, boot is not switched");
+	// interrupted upload: power loss while writing, partially written sectors, boot is not switched
+	CHECK(upload(img_len, crc, 1400, 20000) == -1, "power loss in the middle of upload");
+	cut_after = 2; run_tasks(10); cut_after = -1;
+	power_cycle(0);
+	CHECK(userbin == 0 && reboots == 0 && !uploadable_firmware_is_trial(), "boot is not switched after power loss");
+	// interrupted upload: file upload drops firmware writing
+	CHECK(upload(img_len, crc, 1400, 20000) == -1, "firmware upload in progress");
+	CHECK(uploadable_writer_begin(0x68, 1, 64, NULL) == 0 && mFlashing == 0, "file upload drops firmware writing");
+	uploadable_writer_abort();
+	CHECK(uploadable_firmware_finish() == UP_STATUS_WRONG_CALL, "finish after file upload began rejected");
+	// complete upload with odd chunks
+	CHECK(upload(img_len, crc, 1337, -1) == UP_STATUS_OK, "upload with odd chunks");
+	CHECK(memcmp(user2, img, img_len) == 0, "uploaded image written to user2");
+	CHECK(uploadable_firmware_begin(img_len, crc, 0) == UP_STATUS_WRONG_CALL, "begin while reboot is pending rejected"); // reboot pending
+	CHECK(fire(UPLOADABLE_FIRMWARE_REBOOT_DELAY_MS) == 1 && userbin == 1 && reboots == 1, "boot switched to user2 and rebooted");
+	// new firmware boots on trial and is confirmed
+	power_cycle(1);
+	CHECK(uploadable_firmware_running() == UPLOADABLE_FIRMWARE_USER2 && uploadable_firmware_is_trial(), "new firmware runs on trial");
+	CHECK(uploadable_firmware_begin(img_len, crc, 0) == UP_STATUS_WRONG_CALL, "begin on trial rejected");
+	uploadable_firmware_confirm();
+	CHECK(!uploadable_firmware_is_trial() && fire(FIRMWARE_TRIAL_TIMEOUT_MS) == 0, "trial confirmed, deadline timer stopped");
+	power_cycle(1); CHECK(!uploadable_firmware_is_trial() && userbin == 1, "confirmation survives power cycle");
+	// update again, user1 slot now, new firmware never connects: rollback on deadline
+	int e0 = erases;
+	CHECK(upload(img_len, crc, 4096, -1) == UP_STATUS_OK && memcmp(flash + 0x1000, img, img_len) == 0, "upload to user1 slot");
+	printf("second upload of the same image erased %d sectors\n", erases - e0);
+	CHECK(fire(UPLOADABLE_FIRMWARE_REBOOT_DELAY_MS) == 1 && userbin == 0, "boot switched to user1");
+	power_cycle(1); CHECK(uploadable_firmware_is_trial(), "user1 runs on trial");
+	CHECK(fire(FIRMWARE_TRIAL_TIMEOUT_MS) == 1 && userbin == 1 && reboots == 3, "rollback on trial deadline");
+	power_cycle(1); CHECK(!uploadable_firmware_is_trial() && userbin == 1, "rolled back firmware isn't on trial");
+	// new firmware crashes repeatedly: rollback after max boots
+	CHECK(upload(img_len, crc, 4096, -1) == UP_STATUS_OK && fire(UPLOADABLE_FIRMWARE_REBOOT_DELAY_MS) == 1 && userbin == 0, "upload of crashing firmware");
+	int b;
+	for(b = 0; b < FIRMWARE_TRIAL_MAX_BOOTS; b++) { power_cycle(1); CHECK(uploadable_firmware_is_trial() && userbin == 0, "trial boot %d", b); }
+	power_cycle(1); CHECK(userbin == 1 && !uploadable_firmware_is_trial(), "rollback after max boots");
+	power_cycle(1); CHECK(userbin == 1 && !uploadable_firmware_is_trial(), "rolled back firmware stays after power cycle");
+	// power loss during trial keeps new firmware
+	CHECK(upload(img_len, crc, 4096, -1) == UP_STATUS_OK && fire(UPLOADABLE_FIRMWARE_REBOOT_DELAY_MS) == 1 && userbin == 0, "upload before power loss on trial");
+	power_cycle(0); CHECK(userbin == 0 && !uploadable_firmware_is_trial(), "power loss during trial keeps new firmware");
+	// flash map without second image
+	size_map = FLASH_SIZE_4M_MAP_256_256; CHECK(uploadable_firmware_begin(img_len, crc, 0) == UP_STATUS_WRONG_CALL, "4M 256+256 map rejected");
+	size_map = FLASH_SIZE_8M_MAP_512_512; userbin = 0;
+	CHECK(upload(img_len, crc, 1000, -1) == UP_STATUS_OK && memcmp(flash + 0x81000, img, img_len) == 0, "upload with 8M 512+512 map");
+	// delta to running user1 image
+	power_cycle(0); CHECK(uploadable_firmware_running() == UPLOADABLE_FIRMWARE_USER1, "user1 runs before delta");
+	FILE *f = fopen(OBJDIR "/ota_old.bin", "wb"); fwrite(img, 1, img_len, f); fclose(f);
+	{ int i; for(i = 0; i < 300; i++) img[16 + rand() % 40000] = rand(); memmove(img + 20000, img + 20100, 10000); }
+	f = fopen(OBJDIR "/ota_new.bin", "wb"); fwrite(img, 1, img_len, f); fclose(f);
+	CHECK(system(ESP_DELTA " " OBJDIR "/ota_old.bin " OBJDIR "/ota_new.bin " OBJDIR "/ota_delta.bin > /dev/null") == 0, "esp-delta made delta");
+	static uint8_t delta[200000]; f = fopen(OBJDIR "/ota_delta.bin", "rb"); unsigned int dlen = fread(delta, 1, sizeof(delta), f); fclose(f);
+	crc = crc32(img, img_len);
+	memset(user2 - 0x80000, 0xFF, 0x70000);
+	{ unsigned int pos; int r = uploadable_firmware_begin(img_len, crc, 1);
+	  for(pos = 0; pos < dlen && r == 0; pos += 700) { r = uploadable_firmware_put((char *)delta + pos, dlen - pos < 700 ? dlen - pos : 700); run_tasks(3); }
+	  CHECK(r == 0 && uploadable_firmware_finish() == UP_STATUS_OK && memcmp(flash + 0x81000, img, img_len) == 0, "delta applied to user1 image"); }
+	printf("delta %u bytes for image %u bytes\n", dlen, img_len);
+	power_cycle(0);
+	// delta for the other running image is rejected, nothing is written
+	flash[0x1000 + 100] ^= 1;
+	CHECK(uploadable_firmware_begin(img_len, crc, 1) == 0 && uploadable_firmware_put((char *)delta, dlen) == UP_STATUS_WRONG_CALL, "delta for the other running image rejected");
+	CHECK(uploadable_firmware_finish() == UP_STATUS_WRONG_CALL && flag == 0, "nothing written for rejected delta");
+	return HOST_RESULT();
+}
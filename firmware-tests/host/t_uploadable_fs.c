@@ -0,0 +1,239 @@
+/*
+ * Uploadable file system with flash emulated at its mapped address.
+ * Remount, replacement in full region, size mismatch, overflow and
+ * verification failure, unfinished upload, power loss between header
+ * write and invalidation of old version, erase distribution and import
+ * of page written by previous firmware versions.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <c_types.h>
+#include <spi_flash.h>
+#include <user_interface.h>
+#include "irom.h"
+#include "host.h"
+
+#define FLASH_SIZE (512 * 1024)
+
+/* flash is mapped like ROM, file data is read by pointers */
+uint8_t *flash;
+int erases[FLASH_SIZE / SPI_FLASH_SEC_SIZE], corrupt_write, lose_invalidation;
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec) { erases[sec]++; memset(flash + sec * 4096, 0xFF, 4096); return 0; }
+SpiFlashOpResult spi_flash_write(uint32 addr, uint32 *src, uint32 size) {
+	if((addr & 3) || (size & 3)) { printf("unaligned write\n"); exit(1); }
+	// power is lost before old version is invalidated
+	if(lose_invalidation && size == 4 && *src == 0) return 0;
+	// flash bits can only be cleared by write
+	uint32 i; for(i = 0; i < size; i++) flash[addr + i] &= ((uint8_t*)src)[i];
+	if(corrupt_write) flash[addr + size - 1] ^= 1;
+	return 0; }
+SpiFlashOpResult spi_flash_read(uint32 addr, uint32 *dst, uint32 size) {
+	if((addr & 3) || ((unsigned long)dst & 3)) { printf("unaligned read 0x%x\n", addr); exit(1); }
+	memcpy(dst, flash + addr, size); return 0; }
+os_task_t g_task; int g_posted;
+bool system_os_task(os_task_t t, uint8 p, os_event_t *q, uint8 l) { g_task = t; return 1; }
+bool system_os_post(uint8 p, os_signal_t s, os_param_t a) { if(g_posted) return 0; g_posted = 1; return 1; }
+void run_tasks(int max) { while(g_posted && max--) { g_posted = 0; g_task(0); } }
+os_timer_t *timer; int timer_ms;
+void ets_timer_setfn(os_timer_t *t, os_timer_func_t *f, void *a) { t->timer_func = f; t->timer_arg = a; }
+void ets_timer_disarm(os_timer_t *t) { timer_ms = 0; }
+void ets_timer_arm_new(os_timer_t *t, uint32 ms, bool r, bool m) { timer = t; timer_ms = ms; }
+#include "uploadable_writer.c"
+#include "uploadable_fs.c"
+#include "crc32.h"
+
+#define REGION (flash + UPLOADABLE_FS_START_SECTOR * SPI_FLASH_SEC_SIZE)
+#define REGION_SIZE (UPLOADABLE_FS_SECTORS * SPI_FLASH_SEC_SIZE)
+
+uint8_t data[REGION_SIZE];
+
+/* power cycle: RAM state is lost */
+static void power_cycle(void) {
+	uploadable_writer_abort();
+	mWriterState = WRITER_IDLE; mWriterPosted = 0; g_posted = 0;
+	mMounted = 0; mEntriesCount = 0; mNextSeq = 1; mHeadSector = UPLOADABLE_FS_START_SECTOR;
+	mFlashing = 0; timer_ms = 0;
+}
+
+static void fill(uint8_t *p, unsigned int len, int seed) {
+	unsigned int i;
+	srand(seed);
+	for(i = 0; i < len; i++)
+		p[i] = rand();
+}
+
+/* write file by pieces with tasks run between them */
+static UP_STATUS write_file(const char *name, unsigned int len, int known_size, int seed) {
+	unsigned int pos;
+	fill(data, len, seed);
+	UP_STATUS res = uploadable_fs_begin(name, known_size ? len : 0, 0);
+	for(pos = 0; pos < len && res == UP_STATUS_OK; pos += 1400) {
+		res = uploadable_fs_put((char *)data + pos, len - pos < 1400 ? len - pos : 1400);
+		run_tasks(1);
+	}
+	return (res == UP_STATUS_OK) ? uploadable_fs_finish() : res;
+}
+
+/* check that file has content generated with seed */
+static int has_file(const char *name, unsigned int len, int seed) {
+	UPLOADABLE_FILE file;
+	if(uploadable_fs_find(name, &file) == 0 || file.length != len)
+		return 0;
+	fill(data, len, seed);
+	return memcmp(file.data, data, len) == 0 && file.crc == crc32(data, len);
+}
+
+static unsigned int files(void) {
+	char name[UPLOADABLE_FS_MAX_NAME + 1];
+	UPLOADABLE_FILE file;
+	unsigned int n = 0;
+	while(uploadable_fs_get(n, name, &file))
+		n++;
+	return n;
+}
+
+/* write page like previous firmware versions did */
+static void write_legacy(unsigned int len) {
+	unsigned int i;
+	memset(REGION, 0xFF, REGION_SIZE);
+	srand(len);
+	for(i = 0; i < len; i++)
+		REGION[i] = 'a' + rand() % 26;
+	if(len < REGION_SIZE)
+		REGION[len] = 0;
+	power_cycle();
+}
+
+static int has_legacy(unsigned int len) {
+	UPLOADABLE_FILE file;
+	unsigned int i;
+	if(uploadable_fs_find("index.html", &file) == 0 || file.length != len || file.gzip)
+		return 0;
+	srand(len);
+	for(i = 0; i < len; i++) {
+		if((uint8_t)file.data[i] != 'a' + rand() % 26)
+			return 0;
+	}
+	return file.crc == crc32(file.data, len);
+}
+
+int main(void) {
+	unsigned int i;
+	flash = mmap((void *)IROM_FLASH_BASE_ADDRESS, FLASH_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(flash != (uint8_t *)IROM_FLASH_BASE_ADDRESS) {
+		printf("flash can't be mapped at 0x%X\n", IROM_FLASH_BASE_ADDRESS);
+		return 1;
+	}
+	memset(flash, 0xFF, FLASH_SIZE);
+
+	// empty region, names and sizes
+	CHECK(files() == 0 && uploadable_fs_free() == REGION_SIZE - UPLOADABLE_FS_HEADER_SIZE, "empty region");
+	CHECK(uploadable_fs_begin("", 0, 0) == UP_STATUS_WRONG_CALL, "empty name rejected");
+	CHECK(uploadable_fs_begin("0123456789012345678901234567890123456789abcd", 0, 0) == UP_STATUS_WRONG_CALL, "long name rejected");
+	CHECK(uploadable_fs_begin("big", UPLOADABLE_FS_MAX_SIZE + 1, 0) == UP_STATUS_OVERFLOW, "too big file rejected");
+	CHECK(uploadable_fs_put("x", 1) == UP_STATUS_WRONG_CALL && uploadable_fs_finish() == UP_STATUS_WRONG_CALL, "put and finish without begin");
+
+	// files survive remount
+	CHECK(write_file("index.html", 5000, 1, 1) == UP_STATUS_OK, "index.html written");
+	CHECK(write_file("a.js", 1, 0, 2) == UP_STATUS_OK, "a.js of unknown size written");
+	CHECK(write_file("b.css", 4096 - UPLOADABLE_FS_HEADER_SIZE, 1, 3) == UP_STATUS_OK, "b.css takes exactly one sector");
+	power_cycle();
+	CHECK(files() == 3 && has_file("index.html", 5000, 1) && has_file("a.js", 1, 2)
+			&& has_file("b.css", 4096 - UPLOADABLE_FS_HEADER_SIZE, 3), "files after remount");
+	CHECK(uploadable_fs_delete("a.js") == UP_STATUS_OK && uploadable_fs_delete("a.js") == UP_STATUS_WRONG_CALL, "a.js deleted");
+	power_cycle();
+	CHECK(files() == 2 && !has_file("a.js", 1, 2), "deleted file stays deleted after remount");
+
+	// size mismatch, overflow and verification failure keep old version
+	CHECK(uploadable_fs_begin("index.html", 100, 0) == UP_STATUS_OK && uploadable_fs_put((char *)data, 99) == UP_STATUS_OK
+			&& uploadable_fs_finish() == UP_STATUS_WRONG_CALL, "size mismatch rejected");
+	CHECK(uploadable_fs_begin("index.html", 100, 0) == UP_STATUS_OK && uploadable_fs_put((char *)data, 101) == UP_STATUS_OVERFLOW,
+			"data over size rejected");
+	corrupt_write = 1;
+	CHECK(write_file("index.html", 7000, 1, 4) == UP_STATUS_INTERNAL_ERROR, "verification failure reported");
+	corrupt_write = 0;
+	CHECK(has_file("index.html", 5000, 1), "old version kept after failures");
+	power_cycle();
+	CHECK(files() == 2 && has_file("index.html", 5000, 1), "old version kept after failures and remount");
+
+	// unfinished upload is dropped by timeout and by power loss
+	CHECK(uploadable_fs_begin("index.html", 0, 0) == UP_STATUS_OK && uploadable_fs_put((char *)data, 6000) == UP_STATUS_OK,
+			"upload started");
+	CHECK(timer_ms == UPLOADABLE_FS_TIMEOUT_MS && uploadable_fs_free() == 0, "no free space while file is written");
+	timer->timer_func(timer->timer_arg);
+	CHECK(uploadable_fs_put((char *)data, 1) == UP_STATUS_WRONG_CALL && has_file("index.html", 5000, 1), "timeout drops upload");
+	CHECK(uploadable_fs_begin("index.html", 0, 0) == UP_STATUS_OK && uploadable_fs_put((char *)data, 9000) == UP_STATUS_OK,
+			"upload started again");
+	run_tasks(10);
+	power_cycle();
+	CHECK(files() == 2 && has_file("index.html", 5000, 1), "power loss drops upload");
+
+	// power loss after header of new version is written, but before old one is invalidated
+	lose_invalidation = 1;
+	CHECK(write_file("index.html", 3000, 1, 5) == UP_STATUS_OK, "new version written");
+	lose_invalidation = 0;
+	power_cycle();
+	CHECK(files() == 2 && has_file("index.html", 3000, 5), "newer version after power loss");
+	power_cycle();
+	CHECK(files() == 2 && has_file("index.html", 3000, 5), "old version invalidated on mount");
+
+	// replacement in full region: old version is deleted if there is no space for both
+	CHECK(uploadable_fs_delete("b.css") == UP_STATUS_OK, "b.css deleted");
+	CHECK(write_file("index.html", 40000, 1, 6) == UP_STATUS_OK, "big index.html written");
+	CHECK(write_file("index.html", 50000, 1, 7) == UP_STATUS_OK && has_file("index.html", 50000, 7), "bigger index.html replaced old one");
+	CHECK(write_file("index.html", UPLOADABLE_FS_MAX_SIZE, 0, 8) == UP_STATUS_OK && has_file("index.html", UPLOADABLE_FS_MAX_SIZE, 8),
+			"whole region file of unknown size");
+	CHECK(write_file("other", 10, 1, 9) == UP_STATUS_OVERFLOW && files() == 1, "no space for other file");
+	power_cycle();
+	CHECK(files() == 1 && has_file("index.html", UPLOADABLE_FS_MAX_SIZE, 8), "whole region file after remount");
+	CHECK(uploadable_fs_delete("index.html") == UP_STATUS_OK && files() == 0, "region is empty");
+
+	// rewrites are spread over region
+	memset(erases, 0, sizeof(erases));
+	for(i = 0; i < 160; i++) {
+		CHECK(write_file("index.html", 5000 + i, 1, 10 + i) == UP_STATUS_OK, "rewrite %u", i);
+		if(i % 7 == 0)
+			power_cycle();
+	}
+	CHECK(has_file("index.html", 5000 + 159, 10 + 159), "last rewrite");
+	int min = 1000000, max = 0;
+	for(i = UPLOADABLE_FS_START_SECTOR; i <= UPLOADABLE_FS_END_SECTOR; i++) {
+		if(erases[i] < min)
+			min = erases[i];
+		if(erases[i] > max)
+			max = erases[i];
+	}
+	printf("erases per sector after 160 rewrites: %d..%d\n", min, max);
+	CHECK(min > 0 && max - min <= 2, "erases are spread: %d..%d", min, max);
+	for(i = 0; i < UPLOADABLE_FS_START_SECTOR; i++)
+		CHECK(erases[i] == 0, "sector 0x%X outside region erased", i);
+
+	// page of previous firmware versions is imported once
+	static const unsigned int legacy[] = {1, 100, 4000, 4096, 20000, 30000, 40000, UPLOADABLE_FS_MAX_SIZE};
+	for(i = 0; i < sizeof(legacy) / sizeof(legacy[0]); i++) {
+		write_legacy(legacy[i]);
+		CHECK(files() == 1 && has_legacy(legacy[i]), "legacy page of %u bytes imported", legacy[i]);
+		power_cycle();
+		CHECK(files() == 1 && has_legacy(legacy[i]), "legacy page of %u bytes after remount", legacy[i]);
+		if(legacy[i] < UPLOADABLE_FS_MAX_SIZE)
+			CHECK(write_file("a.js", 10, 1, 11) == UP_STATUS_OK && files() == 2, "new file after %u bytes legacy page", legacy[i]);
+		else
+			CHECK(write_file("a.js", 10, 1, 11) == UP_STATUS_OVERFLOW, "no space after whole region legacy page");
+	}
+	write_legacy(30000);
+	lose_invalidation = 1;
+	CHECK(files() == 1 && has_legacy(30000), "legacy page copied");
+	lose_invalidation = 0;
+	power_cycle();
+	CHECK(files() == 1 && has_legacy(30000) && REGION[0] == 0, "legacy page invalidated after power loss");
+	power_cycle();
+	CHECK(files() == 1 && has_legacy(30000), "legacy page isn't imported twice");
+	write_legacy(REGION_SIZE);
+	CHECK(files() == 0, "legacy page without end isn't imported");
+	write_legacy(0);
+	CHECK(files() == 0, "empty legacy page isn't imported");
+	return HOST_RESULT();
+}
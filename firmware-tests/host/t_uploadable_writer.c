@@ -0,0 +1,140 @@
+/*
+ * Background writer of uploadable data over emulated flash.
+ * Sizes around sector boundaries with different task interleavings,
+ * unchanged sectors are not erased, overflow, write and verification
+ * failures are reported.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <c_types.h>
+#include <spi_flash.h>
+#include <user_interface.h>
+#include "host.h"
+
+#define SECTORS 8
+#define FIRST 2
+
+uint8_t flash[SECTORS * SPI_FLASH_SEC_SIZE];
+int erases, writes, fail_write, corrupt_write;
+SpiFlashOpResult spi_flash_erase_sector(uint16 sec) {
+	if(sec >= SECTORS) { printf("erase out of flash\n"); exit(1); }
+	erases++; memset(flash + sec * SPI_FLASH_SEC_SIZE, 0xFF, SPI_FLASH_SEC_SIZE); return 0; }
+SpiFlashOpResult spi_flash_write(uint32 addr, uint32 *src, uint32 size) {
+	if((addr & 3) || (size & 3) || addr + size > sizeof(flash)) { printf("bad write 0x%x\n", addr); exit(1); }
+	if(fail_write) return 1;
+	// flash bits can only be cleared by write
+	writes++; uint32 i; for(i = 0; i < size; i++) flash[addr + i] &= ((uint8_t*)src)[i];
+	if(corrupt_write) flash[addr + size / 2] ^= 1;
+	return 0; }
+SpiFlashOpResult spi_flash_read(uint32 addr, uint32 *dst, uint32 size) {
+	if((addr & 3) || ((unsigned long)dst & 3) || addr + size > sizeof(flash)) { printf("bad read 0x%x\n", addr); exit(1); }
+	memcpy(dst, flash + addr, size); return 0; }
+os_task_t g_task; int g_posted;
+bool system_os_task(os_task_t t, uint8 p, os_event_t *q, uint8 l) { g_task = t; return 1; }
+bool system_os_post(uint8 p, os_signal_t s, os_param_t a) { if(g_posted) return 0; g_posted = 1; return 1; }
+void run_tasks(int max) { while(g_posted && max--) { g_posted = 0; g_task(0); } }
+#include "uploadable_writer.c"
+
+uint8_t data[SECTORS * SPI_FLASH_SEC_SIZE], old[sizeof(flash)];
+int dropped;
+static void on_dropped(void) { dropped++; }
+
+static void fill(uint8_t *p, unsigned int len) {
+	unsigned int i;
+	for(i = 0; i < len; i++)
+		p[i] = rand();
+}
+
+/* write len bytes after skip with chunks and tasks run after each chunk */
+static UP_STATUS write_data(unsigned int sectors, unsigned int skip, unsigned int len, unsigned int chunk, int tasks) {
+	UP_STATUS res = uploadable_writer_begin(FIRST, sectors, skip, NULL);
+	unsigned int pos;
+	for(pos = 0; pos < len && res == UP_STATUS_OK; pos += chunk) {
+		res = uploadable_writer_put((char *)data + pos, len - pos < chunk ? len - pos : chunk);
+		run_tasks(tasks);
+	}
+	if(res != UP_STATUS_OK) {
+		uploadable_writer_abort();
+		return res;
+	}
+	return uploadable_writer_finish();
+}
+
+int main(void) {
+	static const unsigned int sizes[] = {1, 3, 4, 5, 4095, 4096, 4097, 8191, 8192, 8193, 3 * 4096 + 7};
+	static const unsigned int chunks[] = {1, 7, 700, 4096, 100000};
+	static const int interleaves[] = {0, 1, 2, 100};
+	static const unsigned int skips[] = {0, 64};
+	unsigned int s, c, i, k;
+	CHECK(uploadable_writer_put("a", 1) == UP_STATUS_WRONG_CALL, "put without begin");
+	CHECK(uploadable_writer_finish() == UP_STATUS_WRONG_CALL, "finish without begin");
+	CHECK(uploadable_writer_begin(FIRST, 0, 0, NULL) == UP_STATUS_WRONG_CALL, "no sectors");
+	CHECK(uploadable_writer_begin(FIRST, 1, SPI_FLASH_SEC_SIZE, NULL) == UP_STATUS_WRONG_CALL, "skip whole sector");
+	for(k = 0; k < sizeof(skips) / sizeof(skips[0]); k++) {
+		const unsigned int skip = skips[k];
+		for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			for(c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+				for(i = 0; i < sizeof(interleaves) / sizeof(interleaves[0]); i++) {
+					const unsigned int len = sizes[s];
+					const unsigned int end = FIRST * SPI_FLASH_SEC_SIZE + skip + len;
+					fill(flash, sizeof(flash));
+					fill(data, len);
+					memcpy(old, flash, sizeof(flash));
+					UP_STATUS res = write_data(6, skip, len, chunks[c], interleaves[i]);
+					CHECK(res == UP_STATUS_OK, "write %u after %u by %u with %d tasks: %d", len, skip, chunks[c], interleaves[i], res);
+					CHECK(memcmp(flash + FIRST * SPI_FLASH_SEC_SIZE + skip, data, len) == 0,
+							"data %u after %u by %u with %d tasks", len, skip, chunks[c], interleaves[i]);
+					int erased = 1;
+					unsigned int j;
+					for(j = 0; j < skip; j++)
+						erased &= (flash[FIRST * SPI_FLASH_SEC_SIZE + j] == 0xFF);
+					CHECK(erased, "skipped bytes are erased for %u after %u", len, skip);
+					CHECK(memcmp(flash, old, FIRST * SPI_FLASH_SEC_SIZE) == 0, "flash before %u after %u kept", len, skip);
+					CHECK(memcmp(flash + end, old + end, sizeof(flash) - end) == 0, "flash after %u after %u kept", len, skip);
+				}
+			}
+		}
+	}
+
+	// the same data again, nothing is erased or written
+	fill(data, 3 * 4096 + 7);
+	CHECK(write_data(6, 0, 3 * 4096 + 7, 700, 1) == UP_STATUS_OK, "first write");
+	erases = writes = 0;
+	CHECK(write_data(6, 0, 3 * 4096 + 7, 700, 1) == UP_STATUS_OK && erases == 0 && writes == 0,
+			"unchanged sectors: %d erases, %d writes", erases, writes);
+	data[4096 + 10] ^= 0x10;
+	CHECK(write_data(6, 0, 3 * 4096 + 7, 700, 1) == UP_STATUS_OK && erases == 1 && writes == 1,
+			"one changed sector: %d erases, %d writes", erases, writes);
+
+	// overflow, nothing is written after the last sector
+	fill(flash, sizeof(flash));
+	memcpy(old, flash, sizeof(flash));
+	fill(data, 2 * 4096 + 1);
+	CHECK(write_data(2, 0, 2 * 4096, 4096, 1) == UP_STATUS_OK, "exactly two sectors");
+	CHECK(write_data(2, 0, 2 * 4096 + 1, 4096, 1) == UP_STATUS_OVERFLOW, "overflow by one byte");
+	CHECK(write_data(2, 0, 2 * 4096 + 1, 100000, 1) == UP_STATUS_OVERFLOW, "overflow in one put");
+	CHECK(write_data(2, 16, 2 * 4096, 700, 1) == UP_STATUS_OVERFLOW, "overflow with skip");
+	CHECK(memcmp(flash + (FIRST + 2) * SPI_FLASH_SEC_SIZE, old + (FIRST + 2) * SPI_FLASH_SEC_SIZE,
+			sizeof(flash) - (FIRST + 2) * SPI_FLASH_SEC_SIZE) == 0, "flash after overflow kept");
+
+	// write and verification failures with different interleavings
+	for(i = 0; i < sizeof(interleaves) / sizeof(interleaves[0]); i++) {
+		fill(data, 3 * 4096);
+		fail_write = 1;
+		CHECK(write_data(6, 0, 3 * 4096, 700, interleaves[i]) == UP_STATUS_INTERNAL_ERROR, "write failure with %d tasks", interleaves[i]);
+		fail_write = 0;
+		corrupt_write = 1;
+		CHECK(write_data(6, 0, 3 * 4096, 700, interleaves[i]) == UP_STATUS_INTERNAL_ERROR, "verification failure with %d tasks", interleaves[i]);
+		corrupt_write = 0;
+		CHECK(write_data(6, 0, 3 * 4096, 700, interleaves[i]) == UP_STATUS_OK, "write after failure with %d tasks", interleaves[i]);
+	}
+
+	// the other begin drops writing in progress
+	CHECK(uploadable_writer_begin(FIRST, 2, 0, on_dropped) == UP_STATUS_OK, "begin with dropped callback");
+	CHECK(uploadable_writer_put((char *)data, 5000) == UP_STATUS_OK, "put before drop");
+	CHECK(uploadable_writer_begin(FIRST, 2, 0, NULL) == UP_STATUS_OK && dropped == 1, "dropped callback called %d", dropped);
+	CHECK(uploadable_writer_finish() == UP_STATUS_OK && dropped == 1, "finish after drop");
+	run_tasks(100);
+	return HOST_RESULT();
+}